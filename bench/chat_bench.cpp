@@ -0,0 +1,405 @@
+// MIT License
+// Multi-threaded Chat System - End-to-End Load Generator
+// Copyright (c) 2025
+
+#include "chat_client.h"
+#include "latency_histogram.h"
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchConfig {
+    std::string host = "127.0.0.1";
+    int port = 5000;
+    int clients = 100;              // Connections opened
+    double sender_fraction = 0.1;   // Share of connections that also send
+    double rate = 1000.0;           // Messages per second across all senders
+    int size = 64;                  // Message text bytes
+    double seconds = 5.0;           // Measured run time
+    double warmup = 1.0;            // Unmeasured run time before it
+    double drain = 1.0;             // Time allowed for the last messages to arrive
+    int threads = 0;                // Client driver threads (0 = one per core)
+    int rooms = 0;                  // Rooms clients are spread over (0 = all in the lobby)
+};
+
+// Prefix of every benchmark message; followed by the scheduled send time
+const char BENCH_TAG[] = "bench ";
+const size_t BENCH_TAG_LEN = sizeof(BENCH_TAG) - 1;
+
+/**
+ * Room of client number id ("" = lobby); clients are dealt round-robin
+ */
+std::string room_of(const BenchConfig& config, int id) {
+    return config.rooms > 0 ? "room" + std::to_string(id % config.rooms) : std::string();
+}
+
+/**
+ * Clients that receive a message sent by client number id
+ */
+uint64_t recipients_of(const BenchConfig& config, int id) {
+    if (config.rooms <= 0) {
+        return static_cast<uint64_t>(config.clients - 1);
+    }
+    int room = id % config.rooms;
+    int members = config.clients / config.rooms + (room < config.clients % config.rooms ? 1 : 0);
+    return static_cast<uint64_t>(members - 1);
+}
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Shared run schedule; all times are steady_clock nanoseconds, set by
+ * the main thread once every connection is up
+ */
+struct Schedule {
+    std::atomic<bool> started{false};
+    uint64_t measure_start = 0;     // End of warmup
+    uint64_t send_end = 0;          // Senders stop
+    uint64_t drain_end = 0;         // Drivers stop reading
+    uint64_t send_interval = 0;     // Between two messages of one sender
+};
+
+/**
+ * One driver thread: a slice of the clients on its own epoll instance
+ */
+struct Driver {
+    std::vector<std::unique_ptr<SocketChatClient>> clients;
+    std::vector<size_t> senders;            // Indexes into clients
+    std::vector<uint64_t> sender_offset;    // Stagger within one interval
+    LatencyHistogram latency;
+    uint64_t sent = 0;                      // Measured messages sent
+    uint64_t expected = 0;                  // Deliveries those should cause
+    uint64_t delivered = 0;                 // Measured messages received
+    uint64_t disconnects = 0;
+    bool connect_failed = false;
+    std::string error;
+};
+
+/**
+ * Record the fan-out latency of a benchmark message, if it was sent
+ * inside the measured window
+ */
+void on_delivery(Driver& driver, const Schedule& schedule, const Message& msg) {
+    if (strncmp(msg.text, BENCH_TAG, BENCH_TAG_LEN) != 0) {
+        return;
+    }
+
+    uint64_t sent_at = strtoull(msg.text + BENCH_TAG_LEN, nullptr, 10);
+    if (sent_at < schedule.measure_start || sent_at >= schedule.send_end) {
+        return;
+    }
+
+    uint64_t now = now_ns();
+    driver.latency.record(now > sent_at ? now - sent_at : 0);
+    ++driver.delivered;
+}
+
+void run_driver(Driver& driver, const BenchConfig& config, const Schedule& schedule,
+                int first_id, std::atomic<int>& connected) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        driver.connect_failed = true;
+        driver.error = std::string("epoll_create1: ") + strerror(errno);
+        connected += static_cast<int>(driver.clients.size());
+        return;
+    }
+
+    for (size_t i = 0; i < driver.clients.size(); ++i) {
+        SocketChatClient& client = *driver.clients[i];
+        ChatClientCallbacks callbacks;
+        callbacks.on_message = [&driver, &schedule](const Message& msg) {
+            on_delivery(driver, schedule, msg);
+        };
+        client.set_callbacks(callbacks);
+
+        int id = first_id + static_cast<int>(i);
+        std::string username = "bench" + std::to_string(id);
+        std::string room = room_of(config, id);
+        if (!driver.connect_failed && (!client.connect(config.host, config.port, username) ||
+                                       (!room.empty() && !client.subscribe(room)))) {
+            driver.connect_failed = true;
+            driver.error = username + ": " + client.error();
+        }
+        if (client.connected()) {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd(), &event);
+        }
+        ++connected;
+    }
+
+    while (!schedule.started.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Each sender keeps its own open-loop schedule; the message carries
+    // the scheduled time, not the time it got sent, so a stalled sender
+    // shows up as latency instead of hiding it
+    uint64_t run_start = schedule.measure_start -
+        static_cast<uint64_t>(config.warmup * 1e9);
+    std::vector<uint64_t> next_send(driver.senders.size());
+    for (size_t s = 0; s < driver.senders.size(); ++s) {
+        next_send[s] = run_start + driver.sender_offset[s];
+    }
+
+    std::vector<std::string> rooms;
+    std::vector<uint64_t> recipients;
+    for (size_t sender : driver.senders) {
+        rooms.push_back(room_of(config, first_id + static_cast<int>(sender)));
+        recipients.push_back(recipients_of(config, first_id + static_cast<int>(sender)));
+    }
+
+    char text[MAX_MESSAGE_LEN];
+    std::vector<struct epoll_event> events(256);
+
+    while (true) {
+        uint64_t now = now_ns();
+        if (now >= schedule.drain_end) {
+            break;
+        }
+
+        uint64_t wake = schedule.drain_end;
+        for (size_t s = 0; s < driver.senders.size(); ++s) {
+            SocketChatClient& client = *driver.clients[driver.senders[s]];
+            while (next_send[s] <= now && next_send[s] < schedule.send_end && client.connected()) {
+                int length = snprintf(text, sizeof(text), "%s%" PRIu64 " ", BENCH_TAG, next_send[s]);
+                int padded = std::max(length, std::min(config.size, MAX_MESSAGE_LEN - 1));
+                memset(text + length, 'x', static_cast<size_t>(padded - length));
+                text[padded] = '\0';
+
+                if (client.send(text, rooms[s]) && next_send[s] >= schedule.measure_start) {
+                    ++driver.sent;
+                    driver.expected += recipients[s];
+                }
+                next_send[s] += schedule.send_interval;
+            }
+            if (next_send[s] < schedule.send_end) {
+                wake = std::min(wake, next_send[s]);
+            }
+        }
+
+        int timeout_ms = 0;
+        now = now_ns();
+        if (wake > now) {
+            timeout_ms = static_cast<int>(std::min<uint64_t>((wake - now) / 1000000, 100));
+        }
+
+        int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout_ms);
+        for (int e = 0; e < ready; ++e) {
+            SocketChatClient& client = *driver.clients[events[e].data.u64];
+            if (client.poll(0) < 0) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd(), nullptr);
+                ++driver.disconnects;
+            }
+        }
+    }
+
+    close(epoll_fd);
+    for (auto& client : driver.clients) {
+        client->disconnect();
+    }
+}
+
+/**
+ * Allow one descriptor per client plus slack
+ */
+void raise_fd_limit(int clients) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return;
+    }
+
+    rlim_t wanted = static_cast<rlim_t>(clients) + 64;
+    if (limit.rlim_cur < wanted) {
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --host ADDR       Server address, or unix:PATH (default 127.0.0.1)\n"
+              << "  --port N          Server port (default 5000)\n"
+              << "  --clients N       Connections to open (default 100)\n"
+              << "  --senders F       Fraction of connections that send (default 0.1)\n"
+              << "  --rate R          Messages per second across all senders (default 1000)\n"
+              << "  --size N          Message text bytes (default 64)\n"
+              << "  --seconds S       Measured run time (default 5)\n"
+              << "  --warmup S        Unmeasured time before it (default 1)\n"
+              << "  --drain S         Time allowed for the last messages to arrive (default 1)\n"
+              << "  --threads N       Client driver threads (default: one per core)\n"
+              << "  --rooms N         Spread clients over N rooms; messages go to the sender's room\n"
+              << "                    (default 0: everyone in the lobby)\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--host") {
+            config.host = value;
+        } else if (arg == "--port") {
+            config.port = std::atoi(value);
+        } else if (arg == "--clients") {
+            config.clients = std::atoi(value);
+        } else if (arg == "--senders") {
+            config.sender_fraction = std::atof(value);
+        } else if (arg == "--rate") {
+            config.rate = std::atof(value);
+        } else if (arg == "--size") {
+            config.size = std::atoi(value);
+        } else if (arg == "--seconds") {
+            config.seconds = std::atof(value);
+        } else if (arg == "--warmup") {
+            config.warmup = std::atof(value);
+        } else if (arg == "--drain") {
+            config.drain = std::atof(value);
+        } else if (arg == "--threads") {
+            config.threads = std::atoi(value);
+        } else if (arg == "--rooms") {
+            config.rooms = std::atoi(value);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int senders = static_cast<int>(config.clients * config.sender_fraction + 0.5);
+    if (config.clients < 2 || senders < 1 || senders > config.clients ||
+        config.rate <= 0 || config.seconds <= 0 || config.rooms * 2 > config.clients) {
+        std::cerr << "Need at least 2 clients (2 per room), at least 1 sender and a positive rate"
+                  << std::endl;
+        return 1;
+    }
+
+    int threads = config.threads > 0 ? config.threads
+                                     : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, config.clients));
+    raise_fd_limit(config.clients);
+
+    // Client i goes to driver i % threads, so senders (the first ones) spread out
+    std::vector<Driver> drivers(static_cast<size_t>(threads));
+    for (int i = 0; i < config.clients; ++i) {
+        Driver& driver = drivers[static_cast<size_t>(i % threads)];
+        if (i < senders) {
+            driver.senders.push_back(driver.clients.size());
+        }
+        driver.clients.emplace_back(new SocketChatClient());
+    }
+
+    Schedule schedule;
+    schedule.send_interval = static_cast<uint64_t>(1e9 * senders / config.rate);
+    int sender_index = 0;
+    for (int t = 0; t < threads; ++t) {
+        for (size_t s = 0; s < drivers[t].senders.size(); ++s) {
+            drivers[t].sender_offset.push_back(schedule.send_interval * (sender_index++) / senders);
+        }
+    }
+
+    std::cout << "chat_bench: " << config.clients << " clients (" << senders << " sending) to "
+              << config.host;
+    if (config.host.compare(0, 5, "unix:") != 0) {
+        std::cout << ":" << config.port;
+    }
+    std::cout << ", " << config.rate << " msg/s, "
+              << config.size << "-byte messages, " << config.seconds << "s measured after "
+              << config.warmup << "s warmup, " << threads << " thread(s)";
+    if (config.rooms > 0) {
+        std::cout << ", " << config.rooms << " rooms";
+    }
+    std::cout << std::endl;
+
+    // Usernames only need to be unique: each driver numbers its slice
+    std::atomic<int> connected(0);
+    std::vector<std::thread> workers;
+    int next_id = 0;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back(run_driver, std::ref(drivers[t]), std::cref(config),
+                             std::cref(schedule), next_id, std::ref(connected));
+        next_id += static_cast<int>(drivers[t].clients.size());
+    }
+
+    while (connected.load() < config.clients) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    uint64_t start = now_ns();
+    schedule.measure_start = start + static_cast<uint64_t>(config.warmup * 1e9);
+    schedule.send_end = schedule.measure_start + static_cast<uint64_t>(config.seconds * 1e9);
+    schedule.drain_end = schedule.send_end + static_cast<uint64_t>(config.drain * 1e9);
+    schedule.started.store(true, std::memory_order_release);
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    LatencyHistogram latency;
+    uint64_t sent = 0;
+    uint64_t expected = 0;
+    uint64_t delivered = 0;
+    uint64_t disconnects = 0;
+    for (auto& driver : drivers) {
+        if (driver.connect_failed) {
+            std::cerr << "Connect failed: " << driver.error << std::endl;
+            return 1;
+        }
+        latency.merge(driver.latency);
+        sent += driver.sent;
+        expected += driver.expected;
+        delivered += driver.delivered;
+        disconnects += driver.disconnects;
+    }
+
+    // Every message reaches everyone but its sender (in its room)
+    double delivered_pct = expected ? 100.0 * delivered / expected : 0.0;
+
+    std::cout << std::fixed << std::setprecision(0)
+              << "sent       " << std::setw(12) << sent << " msg  "
+              << std::setw(12) << sent / config.seconds << " msg/s" << std::endl
+              << "delivered  " << std::setw(12) << delivered << " msg  "
+              << std::setw(12) << delivered / config.seconds << " msg/s  "
+              << std::setprecision(2) << delivered_pct << "% of expected" << std::endl
+              << std::setprecision(1)
+              << "fan-out latency  p50 " << latency.percentile(0.50) / 1e3
+              << " us  p99 " << latency.percentile(0.99) / 1e3
+              << " us  p99.9 " << latency.percentile(0.999) / 1e3
+              << " us  max " << latency.max() / 1e3 << " us" << std::endl;
+
+    if (disconnects > 0) {
+        std::cout << "disconnected by server: " << disconnects << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// MIT License
+// Multi-threaded Chat System - Latency Histogram for Benchmarks
+// Copyright (c) 2025
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Fixed-memory latency histogram with bounded relative error
+ *
+ * Values (nanoseconds) are bucketed log-linearly: each power of two
+ * is split into SUB_BUCKETS equal slices, so a percentile is exact to
+ * within 1/SUB_BUCKETS of its value however many samples are recorded.
+ * Not thread-safe; give each thread its own and merge() them
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 6;
+    static const uint64_t SUB_BUCKETS = 1ull << SUB_BITS;
+
+    LatencyHistogram() : counts_((64 - SUB_BITS + 1) * SUB_BUCKETS, 0), total_(0), max_(0) {}
+
+    void record(uint64_t value) {
+        ++counts_[index(value)];
+        ++total_;
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        if (other.max_ > max_) {
+            max_ = other.max_;
+        }
+    }
+
+    /**
+     * Smallest recorded value (to bucket precision) at or below which
+     * the given fraction of samples fall
+     * @param quantile 0.0 - 1.0, e.g. 0.999 for p99.9
+     */
+    uint64_t percentile(double quantile) const {
+        if (total_ == 0) {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total_));
+        if (rank >= total_) {
+            rank = total_ - 1;
+        }
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen > rank) {
+                uint64_t upper = upper_bound(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+private:
+    /**
+     * Values below SUB_BUCKETS get a bucket each; above that, the
+     * leading bit picks the row and the next SUB_BITS bits the slice
+     */
+    static size_t index(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int magnitude = 63 - __builtin_clzll(value);
+        int shift = magnitude - SUB_BITS;
+        uint64_t slice = (value >> shift) - SUB_BUCKETS;
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + slice);
+    }
+
+    static uint64_t upper_bound(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        uint64_t shift = index / SUB_BUCKETS - 1;
+        uint64_t slice = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((slice + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_;
+};
+
+#endif // LATENCY_HISTOGRAM_H
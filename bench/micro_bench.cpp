@@ -0,0 +1,402 @@
+// MIT License
+// Multi-threaded Chat System - Per-Message Primitive Microbenchmarks
+// Copyright (c) 2025
+
+#include "common.h"
+#include "frame.h"
+#include "protocol.h"
+#include "recv_buffer.h"
+#include "shm_ring.h"
+#include "timestamp.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchConfig {
+    double min_time = 0.2;      // Seconds per repetition
+    int repetitions = 5;        // Best one is reported
+    std::string filter;         // Only run benchmarks whose name contains this
+    bool json = true;           // JSON (default) or a text table
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;        // Per repetition
+    double ns_per_op;
+    double cycles_per_op;       // < 0 when no cycle counter is available
+};
+
+/**
+ * Keep the compiler from discarding a value it can prove unused
+ */
+template <typename T>
+inline void do_not_optimize(T const& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Core cycles of this thread via perf_event_open(2); unavailable
+ * (valid() false) in containers or with perf_event_paranoid > 2
+ */
+class CycleCounter {
+public:
+    CycleCounter() : fd_(-1) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~CycleCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool valid() const { return fd_ >= 0; }
+
+    void start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    uint64_t stop() {
+        uint64_t cycles = 0;
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &cycles, sizeof(cycles)) != sizeof(cycles)) {
+                cycles = 0;
+            }
+        }
+        return cycles;
+    }
+
+private:
+    int fd_;
+};
+
+/**
+ * Run op(iterations) with a growing iteration count until one run
+ * takes min_time, then repeat and keep the fastest repetition
+ * (user-space cycles only: syscall-heavy benchmarks undercount)
+ */
+BenchResult run(const std::string& name, const BenchConfig& config, CycleCounter& counter,
+                const std::function<void(uint64_t)>& op) {
+    uint64_t iterations = 1;
+    uint64_t target = static_cast<uint64_t>(config.min_time * 1e9);
+    while (true) {
+        uint64_t start = now_ns();
+        op(iterations);
+        uint64_t elapsed = now_ns() - start;
+        if (elapsed >= target || iterations >= (1ull << 40)) {
+            break;
+        }
+        // Aim a little past the target so the next run usually suffices
+        uint64_t scale = elapsed > 0 ? target * 12 / 10 / elapsed + 1 : 100;
+        iterations *= std::min<uint64_t>(std::max<uint64_t>(scale, 2), 100);
+    }
+
+    BenchResult result{name, iterations, 0.0, -1.0};
+    for (int r = 0; r < config.repetitions; ++r) {
+        counter.start();
+        uint64_t start = now_ns();
+        op(iterations);
+        uint64_t elapsed = now_ns() - start;
+        uint64_t cycles = counter.stop();
+
+        double ns = static_cast<double>(elapsed) / iterations;
+        if (r == 0 || ns < result.ns_per_op) {
+            result.ns_per_op = ns;
+            result.cycles_per_op = counter.valid() ? static_cast<double>(cycles) / iterations : -1.0;
+        }
+    }
+    return result;
+}
+
+void fill_message(Message& msg) {
+    strncpy(msg.username, "benchmark_user", MAX_USERNAME_LEN - 1);
+    strncpy(msg.timestamp, "2025-01-01T00:00:00Z", MAX_TIMESTAMP_LEN - 1);
+    memset(msg.text, 'x', 64);
+}
+
+void print_json(const std::vector<BenchResult>& results, const BenchConfig& config, bool cycles) {
+    printf("{\n");
+    printf("  \"benchmark\": \"micro_bench\",\n");
+    printf("  \"min_time_s\": %.3f,\n", config.min_time);
+    printf("  \"repetitions\": %d,\n", config.repetitions);
+    printf("  \"cycle_counter\": %s,\n", cycles ? "true" : "false");
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& result = results[i];
+        printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"cycles_per_op\": ",
+               result.name.c_str(), static_cast<unsigned long long>(result.iterations),
+               result.ns_per_op);
+        if (result.cycles_per_op >= 0) {
+            printf("%.1f}", result.cycles_per_op);
+        } else {
+            printf("null}");
+        }
+        printf("%s\n", i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+void print_text(const std::vector<BenchResult>& results) {
+    printf("%-28s %14s %12s %14s\n", "benchmark", "iterations", "ns/op", "cycles/op");
+    for (const BenchResult& result : results) {
+        printf("%-28s %14llu %12.2f ", result.name.c_str(),
+               static_cast<unsigned long long>(result.iterations), result.ns_per_op);
+        if (result.cycles_per_op >= 0) {
+            printf("%14.1f\n", result.cycles_per_op);
+        } else {
+            printf("%14s\n", "n/a");
+        }
+    }
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --filter TEXT     Only run benchmarks whose name contains TEXT\n"
+              << "  --min-time S      Seconds per repetition (default 0.2)\n"
+              << "  --repetitions N   Repetitions, fastest reported (default 5)\n"
+              << "  --format F        json (default) or text\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--filter") {
+            config.filter = value;
+        } else if (arg == "--min-time") {
+            config.min_time = std::atof(value);
+        } else if (arg == "--repetitions") {
+            config.repetitions = std::max(1, std::atoi(value));
+        } else if (arg == "--format") {
+            config.json = std::string(value) != "text";
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    CycleCounter counter;
+    std::vector<BenchResult> results;
+    auto bench = [&](const std::string& name, const std::function<void(uint64_t)>& op) {
+        if (config.filter.empty() || name.find(config.filter) != std::string::npos) {
+            results.push_back(run(name, config, counter, op));
+        }
+    };
+
+    Message sample;
+    fill_message(sample);
+
+    bench("message_construct", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            Message msg;
+            do_not_optimize(msg);
+        }
+    });
+
+    bench("message_is_valid", [&sample](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            do_not_optimize(sample);
+            bool valid = sample.is_valid();
+            do_not_optimize(valid);
+        }
+    });
+
+    bench("get_current_timestamp", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            std::string timestamp = Message::get_current_timestamp();
+            do_not_optimize(timestamp);
+        }
+    });
+
+    bench("chat_time_now_ns", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t time_ns = ChatTime::now_ns();
+            do_not_optimize(time_ns);
+        }
+    });
+
+    // Same second every call: the per-thread cache hit the server sees
+    bench("chat_time_format_cached", [](uint64_t n) {
+        char text[MAX_TIMESTAMP_LEN];
+        uint64_t time_ns = ChatTime::now_ns();
+        for (uint64_t i = 0; i < n; ++i) {
+            do_not_optimize(time_ns);
+            size_t length = ChatTime::format(time_ns, text);
+            do_not_optimize(length);
+            do_not_optimize(text);
+        }
+    });
+
+    // Server-stamped message (binary time only) for v2 and v3 peers
+    Message stamped = sample;
+    stamped.timestamp[0] = '\0';
+    stamped.time_ns = ChatTime::now_ns();
+
+    bench("encode_chat_v2_from_time_ns", [&stamped](uint64_t n) {
+        char frame[MAX_FRAME_SIZE];
+        for (uint64_t i = 0; i < n; ++i) {
+            size_t size = ChatUtils::encode_chat(stamped, WireFormat::V2, frame);
+            do_not_optimize(size);
+            do_not_optimize(frame);
+        }
+    });
+
+    bench("encode_chat_v3", [&stamped](uint64_t n) {
+        char frame[MAX_FRAME_SIZE];
+        for (uint64_t i = 0; i < n; ++i) {
+            size_t size = ChatUtils::encode_chat(stamped, WireFormat::V3, frame);
+            do_not_optimize(size);
+            do_not_optimize(frame);
+        }
+    });
+
+    bench("decode_frame_v3", [&stamped](uint64_t n) {
+        char frame[MAX_FRAME_SIZE];
+        size_t size = ChatUtils::encode_chat(stamped, WireFormat::V3, frame);
+        Frame decoded;
+        for (uint64_t i = 0; i < n; ++i) {
+            do_not_optimize(frame);
+            bool ok = ChatUtils::decode_frame(frame, size, decoded);
+            do_not_optimize(ok);
+        }
+    });
+
+    bench("encode_chat_v2", [&sample](uint64_t n) {
+        char frame[MAX_FRAME_SIZE];
+        for (uint64_t i = 0; i < n; ++i) {
+            size_t size = ChatUtils::encode_chat(sample, WireFormat::V2, frame);
+            do_not_optimize(size);
+            do_not_optimize(frame);
+        }
+    });
+
+    bench("decode_frame_v2", [&sample](uint64_t n) {
+        char frame[MAX_FRAME_SIZE];
+        size_t size = ChatUtils::encode_chat(sample, WireFormat::V2, frame);
+        Frame decoded;
+        for (uint64_t i = 0; i < n; ++i) {
+            do_not_optimize(frame);
+            bool ok = ChatUtils::decode_frame(frame, size, decoded);
+            do_not_optimize(ok);
+        }
+    });
+
+    // One 576-byte send() and one recv() per message, no thread hop
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    bench("send_recv_message_legacy", [&sample, &pair](uint64_t n) {
+        Message received;
+        for (uint64_t i = 0; i < n; ++i) {
+            if (!ChatUtils::send_message(pair[0], sample) ||
+                !ChatUtils::recv_message(pair[1], received)) {
+                abort();
+            }
+        }
+    });
+
+    bench("send_recv_frame_v2", [&sample, &pair](uint64_t n) {
+        char frame[MAX_FRAME_SIZE];
+        size_t size = ChatUtils::encode_chat(sample, WireFormat::V2, frame);
+        RecvBuffer buffer;
+        Frame decoded;
+        for (uint64_t i = 0; i < n; ++i) {
+            if (!ChatUtils::send_frame(pair[0], frame, size) ||
+                !ChatUtils::recv_frame(pair[1], buffer, decoded)) {
+                abort();
+            }
+        }
+    });
+
+    close(pair[0]);
+    close(pair[1]);
+
+    // The shared-memory room path, on anonymous shared memory
+    size_t capacity = DEFAULT_SHM_RING_CAPACITY;
+    size_t segment_size = ShmRing::segment_size(capacity, false);
+    void* segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (segment == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    ShmRing::initialize(segment, capacity, false);
+    ShmRing ring(segment);
+
+    bench("shm_publish", [&sample, &ring](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            ring.publish(sample);
+        }
+    });
+
+    bench("shm_publish_read", [&sample, &ring](uint64_t n) {
+        ShmRing::Cursor cursor = ring.newest();
+        ShmRing::Record record;
+        uint64_t missed = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            ring.publish(sample);
+            if (ring.read(cursor, record, missed) != ShmRing::MESSAGE) {
+                abort();
+            }
+            do_not_optimize(record);
+            ring.commit(cursor, record);
+        }
+    });
+
+    munmap(segment, segment_size);
+
+    if (config.json) {
+        print_json(results, config, counter.valid());
+    } else {
+        print_text(results);
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+// MIT License
+// Multi-threaded Chat System - Client Registry Contention Benchmark
+// Copyright (c) 2025
+
+#include "client_registry.h"
+#include "connection.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchConfig {
+    int clients = 1000;         // Registered clients
+    int readers = 4;            // Broadcasting threads
+    int writers = 1;            // Join/leave threads
+    int write_delay_us = 100;   // Pause between join/leave pairs per writer
+    double seconds = 2.0;       // Run time per variant
+};
+
+struct BenchResult {
+    uint64_t broadcasts;
+    uint64_t visited;
+    uint64_t churn;
+};
+
+std::shared_ptr<Connection> make_connection(int client_id) {
+    // No socket: the benchmark only touches registry bookkeeping
+    return std::make_shared<Connection>(-1, client_id, 2, SlowConsumerPolicy::DROP_OLDEST, nullptr);
+}
+
+/**
+ * The registry broadcast used before: a map under a mutex, with
+ * recipients copied out so sends happen after unlocking
+ */
+class MutexRegistry {
+public:
+    void insert(int client_id, std::shared_ptr<Connection> connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clients_[client_id] = std::move(connection);
+    }
+
+    void remove(int client_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clients_.erase(client_id);
+    }
+
+    uint64_t broadcast(int exclude_client_id) {
+        std::vector<std::shared_ptr<Connection>> recipients;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            recipients.reserve(clients_.size());
+            for (auto& pair : clients_) {
+                if (pair.first != exclude_client_id) {
+                    recipients.push_back(pair.second);
+                }
+            }
+        }
+
+        uint64_t visited = 0;
+        for (auto& connection : recipients) {
+            visited += connection->client_id() != 0;
+        }
+        return visited;
+    }
+
+private:
+    std::map<int, std::shared_ptr<Connection>> clients_;
+    std::mutex mutex_;
+};
+
+/**
+ * Adapter giving ClientRegistry the same interface
+ */
+class SnapshotRegistry {
+public:
+    void insert(int client_id, std::shared_ptr<Connection> connection) {
+        registry_.insert(ClientRegistry::Entry{client_id, std::move(connection), ""});
+    }
+
+    void remove(int client_id) {
+        registry_.remove(client_id);
+    }
+
+    uint64_t broadcast(int exclude_client_id) {
+        ClientRegistry::Reader reader(registry_);
+
+        uint64_t visited = 0;
+        for (auto& entry : reader.clients()) {
+            if (entry.client_id != exclude_client_id) {
+                visited += entry.connection->client_id() != 0;
+            }
+        }
+        return visited;
+    }
+
+private:
+    ClientRegistry registry_;
+};
+
+template <typename Registry>
+BenchResult run_variant(const BenchConfig& config) {
+    Registry registry;
+    for (int id = 1; id <= config.clients; ++id) {
+        registry.insert(id, make_connection(id));
+    }
+
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> broadcasts(0);
+    std::atomic<uint64_t> visited(0);
+    std::atomic<uint64_t> churn(0);
+    std::vector<std::thread> threads;
+
+    for (int r = 0; r < config.readers; ++r) {
+        threads.emplace_back([&, r]() {
+            uint64_t count = 0;
+            uint64_t seen = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                seen += registry.broadcast(r + 1);
+                ++count;
+            }
+            broadcasts += count;
+            visited += seen;
+        });
+    }
+
+    for (int w = 0; w < config.writers; ++w) {
+        threads.emplace_back([&, w]() {
+            // Each writer churns its own id range above the static clients
+            int id = config.clients + 1 + w * 1000000;
+            uint64_t count = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                registry.insert(id, make_connection(id));
+                registry.remove(id);
+                ++id;
+                ++count;
+                if (config.write_delay_us > 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(config.write_delay_us));
+                }
+            }
+            churn += count;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    running = false;
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    return BenchResult{broadcasts, visited, churn};
+}
+
+void report(const char* name, const BenchResult& result, const BenchConfig& config) {
+    double broadcasts_per_sec = result.broadcasts / config.seconds;
+    double visits_per_sec = result.visited / config.seconds;
+
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed
+              << std::setprecision(0)
+              << std::setw(14) << broadcasts_per_sec << " broadcasts/s"
+              << std::setw(16) << visits_per_sec << " recipients/s"
+              << std::setw(12) << result.churn / config.seconds << " join+leave/s"
+              << std::endl;
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --clients N     Registered clients (default 1000)\n"
+              << "  --readers N     Broadcasting threads (default 4)\n"
+              << "  --writers N     Join/leave threads (default 1)\n"
+              << "  --delay US      Pause between join/leave pairs (default 100)\n"
+              << "  --seconds S     Run time per variant (default 2)\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--clients") {
+            config.clients = std::atoi(value);
+        } else if (arg == "--readers") {
+            config.readers = std::atoi(value);
+        } else if (arg == "--writers") {
+            config.writers = std::atoi(value);
+        } else if (arg == "--delay") {
+            config.write_delay_us = std::atoi(value);
+        } else if (arg == "--seconds") {
+            config.seconds = std::atof(value);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::cout << "Client registry contention: " << config.clients << " clients, "
+              << config.readers << " reader(s), " << config.writers << " writer(s), "
+              << config.write_delay_us << "us write delay, " << config.seconds << "s per run"
+              << std::endl;
+
+    report("mutex", run_variant<MutexRegistry>(config), config);
+    report("snapshot", run_variant<SnapshotRegistry>(config), config);
+    return 0;
+}
@@ -285,6 +285,8 @@ void MainWindow::on_connect_clicked() {
                        this, &MainWindow::on_shm_disconnected);
                 connect(shm_client_.get(), &ShmClient::error_occurred,
                        this, &MainWindow::on_shm_error);
+                connect(shm_client_.get(), &ShmClient::messages_missed,
+                       this, &MainWindow::on_shm_messages_missed);
             }
 
             shm_client_->join_room(shm_name, username);
@@ -368,6 +370,10 @@ void MainWindow::on_shm_error(const QString& error) {
     update_connection_ui();
 }
 
+void MainWindow::on_shm_messages_missed(quint64 count) {
+    display_system_message(QString("Fell behind, %1 message(s) were overwritten").arg(count));
+}
+
 void MainWindow::update_connection_ui() {
     if (is_connected_) {
         status_label_->setText("Status: <span style='color: #4caf50;'>Connected</span>");
@@ -92,6 +92,11 @@ private slots:
      */
     void on_shm_error(const QString& error);
 
+    /**
+     * Handle messages lost because this reader fell behind
+     */
+    void on_shm_messages_missed(quint64 count);
+
 private:
     // UI Components
     QWidget* central_widget_;
@@ -3,18 +3,10 @@
 
 #include <QObject>
 #include <QString>
-#include <atomic>
-#include <thread>
 #include "../shared/protocol.h"
+#include "../shared/shm_chat_client.h"
 
-const size_t SHM_BUFFER_SIZE = 64;
-
-struct ShmBuffer {
-    Message messages[SHM_BUFFER_SIZE];
-    size_t write_index;
-    size_t read_index;
-};
-
+// Qt adapter over the headless ShmChatClient: callbacks become signals
 class ShmClient : public QObject {
     Q_OBJECT
 
@@ -22,9 +14,10 @@ public:
     ShmClient(QObject* parent = nullptr);
     ~ShmClient();
 
-    bool join_room(const QString& shm_name, const QString& username);
+    bool join_room(const QString& shm_name, const QString& username,
+                   const ShmRoomOptions& options = ShmRoomOptions());
     void leave_room();
-    bool is_joined() const { return joined_; }
+    bool is_joined() const { return client_.joined(); }
     bool send_message(const QString& text);
 
 signals:
@@ -32,24 +25,11 @@ signals:
     void connected();
     void disconnected();
     void error_occurred(QString error_msg);
+    void messages_missed(quint64 count);
 
 private:
-    void read_loop();
-    bool create_or_open_shm(const QString& shm_name);
-    void cleanup_shm();
-
     QString shm_name_;
-    QString username_;
-    int shm_fd_;
-    ShmBuffer* shm_buffer_;
-    size_t last_read_index_;
-
-    std::atomic<bool> joined_;
-    std::atomic<bool> should_stop_;
-    std::thread read_thread_;
-
-    void* write_sem_;
-    void* read_sem_;
+    ShmChatClient client_;
 };
 
 #endif
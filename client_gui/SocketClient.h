@@ -3,10 +3,10 @@
 
 #include <QObject>
 #include <QString>
-#include <atomic>
-#include <thread>
 #include "../shared/protocol.h"
+#include "../shared/chat_client.h"
 
+// Qt adapter over the headless SocketChatClient: callbacks become signals
 class SocketClient : public QObject {
     Q_OBJECT
 
@@ -17,7 +17,8 @@ public:
     bool connect_to_server(const QString& host, int port, const QString& username);
     void disconnect();
     bool send_message(const QString& text);
-    bool is_connected() const { return connected_; }
+    bool is_connected() const { return client_.connected(); }
+    WireFormat wire_format() const { return client_.wire_format(); }
 
 signals:
     void message_received(const QString& username, const QString& timestamp, const QString& text);
@@ -26,13 +27,7 @@ signals:
     void error_occurred(const QString& error);
 
 private:
-    int socket_fd_;
-    std::atomic<bool> connected_;
-    std::atomic<bool> should_stop_;
-    std::thread receive_thread_;
-    QString username_;
-
-    void receive_loop();
+    SocketChatClient client_;
 };
 
 #endif
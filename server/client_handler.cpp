@@ -3,72 +3,263 @@
 // Copyright (c) 2025
 
 #include "client_handler.h"
+#include "connection.h"
+#include "handoff.h"
 #include "server.h"
 #include "common.h"
-#include <unistd.h>
+#include "timestamp.h"
+#include <algorithm>
 
-ClientHandler::ClientHandler(int socket_fd, int client_id, ChatServer* server)
-    : socket_fd_(socket_fd), client_id_(client_id), server_(server), should_stop_(false) {
+constexpr ClientHandler::FrameHandlers ClientHandler::frame_handlers() {
+    // TIMED_CHAT, ROOM_CHAT and DIRECT decode as CHAT; JOIN only
+    // starts a session and ACK/ERROR only flow to the client
+    FrameHandlers handlers{};
+    handlers[static_cast<size_t>(FrameType::CHAT)] = &ClientHandler::handle_chat;
+    handlers[static_cast<size_t>(FrameType::SUBSCRIBE)] = &ClientHandler::handle_subscription;
+    handlers[static_cast<size_t>(FrameType::UNSUBSCRIBE)] = &ClientHandler::handle_subscription;
+    handlers[static_cast<size_t>(FrameType::PING)] = &ClientHandler::handle_ping;
+    handlers[static_cast<size_t>(FrameType::PONG)] = &ClientHandler::handle_pong;
+    handlers[static_cast<size_t>(FrameType::LEAVE)] = &ClientHandler::handle_leave;
+    handlers[static_cast<size_t>(FrameType::HISTORY)] = &ClientHandler::handle_history;
+    return handlers;
+}
+
+constexpr ClientHandler::FrameHandlers ClientHandler::FRAME_HANDLERS =
+    ClientHandler::frame_handlers();
+
+ClientHandler::ClientHandler(std::shared_ptr<Connection> connection, ChatServer* server)
+    : connection_(std::move(connection)), client_id_(connection_->client_id()),
+      server_(server), joined_(false), should_stop_(false) {
 }
 
 ClientHandler::~ClientHandler() {
     should_stop_ = true;
-    if (socket_fd_ >= 0) {
-        close(socket_fd_);
-        socket_fd_ = -1;
+}
+
+void ClientHandler::run(const std::vector<char>& received) {
+    RecvBuffer buffer;
+    buffer.append(received.data(), received.size());
+    Frame frame;
+
+    while (!should_stop_) {
+        RecvBuffer::Status status = buffer.next_frame(frame);
+        if (status == RecvBuffer::FRAME) {
+            if (!on_frame(frame)) {
+                break;
+            }
+            continue;
+        }
+        if (status == RecvBuffer::INVALID) {
+            LOG_WARN("Received invalid message");
+            break;
+        }
+
+        // Between frames is where a handoff can take the client over;
+        // the server interrupts the recv() below with a signal
+        if (server_->handing_off()) {
+            HandoffClient client;
+            detach(buffer, client);
+            server_->park_client(client_id_, std::move(client));
+            return;
+        }
+
+        ssize_t bytes = buffer.fill(connection_->socket_fd());
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes < 0) {
+            if (errno != ECONNRESET) {
+                LOG_ERROR("Receive failed: " << strerror(errno));
+            }
+            break;
+        }
+        if (bytes == 0) {
+            if (buffer.buffered() != 0) {
+                LOG_WARN("Connection closed during receive");
+            }
+            break;
+        }
+        connection_->mark_heard(ChatTime::monotonic_ms());
     }
+
+    if (!joined_) {
+        LOG_ERROR("Failed to receive username from client " << client_id_);
+    }
+
+    // Cleanup
+    on_disconnect();
 }
 
-void ClientHandler::run() {
+bool ClientHandler::on_frame(Frame& frame) {
     // First message must be username
-    if (!receive_username()) {
-        LOG_ERROR("Failed to receive username from client " << client_id_);
-        server_->remove_client(client_id_);
-        return;
+    if (!joined_) {
+        if (!receive_username(frame)) {
+            return false;
+        }
+
+        // Join: replay what it asked for, then go live
+        server_->add_client(connection_, username_, frame.since_seq);
+        joined_ = true;
+        return true;
+    }
+
+    size_t type = static_cast<size_t>(frame.type);
+    FrameHandler handler = type < FRAME_HANDLERS.size() ? FRAME_HANDLERS[type] : nullptr;
+    if (!handler) {
+        LOG_WARN("Client " << client_id_ << " sent unexpected frame type " << type);
+        send_error(ErrorCode::PROTOCOL, "Unexpected frame type " + std::to_string(type));
+        return false;
     }
+    return (this->*handler)(frame);
+}
 
-    // Add client to server's client list
-    server_->add_client(client_id_, socket_fd_, username_);
+void ClientHandler::resume(const HandoffClient& client) {
+    // Frames the old process had queued go out ahead of anything new
+    connection_->set_wire_format(client.format);
+    connection_->set_version(client.version);
+    if (!client.outbound.empty()) {
+        connection_->send(FrameRef::copy_of(client.outbound.data(), client.outbound.size()));
+    }
 
-    // Enter message loop
-    message_loop();
+    if (client.username.empty()) {
+        return;     // Still in the handshake; its JOIN is (partly) in the inbound bytes
+    }
 
-    // Cleanup
+    username_ = client.username;
+    joined_ = true;
+    server_->add_client(connection_, username_, 0);
+    for (const std::string& room : client.rooms) {
+        server_->subscribe(connection_, room);
+    }
+}
+
+void ClientHandler::detach(const RecvBuffer& inbound, HandoffClient& client) const {
+    client.socket_fd = connection_->socket_fd();
+    client.format = connection_->wire_format();
+    client.version = connection_->version();
+    if (joined_) {
+        client.username = username_;
+    }
+    client.inbound.assign(inbound.unparsed(), inbound.unparsed() + inbound.buffered());
+}
+
+void ClientHandler::on_disconnect() {
+    should_stop_ = true;
     server_->remove_client(client_id_);
 }
 
-bool ClientHandler::receive_username() {
-    Message msg;
-    
-    if (!ChatUtils::recv_message(socket_fd_, msg)) {
+bool ClientHandler::receive_username(const Frame& frame) {
+    if (!ChatUtils::opens_session(frame)) {
+        LOG_WARN("Client " << client_id_ << " did not start with a JOIN frame");
+        send_error(ErrorCode::PROTOCOL, "Expected a JOIN frame");
         return false;
     }
 
-    // First message text is the username
-    username_ = msg.text;
-    
+    // A legacy first message only announces its sender, whatever its
+    // text says (older clients put the name there as well)
+    username_ = frame.message.username;
+
     if (username_.empty()) {
         LOG_WARN("Client " << client_id_ << " sent empty username");
         return false;
     }
 
+    if (frame.format == WireFormat::V2) {
+        // Highest version both sides speak
+        uint8_t version = std::min(frame.version, PROTOCOL_VERSION_4);
+        connection_->set_version(version);
+
+        // Switch before acknowledging so every later frame uses it
+        connection_->set_wire_format(version >= PROTOCOL_VERSION_3 ? WireFormat::V3
+                                                                   : WireFormat::V2);
+
+        char ack[MAX_FRAME_SIZE];
+        size_t size = ChatUtils::encode_ack(version, ack);
+        connection_->send(FrameRef::copy_of(ack, size));
+    } else {
+        connection_->set_version(PROTOCOL_VERSION_LEGACY);
+    }
+
+    return true;
+}
+
+bool ClientHandler::handle_chat(Frame& frame) {
+    Message& msg = frame.message;
+
+    // Stamp on the server side; text is only produced when a v2 or
+    // legacy recipient's frame is encoded
+    msg.time_ns = ChatTime::now_ns();
+    msg.timestamp[0] = '\0';
+
+    // Set username (in case client didn't set it correctly)
+    strncpy(msg.username, username_.c_str(), MAX_USERNAME_LEN - 1);
+    msg.username[MAX_USERNAME_LEN - 1] = '\0';
+
+    if (msg.recipient[0] != '\0') {
+        if (!server_->send_direct(msg, client_id_)) {
+            send_error(ErrorCode::RECIPIENT, std::string(msg.recipient) + " is not connected");
+        }
+        return true;
+    }
+
+    // Broadcast to all other clients (of its room, if it has one)
+    server_->broadcast_message(msg, client_id_);
+    return true;
+}
+
+bool ClientHandler::handle_ping(Frame&) {
+    char pong[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_heartbeat(false, pong);
+    connection_->send(FrameRef::copy_of(pong, size));
     return true;
 }
 
-void ClientHandler::message_loop() {
-    Message msg;
-    
-    while (!should_stop_ && ChatUtils::recv_message(socket_fd_, msg)) {
-        // Update timestamp on server side
-        std::string timestamp = Message::get_current_timestamp();
-        strncpy(msg.timestamp, timestamp.c_str(), MAX_TIMESTAMP_LEN - 1);
-        msg.timestamp[MAX_TIMESTAMP_LEN - 1] = '\0';
+bool ClientHandler::handle_pong(Frame&) {
+    return true;    // Receiving it was the point
+}
+
+bool ClientHandler::handle_leave(Frame&) {
+    LOGF_INFO("Client {} left", client_id_);
+    return false;
+}
 
-        // Set username (in case client didn't set it correctly)
-        strncpy(msg.username, username_.c_str(), MAX_USERNAME_LEN - 1);
-        msg.username[MAX_USERNAME_LEN - 1] = '\0';
+bool ClientHandler::handle_history(Frame& frame) {
+    size_t replayed = server_->replay_history(*connection_, frame.since_seq);
+    LOGF_DEBUG("Client {} asked for history from sequence {}: {} messages",
+               client_id_, frame.since_seq, replayed);
+    return true;
+}
 
-        // Broadcast to all other clients
-        server_->broadcast_message(msg, client_id_);
+void ClientHandler::send_error(ErrorCode error, const std::string& text) {
+    // Before the handshake only a framed client can be refused (any
+    // legacy message starts a session), and it reads frames already
+    if (joined_ && connection_->version() < PROTOCOL_VERSION_4) {
+        return;
     }
+
+    char frame[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_error(error, text.c_str(), frame);
+    connection_->send(FrameRef::copy_of(frame, size));
+}
+
+bool ClientHandler::handle_subscription(Frame& frame) {
+    // Only v3 frames can carry room messages back to the client
+    if (connection_->wire_format() != WireFormat::V3) {
+        LOG_WARN("Client " << client_id_ << " asked for a room without protocol v3");
+        return false;
+    }
+
+    std::string room = frame.message.room;
+    if (frame.type == FrameType::SUBSCRIBE) {
+        if (server_->subscribe(connection_, room)) {
+            LOGF_DEBUG("Client {} entered room {}", client_id_, room);
+        } else {
+            LOGF_WARN("Client {} could not enter room {} (already in it or in {} rooms)",
+                      client_id_, room, MAX_ROOMS_PER_CLIENT);
+            send_error(ErrorCode::ROOM, "Could not enter room " + room);
+        }
+    } else if (server_->unsubscribe(client_id_, room)) {
+        LOGF_DEBUG("Client {} left room {}", client_id_, room);
+    }
+    return true;
 }
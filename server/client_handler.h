@@ -6,24 +6,46 @@
 #define CLIENT_HANDLER_H
 
 #include "protocol.h"
+#include "frame.h"
+#include "recv_buffer.h"
+#include <array>
 #include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
 
-// Forward declaration
+// Forward declarations
 class ChatServer;
+class Connection;
+struct HandoffClient;
 
 /**
- * Handles a single client connection in a separate thread
+ * Handles the protocol for a single client connection
  * Receives messages and broadcasts them to other clients
+ *
+ * Transport-agnostic: run() drives it from a dedicated blocking
+ * thread, while an EventLoop or UringLoop feeds it frames via on_frame()
+ *
+ * The first frame selects the wire format for the connection: a v2
+ * JOIN negotiates protocol v2, a legacy Message keeps the fixed
+ * 576-byte format. Once joined, a v3 client may also enter and leave
+ * rooms, and a v4 client send control frames
+ *
+ * A joined client's frames are dispatched through a table indexed by
+ * FrameType and built at compile time; a type without a handler is a
+ * protocol error, so new kinds of frames need no checks on the text
+ *
+ * A client handed over by a previous server process skips the
+ * handshake: resume() restores what the old handler had negotiated
  */
 class ClientHandler {
 public:
     /**
      * Constructor
-     * @param socket_fd Client socket file descriptor
-     * @param client_id Unique client identifier
+     * @param connection Client connection (socket and outbound queue)
      * @param server Pointer to parent server
      */
-    ClientHandler(int socket_fd, int client_id, ChatServer* server);
+    ClientHandler(std::shared_ptr<Connection> connection, ChatServer* server);
 
     /**
      * Destructor
@@ -31,28 +53,103 @@ public:
     ~ClientHandler();
 
     /**
-     * Main thread function
-     * Receives username, then enters message loop
+     * Main thread function (THREADED mode)
+     * Receives username, then enters message loop. Parks the client
+     * with the server instead of disconnecting it when the server is
+     * handing off and interrupts the read
+     * @param received Bytes already received for it (handoff)
      */
-    void run();
+    void run(const std::vector<char>& received = std::vector<char>());
+
+    /**
+     * Continue a client handed over by a previous server process:
+     * queue what it had not been sent yet and, if it had joined,
+     * rejoin it and its rooms
+     * Call before any frame is processed
+     */
+    void resume(const HandoffClient& client);
+
+    /**
+     * Describe this client for a handoff: socket, wire format, username
+     * (if joined) and the unparsed bytes of its receive buffer
+     * Rooms and unsent bytes are added by the caller
+     */
+    void detach(const RecvBuffer& inbound, HandoffClient& client) const;
+
+    /**
+     * Process one complete frame from the client
+     * The first frame carries the username, later ones are dispatched
+     * by type
+     * @param frame Received frame (timestamp/username are rewritten)
+     * @return false if the connection should be closed
+     */
+    bool on_frame(Frame& frame);
+
+    /**
+     * Connection is gone - deregister from the server
+     */
+    void on_disconnect();
+
+    int client_id() const { return client_id_; }
 
 private:
     /**
-     * Receive and validate username (first message)
+     * Handles one frame type of a joined client
+     * @return false if the connection should be closed
+     */
+    using FrameHandler = bool (ClientHandler::*)(Frame& frame);
+    using FrameHandlers = std::array<FrameHandler, FRAME_TYPE_LIMIT>;
+
+    /**
+     * Build the dispatch table (evaluated at compile time)
+     */
+    static constexpr FrameHandlers frame_handlers();
+
+    static const FrameHandlers FRAME_HANDLERS;
+
+    /**
+     * Validate and store the username (first frame)
      * @return true on success, false on error
      */
-    bool receive_username();
+    bool receive_username(const Frame& frame);
+
+    /**
+     * Stamp and broadcast a chat message, or deliver a direct one
+     */
+    bool handle_chat(Frame& frame);
+
+    /**
+     * Enter or leave the room named by a SUBSCRIBE/UNSUBSCRIBE frame
+     */
+    bool handle_subscription(Frame& frame);
+
+    /**
+     * Answer a client's PING; a PONG needs nothing beyond its arrival
+     */
+    bool handle_ping(Frame& frame);
+    bool handle_pong(Frame& frame);
+
+    /**
+     * End the session at the client's request
+     */
+    bool handle_leave(Frame& frame);
+
+    /**
+     * Replay what was sent before the client joined, from since_seq on
+     */
+    bool handle_history(Frame& frame);
 
     /**
-     * Message receiving loop
-     * Receives messages and broadcasts them
+     * Tell a v4 client why a request was refused; older clients only
+     * see the effect
      */
-    void message_loop();
+    void send_error(ErrorCode error, const std::string& text);
 
-    int socket_fd_;
+    std::shared_ptr<Connection> connection_;
     int client_id_;
     ChatServer* server_;
     std::string username_;
+    bool joined_;
     std::atomic<bool> should_stop_;
 };
 
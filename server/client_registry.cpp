@@ -0,0 +1,176 @@
+// MIT License
+// Multi-threaded Chat System - Client Registry Implementation
+// Copyright (c) 2025
+
+#include "client_registry.h"
+#include "connection.h"
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace {
+
+/**
+ * Stripe used by the calling thread, fixed for its lifetime
+ */
+int thread_stripe(int stripes) {
+    static thread_local int stripe =
+        static_cast<int>(std::hash<std::thread::id>()(std::this_thread::get_id()) % stripes);
+    return stripe;
+}
+
+ClientRegistry::Snapshot::iterator find_entry(ClientRegistry::Snapshot& clients, int client_id) {
+    return std::lower_bound(clients.begin(), clients.end(), client_id,
+                            [](const ClientRegistry::Entry& entry, int id) {
+                                return entry.client_id < id;
+                            });
+}
+
+}
+
+ClientRegistry::Reader::Reader(const ClientRegistry& registry) {
+    Stripe& stripe = registry.stripes_[thread_stripe(STRIPES)];
+
+    // Announce the read under the current parity, then confirm the
+    // epoch did not move; the epoch cannot pass E + 1 while a reader
+    // confirmed in E is active, which is what keeps snapshot_ alive
+    while (true) {
+        uint64_t epoch = registry.epoch_.load();
+        counter_ = &stripe.active[epoch & 1];
+        counter_->fetch_add(1);
+        if (registry.epoch_.load() == epoch) {
+            break;
+        }
+        counter_->fetch_sub(1);
+    }
+    snapshot_ = registry.current_.load();
+}
+
+ClientRegistry::Reader::~Reader() {
+    counter_->fetch_sub(1, std::memory_order_release);
+}
+
+ClientRegistry::ClientRegistry()
+    : current_(new Snapshot()), epoch_(0) {
+    for (auto& stripe : stripes_) {
+        stripe.active[0] = 0;
+        stripe.active[1] = 0;
+    }
+}
+
+ClientRegistry::~ClientRegistry() {
+    // No readers may outlive the registry
+    for (auto& retired : retired_) {
+        delete retired.snapshot;
+    }
+    delete current_.load();
+}
+
+void ClientRegistry::insert(Entry entry) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    Snapshot* next = new Snapshot(*current_.load());
+    auto it = find_entry(*next, entry.client_id);
+    if (it != next->end() && it->client_id == entry.client_id) {
+        *it = std::move(entry);
+    } else {
+        next->insert(it, std::move(entry));
+    }
+    publish(next);
+}
+
+bool ClientRegistry::set_username(int client_id, const std::string& username) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    Snapshot* next = new Snapshot(*current_.load());
+    auto it = find_entry(*next, client_id);
+    if (it == next->end() || it->client_id != client_id) {
+        delete next;
+        return false;
+    }
+
+    it->username = username;
+    publish(next);
+    return true;
+}
+
+bool ClientRegistry::remove(int client_id, Entry* removed) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    Snapshot* next = new Snapshot(*current_.load());
+    auto it = find_entry(*next, client_id);
+    if (it == next->end() || it->client_id != client_id) {
+        delete next;
+        return false;
+    }
+
+    if (removed) {
+        *removed = std::move(*it);
+    }
+    next->erase(it);
+    publish(next);
+    return true;
+}
+
+ClientRegistry::Snapshot ClientRegistry::clear() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    Snapshot removed = *current_.load();
+    publish(new Snapshot());
+    return removed;
+}
+
+size_t ClientRegistry::size() const {
+    Reader reader(*this);
+    return reader.clients().size();
+}
+
+void ClientRegistry::publish(Snapshot* next) {
+    const Snapshot* previous = current_.exchange(next);
+    retired_.push_back(Retired{epoch_.load(), previous});
+    reclaim(retired_.size() > MAX_RETIRED);
+}
+
+bool ClientRegistry::try_advance() {
+    // Readers of the previous epoch share a parity with the next one;
+    // it must be empty before new readers start landing in it
+    uint64_t epoch = epoch_.load();
+    int previous = static_cast<int>((epoch + 1) & 1);
+
+    for (auto& stripe : stripes_) {
+        if (stripe.active[previous].load() != 0) {
+            return false;
+        }
+    }
+
+    // Writers are serialized, so nobody else moves the epoch
+    epoch_.store(epoch + 1);
+    return true;
+}
+
+void ClientRegistry::reclaim(bool wait) {
+    for (int spins = 0; ; ++spins) {
+        // Two advances cover every reader that could hold a retired snapshot
+        if (try_advance()) {
+            try_advance();
+        }
+
+        uint64_t epoch = epoch_.load();
+        size_t kept = 0;
+        for (auto& retired : retired_) {
+            if (retired.epoch + 2 <= epoch) {
+                delete retired.snapshot;
+            } else {
+                retired_[kept++] = retired;
+            }
+        }
+        retired_.resize(kept);
+
+        if (!wait || retired_.size() <= MAX_RETIRED) {
+            return;
+        }
+        if (spins > 64) {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,147 @@
+// MIT License
+// Multi-threaded Chat System - Client Registry Header
+// Copyright (c) 2025
+
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Forward declaration
+class Connection;
+
+/**
+ * Copy-on-write registry of connected clients
+ *
+ * Readers (broadcast) pin the current snapshot and iterate it with no
+ * lock. Writers (join/leave) copy the snapshot, apply their change and
+ * publish the copy; the old one is retired and freed by a later write
+ * once no reader can still be using it, so writers do not wait either.
+ *
+ * Reclamation is epoch-based: a reader bumps the active counter of
+ * the current epoch parity while it holds a snapshot. The epoch only
+ * advances once the previous parity has drained, and a snapshot
+ * retired in epoch E is freed once the epoch reaches E + 2. Counters
+ * are striped across cache lines so readers do not contend.
+ */
+class ClientRegistry {
+public:
+    /**
+     * One registered client
+     */
+    struct Entry {
+        int client_id;
+        std::shared_ptr<Connection> connection;
+        std::string username;
+    };
+
+    /**
+     * Immutable list of clients, sorted by client_id
+     */
+    using Snapshot = std::vector<Entry>;
+
+    /**
+     * RAII read-side critical section
+     * The snapshot stays valid until the Reader is destroyed; keep it
+     * short, and never modify the registry while holding one (the
+     * writer would wait for itself)
+     */
+    class Reader {
+    public:
+        explicit Reader(const ClientRegistry& registry);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const Snapshot& clients() const { return *snapshot_; }
+
+    private:
+        std::atomic<long>* counter_;     // Active count this reader bumped
+        const Snapshot* snapshot_;
+    };
+
+    ClientRegistry();
+    ~ClientRegistry();
+
+    ClientRegistry(const ClientRegistry&) = delete;
+    ClientRegistry& operator=(const ClientRegistry&) = delete;
+
+    /**
+     * Add a client (replaces an existing entry with the same id)
+     */
+    void insert(Entry entry);
+
+    /**
+     * Set the username of a registered client
+     * @return false if the client is not registered
+     */
+    bool set_username(int client_id, const std::string& username);
+
+    /**
+     * Remove a client
+     * @param removed Receives the removed entry (optional)
+     * @return false if the client is not registered
+     */
+    bool remove(int client_id, Entry* removed = nullptr);
+
+    /**
+     * Remove every client
+     * @return the removed entries
+     */
+    Snapshot clear();
+
+    /**
+     * Number of registered clients
+     */
+    size_t size() const;
+
+private:
+    static const int STRIPES = 16;
+    static const size_t MAX_RETIRED = 64;    // Writers wait beyond this
+
+    /**
+     * Snapshot waiting for its grace period
+     */
+    struct Retired {
+        uint64_t epoch;
+        const Snapshot* snapshot;
+    };
+
+    /**
+     * Reader counters for one stripe, padded to a cache line
+     */
+    struct alignas(64) Stripe {
+        std::atomic<long> active[2];
+    };
+
+    /**
+     * Publish a new snapshot and retire the old one; caller holds write_mutex_
+     */
+    void publish(Snapshot* next);
+
+    /**
+     * Advance the epoch if no reader is left in the previous one
+     * @return true if the epoch advanced
+     */
+    bool try_advance();
+
+    /**
+     * Free retired snapshots whose grace period has passed
+     * @param wait Keep advancing until at most MAX_RETIRED remain
+     */
+    void reclaim(bool wait);
+
+    std::atomic<const Snapshot*> current_;
+    std::atomic<uint64_t> epoch_;
+    mutable Stripe stripes_[STRIPES];
+    std::mutex write_mutex_;        // Serializes writers only
+    std::vector<Retired> retired_;  // Protected by write_mutex_
+};
+
+#endif // CLIENT_REGISTRY_H
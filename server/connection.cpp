@@ -0,0 +1,228 @@
+// MIT License
+// Multi-threaded Chat System - Connection Implementation
+// Copyright (c) 2025
+
+#include "connection.h"
+#include "common.h"
+#include "timestamp.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace {
+// Frames handed to the kernel per sendmsg() call
+const size_t MAX_IOV_BATCH = 64;
+}
+
+Connection::Connection(int socket_fd, int client_id, size_t max_queue,
+                       SlowConsumerPolicy policy, OutboundStats* stats)
+    : socket_fd_(socket_fd), client_id_(client_id),
+      max_queue_(std::max<size_t>(max_queue, 2)), policy_(policy), stats_(stats),
+      scheduler_(nullptr), send_scheduled_(false), head_offset_(0),
+      format_(WireFormat::LEGACY), live_from_(UINT64_MAX), closing_(false), dropped_(0),
+      opened_ms_(ChatTime::monotonic_ms()), heard_ms_(opened_ms_), version_(0),
+      ping_sent_ms_(0) {
+}
+
+Connection::~Connection() {
+    if (socket_fd_ >= 0) {
+        close(socket_fd_);
+        socket_fd_ = -1;
+    }
+}
+
+bool Connection::send(const FrameRef& frame) {
+    if (closing_) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enqueue_locked(frame)) {
+        return false;
+    }
+    start_send_locked();
+    return true;
+}
+
+bool Connection::send_broadcast(const FrameRef& frame, uint64_t seq) {
+    if (closing_) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (seq < live_from_.load(std::memory_order_relaxed) || !enqueue_locked(frame)) {
+        return false;
+    }
+    start_send_locked();
+    return true;
+}
+
+void Connection::go_live(const std::function<uint64_t(std::vector<FrameRef>&)>& backlog) {
+    std::vector<FrameRef> frames;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t live_from = backlog(frames);
+    bool queued = false;
+    for (const FrameRef& frame : frames) {
+        queued = enqueue_locked(frame) || queued;
+    }
+    live_from_.store(live_from, std::memory_order_release);
+
+    if (queued && !closing_) {
+        start_send_locked();
+    }
+}
+
+bool Connection::enqueue_locked(const FrameRef& frame) {
+    if (queue_.size() >= max_queue_) {
+        switch (policy_) {
+        case SlowConsumerPolicy::DROP_OLDEST:
+            // The head may be partially written; evict the next one instead
+            queue_.erase(head_offset_ > 0 ? queue_.begin() + 1 : queue_.begin());
+            stats_->dropped_oldest++;
+            break;
+
+        case SlowConsumerPolicy::DROP_NEWEST:
+            stats_->dropped_newest++;
+            if (dropped_++ == 0) {
+                LOGF_WARN("Client {} is a slow consumer, dropping newest messages", client_id_);
+            }
+            return false;
+
+        case SlowConsumerPolicy::DISCONNECT:
+            stats_->disconnected++;
+            LOGF_WARN("Client {} is a slow consumer, disconnecting", client_id_);
+            closing_ = true;
+            ::shutdown(socket_fd_, SHUT_RDWR);
+            return false;
+        }
+
+        if (dropped_++ == 0) {
+            LOGF_WARN("Client {} is a slow consumer, dropping oldest messages", client_id_);
+        }
+    }
+
+    queue_.push_back(frame);
+    stats_->queued++;
+    return true;
+}
+
+void Connection::start_send_locked() {
+    if (scheduler_) {
+        // The loop batches this with other sends into one submission
+        if (!send_scheduled_) {
+            send_scheduled_ = true;
+            scheduler_->schedule_send(*this);
+        }
+        return;
+    }
+
+    // Opportunistic write; whatever does not fit waits for EPOLLOUT
+    if (!flush_locked()) {
+        shutdown();
+    }
+}
+
+bool Connection::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flush_locked();
+}
+
+bool Connection::flush_locked() {
+    struct iovec iov[MAX_IOV_BATCH];
+
+    while (!queue_.empty()) {
+        // Gather as many queued frames as fit into one syscall
+        size_t count = std::min(queue_.size(), MAX_IOV_BATCH);
+        for (size_t i = 0; i < count; ++i) {
+            const FrameRef& frame = queue_[i];
+            size_t skip = (i == 0) ? head_offset_ : 0;
+            iov[i].iov_base = const_cast<char*>(frame.data()) + skip;
+            iov[i].iov_len = frame.size() - skip;
+        }
+
+        struct msghdr hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = iov;
+        hdr.msg_iovlen = count;
+
+        ssize_t sent = sendmsg(socket_fd_, &hdr, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (!closing_) {
+                LOGF_WARN("Failed to send message to client {}: {}", client_id_, strerror(errno));
+                stats_->send_errors++;
+            }
+            queue_.clear();
+            head_offset_ = 0;
+            return false;
+        }
+
+        // Release fully written frames; the last holder frees the bytes
+        size_t remaining = static_cast<size_t>(sent);
+        while (remaining > 0) {
+            size_t left = queue_.front().size() - head_offset_;
+            if (remaining < left) {
+                head_offset_ += remaining;
+                break;
+            }
+            remaining -= left;
+            queue_.pop_front();
+            head_offset_ = 0;
+        }
+    }
+
+    return true;
+}
+
+size_t Connection::take_queued(std::vector<FrameRef>& frames, size_t max_frames) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t count = std::min(queue_.size(), max_frames);
+    for (size_t i = 0; i < count; ++i) {
+        frames.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+    }
+
+    // Nothing left: the next send() has to schedule again
+    send_scheduled_ = !queue_.empty();
+    return count;
+}
+
+void Connection::take_unsent(std::vector<char>& bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t skip = head_offset_;
+    for (const FrameRef& frame : queue_) {
+        bytes.insert(bytes.end(), frame.data() + skip, frame.data() + frame.size());
+        skip = 0;
+    }
+    queue_.clear();
+    head_offset_ = 0;
+}
+
+void Connection::send_failed(int error) {
+    if (!closing_) {
+        LOGF_WARN("Failed to send message to client {}: {}", client_id_, strerror(error));
+        stats_->send_errors++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+    }
+    shutdown();
+}
+
+void Connection::shutdown() {
+    if (!closing_.exchange(true)) {
+        ::shutdown(socket_fd_, SHUT_RDWR);
+    }
+}
@@ -0,0 +1,245 @@
+// MIT License
+// Multi-threaded Chat System - Connection Header
+// Copyright (c) 2025
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "protocol.h"
+#include "frame_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class Connection;
+
+/**
+ * What to do when a client's outbound queue is full
+ */
+enum class SlowConsumerPolicy {
+    DROP_OLDEST,    // Discard the oldest unsent message
+    DROP_NEWEST,    // Discard the message being queued
+    DISCONNECT      // Close the connection
+};
+
+/**
+ * Server-wide counters for outbound queue activity
+ */
+struct OutboundStats {
+    std::atomic<uint64_t> queued{0};            // Messages accepted into a queue
+    std::atomic<uint64_t> dropped_oldest{0};    // DROP_OLDEST evictions
+    std::atomic<uint64_t> dropped_newest{0};    // DROP_NEWEST rejections
+    std::atomic<uint64_t> disconnected{0};      // DISCONNECT policy firings
+    std::atomic<uint64_t> send_errors{0};       // Connections failed while flushing
+};
+
+/**
+ * Takes over writing for connections whose sends are submitted by an
+ * event loop rather than written inline (io_uring backend)
+ */
+class SendScheduler {
+public:
+    virtual ~SendScheduler() {}
+
+    /**
+     * A connection's queue went from idle to non-empty; the scheduler
+     * must call take_queued() on it later
+     */
+    virtual void schedule_send(Connection& connection) = 0;
+};
+
+/**
+ * A client socket plus its bounded outbound queue
+ * Shared between the reader (handler thread or reactor) and any
+ * thread that broadcasts to it; the socket is closed when the last
+ * reference goes away, so a queued writer never sees a reused fd
+ */
+class Connection {
+public:
+    /**
+     * Constructor
+     * @param socket_fd Client socket file descriptor (owned)
+     * @param client_id Unique client identifier
+     * @param max_queue Maximum number of queued outbound messages
+     * @param policy Action taken when the queue is full
+     * @param stats Server-wide counters to update
+     */
+    Connection(int socket_fd, int client_id, size_t max_queue,
+               SlowConsumerPolicy policy, OutboundStats* stats);
+
+    /**
+     * Destructor - closes the socket
+     */
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    /**
+     * Queue an encoded frame and try to send it without blocking
+     * Thread-safe; applies the slow-consumer policy when full.
+     * The frame is shared, not copied
+     * @param frame Encoded frame to send
+     * @return false if the frame was not queued
+     */
+    bool send(const FrameRef& frame);
+
+    /**
+     * Queue a numbered broadcast if the client is live for it
+     * Checked under the queue lock, so it cannot interleave with
+     * go_live(): the broadcast is either covered by the replay or
+     * queued after it
+     * @param frame Encoded frame to send
+     * @param seq History sequence number of the message
+     * @return false if the frame was not queued
+     */
+    bool send_broadcast(const FrameRef& frame, uint64_t seq);
+
+    /**
+     * Start sending broadcasts live, queueing what the client missed first
+     * The callback runs under the queue lock; it picks the first
+     * sequence number sent live and fills in the replay before it
+     * @param backlog Appends the replay to its argument and returns
+     *                the first live sequence number
+     */
+    void go_live(const std::function<uint64_t(std::vector<FrameRef>&)>& backlog);
+
+    /**
+     * Write as much queued data as the socket accepts without blocking
+     * Called when the socket becomes writable
+     * @return false if the connection failed and should be closed
+     */
+    bool flush();
+
+    /**
+     * Route sends through a scheduler instead of writing inline
+     * Must be set before the first send()
+     */
+    void set_send_scheduler(SendScheduler* scheduler) { scheduler_ = scheduler; }
+
+    /**
+     * Move queued frames out for an asynchronous write (scheduler only)
+     * The slow-consumer policy no longer applies to frames taken
+     * @param frames Receives the frames, oldest first
+     * @param max_frames Upper bound on frames taken
+     * @return number of frames taken; 0 also re-arms schedule_send()
+     */
+    size_t take_queued(std::vector<FrameRef>& frames, size_t max_frames);
+
+    /**
+     * Move every unsent byte out of the queue, for a connection that
+     * is handed to another process; call once nothing else sends to it
+     * @param bytes Receives the bytes (appended), starting mid-frame
+     *              if the head was partially written
+     */
+    void take_unsent(std::vector<char>& bytes);
+
+    /**
+     * Record that an asynchronous write failed and shut down
+     * @param error errno value reported for the write
+     */
+    void send_failed(int error);
+
+    /**
+     * Shut the socket down so the reader side observes a disconnect
+     * Thread-safe and idempotent
+     */
+    void shutdown();
+
+    int socket_fd() const { return socket_fd_; }
+    int client_id() const { return client_id_; }
+
+    /**
+     * Wire format negotiated during the join handshake
+     */
+    WireFormat wire_format() const { return format_; }
+    void set_wire_format(WireFormat format) { format_ = format; }
+
+    /**
+     * Whether a broadcast with this sequence number is sent live
+     * Nothing is until the client has joined; messages before its
+     * first live one are covered by the history replayed on join.
+     * A hint only: send_broadcast() decides under the queue lock
+     */
+    bool receives(uint64_t seq) const { return seq >= live_from_.load(std::memory_order_acquire); }
+    uint64_t live_from() const { return live_from_.load(std::memory_order_acquire); }
+    void set_live_from(uint64_t seq) { live_from_.store(seq, std::memory_order_release); }
+
+    /**
+     * Whether the client has joined (it receives broadcasts)
+     */
+    bool joined() const { return live_from_.load(std::memory_order_acquire) != UINT64_MAX; }
+
+    /**
+     * Liveness, on ChatTime::monotonic_ms(): the reader stamps every
+     * receive, the loop timing the connection out compares
+     */
+    uint64_t opened_ms() const { return opened_ms_; }
+    uint64_t heard_ms() const { return heard_ms_.load(std::memory_order_relaxed); }
+    void mark_heard(uint64_t now_ms) { heard_ms_.store(now_ms, std::memory_order_relaxed); }
+
+    /**
+     * Protocol version negotiated during the join handshake (0 = none
+     * yet); from PROTOCOL_VERSION_4 on the client answers PING and
+     * understands the other control frames
+     */
+    uint8_t version() const { return version_.load(std::memory_order_relaxed); }
+    void set_version(uint8_t version) { version_.store(version, std::memory_order_relaxed); }
+
+    /**
+     * When the unanswered PING went out (0 = none); timing loop only
+     */
+    uint64_t ping_sent_ms() const { return ping_sent_ms_; }
+    void set_ping_sent_ms(uint64_t now_ms) { ping_sent_ms_ = now_ms; }
+
+    /**
+     * Number of messages dropped by the slow-consumer policy
+     */
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    /**
+     * Append a frame, applying the slow-consumer policy; caller must
+     * hold mutex_
+     * @return false if the frame was not queued
+     */
+    bool enqueue_locked(const FrameRef& frame);
+
+    /**
+     * Hand newly queued frames to the scheduler, or write what the
+     * socket takes now; caller must hold mutex_
+     */
+    void start_send_locked();
+
+    /**
+     * Write queued frames with gathered writes; caller must hold mutex_
+     */
+    bool flush_locked();
+
+    int socket_fd_;
+    int client_id_;
+    size_t max_queue_;
+    SlowConsumerPolicy policy_;
+    OutboundStats* stats_;
+    SendScheduler* scheduler_;      // null = write inline
+    bool send_scheduled_;           // Scheduler owes a take_queued() call
+
+    std::mutex mutex_;              // Protects queue_ and head_offset_, orders live_from_ changes
+    std::deque<FrameRef> queue_;    // Unsent frames, oldest first
+    size_t head_offset_;            // Bytes of queue_.front() already sent
+
+    std::atomic<WireFormat> format_;
+    std::atomic<uint64_t> live_from_;   // First broadcast sequence sent live
+    std::atomic<bool> closing_;
+    std::atomic<uint64_t> dropped_;
+
+    const uint64_t opened_ms_;
+    std::atomic<uint64_t> heard_ms_;    // Last receive
+    std::atomic<uint8_t> version_;
+    uint64_t ping_sent_ms_;
+};
+
+#endif // CONNECTION_H
@@ -0,0 +1,656 @@
+// MIT License
+// Multi-threaded Chat System - Epoll Event Loop Implementation
+// Copyright (c) 2025
+
+#include "event_loop.h"
+#include "server.h"
+#include "common.h"
+#include "timestamp.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+const int MAX_EVENTS = 256;
+
+// Broadcasts in flight from one shard to another before spilling
+const size_t SHARD_QUEUE_CAPACITY = 4096;
+
+thread_local EventLoop* current_loop = nullptr;
+}
+
+EventLoop::EventLoop(int loop_id, ChatServer* server)
+    : loop_id_(loop_id), server_(server), epoll_fd_(-1), wake_fd_(-1),
+      listen_fd_(-1), local_listen_fd_(-1), cpu_(-1), running_(false),
+      timers_(LIVENESS_TICK_MS, ChatTime::monotonic_ms()), wake_pending_(false) {
+}
+
+EventLoop::~EventLoop() {
+    stop();
+
+    // Kept open until now: other shards may still signal it after stop()
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
+
+EventLoop* EventLoop::current() {
+    return current_loop;
+}
+
+void EventLoop::set_listener(int listen_fd) {
+    listen_fd_ = listen_fd;
+}
+
+void EventLoop::connect_shards(const std::vector<EventLoop*>& shards) {
+    shards_ = shards;
+    inbox_.clear();
+    for (size_t i = 0; i < shards.size(); ++i) {
+        inbox_.emplace_back(new SpscQueue<ShardFrame>(SHARD_QUEUE_CAPACITY));
+    }
+    outbox_.assign(shards.size(), std::deque<ShardFrame>());
+    dirty_.assign(shards.size(), false);
+}
+
+bool EventLoop::start() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_ERROR("epoll_create1 failed: " << strerror(errno));
+        return false;
+    }
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        LOG_ERROR("eventfd failed: " << strerror(errno));
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0) {
+        LOG_ERROR("epoll_ctl(wake) failed: " << strerror(errno));
+        close(wake_fd_);
+        close(epoll_fd_);
+        wake_fd_ = epoll_fd_ = -1;
+        return false;
+    }
+
+    if (listen_fd_ >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0) {
+            LOG_ERROR("epoll_ctl(listen) failed: " << strerror(errno));
+            close(wake_fd_);
+            close(epoll_fd_);
+            wake_fd_ = epoll_fd_ = -1;
+            return false;
+        }
+    }
+
+    if (local_listen_fd_ >= 0) {
+        // Every shard waits on the same socket; wake one per connection
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = local_listen_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, local_listen_fd_, &ev) < 0) {
+            LOG_ERROR("epoll_ctl(unix listen) failed: " << strerror(errno));
+            close(wake_fd_);
+            close(epoll_fd_);
+            wake_fd_ = epoll_fd_ = -1;
+            return false;
+        }
+    }
+
+    running_ = true;
+    thread_ = std::thread(&EventLoop::run, this);
+    return true;
+}
+
+void EventLoop::stop() {
+    halt();
+
+    // Loop thread is gone; remaining connections can be torn down here
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+    while (!sessions_.empty()) {
+        close_session(sessions_.begin()->first);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_.clear();
+    }
+
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+}
+
+void EventLoop::halt() {
+    if (running_.exchange(false)) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            LOG_WARN("Failed to wake reactor " << loop_id_ << ": " << strerror(errno));
+        }
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool EventLoop::settle() {
+    bool waiting = !shards_.empty() && flush_outbox();
+    drain_inbox();
+    return waiting;
+}
+
+void EventLoop::detach(std::vector<HandoffClient>& clients) {
+    for (auto& pair : sessions_) {
+        Session& session = pair.second;
+        if (!session.handler) {
+            continue;
+        }
+
+        HandoffClient client;
+        session.handler->detach(session.inbound, client);
+        if (const std::vector<std::string>* rooms = rooms_.rooms_of(session.connection->client_id())) {
+            client.rooms = *rooms;
+        }
+        session.connection->take_unsent(client.outbound);
+        clients.push_back(std::move(client));
+    }
+
+    // Neither shut down nor deregistered: the server lets go of the
+    // connections without touching the sockets the successor now serves
+    sessions_.clear();
+    rooms_.clear();
+}
+
+void EventLoop::watch_writable(std::shared_ptr<Connection> connection) {
+    post(PendingOp{PendingOp::WATCH, std::move(connection), -1});
+}
+
+void EventLoop::remove_connection(int socket_fd) {
+    post(PendingOp{PendingOp::REMOVE, nullptr, socket_fd});
+}
+
+void EventLoop::post(PendingOp op) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_.push_back(std::move(op));
+    }
+
+    uint64_t one = 1;
+    if (wake_fd_ >= 0 && write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_WARN("Failed to wake reactor " << loop_id_ << ": " << strerror(errno));
+    }
+}
+
+void EventLoop::run() {
+    struct epoll_event events[MAX_EVENTS];
+    current_loop = this;
+
+    if (cpu_ >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu_, &cpus);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error != 0) {
+            LOG_WARN("Failed to pin reactor " << loop_id_ << " to CPU " << cpu_
+                     << ": " << strerror(error));
+        }
+    }
+
+    // Handed over by the previous process; registered here so their
+    // rooms land in this shard's index, and read only once every
+    // shard has rejoined its share
+    for (HandoffClient& client : adopted_) {
+        std::shared_ptr<Connection> connection = server_->resume_connection(client.socket_fd);
+        register_session(std::move(connection), true, &client);
+    }
+    server_->wait_for_resumed();
+    for (const HandoffClient& client : adopted_) {
+        auto it = sessions_.find(client.socket_fd);
+        if (it != sessions_.end()) {
+            start_session(it->second);
+        }
+    }
+    adopted_.clear();
+
+    bool backlog = false;
+    while (running_) {
+        // Sleep until the next timer, or poll briefly while forwards
+        // wait for room in a peer's queue
+        int timeout = timers_.timeout_ms(ChatTime::monotonic_ms());
+        if (backlog && (timeout < 0 || timeout > 1)) {
+            timeout = 1;
+        }
+        int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("epoll_wait failed: " << strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+
+            if (fd == wake_fd_) {
+                // Clear before draining so a later forward signals again
+                wake_pending_.store(false);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                uint64_t counter;
+                while (read(wake_fd_, &counter, sizeof(counter)) > 0) {
+                }
+                process_pending();
+                drain_inbox();
+                continue;
+            }
+
+            if (fd == listen_fd_ || fd == local_listen_fd_) {
+                accept_connections(fd);
+                continue;
+            }
+
+            auto it = sessions_.find(fd);
+            if (it == sessions_.end()) {
+                continue;
+            }
+
+            Session& session = it->second;
+            bool keep = true;
+
+            if (events[i].events & EPOLLOUT) {
+                keep = session.connection->flush();
+            }
+            if (keep && session.handler && (events[i].events & EPOLLIN)) {
+                keep = handle_readable(session);
+            }
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                keep = false;
+            }
+
+            if (!keep) {
+                drop_session(session);
+            }
+        }
+
+        expire_timers();
+
+        if (!shards_.empty()) {
+            backlog = flush_outbox();
+            notify_shards();
+        }
+    }
+}
+
+void EventLoop::process_pending() {
+    std::vector<PendingOp> batch;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        batch.swap(pending_);
+    }
+
+    for (auto& op : batch) {
+        switch (op.kind) {
+        case PendingOp::WATCH:
+            register_session(std::move(op.connection), false);
+            break;
+        case PendingOp::REMOVE:
+            close_session(op.socket_fd);
+            break;
+        }
+    }
+}
+
+void EventLoop::register_session(std::shared_ptr<Connection> connection, bool serve_reads,
+                                 const HandoffClient* resumed) {
+    int fd = connection->socket_fd();
+
+    Session& session = sessions_[fd];
+    session.connection = std::move(connection);
+    if (serve_reads) {
+        session.handler.reset(new ClientHandler(session.connection, server_));
+    }
+    if (resumed) {
+        session.handler->resume(*resumed);
+        session.inbound.append(resumed->inbound.data(), resumed->inbound.size());
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT | EPOLLET;
+    if (serve_reads) {
+        ev.events |= EPOLLIN | EPOLLRDHUP;
+    }
+    ev.data.fd = fd;
+
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOG_ERROR("epoll_ctl(add) failed for client " << session.connection->client_id()
+                  << ": " << strerror(errno));
+        session.connection->shutdown();
+        close_session(fd);
+        return;
+    }
+
+    if (!resumed) {
+        start_session(session);
+    }
+}
+
+void EventLoop::start_session(Session& session) {
+    int fd = session.connection->socket_fd();
+
+    // Data may have arrived before registration, or came buffered with
+    // a client handed over; edge-triggered mode would not report it,
+    // so dispatch and drain once up front
+    if (session.handler && (!dispatch(session) || !handle_readable(session))) {
+        close_session(fd);
+        return;
+    }
+
+    session.timer.id = fd;
+    if (!check_liveness(session, ChatTime::monotonic_ms())) {
+        drop_session(session);
+    }
+}
+
+bool EventLoop::handle_readable(Session& session) {
+    int fd = session.connection->socket_fd();
+
+    // Edge-triggered: keep reading until the socket is drained
+    while (true) {
+        size_t requested = session.inbound.writable();
+        ssize_t received = session.inbound.fill(fd);
+
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno != ECONNRESET) {
+                LOGF_ERROR("Receive failed: {}", strerror(errno));
+            }
+            return false;
+        }
+
+        if (received == 0) {
+            if (session.inbound.buffered() != 0) {
+                LOGF_WARN("Connection closed during receive");
+            }
+            return false;
+        }
+        session.connection->mark_heard(ChatTime::monotonic_ms());
+
+        if (!dispatch(session)) {
+            return false;
+        }
+
+        // A short read means the socket is drained; a later arrival
+        // raises a new edge, so skip the recv() that would hit EAGAIN
+        if (static_cast<size_t>(received) < requested) {
+            return true;
+        }
+    }
+}
+
+bool EventLoop::dispatch(Session& session) {
+    // Dispatch every complete frame; a partial one stays buffered
+    RecvBuffer::Status status;
+    while ((status = session.inbound.next_frame(session.frame)) == RecvBuffer::FRAME) {
+        if (!session.handler->on_frame(session.frame)) {
+            return false;
+        }
+    }
+    if (status == RecvBuffer::INVALID) {
+        LOGF_WARN("Received invalid message");
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::close_session(int socket_fd) {
+    auto it = sessions_.find(socket_fd);
+    if (it == sessions_.end()) {
+        return;
+    }
+
+    if (epoll_fd_ >= 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket_fd, nullptr);
+    }
+
+    rooms_.leave_all(it->second.connection->client_id());
+
+    // Handler deregisters from the server; the socket closes once the
+    // last broadcaster holding the connection lets go of it
+    if (it->second.handler) {
+        it->second.connection->shutdown();
+        it->second.handler->on_disconnect();
+    }
+    sessions_.erase(it);
+}
+
+void EventLoop::drop_session(Session& session) {
+    if (session.handler) {
+        close_session(session.connection->socket_fd());
+    } else {
+        // The reading thread notices the shutdown and deregisters
+        session.connection->shutdown();
+    }
+}
+
+bool EventLoop::check_liveness(Session& session, uint64_t now_ms) {
+    uint64_t next_ms = 0;
+    if (!server_->check_liveness(*session.connection, now_ms, next_ms)) {
+        return false;
+    }
+    if (next_ms > 0) {
+        timers_.arm(session.timer, next_ms);
+    }
+    return true;
+}
+
+void EventLoop::expire_timers() {
+    uint64_t now_ms = ChatTime::monotonic_ms();
+    expired_.clear();
+    if (timers_.advance(now_ms, expired_) == 0) {
+        return;
+    }
+
+    for (int fd : expired_) {
+        auto it = sessions_.find(fd);
+        if (it != sessions_.end() && !check_liveness(it->second, now_ms)) {
+            drop_session(it->second);
+        }
+    }
+}
+
+void EventLoop::accept_connections(int listen_fd) {
+    // Level-triggered listener: take what is queued, the rest re-reports
+    for (int i = 0; i < MAX_EVENTS; ++i) {
+        struct sockaddr_storage client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+
+        int client_fd = accept4(listen_fd, (struct sockaddr*)&client_addr, &client_addr_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR("Accept failed on reactor " << loop_id_ << ": " << strerror(errno));
+            }
+            return;
+        }
+
+        register_session(server_->open_connection(client_fd, client_addr), true);
+    }
+}
+
+bool EventLoop::subscribe(const std::shared_ptr<Connection>& connection, const std::string& room) {
+    return rooms_.join(room, connection);
+}
+
+bool EventLoop::unsubscribe(int client_id, const std::string& room) {
+    return rooms_.leave(room, client_id);
+}
+
+void EventLoop::broadcast(const Message& msg, int exclude_client_id) {
+    // The sender is ours, so is its membership
+    bool room = msg.room[0] != '\0';
+    if (room && !rooms_.is_member(msg.room, exclude_client_id)) {
+        LOGF_SAMPLED(LogLevel::WARN, "Client {} sent to room {} without being a member",
+                     exclude_client_id, msg.room);
+        return;
+    }
+
+    ShardFrame shard_frame;
+    shard_frame.exclude_client_id = exclude_client_id;
+    shard_frame.seq = msg.seq;
+    memcpy(shard_frame.room, msg.room, MAX_ROOM_LEN);
+    size_t recipients = deliver(shard_frame, &msg);
+
+    // Per message: sampled debug record, formatted off this thread
+    LOGF_SAMPLED(LogLevel::DEBUG, "Broadcast message {} from {} to {} clients on reactor {}{}",
+                 msg.seq, msg.username, recipients, loop_id_,
+                 shards_.size() > 1 ? " and forwarding to other reactors" : "");
+
+    if (shards_.size() <= 1) {
+        return;
+    }
+
+    // Peers may serve any format; encode each once, here. Room
+    // members all speak v3
+    for (int format = 0; format < WIRE_FORMAT_COUNT; ++format) {
+        if (room && format != static_cast<int>(WireFormat::V3)) {
+            continue;
+        }
+        if (!shard_frame.frames[format]) {
+            shard_frame.frames[format] = FrameRef::encode(msg, static_cast<WireFormat>(format));
+        }
+    }
+
+    for (size_t peer = 0; peer < shards_.size(); ++peer) {
+        if (static_cast<int>(peer) == loop_id_) {
+            continue;
+        }
+
+        // Keep order: once a forward spilled, later ones queue behind it
+        ShardFrame forward = shard_frame;
+        if (!outbox_[peer].empty() ||
+            !shards_[peer]->inbox_[loop_id_]->try_push(forward)) {
+            outbox_[peer].push_back(std::move(forward));
+        }
+        dirty_[peer] = true;
+    }
+}
+
+size_t EventLoop::deliver(ShardFrame& shard_frame, const Message* msg) {
+    size_t recipients = 0;
+
+    if (shard_frame.room[0] != '\0') {
+        // Only this shard's members of the room; none is the usual case
+        const std::vector<RoomIndex::Member>* members = rooms_.members(shard_frame.room);
+        if (!members) {
+            return 0;
+        }
+
+        FrameRef& frame = shard_frame.frames[static_cast<int>(WireFormat::V3)];
+        for (const RoomIndex::Member& member : *members) {
+            if (member.client_id == shard_frame.exclude_client_id) {
+                continue;
+            }
+            if (!frame) {
+                frame = FrameRef::encode(*msg, WireFormat::V3);
+            }
+            member.connection->send(frame);
+            ++recipients;
+        }
+        return recipients;
+    }
+
+    for (auto& pair : sessions_) {
+        Session& session = pair.second;
+        if (!session.handler || session.connection->client_id() == shard_frame.exclude_client_id) {
+            continue;
+        }
+        // Serialize once per wire format; every queue shares the same immutable frame
+        FrameRef& frame = shard_frame.frames[static_cast<int>(session.connection->wire_format())];
+        if (!frame) {
+            frame = FrameRef::encode(*msg, session.connection->wire_format());
+        }
+        // Checked on delivery: a client may have joined (and been
+        // replayed this message) since it was forwarded
+        if (session.connection->send_broadcast(frame, shard_frame.seq)) {
+            ++recipients;
+        }
+    }
+
+    return recipients;
+}
+
+void EventLoop::drain_inbox() {
+    ShardFrame shard_frame;
+
+    for (size_t peer = 0; peer < inbox_.size(); ++peer) {
+        while (inbox_[peer]->try_pop(shard_frame)) {
+            deliver(shard_frame, nullptr);
+        }
+    }
+}
+
+bool EventLoop::flush_outbox() {
+    bool waiting = false;
+
+    for (size_t peer = 0; peer < outbox_.size(); ++peer) {
+        auto& pending = outbox_[peer];
+        while (!pending.empty() && shards_[peer]->inbox_[loop_id_]->try_push(pending.front())) {
+            pending.pop_front();
+            dirty_[peer] = true;
+        }
+        waiting = waiting || !pending.empty();
+    }
+
+    return waiting;
+}
+
+void EventLoop::notify_shards() {
+    for (size_t peer = 0; peer < dirty_.size(); ++peer) {
+        if (dirty_[peer]) {
+            dirty_[peer] = false;
+            shards_[peer]->notify();
+        }
+    }
+}
+
+void EventLoop::notify() {
+    // Publish the pushes before checking whether a wakeup is already due
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (wake_pending_.exchange(true)) {
+        return;
+    }
+
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_WARN("Failed to wake reactor " << loop_id_ << ": " << strerror(errno));
+    }
+}
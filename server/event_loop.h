@@ -0,0 +1,325 @@
+// MIT License
+// Multi-threaded Chat System - Epoll Event Loop Header
+// Copyright (c) 2025
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "protocol.h"
+#include "frame.h"
+#include "recv_buffer.h"
+#include "client_handler.h"
+#include "connection.h"
+#include "frame_buffer.h"
+#include "handoff.h"
+#include "room_index.h"
+#include "spsc_queue.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Forward declaration
+class ChatServer;
+
+/**
+ * Edge-triggered epoll reactor running on a single thread
+ * Multiplexes many non-blocking client sockets; each socket is
+ * owned by exactly one loop for its whole lifetime
+ *
+ * A loop either serves connections fully (EPOLL mode: reads,
+ * dispatches to a ClientHandler and drains outbound queues) or
+ * only drains outbound queues for sockets read elsewhere
+ * (THREADED mode writer)
+ *
+ * In EPOLL mode every loop is a shard: it accepts from its own
+ * SO_REUSEPORT listener, owns the connections it accepted and hands
+ * broadcasts to the other shards through one SPSC queue per pair.
+ * Room membership is indexed per shard as well, so a room message
+ * only visits the members each shard holds
+ *
+ * Each loop times its own sockets (join deadline, heartbeats, idle
+ * timeout) on a timer wheel, one timer per session; epoll_wait sleeps
+ * until the next one is due
+ */
+class EventLoop {
+public:
+    /**
+     * Constructor
+     * @param loop_id Index of this loop (for logging)
+     * @param server Pointer to parent server
+     */
+    EventLoop(int loop_id, ChatServer* server);
+
+    /**
+     * Destructor - stops the loop and closes owned sockets
+     */
+    ~EventLoop();
+
+    /**
+     * Create the epoll instance and start the loop thread
+     * @return true on success, false on error
+     */
+    bool start();
+
+    /**
+     * Stop the loop thread and close all owned connections
+     */
+    void stop();
+
+    /**
+     * Stop the loop thread but leave every connection open (handoff)
+     * Follow with settle() and detach(), then stop()
+     */
+    void halt();
+
+    /**
+     * After halt() on every shard: push forwards still waiting for a
+     * peer's queue and deliver those that arrived
+     * @return true while some are still waiting; repeat across shards
+     */
+    bool settle();
+
+    /**
+     * After settle(): describe every served connection for a handoff
+     * and let go of it without closing the socket
+     * @param clients Receives one entry per connection
+     */
+    void detach(std::vector<HandoffClient>& clients);
+
+    /**
+     * Serve connections handed over by a previous process (call before start)
+     * @param clients Their sockets are owned by the loop from here on
+     */
+    void adopt(std::vector<HandoffClient> clients) { adopted_ = std::move(clients); }
+
+    /**
+     * Shard listener, -1 if none
+     */
+    int listener() const { return listen_fd_; }
+
+    /**
+     * Accept connections from a listening socket (call before start)
+     * @param listen_fd Non-blocking listening socket; the loop closes it
+     */
+    void set_listener(int listen_fd);
+
+    /**
+     * Also accept from a listener every shard shares (call before start)
+     * @param listen_fd Non-blocking Unix socket listener, or -1; the server closes it
+     */
+    void set_local_listener(int listen_fd) { local_listen_fd_ = listen_fd; }
+
+    /**
+     * Pin the loop thread to a CPU (call before start)
+     * @param cpu CPU index, or -1 for no pinning
+     */
+    void set_cpu(int cpu) { cpu_ = cpu; }
+
+    /**
+     * Wire up cross-shard broadcast (call on every shard before any starts)
+     * @param shards All shards, indexed by loop_id (including this one)
+     */
+    void connect_shards(const std::vector<EventLoop*>& shards);
+
+    /**
+     * Broadcast to this shard's clients and forward to every other shard
+     * Loop thread only
+     * @param msg Message to broadcast
+     * @param exclude_client_id Client ID to exclude from broadcast
+     */
+    void broadcast(const Message& msg, int exclude_client_id);
+
+    /**
+     * Add one of this shard's connections to a room
+     * Loop thread only
+     * @return false if already a member or in too many rooms
+     */
+    bool subscribe(const std::shared_ptr<Connection>& connection, const std::string& room);
+
+    /**
+     * Remove one of this shard's connections from a room
+     * Loop thread only
+     * @return false if it was not a member
+     */
+    bool unsubscribe(int client_id, const std::string& room);
+
+    /**
+     * Loop running on the calling thread, or nullptr
+     */
+    static EventLoop* current();
+
+    /**
+     * Drain a connection's outbound queue whenever it becomes writable
+     * Thread-safe; used for sockets whose reads happen elsewhere
+     * @param connection Client connection to write to
+     */
+    void watch_writable(std::shared_ptr<Connection> connection);
+
+    /**
+     * Stop watching a connection registered with watch_writable()
+     * Thread-safe
+     * @param socket_fd Socket of the connection
+     */
+    void remove_connection(int socket_fd);
+
+private:
+    /**
+     * Per-socket reactor state
+     */
+    struct Session {
+        std::shared_ptr<Connection> connection;
+        std::unique_ptr<ClientHandler> handler;     // null for write-only sessions
+        RecvBuffer inbound;                         // Received, unparsed bytes
+        Frame frame;                                // Last decoded frame
+        TimerWheel::Timer timer;                    // Next liveness check
+    };
+
+    /**
+     * Broadcast handed between shards, encoded once for every format
+     */
+    struct ShardFrame {
+        FrameRef frames[WIRE_FORMAT_COUNT];     // Indexed by WireFormat
+        int exclude_client_id = -1;
+        uint64_t seq = 0;                       // History sequence number
+        char room[MAX_ROOM_LEN] = {};           // Empty = lobby
+    };
+
+    /**
+     * Work posted from other threads
+     */
+    struct PendingOp {
+        enum Kind { WATCH, REMOVE } kind;
+        std::shared_ptr<Connection> connection;
+        int socket_fd;
+    };
+
+    /**
+     * Main thread function - waits for and dispatches events
+     */
+    void run();
+
+    /**
+     * Queue an operation and wake the loop
+     */
+    void post(PendingOp op);
+
+    /**
+     * Apply operations queued by other threads
+     */
+    void process_pending();
+
+    /**
+     * Register a socket with epoll and start tracking it
+     * @param resumed State handed over by a previous process, if any;
+     *                such a session is rejoined but not read until
+     *                start_session()
+     */
+    void register_session(std::shared_ptr<Connection> connection, bool serve_reads,
+                          const HandoffClient* resumed = nullptr);
+
+    /**
+     * Read what a registered session has pending and arm its timer
+     */
+    void start_session(Session& session);
+
+    /**
+     * Drain a readable socket, dispatching every complete frame
+     * @return false if the connection should be closed
+     */
+    bool handle_readable(Session& session);
+
+    /**
+     * Dispatch every complete frame buffered in a session
+     * @return false if the connection should be closed
+     */
+    bool dispatch(Session& session);
+
+    /**
+     * Deregister and close a connection
+     */
+    void close_session(int socket_fd);
+
+    /**
+     * Close a served connection; for a write-only one, shut it down
+     * and leave deregistering to the thread reading it
+     */
+    void drop_session(Session& session);
+
+    /**
+     * Run the server's liveness check and re-arm the session's timer
+     * @return false if the connection should be dropped
+     */
+    bool check_liveness(Session& session, uint64_t now_ms);
+
+    /**
+     * Check every session whose timer came due
+     */
+    void expire_timers();
+
+    /**
+     * Accept every pending connection on a listener
+     * @param listen_fd Shard listener or the shared Unix socket listener
+     */
+    void accept_connections(int listen_fd);
+
+    /**
+     * Queue a frame to this shard's clients
+     * @return number of recipients
+     */
+    size_t deliver(ShardFrame& shard_frame, const Message* msg);
+
+    /**
+     * Deliver broadcasts forwarded by other shards
+     */
+    void drain_inbox();
+
+    /**
+     * Retry forwards that found a peer's queue full
+     * @return true if some are still waiting
+     */
+    bool flush_outbox();
+
+    /**
+     * Wake shards that were forwarded frames since the last call
+     */
+    void notify_shards();
+
+    /**
+     * Wake this loop for forwarded frames (called from other shards)
+     */
+    void notify();
+
+    int loop_id_;
+    ChatServer* server_;
+    int epoll_fd_;
+    int wake_fd_;                   // eventfd used to interrupt epoll_wait
+    int listen_fd_;                 // Shard listener (-1 if none)
+    int local_listen_fd_;           // Shared Unix socket listener (-1 if none)
+    int cpu_;                       // CPU to pin to (-1 = unpinned)
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+
+    std::mutex pending_mutex_;                  // Protects pending_
+    std::vector<PendingOp> pending_;
+
+    std::unordered_map<int, Session> sessions_; // socket_fd -> Session, loop thread only
+    std::vector<HandoffClient> adopted_;        // Registered when the loop thread starts
+    RoomIndex rooms_;                           // Rooms of this shard's connections, loop thread only
+    TimerWheel timers_;                         // One timer per session, loop thread only
+    std::vector<int> expired_;                  // Scratch for expire_timers()
+
+    // Cross-shard broadcast; inbox_[i] is written only by shard i
+    std::vector<EventLoop*> shards_;
+    std::vector<std::unique_ptr<SpscQueue<ShardFrame>>> inbox_;
+    std::vector<std::deque<ShardFrame>> outbox_;    // Per peer, when its inbox is full
+    std::vector<bool> dirty_;                       // Per peer, needs a wakeup
+    std::atomic<bool> wake_pending_;                // A peer already signalled wake_fd_
+};
+
+#endif // EVENT_LOOP_H
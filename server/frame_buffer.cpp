@@ -0,0 +1,48 @@
+// MIT License
+// Multi-threaded Chat System - Shared Frame Buffer Implementation
+// Copyright (c) 2025
+
+#include "frame_buffer.h"
+#include <cstring>
+#include <new>
+
+FrameRef FrameRef::copy_of(const void* data, size_t size) {
+    void* raw = ::operator new(offsetof(Block, bytes) + size);
+    Block* block = static_cast<Block*>(raw);
+    new (&block->refs) std::atomic<long>(1);
+    block->size = size;
+    block->data = block->bytes;
+    block->owner = nullptr;
+    memcpy(block->bytes, data, size);
+    return FrameRef(block);
+}
+
+FrameRef FrameRef::view(const char* data, size_t size, std::shared_ptr<const void> owner) {
+    void* raw = ::operator new(offsetof(Block, bytes));
+    Block* block = static_cast<Block*>(raw);
+    new (&block->refs) std::atomic<long>(1);
+    block->size = size;
+    block->data = data;
+    block->owner = new std::shared_ptr<const void>(std::move(owner));
+    return FrameRef(block);
+}
+
+FrameRef FrameRef::encode(const Message& msg, WireFormat format) {
+    char buffer[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_chat(msg, format, buffer);
+    return copy_of(buffer, size);
+}
+
+void FrameRef::release() {
+    if (!block_) {
+        return;
+    }
+
+    // acq_rel: the thread that frees must see every other holder's reads finish
+    if (block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete static_cast<std::shared_ptr<const void>*>(block_->owner);
+        block_->refs.~atomic();
+        ::operator delete(block_);
+    }
+    block_ = nullptr;
+}
@@ -0,0 +1,105 @@
+// MIT License
+// Multi-threaded Chat System - Shared Frame Buffer Header
+// Copyright (c) 2025
+
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include "protocol.h"
+#include "frame.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ * Handle to an immutable, reference-counted wire frame
+ *
+ * A broadcast encodes its payload once into a single allocation
+ * (refcount + bytes) and every recipient queue holds a handle to it;
+ * copying a handle only bumps the count, and the bytes are freed when
+ * the last queue has flushed them
+ *
+ * A handle can also view bytes owned by something else (a mapped
+ * segment of the message store); the owner is kept alive until the
+ * last handle goes away
+ */
+class FrameRef {
+public:
+    FrameRef() : block_(nullptr) {}
+    ~FrameRef() { release(); }
+
+    FrameRef(const FrameRef& other) : block_(other.block_) { retain(); }
+    FrameRef(FrameRef&& other) noexcept : block_(other.block_) { other.block_ = nullptr; }
+
+    FrameRef& operator=(const FrameRef& other) {
+        if (this != &other) {
+            other.retain();
+            release();
+            block_ = other.block_;
+        }
+        return *this;
+    }
+
+    FrameRef& operator=(FrameRef&& other) noexcept {
+        if (this != &other) {
+            release();
+            block_ = other.block_;
+            other.block_ = nullptr;
+        }
+        return *this;
+    }
+
+    /**
+     * Allocate a frame and copy bytes into it
+     * @param data Encoded frame bytes
+     * @param size Number of bytes
+     */
+    static FrameRef copy_of(const void* data, size_t size);
+
+    /**
+     * Refer to bytes without copying them
+     * @param data Encoded frames, immutable while any handle exists
+     * @param size Number of bytes
+     * @param owner Keeps data valid
+     */
+    static FrameRef view(const char* data, size_t size, std::shared_ptr<const void> owner);
+
+    /**
+     * Encode a chat message into a new frame
+     * @param msg Message to encode
+     * @param format Wire format of the recipients
+     */
+    static FrameRef encode(const Message& msg, WireFormat format);
+
+    const char* data() const { return block_ ? block_->data : nullptr; }
+    size_t size() const { return block_ ? block_->size : 0; }
+    explicit operator bool() const { return block_ != nullptr; }
+
+    /**
+     * Number of live handles (for diagnostics and tests)
+     */
+    long use_count() const { return block_ ? block_->refs.load(std::memory_order_relaxed) : 0; }
+
+private:
+    struct Block {
+        std::atomic<long> refs;
+        size_t size;
+        const char* data;   // bytes, or the viewed memory
+        void* owner;        // Views only: heap std::shared_ptr<const void>
+        char bytes[1];      // Frame bytes follow the header in one allocation
+    };
+
+    explicit FrameRef(Block* block) : block_(block) {}
+
+    void retain() const {
+        if (block_) {
+            block_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void release();
+
+    Block* block_;
+};
+
+#endif // FRAME_BUFFER_H
@@ -0,0 +1,482 @@
+// MIT License
+// Multi-threaded Chat System - Server Handoff Implementation
+// Copyright (c) 2025
+
+#include "handoff.h"
+#include "common.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace {
+
+const uint32_t HANDOFF_MAGIC = 0x43484f46;     // "CHOF"
+const uint16_t HANDOFF_VERSION = 1;
+
+// Raw bytes per DATA record; well inside a Unix socket's send buffer
+const size_t HANDOFF_CHUNK = 32 * 1024;
+
+// Largest record: a DATA chunk plus its header
+const size_t MAX_RECORD_SIZE = HANDOFF_CHUNK + 64;
+
+// Descriptors one record may carry (the kernel's SCM_MAX_FD)
+const size_t MAX_RECORD_FDS = 253;
+
+enum RecordType : uint8_t {
+    RECORD_HELLO = 1,
+    RECORD_REPLY,
+    RECORD_STATE,
+    RECORD_CLIENT,
+    RECORD_DATA,
+    RECORD_END
+};
+
+/**
+ * Builds one record: magic, type, then native-endian fields
+ */
+class RecordWriter {
+public:
+    explicit RecordWriter(RecordType type) {
+        put(HANDOFF_MAGIC);
+        put(static_cast<uint8_t>(type));
+    }
+
+    template <typename T>
+    void put(T value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        data_.insert(data_.end(), bytes, bytes + sizeof(value));
+    }
+
+    void put_string(const std::string& value) {
+        put(static_cast<uint8_t>(value.size()));
+        data_.insert(data_.end(), value.begin(), value.end());
+    }
+
+    void put_bytes(const char* bytes, size_t size) {
+        data_.insert(data_.end(), bytes, bytes + size);
+    }
+
+    const std::vector<char>& data() const { return data_; }
+
+private:
+    std::vector<char> data_;
+};
+
+/**
+ * Reads the fields of a received record; every read is bounds-checked
+ */
+class RecordReader {
+public:
+    explicit RecordReader(const std::vector<char>& data) : data_(data), offset_(0) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (data_.size() - offset_ < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, data_.data() + offset_, sizeof(value));
+        offset_ += sizeof(value);
+        return true;
+    }
+
+    bool get_string(std::string& value) {
+        uint8_t size;
+        if (!get(size) || data_.size() - offset_ < size) {
+            return false;
+        }
+        value.assign(data_.data() + offset_, size);
+        offset_ += size;
+        return true;
+    }
+
+    /**
+     * Check the magic and read the record type
+     */
+    bool get_header(RecordType& type) {
+        uint32_t magic;
+        uint8_t raw;
+        if (!get(magic) || magic != HANDOFF_MAGIC || !get(raw)) {
+            return false;
+        }
+        type = static_cast<RecordType>(raw);
+        return true;
+    }
+
+    const char* rest() const { return data_.data() + offset_; }
+    size_t remaining() const { return data_.size() - offset_; }
+
+private:
+    const std::vector<char>& data_;
+    size_t offset_;
+};
+
+void close_all(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+/**
+ * Send one record with descriptors attached (blocking)
+ */
+bool send_record(int fd, const std::vector<char>& data, const int* fds = nullptr,
+                 size_t fd_count = 0) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data.data());
+    iov.iov_len = data.size();
+
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    std::vector<char> control;
+    if (fd_count > 0) {
+        control.assign(CMSG_SPACE(sizeof(int) * fd_count), 0);
+        hdr.msg_control = control.data();
+        hdr.msg_controllen = control.size();
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fd_count);
+    }
+
+    while (sendmsg(fd, &hdr, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR("Handoff send failed: " << strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Receive one record and the descriptors attached to it
+ * @param timeout_ms Maximum wait (-1 = no limit)
+ */
+bool recv_record(int fd, std::vector<char>& data, std::vector<int>& fds, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {
+    }
+    if (ready <= 0) {
+        LOG_ERROR("Handoff peer did not answer in time");
+        return false;
+    }
+
+    data.resize(MAX_RECORD_SIZE);
+    struct iovec iov;
+    iov.iov_base = data.data();
+    iov.iov_len = data.size();
+
+    char control[CMSG_SPACE(sizeof(int) * MAX_RECORD_FDS)];
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    while ((received = recvmsg(fd, &hdr, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    if (received <= 0) {
+        LOG_ERROR("Handoff peer went away: " << (received < 0 ? strerror(errno) : "closed"));
+        return false;
+    }
+    data.resize(static_cast<size_t>(received));
+
+    fds.clear();
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* passed = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds.insert(fds.end(), passed, passed + count);
+        }
+    }
+
+    if (hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        LOG_ERROR("Handoff record truncated");
+        close_all(fds);
+        fds.clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Send bytes as DATA records
+ */
+bool send_data(int fd, const std::vector<char>& bytes) {
+    for (size_t offset = 0; offset < bytes.size(); offset += HANDOFF_CHUNK) {
+        RecordWriter record(RECORD_DATA);
+        record.put_bytes(bytes.data() + offset, std::min(HANDOFF_CHUNK, bytes.size() - offset));
+        if (!send_record(fd, record.data())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Receive size bytes sent by send_data()
+ */
+bool recv_data(int fd, std::vector<char>& bytes, size_t size, int timeout_ms) {
+    std::vector<char> data;
+    std::vector<int> fds;
+    bytes.clear();
+
+    while (bytes.size() < size) {
+        RecordType type;
+        if (!recv_record(fd, data, fds, timeout_ms)) {
+            return false;
+        }
+        RecordReader reader(data);
+        if (!fds.empty() || !reader.get_header(type) || type != RECORD_DATA ||
+            reader.remaining() > size - bytes.size()) {
+            close_all(fds);
+            return false;
+        }
+        bytes.insert(bytes.end(), reader.rest(), reader.rest() + reader.remaining());
+    }
+    return true;
+}
+
+/**
+ * Receive one client: its socket, state and buffered bytes
+ */
+bool recv_client(int fd, HandoffClient& client, int timeout_ms) {
+    std::vector<char> data;
+    std::vector<int> fds;
+    if (!recv_record(fd, data, fds, timeout_ms)) {
+        return false;
+    }
+    if (fds.size() != 1) {
+        close_all(fds);
+        return false;
+    }
+    client.socket_fd = fds[0];
+
+    RecordReader reader(data);
+    RecordType type;
+    uint8_t format;
+    uint8_t room_count;
+    uint32_t inbound_size;
+    uint32_t outbound_size;
+    if (!reader.get_header(type) || type != RECORD_CLIENT || !reader.get(format) ||
+        format >= WIRE_FORMAT_COUNT || !reader.get(client.version) ||
+        !reader.get_string(client.username) || !reader.get(room_count)) {
+        return false;
+    }
+    client.format = static_cast<WireFormat>(format);
+
+    client.rooms.resize(room_count);
+    for (std::string& room : client.rooms) {
+        if (!reader.get_string(room)) {
+            return false;
+        }
+    }
+
+    if (!reader.get(inbound_size) || !reader.get(outbound_size)) {
+        return false;
+    }
+
+    return recv_data(fd, client.inbound, inbound_size, timeout_ms) &&
+           recv_data(fd, client.outbound, outbound_size, timeout_ms);
+}
+
+/**
+ * Close every descriptor received so far
+ */
+void release(HandoffState& state) {
+    close_all(state.listeners);
+    state.listeners.clear();
+    if (state.unix_listener >= 0) {
+        close(state.unix_listener);
+        state.unix_listener = -1;
+    }
+    for (const HandoffClient& client : state.clients) {
+        if (client.socket_fd >= 0) {
+            close(client.socket_fd);
+        }
+    }
+    state.clients.clear();
+}
+
+} // namespace
+
+namespace Handoff {
+
+int listen_at(const std::string& path, bool replace) {
+    return ChatUtils::listen_unix(path, SOCK_SEQPACKET, replace);
+}
+
+int connect_to(const std::string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_hello(int fd, const HandoffLayout& layout) {
+    RecordWriter record(RECORD_HELLO);
+    record.put(HANDOFF_VERSION);
+    record.put(static_cast<uint8_t>(layout.sharded));
+    record.put(layout.listeners);
+    return send_record(fd, record.data());
+}
+
+bool recv_hello(int fd, HandoffLayout& layout, int timeout_ms) {
+    std::vector<char> data;
+    std::vector<int> fds;
+    if (!recv_record(fd, data, fds, timeout_ms)) {
+        return false;
+    }
+    close_all(fds);
+
+    RecordReader reader(data);
+    RecordType type;
+    uint16_t version;
+    uint8_t sharded;
+    if (!reader.get_header(type) || type != RECORD_HELLO || !reader.get(version) ||
+        version != HANDOFF_VERSION || !reader.get(sharded) || !reader.get(layout.listeners)) {
+        LOG_ERROR("Malformed handoff request");
+        return false;
+    }
+    layout.sharded = sharded != 0;
+    return true;
+}
+
+bool send_reply(int fd, bool accepted, const HandoffLayout& layout) {
+    RecordWriter record(RECORD_REPLY);
+    record.put(static_cast<uint8_t>(accepted));
+    record.put(static_cast<uint8_t>(layout.sharded));
+    record.put(layout.listeners);
+    return send_record(fd, record.data());
+}
+
+bool recv_reply(int fd, bool& accepted, HandoffLayout& layout, int timeout_ms) {
+    std::vector<char> data;
+    std::vector<int> fds;
+    if (!recv_record(fd, data, fds, timeout_ms)) {
+        return false;
+    }
+    close_all(fds);
+
+    RecordReader reader(data);
+    RecordType type;
+    uint8_t ok;
+    uint8_t sharded;
+    if (!reader.get_header(type) || type != RECORD_REPLY || !reader.get(ok) ||
+        !reader.get(sharded) || !reader.get(layout.listeners)) {
+        LOG_ERROR("Malformed handoff reply");
+        return false;
+    }
+    accepted = ok != 0;
+    layout.sharded = sharded != 0;
+    return true;
+}
+
+bool send_state(int fd, const HandoffState& state) {
+    std::vector<int> fds = state.listeners;
+    if (state.unix_listener >= 0) {
+        fds.push_back(state.unix_listener);
+    }
+    if (fds.size() > MAX_RECORD_FDS) {
+        LOG_ERROR("Too many listeners to hand off: " << fds.size());
+        return false;
+    }
+
+    RecordWriter header(RECORD_STATE);
+    header.put(state.last_seq);
+    header.put(static_cast<uint16_t>(state.listeners.size()));
+    header.put(static_cast<uint8_t>(state.unix_listener >= 0));
+    header.put_string(state.unix_path);
+    header.put(static_cast<uint32_t>(state.clients.size()));
+    if (!send_record(fd, header.data(), fds.data(), fds.size())) {
+        return false;
+    }
+
+    for (const HandoffClient& client : state.clients) {
+        RecordWriter record(RECORD_CLIENT);
+        record.put(static_cast<uint8_t>(client.format));
+        record.put(client.version);
+        record.put_string(client.username);
+        record.put(static_cast<uint8_t>(client.rooms.size()));
+        for (const std::string& room : client.rooms) {
+            record.put_string(room);
+        }
+        record.put(static_cast<uint32_t>(client.inbound.size()));
+        record.put(static_cast<uint32_t>(client.outbound.size()));
+
+        if (!send_record(fd, record.data(), &client.socket_fd, 1) ||
+            !send_data(fd, client.inbound) || !send_data(fd, client.outbound)) {
+            return false;
+        }
+    }
+
+    return send_record(fd, RecordWriter(RECORD_END).data());
+}
+
+bool recv_state(int fd, HandoffState& state, int timeout_ms) {
+    std::vector<char> data;
+    std::vector<int> fds;
+    if (!recv_record(fd, data, fds, timeout_ms)) {
+        return false;
+    }
+
+    RecordReader reader(data);
+    RecordType type;
+    uint16_t listener_count;
+    uint8_t has_unix;
+    uint32_t client_count;
+    if (!reader.get_header(type) || type != RECORD_STATE || !reader.get(state.last_seq) ||
+        !reader.get(listener_count) || !reader.get(has_unix) ||
+        !reader.get_string(state.unix_path) || !reader.get(client_count) ||
+        fds.size() != static_cast<size_t>(listener_count) + (has_unix ? 1 : 0)) {
+        LOG_ERROR("Malformed handoff state");
+        close_all(fds);
+        return false;
+    }
+    state.listeners.assign(fds.begin(), fds.begin() + listener_count);
+    state.unix_listener = has_unix ? fds.back() : -1;
+
+    // Records follow back to back now; the first one was the slow one
+    const int record_timeout_ms = 5000;
+    for (uint32_t i = 0; i < client_count; ++i) {
+        state.clients.emplace_back();
+        if (!recv_client(fd, state.clients.back(), record_timeout_ms)) {
+            LOG_ERROR("Handoff of client " << i << " of " << client_count << " failed");
+            release(state);
+            return false;
+        }
+    }
+
+    if (!recv_record(fd, data, fds, record_timeout_ms) ||
+        !RecordReader(data).get_header(type) || type != RECORD_END) {
+        LOG_ERROR("Handoff did not finish");
+        close_all(fds);
+        release(state);
+        return false;
+    }
+    return true;
+}
+
+} // namespace Handoff
@@ -0,0 +1,111 @@
+// MIT License
+// Multi-threaded Chat System - Server Handoff Header
+// Copyright (c) 2025
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "frame.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A client connection carried over to the next server process
+ */
+struct HandoffClient {
+    int socket_fd = -1;                 // Sender: still owned by its connection; receiver: owned
+    std::string username;               // Empty = had not joined yet
+    WireFormat format = WireFormat::LEGACY;
+    uint8_t version = 0;                // Negotiated protocol version (0 = none yet)
+    std::vector<std::string> rooms;
+    std::vector<char> inbound;          // Received from the client, not yet parsed
+    std::vector<char> outbound;         // Queued for the client, not yet written
+};
+
+/**
+ * Everything a server process passes to its successor
+ */
+struct HandoffState {
+    std::vector<int> listeners;         // TCP listeners, in shard order
+    int unix_listener = -1;             // Unix socket listener (-1 = none)
+    std::string unix_path;              // Path it is bound to
+    uint64_t last_seq = 0;              // Newest broadcast sequence number
+    std::vector<HandoffClient> clients;
+};
+
+/**
+ * Shape of a server's TCP listeners; a handoff needs both sides to agree,
+ * since a successor takes the listeners over as they are
+ */
+struct HandoffLayout {
+    bool sharded = false;               // SO_REUSEPORT listener per shard (EPOLL/URING)
+    uint16_t listeners = 0;
+};
+
+/**
+ * Hot-upgrade channel between two server processes on the same host
+ *
+ * The running server listens on a SOCK_SEQPACKET Unix socket. A new
+ * process connects and sends its listener layout; if it matches, the
+ * old process stops reading, sends its listeners and every client
+ * socket with the state needed to resume it, each descriptor attached
+ * with SCM_RIGHTS, and exits without closing a single connection.
+ * Records are native-endian; both ends run on one host
+ */
+namespace Handoff {
+
+/**
+ * Listen for a successor at path (non-blocking)
+ * @param replace Unlink whatever is at path first; otherwise an existing
+ *                socket is only replaced if nobody answers on it
+ * @return socket fd, or -1 on error
+ */
+int listen_at(const std::string& path, bool replace);
+
+/**
+ * Connect to a running predecessor
+ * @return socket fd, or -1 if no server listens at path
+ */
+int connect_to(const std::string& path);
+
+/**
+ * Predecessor: read the successor's request
+ * @return false if it did not arrive within timeout_ms or is malformed
+ */
+bool recv_hello(int fd, HandoffLayout& layout, int timeout_ms);
+
+/**
+ * Successor: ask for the handoff
+ */
+bool send_hello(int fd, const HandoffLayout& layout);
+
+/**
+ * Predecessor: accept or refuse the request
+ * @param layout Own layout, reported back either way
+ */
+bool send_reply(int fd, bool accepted, const HandoffLayout& layout);
+
+/**
+ * Successor: wait for the answer
+ * @param accepted Whether the predecessor goes ahead
+ * @param layout The predecessor's layout
+ */
+bool recv_reply(int fd, bool& accepted, HandoffLayout& layout, int timeout_ms);
+
+/**
+ * Predecessor: send listeners and clients; the descriptors stay open here
+ */
+bool send_state(int fd, const HandoffState& state);
+
+/**
+ * Successor: receive what send_state() sent; the descriptors are
+ * owned by the caller (closed here on failure)
+ * @param timeout_ms Maximum wait for the first record, which comes
+ *                   once the predecessor has stopped its readers
+ */
+bool recv_state(int fd, HandoffState& state, int timeout_ms);
+
+} // namespace Handoff
+
+#endif // HANDOFF_H
@@ -6,6 +6,9 @@
 #include "common.h"
 #include <csignal>
 #include <iostream>
+#include <sched.h>
+#include <sstream>
+#include <string>
 
 // Global server instance for signal handler
 ChatServer* g_server = nullptr;
@@ -15,27 +18,197 @@ ChatServer* g_server = nullptr;
  */
 void signal_handler(int signum) {
     if (signum == SIGINT) {
-        LOG_INFO("\nReceived SIGINT, shutting down gracefully...");
+        // The interrupted thread may be mid-way through a log call;
+        // write directly instead of going through the logger
+        static const char notice[] =
+            "\n" ANSI_COLOR_GREEN "[INFO] " ANSI_COLOR_RESET "Received SIGINT, shutting down gracefully...\n";
+        if (write(STDOUT_FILENO, notice, sizeof(notice) - 1) < 0) {
+            // Nothing useful to do from a signal handler
+        }
         if (g_server) {
             g_server->stop();
         }
     }
 }
 
+/**
+ * Print command line usage
+ */
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [host] [port]\n"
+              << "  --mode threaded|epoll|uring  Connection handling strategy (default: threaded)\n"
+              << "  --threads N            Reactor threads in epoll/uring mode (default: one per core)\n"
+              << "  --pin                  Pin reactor i to CPU i\n"
+              << "  --cpus LIST            Pin reactors to these CPUs, e.g. 0,2,4,6\n"
+              << "  --unix PATH            Also accept same-host clients on this Unix socket\n"
+              << "  --handoff PATH         Take over from a server running with the same PATH,\n"
+              << "                         and hand over to the next one started with it\n"
+              << "  --max-queue N          Outbound messages queued per client (default: 1024)\n"
+              << "  --slow-policy P        drop-oldest|drop-newest|disconnect when a queue is full\n"
+              << "  --history-bytes N      Recent messages kept for replay on join (default: 1048576, 0 = off)\n"
+              << "  --store DIR            Persist messages to segment files in DIR (replaces --history-bytes)\n"
+              << "  --segment-mb N         Store segment file size (default: 64)\n"
+              << "  --retain-mb N          Delete the oldest segments beyond N MB (default: 1024, 0 = keep all)\n"
+              << "  --replay-max N         Most stored messages replayed at once (default: 100000, 0 = all)\n"
+              << "  --sync-ms N            Store group commit interval (default: 10)\n"
+              << "  --sync-batch N         Commit early once N messages are waiting (default: 256)\n"
+              << "  --join-timeout-ms N    Drop clients that have not joined after N ms (default: 10000, 0 = off)\n"
+              << "  --heartbeat-ms N       PING v4 clients silent for N ms, drop them if still silent\n"
+              << "                         after another N ms (default: 30000, 0 = off)\n"
+              << "  --idle-timeout-ms N    Drop other clients silent for N ms (default: 0 = off)\n"
+              << "  --log-level L          debug|info|warn|error (default: info)\n"
+              << "  --log-sample N         Keep 1 in N per-message debug records (default: 1)\n"
+              << "  --help                 Show this message\n";
+}
+
 int main(int argc, char* argv[]) {
     // Default configuration
-    std::string host = "0.0.0.0";
-    int port = 5000;
+    ServerConfig config;
+    ChatLog::LogConfig log_config;
+    int positional = 0;
 
     // Parse command line arguments
-    if (argc > 1) {
-        host = argv[1];
-    }
-    if (argc > 2) {
-        port = std::atoi(argv[2]);
-        if (port <= 0 || port > 65535) {
-            LOG_ERROR("Invalid port number: " << port);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "threaded") {
+                config.mode = ServerMode::THREADED;
+            } else if (mode == "epoll") {
+                config.mode = ServerMode::EPOLL;
+            } else if (mode == "uring") {
+                config.mode = ServerMode::URING;
+            } else {
+                LOG_ERROR("Unknown mode: " << mode);
+                return 1;
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.reactor_threads = std::atoi(argv[++i]);
+            if (config.reactor_threads <= 0) {
+                LOG_ERROR("Invalid thread count: " << argv[i]);
+                return 1;
+            }
+        } else if (arg == "--pin") {
+            config.pin_reactors = true;
+        } else if (arg == "--cpus" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string cpu;
+            while (std::getline(list, cpu, ',')) {
+                char* end = nullptr;
+                long value = std::strtol(cpu.c_str(), &end, 10);
+                if (cpu.empty() || *end != '\0' || value < 0 || value >= CPU_SETSIZE) {
+                    LOG_ERROR("Invalid CPU list: " << argv[i]);
+                    return 1;
+                }
+                config.reactor_cpus.push_back(static_cast<int>(value));
+            }
+        } else if (arg == "--unix" && i + 1 < argc) {
+            config.unix_path = argv[++i];
+        } else if (arg == "--handoff" && i + 1 < argc) {
+            config.handoff_path = argv[++i];
+        } else if (arg == "--max-queue" && i + 1 < argc) {
+            int max_queue = std::atoi(argv[++i]);
+            if (max_queue <= 0) {
+                LOG_ERROR("Invalid queue size: " << argv[i]);
+                return 1;
+            }
+            config.max_outbound_queue = static_cast<size_t>(max_queue);
+        } else if (arg == "--history-bytes" && i + 1 < argc) {
+            long long history_bytes = std::atoll(argv[++i]);
+            if (history_bytes < 0) {
+                LOG_ERROR("Invalid history size: " << argv[i]);
+                return 1;
+            }
+            config.history_bytes = static_cast<size_t>(history_bytes);
+        } else if ((arg == "--join-timeout-ms" || arg == "--heartbeat-ms" ||
+                    arg == "--idle-timeout-ms") && i + 1 < argc) {
+            long long timeout_ms = std::atoll(argv[++i]);
+            if (timeout_ms < 0) {
+                LOG_ERROR("Invalid timeout: " << argv[i]);
+                return 1;
+            }
+            uint64_t& target = arg == "--join-timeout-ms" ? config.join_timeout_ms
+                             : arg == "--heartbeat-ms" ? config.heartbeat_ms
+                             : config.idle_timeout_ms;
+            target = static_cast<uint64_t>(timeout_ms);
+        } else if (arg == "--store" && i + 1 < argc) {
+            config.store.directory = argv[++i];
+        } else if (arg == "--segment-mb" && i + 1 < argc) {
+            int segment_mb = std::atoi(argv[++i]);
+            if (segment_mb <= 0) {
+                LOG_ERROR("Invalid segment size: " << argv[i]);
+                return 1;
+            }
+            config.store.segment_bytes = static_cast<size_t>(segment_mb) * 1024 * 1024;
+        } else if (arg == "--retain-mb" && i + 1 < argc) {
+            long long retain_mb = std::atoll(argv[++i]);
+            if (retain_mb < 0) {
+                LOG_ERROR("Invalid retention size: " << argv[i]);
+                return 1;
+            }
+            config.store.retain_bytes = static_cast<size_t>(retain_mb) * 1024 * 1024;
+        } else if (arg == "--replay-max" && i + 1 < argc) {
+            long long replay_max = std::atoll(argv[++i]);
+            if (replay_max < 0) {
+                LOG_ERROR("Invalid replay limit: " << argv[i]);
+                return 1;
+            }
+            config.store.replay_limit = static_cast<size_t>(replay_max);
+        } else if (arg == "--sync-ms" && i + 1 < argc) {
+            config.store.sync_interval_ms = std::atoi(argv[++i]);
+            if (config.store.sync_interval_ms <= 0) {
+                LOG_ERROR("Invalid sync interval: " << argv[i]);
+                return 1;
+            }
+        } else if (arg == "--sync-batch" && i + 1 < argc) {
+            int sync_batch = std::atoi(argv[++i]);
+            if (sync_batch <= 0) {
+                LOG_ERROR("Invalid sync batch: " << argv[i]);
+                return 1;
+            }
+            config.store.sync_batch = static_cast<size_t>(sync_batch);
+        } else if (arg == "--slow-policy" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "drop-oldest") {
+                config.slow_consumer_policy = SlowConsumerPolicy::DROP_OLDEST;
+            } else if (policy == "drop-newest") {
+                config.slow_consumer_policy = SlowConsumerPolicy::DROP_NEWEST;
+            } else if (policy == "disconnect") {
+                config.slow_consumer_policy = SlowConsumerPolicy::DISCONNECT;
+            } else {
+                LOG_ERROR("Unknown slow-consumer policy: " << policy);
+                return 1;
+            }
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            if (!ChatLog::parse_level(argv[++i], log_config.level)) {
+                LOG_ERROR("Unknown log level: " << argv[i]);
+                return 1;
+            }
+        } else if (arg == "--log-sample" && i + 1 < argc) {
+            int every = std::atoi(argv[++i]);
+            if (every <= 0) {
+                LOG_ERROR("Invalid sampling rate: " << argv[i]);
+                return 1;
+            }
+            log_config.sample_every = static_cast<uint32_t>(every);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            LOG_ERROR("Unknown option: " << arg);
+            print_usage(argv[0]);
             return 1;
+        } else if (positional == 0) {
+            config.host = arg;
+            ++positional;
+        } else if (positional == 1) {
+            config.port = std::atoi(arg.c_str());
+            if (config.port <= 0 || config.port > 65535) {
+                LOG_ERROR("Invalid port number: " << config.port);
+                return 1;
+            }
+            ++positional;
         }
     }
 
@@ -47,8 +220,11 @@ int main(int argc, char* argv[]) {
     std::cout << "╚════════════════════════════════════════╝\n";
     std::cout << "\n";
 
+    // Log records are formatted and written by a background thread from here on
+    ChatLog::start(log_config);
+
     // Create server instance
-    g_server = new ChatServer(host, port);
+    g_server = new ChatServer(config);
 
     // Setup signal handler
     std::signal(SIGINT, signal_handler);
@@ -57,6 +233,7 @@ int main(int argc, char* argv[]) {
     if (!g_server->start()) {
         LOG_ERROR("Failed to start server");
         delete g_server;
+        ChatLog::stop();
         return 1;
     }
 
@@ -65,5 +242,6 @@ int main(int argc, char* argv[]) {
     g_server = nullptr;
 
     LOG_INFO("Server shutdown complete");
+    ChatLog::stop();
     return 0;
 }
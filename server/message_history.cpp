@@ -0,0 +1,308 @@
+// MIT License
+// Multi-threaded Chat System - Message History Implementation
+// Copyright (c) 2025
+
+#include "message_history.h"
+#include "connection.h"
+#include "frame_buffer.h"
+#include "message_store.h"
+#include "common.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+/**
+ * Append a stored v3 frame to a replay batch in an older format;
+ * those peers get the same text timestamps as live broadcasts
+ */
+void append_reencoded(std::vector<char>& batch, const char* frame, size_t size, WireFormat format) {
+    Frame decoded;
+    char encoded[MAX_FRAME_SIZE];
+    if (ChatUtils::decode_frame(frame, size, decoded)) {
+        size_t encoded_size = ChatUtils::encode_chat(decoded.message, format, encoded);
+        batch.insert(batch.end(), encoded, encoded + encoded_size);
+    }
+}
+
+} // namespace
+
+MessageHistory::MessageHistory(size_t budget_bytes)
+    : next_seq_(1), recorded_(1), ring_(budget_bytes), write_offset_(0), first_seq_(1),
+      store_(nullptr) {
+    if (budget_bytes > 0) {
+        pending_.reset(new Pending[PENDING_SLOTS]);
+    }
+}
+
+MessageHistory::~MessageHistory() {
+    if (store_) {
+        store_->set_collector(nullptr);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    record_published();
+}
+
+void MessageHistory::set_store(MessageStore* store) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        store_ = store;
+        entries_.clear();
+        if (!pending_) {
+            pending_.reset(new Pending[PENDING_SLOTS]);
+        }
+        uint64_t next_seq = std::max(next_seq_.load(), store->last_seq() + 1);
+        next_seq_ = next_seq;
+        recorded_ = next_seq;
+        first_seq_ = next_seq;
+    }
+
+    // Published frames reach the store by the next group commit at the latest
+    store->set_collector([this] {
+        std::lock_guard<std::mutex> lock(mutex_);
+        record_published();
+    });
+}
+
+void MessageHistory::resume(uint64_t last_seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t next_seq = std::max(next_seq_.load(), last_seq + 1);
+    next_seq_ = next_seq;
+    recorded_ = next_seq;
+    if (entries_.empty()) {
+        first_seq_ = next_seq;
+    }
+}
+
+void MessageHistory::append(Message& msg) {
+    msg.seq = next_seq_.fetch_add(1, std::memory_order_relaxed);
+    if (!pending_) {
+        return;     // History disabled
+    }
+
+    // The slot is free once the message PENDING_SLOTS before is recorded
+    while (msg.seq >= recorded_.load(std::memory_order_acquire) + PENDING_SLOTS) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        record_published();
+        if (msg.seq >= recorded_.load(std::memory_order_relaxed) + PENDING_SLOTS) {
+            // Waiting on a broadcaster that is still encoding
+            lock.unlock();
+            std::this_thread::yield();
+        }
+    }
+
+    Pending& slot = pending_[msg.seq % PENDING_SLOTS];
+    slot.size = ChatUtils::encode_chat(msg, WireFormat::V3, slot.frame);
+    slot.seq.store(msg.seq, std::memory_order_release);
+
+    if (msg.seq % RECORD_INTERVAL == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        record_published();
+    }
+}
+
+void MessageHistory::flush() {
+    lock_recorded(next_seq_.load(std::memory_order_acquire));
+}
+
+void MessageHistory::record_published() {
+    if (!pending_) {
+        return;
+    }
+
+    uint64_t seq = recorded_.load(std::memory_order_relaxed);
+    while (true) {
+        const Pending& slot = pending_[seq % PENDING_SLOTS];
+        if (slot.seq.load(std::memory_order_acquire) != seq) {
+            break;
+        }
+        record(seq, slot.frame, slot.size);
+        ++seq;
+    }
+
+    // Frees the slots for reuse
+    recorded_.store(seq, std::memory_order_release);
+}
+
+void MessageHistory::record(uint64_t seq, const char* frame, size_t size) {
+    if (store_) {
+        store_->append(seq, frame, size);
+        return;
+    }
+
+    if (size > ring_.size()) {
+        // Nothing fits; the history starts again after this message
+        entries_.clear();
+        first_seq_ = seq + 1;
+        return;
+    }
+
+    size_t offset = reserve(size);
+    if (entries_.empty()) {
+        first_seq_ = seq;
+    }
+    memcpy(&ring_[offset], frame, size);
+    entries_.push_back(Entry{offset, size});
+}
+
+std::unique_lock<std::mutex> MessageHistory::lock_recorded(uint64_t end_seq) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    record_published();
+    while (pending_ && recorded_.load(std::memory_order_relaxed) < end_seq) {
+        // Never wait holding the lock: a broadcaster may need it for a slot
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+        record_published();
+    }
+    return lock;
+}
+
+size_t MessageHistory::reserve(size_t size) {
+    size_t offset = write_offset_;
+
+    if (offset + size > ring_.size()) {
+        // Frames kept in the skipped tail are the oldest; drop them first
+        while (!entries_.empty() && entries_.front().offset >= offset) {
+            entries_.pop_front();
+            ++first_seq_;
+        }
+        offset = 0;
+    }
+
+    // Evict the oldest frames the new one would overwrite
+    while (!entries_.empty() && entries_.front().offset >= offset &&
+           entries_.front().offset < offset + size) {
+        entries_.pop_front();
+        ++first_seq_;
+    }
+
+    write_offset_ = offset + size;
+    return offset;
+}
+
+size_t MessageHistory::attach(Connection& connection, uint64_t since_seq) {
+    size_t replayed = 0;
+    WireFormat format = connection.wire_format();
+
+    connection.go_live([&](std::vector<FrameRef>& frames) {
+        // Read under the connection's queue lock: a broadcast numbered
+        // from here on reaches send_broadcast() after live_from is set
+        uint64_t live_from = next_seq_.load(std::memory_order_relaxed);
+        if (since_seq != 0) {
+            std::unique_lock<std::mutex> lock = lock_recorded(live_from);
+            replayed = collect_locked(format, since_seq, live_from, frames);
+        }
+        return live_from;
+    });
+    return replayed;
+}
+
+size_t MessageHistory::replay(Connection& connection, uint64_t since_seq) {
+    // Everything from live_from on was (or will be) sent live
+    uint64_t live_from = std::min(connection.live_from(),
+                                  next_seq_.load(std::memory_order_relaxed));
+    std::vector<FrameRef> frames;
+    size_t replayed = 0;
+    {
+        std::unique_lock<std::mutex> lock = lock_recorded(live_from);
+        replayed = collect_locked(connection.wire_format(), std::max<uint64_t>(since_seq, 1),
+                                  live_from, frames);
+    }
+
+    for (const FrameRef& frame : frames) {
+        connection.send(frame);
+    }
+    return replayed;
+}
+
+size_t MessageHistory::collect_locked(WireFormat format, uint64_t since_seq, uint64_t end_seq,
+                                      std::vector<FrameRef>& frames) {
+    if (store_) {
+        return collect_stored(format, since_seq, end_seq, frames);
+    }
+
+    size_t replayed = 0;
+    end_seq = std::min<uint64_t>(end_seq, first_seq_ + entries_.size());
+    uint64_t seq = std::max(since_seq, first_seq_);
+
+    // One frame holding the whole backlog: one queue entry, one write
+    std::vector<char> batch;
+    for (; seq < end_seq; ++seq) {
+        const Entry& entry = entries_[seq - first_seq_];
+        const char* frame = &ring_[entry.offset];
+
+        if (format == WireFormat::V3) {
+            batch.insert(batch.end(), frame, frame + entry.size);
+        } else {
+            append_reencoded(batch, frame, entry.size, format);
+        }
+        ++replayed;
+    }
+
+    if (!batch.empty()) {
+        frames.push_back(FrameRef::copy_of(batch.data(), batch.size()));
+    }
+    return replayed;
+}
+
+size_t MessageHistory::collect_stored(WireFormat format, uint64_t since_seq, uint64_t end_seq,
+                                      std::vector<FrameRef>& frames) {
+    // Only the newest replay_limit: a since_seq of 1 must not send the whole log
+    size_t limit = store_->replay_limit();
+    if (limit != 0 && end_seq > limit) {
+        since_seq = std::max<uint64_t>(since_seq, end_seq - limit);
+    }
+
+    std::vector<MessageStore::Slice> slices;
+    store_->slices_from(since_seq, slices);
+    size_t replayed = 0;
+
+    std::vector<char> batch;
+    for (MessageStore::Slice& slice : slices) {
+        if (slice.first_seq >= end_seq) {
+            break;
+        }
+        size_t messages = static_cast<size_t>(
+            std::min<uint64_t>(slice.messages, end_seq - slice.first_seq));
+        replayed += messages;
+
+        if (format == WireFormat::V3) {
+            // Straight from the mapped segments; the queue's gathered
+            // write sends every slice in one call
+            size_t size = slice.size;
+            if (messages < slice.messages) {
+                size = 0;
+                for (size_t i = 0; i < messages; ++i) {
+                    size += static_cast<size_t>(
+                        ChatUtils::frame_size(slice.data + size, FRAME_LENGTH_SIZE));
+                }
+            }
+            frames.push_back(FrameRef::view(slice.data, size, std::move(slice.owner)));
+            continue;
+        }
+
+        const char* frame = slice.data;
+        for (size_t i = 0; i < messages; ++i) {
+            size_t size = static_cast<size_t>(ChatUtils::frame_size(frame, FRAME_LENGTH_SIZE));
+            append_reencoded(batch, frame, size, format);
+            frame += size;
+        }
+    }
+
+    if (!batch.empty()) {
+        frames.push_back(FrameRef::copy_of(batch.data(), batch.size()));
+    }
+    return replayed;
+}
+
+uint64_t MessageHistory::last_seq() const {
+    return next_seq_.load(std::memory_order_acquire) - 1;
+}
+
+size_t MessageHistory::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    record_published();
+    return entries_.size();
+}
@@ -0,0 +1,199 @@
+// MIT License
+// Multi-threaded Chat System - Message History Header
+// Copyright (c) 2025
+
+#ifndef MESSAGE_HISTORY_H
+#define MESSAGE_HISTORY_H
+
+#include "protocol.h"
+#include "frame.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Connection;
+class FrameRef;
+class MessageStore;
+
+/**
+ * Bounded history of recent broadcasts, replayed to joining clients
+ *
+ * Every broadcast gets the next sequence number here and its v3 frame
+ * is copied into a fixed byte ring; the oldest frames are evicted when
+ * the ring is full, so memory stays at the configured budget. A client
+ * that joins with since_seq N is sent every kept message from N on as
+ * one batched frame, ahead of anything broadcast afterwards.
+ *
+ * With a persistent MessageStore attached the frames go to the store
+ * instead of the ring, numbering continues from what it recovered and
+ * replay reads the store's mapped segments, at most the store's
+ * replay_limit newest messages at a time
+ *
+ * Broadcasting takes no shared lock. append() numbers a message with
+ * an atomic counter and publishes its frame in a slot of a small
+ * table; whoever holds the history lock next records the published
+ * frames in sequence order: a join or replay, the broadcaster of every
+ * RECORD_INTERVAL-th message, or the store's sync thread. A
+ * broadcaster only waits when the table is full
+ *
+ * A join picks its first live sequence number under the connection's
+ * queue lock (Connection::go_live) and waits until everything before
+ * it is recorded; broadcasts are checked under that same lock
+ * (Connection::send_broadcast), so each message reaches a joining
+ * client exactly once: either it is numbered before the join and is
+ * in the replay, or after and the connection is already live for it
+ */
+class MessageHistory {
+public:
+    /**
+     * Constructor
+     * @param budget_bytes Ring size for encoded frames (0 = keep none,
+     *                     sequence numbers are still assigned)
+     */
+    explicit MessageHistory(size_t budget_bytes);
+
+    /**
+     * Destructor - records what was published (into the store, if any)
+     */
+    ~MessageHistory();
+
+    MessageHistory(const MessageHistory&) = delete;
+    MessageHistory& operator=(const MessageHistory&) = delete;
+
+    /**
+     * Keep messages in a persistent store instead of the ring
+     * Call before the first append()
+     * @param store Opened store; must outlive this history
+     */
+    void set_store(MessageStore* store);
+
+    /**
+     * Continue numbering after a previous server process
+     * Call before the first append(); its kept messages are not carried
+     * over, only a persistent store has them
+     * @param last_seq Newest sequence number it assigned
+     */
+    void resume(uint64_t last_seq);
+
+    /**
+     * Assign the next sequence number to a message and keep its frame
+     * Thread-safe; lock-free unless this message records a batch
+     * @param msg Message about to be broadcast; msg.seq is set here
+     */
+    void append(Message& msg);
+
+    /**
+     * Record every message numbered so far
+     * Call once broadcasts have stopped (before closing the store)
+     */
+    void flush();
+
+    /**
+     * Queue what a joining client missed and make it live
+     * Call once its wire format is negotiated and its ACK queued.
+     * Thread-safe
+     * @param connection Joining client
+     * @param since_seq First sequence number wanted (0 = no replay)
+     * @return number of messages replayed
+     */
+    size_t attach(Connection& connection, uint64_t since_seq);
+
+    /**
+     * Queue the kept messages a joined client was not sent live,
+     * from since_seq up to the first one it was
+     * Thread-safe
+     * @param connection Joined client
+     * @param since_seq First sequence number wanted
+     * @return number of messages replayed
+     */
+    size_t replay(Connection& connection, uint64_t since_seq);
+
+    /**
+     * Sequence number of the newest message (0 = none yet)
+     */
+    uint64_t last_seq() const;
+
+    /**
+     * Number of messages currently kept
+     */
+    size_t size();
+
+private:
+    /**
+     * A published frame waiting to be recorded; pending_[seq % PENDING_SLOTS]
+     */
+    struct Pending {
+        std::atomic<uint64_t> seq{0};   // Set last: the frame below is complete
+        size_t size = 0;
+        char frame[MAX_FRAME_SIZE];
+    };
+
+    static const uint64_t PENDING_SLOTS = 256;
+    static const uint64_t RECORD_INTERVAL = 64;
+
+    /**
+     * A kept frame; entries_[i] holds sequence number first_seq_ + i
+     */
+    struct Entry {
+        size_t offset;
+        size_t size;
+    };
+
+    /**
+     * Record published frames in sequence order, up to the first
+     * that is not published yet; caller must hold mutex_
+     */
+    void record_published();
+
+    /**
+     * Keep one frame in the store or the ring; caller must hold mutex_
+     */
+    void record(uint64_t seq, const char* frame, size_t size);
+
+    /**
+     * Take mutex_ once every message before end_seq is recorded
+     * Broadcasters publish without locks, so this only waits for
+     * ones that were numbered and are still encoding
+     */
+    std::unique_lock<std::mutex> lock_recorded(uint64_t end_seq);
+
+    /**
+     * Reserve ring space for a frame, evicting the oldest as needed;
+     * frames never wrap, the tail too short for one is skipped
+     * @return offset of the space, caller must hold mutex_
+     */
+    size_t reserve(size_t size);
+
+    /**
+     * Collect kept messages [since_seq, end_seq) in a wire format as
+     * one batch from the ring, or slices of the store; caller must
+     * hold mutex_
+     * @return number of messages collected
+     */
+    size_t collect_locked(WireFormat format, uint64_t since_seq, uint64_t end_seq,
+                          std::vector<FrameRef>& frames);
+
+    /**
+     * Collect from the store; caller must hold mutex_
+     * @return number of messages collected
+     */
+    size_t collect_stored(WireFormat format, uint64_t since_seq, uint64_t end_seq,
+                          std::vector<FrameRef>& frames);
+
+    std::atomic<uint64_t> next_seq_;    // Assigned to the next append()
+    std::atomic<uint64_t> recorded_;    // Every message before it is recorded
+    std::unique_ptr<Pending[]> pending_;    // Published frames (null = history disabled)
+
+    std::mutex mutex_;              // Protects everything below
+    std::vector<char> ring_;        // Encoded v3 frames
+    std::deque<Entry> entries_;     // Oldest first
+    size_t write_offset_;           // End of the newest frame
+    uint64_t first_seq_;            // Sequence number of entries_.front()
+    MessageStore* store_;           // Replaces the ring when set
+};
+
+#endif // MESSAGE_HISTORY_H
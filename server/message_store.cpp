@@ -0,0 +1,513 @@
+// MIT License
+// Multi-threaded Chat System - Persistent Message Store Implementation
+// Copyright (c) 2025
+
+#include "message_store.h"
+#include "common.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const size_t SEGMENT_NAME_DIGITS = 20;
+const char SEGMENT_SUFFIX[] = ".log";
+const char SPARE_NAME[] = "next.tmp";     // Pre-created segment, renamed when rolled into
+
+uint64_t read_be(const char* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(data[i]);
+    }
+    return value;
+}
+
+size_t stored_size(const char* frame) {
+    return FRAME_LENGTH_SIZE + static_cast<size_t>(read_be(frame, FRAME_LENGTH_SIZE));
+}
+
+/**
+ * Size of the frame at data if it is a complete, well-formed
+ * TIMED_CHAT frame for expected_seq, 0 otherwise
+ * Checks the layout only; nothing is copied
+ */
+size_t check_frame(const char* data, size_t available, uint64_t expected_seq) {
+    if (available < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+
+    size_t size = stored_size(data);
+    if (size <= FRAME_HEADER_SIZE || size > MAX_FRAME_SIZE || size > available ||
+        static_cast<FrameType>(data[FRAME_LENGTH_SIZE]) != FrameType::TIMED_CHAT) {
+        return 0;
+    }
+
+    // uint8 name_len, name, uint64 seq, uint64 time_ns, uint16 text_len, text
+    const char* payload = data + FRAME_HEADER_SIZE;
+    size_t payload_size = size - FRAME_HEADER_SIZE;
+    size_t name_len = static_cast<uint8_t>(payload[0]);
+    size_t fixed = 1 + name_len + 8 + 8 + 2;
+    if (fixed > payload_size || read_be(payload + 1 + name_len, 8) != expected_seq) {
+        return 0;
+    }
+
+    size_t text_len = static_cast<size_t>(read_be(payload + fixed - 2, 2));
+    return fixed + text_len == payload_size ? size : 0;
+}
+
+std::string segment_name(uint64_t first_seq) {
+    char name[SEGMENT_NAME_DIGITS + sizeof(SEGMENT_SUFFIX)];
+    snprintf(name, sizeof(name), "%020llu%s", static_cast<unsigned long long>(first_seq),
+             SEGMENT_SUFFIX);
+    return name;
+}
+
+bool parse_segment_name(const char* name, uint64_t& first_seq) {
+    size_t length = strlen(name);
+    if (length != SEGMENT_NAME_DIGITS + strlen(SEGMENT_SUFFIX) ||
+        strcmp(name + SEGMENT_NAME_DIGITS, SEGMENT_SUFFIX) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < SEGMENT_NAME_DIGITS; ++i) {
+        if (name[i] < '0' || name[i] > '9') {
+            return false;
+        }
+    }
+    first_seq = strtoull(name, nullptr, 10);
+    return first_seq != 0;
+}
+
+} // namespace
+
+MessageStore::Segment::~Segment() {
+    if (data) {
+        munmap(data, capacity);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+MessageStore::MessageStore(const StoreConfig& config)
+    : config_(config), dir_fd_(-1), active_(nullptr), last_seq_(0), failed_(false),
+      pending_(0), first_unsynced_(0), stopping_(false) {
+    config_.segment_bytes = std::max(config_.segment_bytes, MAX_FRAME_SIZE);
+    config_.sync_interval_ms = std::max(config_.sync_interval_ms, 1);
+    config_.sync_batch = std::max<size_t>(config_.sync_batch, 1);
+}
+
+MessageStore::~MessageStore() {
+    close();
+    if (dir_fd_ >= 0) {
+        ::close(dir_fd_);
+    }
+}
+
+bool MessageStore::open() {
+    const std::string& directory = config_.directory;
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        error_ = "Cannot create " + directory + ": " + strerror(errno);
+        return false;
+    }
+
+    dir_fd_ = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = dir_fd_ >= 0 ? fdopendir(dup(dir_fd_)) : nullptr;
+    if (!dir) {
+        error_ = "Cannot read " + directory + ": " + strerror(errno);
+        return false;
+    }
+
+    // A spare never rolled into holds nothing
+    unlinkat(dir_fd_, SPARE_NAME, 0);
+
+    std::vector<uint64_t> first_seqs;
+    while (struct dirent* entry = readdir(dir)) {
+        uint64_t first_seq = 0;
+        if (parse_segment_name(entry->d_name, first_seq)) {
+            first_seqs.push_back(first_seq);
+        }
+    }
+    closedir(dir);
+    std::sort(first_seqs.begin(), first_seqs.end());
+
+    // Segments must continue one another; stop at the first gap
+    for (size_t i = 0; i < first_seqs.size(); ++i) {
+        std::string path = directory + "/" + segment_name(first_seqs[i]);
+
+        if (last_seq_ != 0 && first_seqs[i] != last_seq_ + 1) {
+            LOGF_WARN("Message store: {} does not follow sequence {}; set aside as .corrupt",
+                      path, last_seq_);
+            std::string corrupt = path + ".corrupt";
+            rename(path.c_str(), corrupt.c_str());
+            continue;
+        }
+
+        std::shared_ptr<Segment> segment = map_segment(path, first_seqs[i], false, error_);
+        if (!segment) {
+            return false;
+        }
+        recover_segment(*segment);
+        if (segment->last_seq != 0) {
+            last_seq_ = segment->last_seq;
+        }
+        segments_.push_back(segment);
+    }
+
+    if (!segments_.empty()) {
+        active_ = segments_.back().get();
+        clear_tail(*active_);
+        retire_segments();
+        LOGF_INFO("Message store: recovered {} messages in {} segments, last sequence {}",
+                  size(), segments_.size(), last_seq_);
+    }
+
+    sync_thread_ = std::thread(&MessageStore::sync_loop, this);
+    return true;
+}
+
+void MessageStore::close() {
+    if (!sync_thread_.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        stopping_ = true;
+    }
+    sync_cv_.notify_one();
+    sync_thread_.join();
+
+    // Whatever was appended after the last group
+    sync_all();
+
+    if (spare_) {
+        unlink(spare_->path.c_str());
+        spare_.reset();
+    }
+}
+
+void MessageStore::set_collector(std::function<void()> collector) {
+    std::lock_guard<std::mutex> lock(collector_mutex_);
+    collector_ = std::move(collector);
+}
+
+std::shared_ptr<MessageStore::Segment> MessageStore::map_segment(const std::string& path,
+                                                                 uint64_t first_seq, bool create,
+                                                                 std::string& error) {
+    int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0);
+    int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        error = "Cannot open " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = "Cannot stat " + path + ": " + strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+
+    // New (or created but never sized before a crash): a sparse file,
+    // blocks are allocated as frames are written
+    size_t capacity = static_cast<size_t>(info.st_size);
+    if (capacity == 0) {
+        capacity = config_.segment_bytes;
+        if (ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+            error = "Cannot size " + path + ": " + strerror(errno);
+            ::close(fd);
+            return nullptr;
+        }
+    }
+
+    void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        error = "Cannot map " + path + ": " + strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+
+    auto segment = std::make_shared<Segment>();
+    segment->path = path;
+    segment->fd = fd;
+    segment->data = static_cast<char*>(data);
+    segment->capacity = capacity;
+    segment->first_seq = first_seq;
+    return segment;
+}
+
+void MessageStore::recover_segment(Segment& segment) {
+    size_t offset = 0;
+    uint64_t seq = segment.first_seq;
+
+    while (size_t size = check_frame(segment.data + offset, segment.capacity - offset, seq)) {
+        if ((seq - segment.first_seq) % STORE_INDEX_INTERVAL == 0) {
+            segment.index.push_back(IndexEntry{seq, offset});
+        }
+        segment.last_seq = seq++;
+        offset += size;
+    }
+
+    segment.used = offset;
+    segment.written.store(offset, std::memory_order_relaxed);
+    segment.synced = offset;
+    segment.dir_synced = true;
+}
+
+void MessageStore::clear_tail(Segment& segment) {
+    size_t end = segment.used;
+    if (end == segment.capacity) {
+        return;
+    }
+
+    // Release whole pages as holes (reads back as zeros, nothing is
+    // written); only the page the valid data ends in is zeroed by hand
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t hole = (end + page - 1) / page * page;
+    if (hole < segment.capacity &&
+        fallocate(segment.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(hole), static_cast<off_t>(segment.capacity - hole)) != 0) {
+        hole = segment.capacity;
+    }
+    memset(segment.data + end, 0, std::min(hole, segment.capacity) - end);
+    msync(segment.data + end / page * page, std::min(hole, segment.capacity) - end / page * page,
+          MS_SYNC);
+}
+
+bool MessageStore::append(uint64_t seq, const char* frame, size_t size) {
+    if (failed_) {
+        return false;
+    }
+
+    if (!active_ || active_->used + size > active_->capacity) {
+        if (!roll(seq)) {
+            failed_ = true;
+            LOGF_ERROR("Message store stopped: {}", error_);
+            return false;
+        }
+    }
+
+    Segment& segment = *active_;
+    if ((seq - segment.first_seq) % STORE_INDEX_INTERVAL == 0) {
+        segment.index.push_back(IndexEntry{seq, segment.used});
+    }
+    memcpy(segment.data + segment.used, frame, size);
+    segment.used += size;
+    segment.last_seq = seq;
+    last_seq_ = seq;
+    segment.written.store(segment.used, std::memory_order_release);
+
+    // Group commit: the sync thread wakes on its interval, or now
+    if (pending_.fetch_add(1, std::memory_order_relaxed) + 1 == config_.sync_batch) {
+        std::lock_guard<std::mutex> lock(sync_mutex_);
+        sync_cv_.notify_one();
+    }
+    return true;
+}
+
+bool MessageStore::roll(uint64_t seq) {
+    std::string path = config_.directory + "/" + segment_name(seq);
+    std::shared_ptr<Segment> segment;
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        segment.swap(spare_);
+    }
+
+    if (segment && rename(segment->path.c_str(), path.c_str()) != 0) {
+        LOGF_WARN("Message store: cannot rename {}: {}", segment->path, strerror(errno));
+        unlink(segment->path.c_str());
+        segment.reset();
+    }
+
+    if (segment) {
+        segment->path = path;
+        segment->first_seq = seq;
+    } else {
+        // No spare ready: create the file here, on the appender
+        segment = map_segment(path, seq, true, error_);
+        if (!segment) {
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        segments_.push_back(segment);
+        active_ = segment.get();
+    }
+    retire_segments();
+    return true;
+}
+
+void MessageStore::retire_segments() {
+    if (config_.retain_bytes == 0) {
+        return;
+    }
+
+    size_t kept = 0;
+    for (const auto& segment : segments_) {
+        kept += segment->capacity;
+    }
+
+    while (segments_.size() > 1 && kept > config_.retain_bytes) {
+        std::shared_ptr<Segment> oldest = segments_.front();
+        {
+            std::lock_guard<std::mutex> lock(segments_mutex_);
+            segments_.erase(segments_.begin());
+        }
+        kept -= oldest->capacity;
+
+        // Unmapped by the last slice of it still queued for a client
+        if (unlink(oldest->path.c_str()) != 0) {
+            LOGF_WARN("Message store: cannot delete {}: {}", oldest->path, strerror(errno));
+        }
+        LOGF_INFO("Message store: retired {} (messages up to {})", oldest->path, oldest->last_seq);
+    }
+}
+
+void MessageStore::prepare_spare() {
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        if (spare_) {
+            return;
+        }
+    }
+
+    std::string error;
+    std::shared_ptr<Segment> spare = map_segment(config_.directory + "/" + SPARE_NAME, 0, true, error);
+    if (!spare) {
+        // roll() falls back to creating the segment itself
+        LOGF_SAMPLED(LogLevel::WARN, "Message store: cannot prepare the next segment: {}", error);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    spare_ = spare;
+}
+
+size_t MessageStore::slices_from(uint64_t seq, std::vector<Slice>& slices) const {
+    size_t messages = 0;
+
+    // Last segment starting at or before seq (or the first one)
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), seq,
+                               [](uint64_t value, const std::shared_ptr<Segment>& segment) {
+                                   return value < segment->first_seq;
+                               });
+    if (it != segments_.begin()) {
+        --it;
+    }
+
+    for (; it != segments_.end(); ++it) {
+        const Segment& segment = **it;
+        if (segment.last_seq == 0 || segment.last_seq < seq) {
+            continue;
+        }
+
+        size_t offset = 0;
+        uint64_t first = segment.first_seq;
+        if (seq > first) {
+            // Nearest indexed frame at or before seq, then walk forward
+            auto entry = std::upper_bound(segment.index.begin(), segment.index.end(), seq,
+                                          [](uint64_t value, const IndexEntry& indexed) {
+                                              return value < indexed.seq;
+                                          });
+            --entry;
+            offset = entry->offset;
+            for (first = entry->seq; first < seq; ++first) {
+                offset += stored_size(segment.data + offset);
+            }
+        }
+
+        size_t count = static_cast<size_t>(segment.last_seq - first + 1);
+        slices.push_back(Slice{segment.data + offset, segment.used - offset, first, count, *it});
+        messages += count;
+    }
+
+    return messages;
+}
+
+uint64_t MessageStore::size() const {
+    uint64_t messages = 0;
+    for (const auto& segment : segments_) {
+        if (segment->last_seq != 0) {
+            messages += segment->last_seq - segment->first_seq + 1;
+        }
+    }
+    return messages;
+}
+
+void MessageStore::sync_loop() {
+    std::unique_lock<std::mutex> lock(sync_mutex_);
+
+    while (!stopping_) {
+        sync_cv_.wait_for(lock, std::chrono::milliseconds(config_.sync_interval_ms), [this] {
+            return stopping_ || pending_.load(std::memory_order_relaxed) >= config_.sync_batch;
+        });
+
+        lock.unlock();
+        {
+            // Not under sync_mutex_: the collector appends, which may notify
+            std::lock_guard<std::mutex> collecting(collector_mutex_);
+            if (collector_) {
+                collector_();
+            }
+        }
+        sync_all();
+        prepare_spare();
+        lock.lock();
+    }
+}
+
+void MessageStore::sync_all() {
+    pending_.store(0, std::memory_order_relaxed);
+
+    // Only the segments still being written, or sealed since the last pass
+    std::vector<std::shared_ptr<Segment>> segments;
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        for (const auto& segment : segments_) {
+            if (segment->first_seq >= first_unsynced_) {
+                segments.push_back(segment);
+            }
+        }
+    }
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t done = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        Segment& segment = *segments[i];
+        size_t written = segment.written.load(std::memory_order_acquire);
+
+        if (written > segment.synced) {
+            size_t start = segment.synced / page * page;
+            if (msync(segment.data + start, written - start, MS_SYNC) != 0) {
+                LOGF_ERROR("Message store: msync of {} failed: {}", segment.path, strerror(errno));
+                break;
+            }
+            segment.synced = written;
+        }
+
+        // A new file is only durable once its directory entry is
+        if (!segment.dir_synced && written > 0 && dir_fd_ >= 0) {
+            fsync(dir_fd_);
+            segment.dir_synced = true;
+        }
+
+        // Sealed (a newer one exists) and fully synced: skip it from now on
+        if (i + 1 < segments.size() && done == i && segment.synced == written) {
+            ++done;
+        }
+    }
+    if (done > 0) {
+        first_unsynced_ = done < segments.size() ? segments[done]->first_seq
+                                                 : segments[done - 1]->first_seq + 1;
+    }
+}
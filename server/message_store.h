@@ -0,0 +1,233 @@
+// MIT License
+// Multi-threaded Chat System - Persistent Message Store Header
+// Copyright (c) 2025
+
+#ifndef MESSAGE_STORE_H
+#define MESSAGE_STORE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const size_t DEFAULT_STORE_SEGMENT_BYTES = 64 * 1024 * 1024;
+const size_t DEFAULT_STORE_RETAIN_BYTES = 1024 * 1024 * 1024;
+const uint64_t STORE_INDEX_INTERVAL = 64;       // Messages between sparse index entries
+
+/**
+ * Store settings
+ */
+struct StoreConfig {
+    std::string directory;                      // Segment files live here
+    size_t segment_bytes = DEFAULT_STORE_SEGMENT_BYTES;
+    int sync_interval_ms = 10;                  // Longest a message waits to be synced
+    size_t sync_batch = 256;                    // Sync early once this many are waiting
+    size_t retain_bytes = DEFAULT_STORE_RETAIN_BYTES;  // Oldest segments beyond this are deleted (0 = keep all)
+    size_t replay_limit = 100000;               // Most messages one replay sends, the newest (0 = all)
+};
+
+/**
+ * Append-only, memory-mapped log of broadcast messages
+ *
+ * Messages are stored as their v3 wire frames, back to back, in
+ * segment files named after the first sequence number they hold
+ * (e.g. 00000000000000000001.log). Each segment is a sparse file of
+ * segment_bytes mapped shared; appending is a memcpy into the mapping
+ * and never waits for the disk. A background thread msync()s what was
+ * appended every sync_interval_ms, or sooner once sync_batch messages
+ * are waiting, so one sync commits a whole group
+ *
+ * Because a segment is a valid stream of frames, a run of messages
+ * can be sent to a v3 client straight from the mapping. A sparse
+ * index (every STORE_INDEX_INTERVAL messages) finds where a sequence
+ * number starts
+ *
+ * The sync thread also keeps the next segment file created, sized and
+ * mapped ahead of time, so rolling over is a rename. Once the segments
+ * exceed retain_bytes the oldest are unlinked; each is unmapped when
+ * the last replay still sending from it lets go
+ *
+ * open() recovers by scanning each segment until the first frame that
+ * is missing, malformed or out of sequence; anything after it (a torn
+ * write from a crash) is discarded
+ *
+ * append() and slices_from() must be serialized by the caller (the
+ * message history's lock); syncing runs concurrently with both. The
+ * history hands its published messages over through a collector the
+ * sync thread calls before each group commit
+ */
+class MessageStore {
+public:
+    /**
+     * A run of consecutive stored frames in one segment
+     */
+    struct Slice {
+        const char* data;
+        size_t size;
+        uint64_t first_seq;
+        size_t messages;
+        std::shared_ptr<const void> owner;      // Keeps the mapping alive
+    };
+
+    explicit MessageStore(const StoreConfig& config);
+
+    /**
+     * Destructor - syncs and unmaps everything
+     */
+    ~MessageStore();
+
+    MessageStore(const MessageStore&) = delete;
+    MessageStore& operator=(const MessageStore&) = delete;
+
+    /**
+     * Create the directory if needed, recover existing segments and
+     * start the sync thread
+     * @return false on error (see error())
+     */
+    bool open();
+
+    /**
+     * Sync everything appended and stop the sync thread
+     */
+    void close();
+
+    /**
+     * Have the sync thread call this before each group commit
+     * Thread-safe; once it returns the previous collector is not running
+     * @param collector Appends what is waiting (empty = none)
+     */
+    void set_collector(std::function<void()> collector);
+
+    /**
+     * Store one message
+     * @param seq Sequence number; must follow last_seq()
+     * @param frame Encoded v3 frame of the message
+     * @param size Frame size
+     * @return false if it was not stored (the store stops after an error)
+     */
+    bool append(uint64_t seq, const char* frame, size_t size);
+
+    /**
+     * Stored messages from a sequence number on, without copying
+     * @param seq First sequence number wanted (older ones are skipped
+     *            if they were never stored)
+     * @param slices Receives one slice per segment, oldest first
+     * @return number of messages in the slices
+     */
+    size_t slices_from(uint64_t seq, std::vector<Slice>& slices) const;
+
+    /**
+     * Most messages one replay sends
+     */
+    size_t replay_limit() const { return config_.replay_limit; }
+
+    /**
+     * Sequence number of the newest stored message (0 = none)
+     */
+    uint64_t last_seq() const { return last_seq_; }
+
+    /**
+     * Number of messages stored (recovered or appended)
+     */
+    uint64_t size() const;
+
+    const std::string& error() const { return error_; }
+
+private:
+    struct IndexEntry {
+        uint64_t seq;
+        size_t offset;
+    };
+
+    struct Segment {
+        std::string path;
+        int fd = -1;
+        char* data = nullptr;
+        size_t capacity = 0;
+        uint64_t first_seq = 0;
+        uint64_t last_seq = 0;                  // 0 = empty
+        size_t used = 0;                        // Appender's end of data
+        std::atomic<size_t> written{0};         // used, published to the sync thread
+        size_t synced = 0;                      // Sync thread only
+        bool dir_synced = false;                // Sync thread only: directory entry durable
+        std::vector<IndexEntry> index;          // Sparse, by sequence number
+
+        ~Segment();
+    };
+
+    /**
+     * Map a segment file, creating it at capacity if it does not exist
+     * @param error Set on failure
+     */
+    std::shared_ptr<Segment> map_segment(const std::string& path, uint64_t first_seq, bool create,
+                                         std::string& error);
+
+    /**
+     * Scan a recovered segment from its first sequence number until
+     * the valid frames end, rebuilding its index
+     */
+    void recover_segment(Segment& segment);
+
+    /**
+     * Zero whatever follows the valid data of a segment, so a torn
+     * write can never be read back once new frames are appended
+     */
+    void clear_tail(Segment& segment);
+
+    /**
+     * Seal the active segment and start a new one at seq, from the
+     * spare when the sync thread has one ready
+     */
+    bool roll(uint64_t seq);
+
+    /**
+     * Delete the oldest segments while the rest exceed retain_bytes;
+     * the active one always stays
+     */
+    void retire_segments();
+
+    /**
+     * Sync thread: have a spare segment ready for the next roll()
+     */
+    void prepare_spare();
+
+    /**
+     * Sync thread: msync appended ranges in groups
+     */
+    void sync_loop();
+
+    /**
+     * msync everything appended so far
+     */
+    void sync_all();
+
+    StoreConfig config_;
+    std::string error_;
+    int dir_fd_;                                // For syncing new directory entries
+
+    // Appender side (caller-serialized)
+    std::vector<std::shared_ptr<Segment>> segments_;    // Oldest first
+    Segment* active_;
+    uint64_t last_seq_;
+    bool failed_;
+
+    // Sync side
+    std::mutex segments_mutex_;                 // Guards segments_ and spare_ between roll() and the sync thread
+    std::shared_ptr<Segment> spare_;            // Created ahead for the next roll() (null = none)
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cv_;
+    std::atomic<size_t> pending_;               // Appended since the last sync
+    std::function<void()> collector_;           // Called before each group commit
+    std::mutex collector_mutex_;                // Held while collector_ runs
+    uint64_t first_unsynced_;                   // Sync thread only: segments starting before it are done
+    bool stopping_;                             // Guarded by sync_mutex_
+    std::thread sync_thread_;
+};
+
+#endif // MESSAGE_STORE_H
@@ -0,0 +1,95 @@
+// MIT License
+// Multi-threaded Chat System - Room Index Implementation
+// Copyright (c) 2025
+
+#include "room_index.h"
+#include "connection.h"
+#include <algorithm>
+
+bool RoomIndex::join(const std::string& room, const std::shared_ptr<Connection>& connection) {
+    int client_id = connection->client_id();
+    std::vector<std::string>& rooms = joined_[client_id];
+    if (rooms.size() >= MAX_ROOMS_PER_CLIENT) {
+        return false;
+    }
+
+    Room& entry = rooms_[room];
+    if (!entry.slots.emplace(client_id, entry.members.size()).second) {
+        return false;
+    }
+
+    entry.members.push_back(Member{client_id, connection});
+    rooms.push_back(room);
+    return true;
+}
+
+bool RoomIndex::leave(const std::string& room, int client_id) {
+    auto it = rooms_.find(room);
+    if (it == rooms_.end() || it->second.slots.count(client_id) == 0) {
+        return false;
+    }
+
+    erase_member(it, client_id);
+
+    // A client is in few rooms; a linear scan of its list is cheap
+    auto joined = joined_.find(client_id);
+    std::vector<std::string>& rooms = joined->second;
+    rooms.erase(std::find(rooms.begin(), rooms.end(), room));
+    if (rooms.empty()) {
+        joined_.erase(joined);
+    }
+    return true;
+}
+
+void RoomIndex::leave_all(int client_id) {
+    auto joined = joined_.find(client_id);
+    if (joined == joined_.end()) {
+        return;
+    }
+
+    for (const std::string& room : joined->second) {
+        auto it = rooms_.find(room);
+        if (it != rooms_.end()) {
+            erase_member(it, client_id);
+        }
+    }
+    joined_.erase(joined);
+}
+
+void RoomIndex::clear() {
+    rooms_.clear();
+    joined_.clear();
+}
+
+bool RoomIndex::is_member(const std::string& room, int client_id) const {
+    auto it = rooms_.find(room);
+    return it != rooms_.end() && it->second.slots.count(client_id) != 0;
+}
+
+const std::vector<std::string>* RoomIndex::rooms_of(int client_id) const {
+    auto it = joined_.find(client_id);
+    return it == joined_.end() ? nullptr : &it->second;
+}
+
+const std::vector<RoomIndex::Member>* RoomIndex::members(const std::string& room) const {
+    auto it = rooms_.find(room);
+    return it == rooms_.end() ? nullptr : &it->second.members;
+}
+
+void RoomIndex::erase_member(std::unordered_map<std::string, Room>::iterator room, int client_id) {
+    Room& entry = room->second;
+    auto slot = entry.slots.find(client_id);
+    size_t index = slot->second;
+    entry.slots.erase(slot);
+
+    // Move the last member into the hole
+    if (index + 1 != entry.members.size()) {
+        entry.members[index] = std::move(entry.members.back());
+        entry.slots[entry.members[index].client_id] = index;
+    }
+    entry.members.pop_back();
+
+    if (entry.members.empty()) {
+        rooms_.erase(room);
+    }
+}
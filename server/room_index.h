@@ -0,0 +1,106 @@
+// MIT License
+// Multi-threaded Chat System - Room Index Header
+// Copyright (c) 2025
+
+#ifndef ROOM_INDEX_H
+#define ROOM_INDEX_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Connection;
+
+const size_t MAX_ROOMS_PER_CLIENT = 64;
+
+/**
+ * Room -> members index for targeted fan-out
+ *
+ * Each room keeps its members in a dense vector, iterated by a room
+ * broadcast, plus a client_id -> position map; leaving swaps the last
+ * member into the freed slot, so joining and leaving are O(1) and a
+ * broadcast costs the size of its room. A room disappears with its
+ * last member
+ *
+ * Not thread-safe: each EPOLL shard owns one for its own connections,
+ * the server guards a shared one for THREADED and URING mode
+ */
+class RoomIndex {
+public:
+    /**
+     * One room member
+     */
+    struct Member {
+        int client_id;
+        std::shared_ptr<Connection> connection;
+    };
+
+    RoomIndex() {}
+
+    RoomIndex(const RoomIndex&) = delete;
+    RoomIndex& operator=(const RoomIndex&) = delete;
+
+    /**
+     * Add a client to a room (created on first use)
+     * @param room Room name (non-empty)
+     * @param connection Client connection
+     * @return false if it is already a member or in MAX_ROOMS_PER_CLIENT rooms
+     */
+    bool join(const std::string& room, const std::shared_ptr<Connection>& connection);
+
+    /**
+     * Remove a client from a room
+     * @return false if it was not a member
+     */
+    bool leave(const std::string& room, int client_id);
+
+    /**
+     * Remove a client from every room it is in
+     */
+    void leave_all(int client_id);
+
+    /**
+     * Remove every client from every room
+     */
+    void clear();
+
+    /**
+     * Whether a client is a member of a room
+     */
+    bool is_member(const std::string& room, int client_id) const;
+
+    /**
+     * Rooms a client is in, in the order it joined them
+     * @return null if it is in none; valid until the next change
+     */
+    const std::vector<std::string>* rooms_of(int client_id) const;
+
+    /**
+     * Members of a room, in no particular order
+     * @return null if the room has no members; valid until the next change
+     */
+    const std::vector<Member>* members(const std::string& room) const;
+
+    /**
+     * Number of rooms with at least one member
+     */
+    size_t size() const { return rooms_.size(); }
+
+private:
+    struct Room {
+        std::vector<Member> members;
+        std::unordered_map<int, size_t> slots;      // client_id -> index in members
+    };
+
+    /**
+     * Remove a member from a room, erasing the room once it is empty
+     */
+    void erase_member(std::unordered_map<std::string, Room>::iterator room, int client_id);
+
+    std::unordered_map<std::string, Room> rooms_;
+    std::unordered_map<int, std::vector<std::string>> joined_;     // client_id -> its rooms
+};
+
+#endif // ROOM_INDEX_H
@@ -1,176 +1,1087 @@
-    // MIT License
+// MIT License
 // Multi-threaded Chat System - Server Implementation
 // Copyright (c) 2025
 
 #include "server.h"
 #include "client_handler.h"
+#include "event_loop.h"
+#include "uring_loop.h"
+#include "uring.h"
 #include "common.h"
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <chrono>
+#include <csignal>
 #include <cstring>
 #include <algorithm>
+#include <poll.h>
+
+namespace {
+
+// Interrupts a THREADED mode handler's blocking recv() for a handoff
+const int HANDOFF_SIGNAL = SIGUSR2;
+
+// A successor asks right after connecting and the predecessor answers
+// at once; the state follows once the predecessor's readers stopped
+const int HANDOFF_REQUEST_TIMEOUT_MS = 3000;
+const int HANDOFF_STATE_TIMEOUT_MS = 30000;
+
+void interrupt_read(int) {
+}
+
+bool set_blocking(int socket_fd) {
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket_fd, F_SETFL, flags & ~O_NONBLOCK) == 0;
+}
+
+std::string describe(const HandoffLayout& layout) {
+    return layout.sharded ? std::to_string(layout.listeners) + " sharded listener(s)"
+                          : std::string("one threaded-mode listener");
+}
+
+/**
+ * Deal clients taken over round-robin to count loops
+ */
+std::vector<std::vector<HandoffClient>> deal(std::vector<HandoffClient>& clients, int count) {
+    std::vector<std::vector<HandoffClient>> shares(count);
+    for (size_t i = 0; i < clients.size(); ++i) {
+        shares[i % count].push_back(std::move(clients[i]));
+    }
+    clients.clear();
+    return shares;
+}
+
+} // namespace
 
 ChatServer::ChatServer(const std::string& host, int port)
-    : host_(host), port_(port), server_fd_(-1), next_client_id_(1), running_(false) {
+    : server_fd_(-1), unix_fd_(-1), stop_fd_(-1), handoff_fd_(-1), resuming_(0),
+      next_client_id_(1),
+      history_(config_.history_bytes), running_(false), handing_off_(false), handed_off_(false) {
+    config_.host = host;
+    config_.port = port;
+}
+
+ChatServer::ChatServer(const ServerConfig& config)
+    : config_(config), server_fd_(-1), unix_fd_(-1), stop_fd_(-1), handoff_fd_(-1),
+      resuming_(0), next_client_id_(1), history_(config_.history_bytes), running_(false),
+      handing_off_(false), handed_off_(false) {
 }
 
 ChatServer::~ChatServer() {
     stop();
+    shutdown_clients();
 }
 
 bool ChatServer::start() {
+    char ping[MAX_FRAME_SIZE];
+    ping_frame_ = FrameRef::copy_of(ping, ChatUtils::encode_heartbeat(true, ping));
+
+    // Before anything is bound: a running predecessor hands its
+    // listeners over, and closes its store before we open it
+    if (!config_.handoff_path.empty() && !take_over()) {
+        return false;
+    }
+    bool inherited = !inherited_listeners_.empty();
+
+    if (!open_store()) {
+        shutdown_clients();
+        return false;
+    }
+
+    // Shared by whichever threads accept: the accept loop, or every reactor
+    if (!config_.unix_path.empty() && unix_fd_ < 0) {
+        unix_fd_ = ChatUtils::listen_unix(config_.unix_path, SOCK_STREAM, false);
+        if (unix_fd_ < 0) {
+            shutdown_clients();
+            return false;
+        }
+    }
+
+    if (config_.mode == ServerMode::THREADED) {
+        // Non-blocking: the accept loop polls it together with unix_fd_
+        server_fd_ = inherited ? inherited_listeners_[0] : open_listener(false);
+        inherited_listeners_.clear();
+        if (server_fd_ < 0 || !ChatUtils::set_nonblocking(server_fd_)) {
+            shutdown_clients();
+            return false;
+        }
+    } else {
+        // Woken by stop(); the reactors do all accepting
+        stop_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (stop_fd_ < 0) {
+            LOG_ERROR("eventfd failed: " << strerror(errno));
+            shutdown_clients();
+            return false;
+        }
+    }
+
+    if (!config_.handoff_path.empty()) {
+        // The predecessor still has the old socket open; just replace the file
+        handoff_fd_ = Handoff::listen_at(config_.handoff_path, inherited);
+        if (handoff_fd_ < 0) {
+            shutdown_clients();
+            return false;
+        }
+
+        if (config_.mode == ServerMode::THREADED) {
+            // No SA_RESTART: an interrupted recv() fails with EINTR
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = interrupt_read;
+            sigemptyset(&action.sa_mask);
+            sigaction(HANDOFF_SIGNAL, &action, nullptr);
+        }
+    }
+
+    if (!start_reactors()) {
+        shutdown_clients();
+        return false;
+    }
+
+    const char* mode_name = config_.mode == ServerMode::URING ? "io_uring"
+                          : config_.mode == ServerMode::EPOLL ? "epoll" : "threaded";
+    LOG_INFO("Chat server starting on " << config_.host << ":" << config_.port << " ("
+             << mode_name << " mode)...");
+    if (unix_fd_ >= 0) {
+        LOGF_INFO("Accepting same-host clients on unix:{}", config_.unix_path);
+    }
+    if (handoff_fd_ >= 0) {
+        LOGF_INFO("A new server started with --handoff {} takes over from this one",
+                  config_.handoff_path);
+    }
+    LOG_INFO("Server is running. Press Ctrl+C to stop.");
+
+    running_ = true;
+    if (config_.mode == ServerMode::THREADED) {
+        resume_threaded_clients();
+        accept_loop();
+    } else {
+        struct pollfd fds[2] = {{stop_fd_, POLLIN, 0}, {handoff_fd_, POLLIN, 0}};
+        nfds_t nfds = handoff_fd_ >= 0 ? 2 : 1;
+        while (running_) {
+            if (poll(fds, nfds, -1) > 0 && nfds == 2 && (fds[1].revents & POLLIN)) {
+                serve_successor();
+            }
+        }
+    }
+
+    shutdown_clients();
+    if (outbound_stats_.queued > 0) {
+        LOG_INFO("Outbound queues: " << outbound_stats_.queued << " queued, "
+                 << outbound_stats_.dropped_oldest << " dropped (oldest), "
+                 << outbound_stats_.dropped_newest << " dropped (newest), "
+                 << outbound_stats_.disconnected << " slow consumers disconnected, "
+                 << outbound_stats_.send_errors << " send errors");
+    }
+
+    // Commit what the last group commit did not cover yet
+    history_.flush();
+    if (store_) {
+        store_->close();
+    }
+
+    return true;
+}
+
+bool ChatServer::open_store() {
+    if (config_.store.directory.empty()) {
+        return true;
+    }
+
+    store_.reset(new MessageStore(config_.store));
+    if (!store_->open()) {
+        LOG_ERROR("Failed to open message store: " << store_->error());
+        store_.reset();
+        return false;
+    }
+
+    history_.set_store(store_.get());
+    LOGF_INFO("Persisting messages to {} (sync every {} ms or {} messages)",
+              config_.store.directory, config_.store.sync_interval_ms, config_.store.sync_batch);
+    return true;
+}
+
+void ChatServer::stop() {
+    if (!running_) {
+        return;
+    }
+
+    running_ = false;
+
+    // Wake the accept loop (or the idle main thread); start() performs
+    // the remaining cleanup. Both calls are async-signal-safe. Shutting
+    // a listener down would also stop it in a successor taking it over
+    if (server_fd_ >= 0 && !handing_off_) {
+        shutdown(server_fd_, SHUT_RDWR);
+    }
+    if (unix_fd_ >= 0 && config_.mode == ServerMode::THREADED && !handing_off_) {
+        shutdown(unix_fd_, SHUT_RDWR);
+    }
+    if (stop_fd_ >= 0) {
+        uint64_t one = 1;
+        if (write(stop_fd_, &one, sizeof(one)) < 0) {
+            // Nothing useful to do from a signal handler
+        }
+    }
+}
+
+int ChatServer::open_listener(bool reuse_port) {
     // Create socket
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd_ < 0) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
         LOG_ERROR("Failed to create socket: " << strerror(errno));
-        return false;
+        return -1;
     }
 
     // Set socket options
-    if (!ChatUtils::set_socket_options(server_fd_)) {
+    if (!ChatUtils::set_socket_options(listen_fd)) {
         LOG_WARN("Failed to set socket options (non-critical)");
     }
 
+    // Let every reactor bind its own listener; the kernel spreads
+    // incoming connections across them
+    int opt = 1;
+    if (reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR("Failed to set SO_REUSEPORT: " << strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
     // Bind socket
     struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port_);
-    
-    if (host_ == "0.0.0.0") {
+    server_addr.sin_port = htons(config_.port);
+
+    if (config_.host == "0.0.0.0") {
         server_addr.sin_addr.s_addr = INADDR_ANY;
     } else {
-        if (inet_pton(AF_INET, host_.c_str(), &server_addr.sin_addr) <= 0) {
-            LOG_ERROR("Invalid address: " << host_);
-            close(server_fd_);
-            return false;
+        if (inet_pton(AF_INET, config_.host.c_str(), &server_addr.sin_addr) <= 0) {
+            LOG_ERROR("Invalid address: " << config_.host);
+            close(listen_fd);
+            return -1;
         }
     }
 
-    if (bind(server_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         LOG_ERROR("Bind failed: " << strerror(errno));
-        close(server_fd_);
-        return false;
+        close(listen_fd);
+        return -1;
     }
 
     // Listen
-    if (listen(server_fd_, 10) < 0) {
+    if (listen(listen_fd, SOMAXCONN) < 0) {
         LOG_ERROR("Listen failed: " << strerror(errno));
-        close(server_fd_);
-        return false;
+        close(listen_fd);
+        return -1;
     }
 
-    LOG_INFO("Chat server starting on " << host_ << ":" << port_ << "...");
-    LOG_INFO("Server is running. Press Ctrl+C to stop.");
+    return listen_fd;
+}
 
-    running_ = true;
-    accept_loop();
+bool ChatServer::start_reactors() {
+    if (config_.mode == ServerMode::THREADED) {
+        // Handler threads read; one loop drains every outbound queue
+        writer_.reset(new EventLoop(0, this));
+        if (!writer_->start()) {
+            writer_.reset();
+            return false;
+        }
+        return true;
+    }
+
+    int count = reactor_count();
+
+    if (config_.mode == ServerMode::URING) {
+        if (IoUring::supported()) {
+            return start_uring_loops(count);
+        }
+        LOG_WARN("io_uring is not available on this kernel, falling back to epoll");
+        config_.mode = ServerMode::EPOLL;
+    }
+
+    // One shard per reactor: own listener, own connections; clients
+    // taken over are dealt to them round-robin
+    std::vector<std::vector<HandoffClient>> shares = deal(adopted_, count);
+    std::vector<EventLoop*> shards;
+    for (int i = 0; i < count; ++i) {
+        // Edge-triggered reads drain until EAGAIN
+        for (const HandoffClient& client : shares[i]) {
+            ChatUtils::set_nonblocking(client.socket_fd);
+        }
+
+        int listen_fd = i < static_cast<int>(inherited_listeners_.size())
+                        ? inherited_listeners_[i] : open_listener(true);
+        if (listen_fd < 0 || !ChatUtils::set_nonblocking(listen_fd)) {
+            if (listen_fd >= 0) {
+                close(listen_fd);
+            }
+            reactors_.clear();
+            return false;
+        }
 
+        std::unique_ptr<EventLoop> loop(new EventLoop(i, this));
+        loop->set_listener(listen_fd);
+        loop->set_local_listener(unix_fd_);
+        loop->set_cpu(reactor_cpu(i));
+        loop->adopt(std::move(shares[i]));
+        shards.push_back(loop.get());
+        reactors_.push_back(std::move(loop));
+    }
+    inherited_listeners_.clear();
+
+    // Queues must exist on every shard before any of them can forward
+    for (auto& loop : reactors_) {
+        loop->connect_shards(shards);
+    }
+
+    expect_resumers(count);
+    for (auto& loop : reactors_) {
+        if (!loop->start()) {
+            expect_resumers(0);
+            for (auto& started : reactors_) {
+                started->stop();
+            }
+            reactors_.clear();
+            return false;
+        }
+    }
+
+    LOG_INFO("Started " << count << " epoll reactor thread(s)"
+             << (config_.pin_reactors || !config_.reactor_cpus.empty() ? " (pinned)" : ""));
     return true;
 }
 
-void ChatServer::stop() {
-    if (!running_) {
-        return;
+bool ChatServer::start_uring_loops(int count) {
+    // Same sharding as EPOLL mode; broadcasts reach other loops'
+    // connections through the registry and their send schedulers
+    std::vector<std::vector<HandoffClient>> shares = deal(adopted_, count);
+    for (int i = 0; i < count; ++i) {
+        // Sends go through the ring, which waits for room itself
+        for (const HandoffClient& client : shares[i]) {
+            set_blocking(client.socket_fd);
+        }
+
+        int listen_fd = i < static_cast<int>(inherited_listeners_.size())
+                        ? inherited_listeners_[i] : open_listener(true);
+        if (listen_fd < 0) {
+            uring_loops_.clear();
+            return false;
+        }
+
+        std::unique_ptr<UringLoop> loop(new UringLoop(i, this));
+        loop->set_listener(listen_fd);
+        loop->set_local_listener(unix_fd_);
+        loop->set_cpu(reactor_cpu(i));
+        loop->adopt(std::move(shares[i]));
+        uring_loops_.push_back(std::move(loop));
     }
+    inherited_listeners_.clear();
 
-    running_ = false;
+    expect_resumers(count);
+    for (auto& loop : uring_loops_) {
+        if (!loop->start()) {
+            expect_resumers(0);
+            for (auto& started : uring_loops_) {
+                started->stop();
+            }
+            uring_loops_.clear();
+            return false;
+        }
+    }
+
+    LOG_INFO("Started " << count << " io_uring loop thread(s)"
+             << (config_.pin_reactors || !config_.reactor_cpus.empty() ? " (pinned)" : ""));
+    return true;
+}
+
+int ChatServer::reactor_count() const {
+    int count = config_.reactor_threads;
+    if (count <= 0) {
+        count = config_.reactor_cpus.empty()
+            ? static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))
+            : static_cast<int>(config_.reactor_cpus.size());
+    }
+    return count;
+}
+
+int ChatServer::reactor_cpu(int index) const {
+    if (!config_.reactor_cpus.empty()) {
+        return config_.reactor_cpus[index % config_.reactor_cpus.size()];
+    }
+    if (config_.pin_reactors) {
+        return index % static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    return -1;
+}
 
-    // Close server socket
+void ChatServer::shutdown_clients() {
     if (server_fd_ >= 0) {
-        shutdown(server_fd_, SHUT_RDWR);
         close(server_fd_);
         server_fd_ = -1;
     }
+    if (stop_fd_ >= 0) {
+        close(stop_fd_);
+        stop_fd_ = -1;
+    }
+
+    // Reactors own their sockets and deregister them on stop
+    for (auto& loop : reactors_) {
+        loop->stop();
+    }
+    for (auto& loop : uring_loops_) {
+        loop->stop();
+    }
+    reactors_.clear();
+    uring_loops_.clear();
 
-    // Close all client connections
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    for (auto& pair : clients_) {
-        if (pair.second.socket_fd >= 0) {
-            shutdown(pair.second.socket_fd, SHUT_RDWR);
-            close(pair.second.socket_fd);
+    // No acceptor uses it any more; after a handoff the path is the successor's
+    if (unix_fd_ >= 0) {
+        close(unix_fd_);
+        unix_fd_ = -1;
+        if (!handed_off_) {
+            unlink(config_.unix_path.c_str());
         }
-        if (pair.second.handler_thread.joinable()) {
-            pair.second.handler_thread.join();
+    }
+    if (handoff_fd_ >= 0) {
+        close(handoff_fd_);
+        handoff_fd_ = -1;
+        if (!handed_off_) {
+            unlink(config_.handoff_path.c_str());
+        }
+    }
+
+    // Taken over but never served (start() failed)
+    for (int listen_fd : inherited_listeners_) {
+        close(listen_fd);
+    }
+    inherited_listeners_.clear();
+    for (const HandoffClient& client : adopted_) {
+        close(client.socket_fd);
+    }
+    adopted_.clear();
+
+    // Wake blocked handler threads so they can exit; handed-over
+    // clients only lose this process's descriptor
+    for (auto& entry : clients_.clear()) {
+        if (!handed_off_) {
+            entry.connection->shutdown();
         }
     }
-    clients_.clear();
+    {
+        std::unique_lock<std::shared_mutex> lock(rooms_mutex_);
+        rooms_.clear();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(users_mutex_);
+        users_.clear();
+    }
+
+    std::map<int, std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        threads.swap(handler_threads_);
+        parked_.clear();
+    }
+
+    for (auto& pair : threads) {
+        pair.second.join();
+    }
+
+    if (writer_) {
+        writer_->stop();
+        writer_.reset();
+    }
 }
 
 void ChatServer::accept_loop() {
+    struct pollfd fds[3];
+    nfds_t nfds = 0;
+    fds[nfds++] = {server_fd_, POLLIN, 0};
+    if (unix_fd_ >= 0) {
+        fds[nfds++] = {unix_fd_, POLLIN, 0};
+    }
+    if (handoff_fd_ >= 0) {
+        fds[nfds++] = {handoff_fd_, POLLIN, 0};
+    }
+
     while (running_) {
-        struct sockaddr_in client_addr;
-        socklen_t client_addr_len = sizeof(client_addr);
-
-        int client_fd = accept(server_fd_, (struct sockaddr*)&client_addr, &client_addr_len);
-        
-        if (client_fd < 0) {
-            if (running_) {
-                LOG_ERROR("Accept failed: " << strerror(errno));
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            LOG_ERROR("poll failed: " << strerror(errno));
             break;
         }
 
-        // Get client info
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        int client_port = ntohs(client_addr.sin_port);
+        bool ok = true;
+        for (nfds_t i = 0; i < nfds && ok; ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if (fds[i].fd == handoff_fd_) {
+                ok = !serve_successor();
+            } else {
+                ok = accept_client(fds[i].fd);
+            }
+        }
+        if (!ok) {
+            break;
+        }
+    }
+}
 
-        int client_id = next_client_id_++;
-        LOG_INFO("Client connected: ID " << client_id << " from " << client_ip << ":" << client_port);
+bool ChatServer::accept_client(int listen_fd) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
 
-        // Create client handler thread
-        ClientHandler* handler = new ClientHandler(client_fd, client_id, this);
-        
-        std::lock_guard<std::mutex> lock(clients_mutex_);
-        clients_[client_id] = ClientInfo{client_fd, "", std::thread(&ClientHandler::run, handler)};
+    // The listeners are non-blocking; handler threads want blocking sockets
+    int client_fd = accept4(listen_fd, (struct sockaddr*)&client_addr, &client_addr_len,
+                            SOCK_CLOEXEC);
+
+    if (client_fd < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+            return true;
+        }
+        if (running_) {
+            LOG_ERROR("Accept failed: " << strerror(errno));
+        }
+        return false;
     }
+
+    std::shared_ptr<Connection> connection = open_connection(client_fd, client_addr);
+    writer_->watch_writable(connection);
+
+    // Create client handler thread; storing it under the lock
+    // guarantees the handle exists before the thread can remove it
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    handler_threads_[connection->client_id()] = std::thread([this, connection]() {
+        ClientHandler handler(connection, this);
+        handler.run();
+    });
+    return true;
+}
+
+std::shared_ptr<Connection> ChatServer::resume_connection(int client_fd,
+                                                          SendScheduler* scheduler) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    memset(&client_addr, 0, sizeof(client_addr));
+    getpeername(client_fd, (struct sockaddr*)&client_addr, &client_addr_len);
+    return open_connection(client_fd, client_addr, scheduler);
 }
 
-void ChatServer::broadcast_message(const Message& msg, int exclude_client_id) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
+std::shared_ptr<Connection> ChatServer::open_connection(int client_fd,
+                                                        const struct sockaddr_storage& client_addr,
+                                                        SendScheduler* scheduler) {
+    int client_id = next_client_id_++;
+
+    // Get client info; Unix peers are unnamed, so name the socket they came in on
+    if (client_addr.ss_family == AF_UNIX) {
+        LOGF_INFO("Client connected: ID {} on unix:{}", client_id, config_.unix_path);
+    } else {
+        const struct sockaddr_in& peer = reinterpret_cast<const struct sockaddr_in&>(client_addr);
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, client_ip, INET_ADDRSTRLEN);
+        LOGF_INFO("Client connected: ID {} from {}:{}", client_id, client_ip,
+                  ntohs(peer.sin_port));
+    }
+
+    auto connection = std::make_shared<Connection>(client_fd, client_id,
+                                                   config_.max_outbound_queue,
+                                                   config_.slow_consumer_policy,
+                                                   &outbound_stats_);
+    // Before publishing: a broadcaster may send as soon as it is registered
+    connection->set_send_scheduler(scheduler);
+    clients_.insert(ClientRegistry::Entry{client_id, connection, ""});
+    return connection;
+}
+
+void ChatServer::broadcast_message(Message& msg, int exclude_client_id) {
+    // Room messages are live only; the history numbers lobby messages
+    if (msg.room[0] != '\0') {
+        msg.seq = 0;
+    } else {
+        history_.append(msg);
+    }
+
+    // Reactor shards fan out locally and forward to their peers
+    EventLoop* shard = EventLoop::current();
+    if (config_.mode == ServerMode::EPOLL && shard) {
+        shard->broadcast(msg, exclude_client_id);
+        return;
+    }
+
+    if (msg.room[0] != '\0') {
+        size_t recipients = broadcast_to_room(msg, exclude_client_id);
+        LOGF_SAMPLED(LogLevel::DEBUG, "Broadcast message from {} to {} clients in room {}",
+                     msg.username, recipients, msg.room);
+        return;
+    }
 
-    LOG_INFO("Broadcasting message from " << msg.username << " to " 
-             << (clients_.size() - 1) << " clients");
+    // Iterate the published snapshot without locking; joins and leaves
+    // publish a new one and never block this loop
+    ClientRegistry::Reader reader(clients_);
+    const ClientRegistry::Snapshot& clients = reader.clients();
 
-    for (auto& pair : clients_) {
-        if (pair.first == exclude_client_id) {
+    // Serialize once per wire format; every queue shares the same immutable frame
+    FrameRef frames[WIRE_FORMAT_COUNT];
+    size_t recipients = 0;
+    for (auto& entry : clients) {
+        if (entry.client_id == exclude_client_id) {
             continue;  // Don't send to sender
         }
+        WireFormat format = entry.connection->wire_format();
+        FrameRef& frame = frames[static_cast<int>(format)];
+        if (!frame) {
+            frame = FrameRef::encode(msg, format);
+        }
+        // Skipped until the client joins, and if its join replayed it
+        if (entry.connection->send_broadcast(frame, msg.seq)) {
+            ++recipients;
+        }
+    }
+
+    // Per message: sampled debug record, formatted off this thread
+    LOGF_SAMPLED(LogLevel::DEBUG, "Broadcast message {} from {} to {} clients",
+                 msg.seq, msg.username, recipients);
+}
+
+size_t ChatServer::broadcast_to_room(const Message& msg, int sender_id) {
+    std::string room(msg.room);
+    std::shared_lock<std::shared_mutex> lock(rooms_mutex_);
+
+    // Only the room's members are visited, however many clients are connected
+    const std::vector<RoomIndex::Member>* members = rooms_.members(room);
+    if (!members || !rooms_.is_member(room, sender_id)) {
+        LOGF_SAMPLED(LogLevel::WARN, "Client {} sent to room {} without being a member",
+                     sender_id, msg.room);
+        return 0;
+    }
 
-        if (!ChatUtils::send_message(pair.second.socket_fd, msg)) {
-            LOG_WARN("Failed to send message to client " << pair.first);
+    // Members all speak v3, so one encoding serves the whole room
+    FrameRef frame;
+    size_t recipients = 0;
+    for (const RoomIndex::Member& member : *members) {
+        if (member.client_id == sender_id) {
+            continue;
         }
+        if (!frame) {
+            frame = FrameRef::encode(msg, WireFormat::V3);
+        }
+        member.connection->send(frame);
+        ++recipients;
+    }
+    return recipients;
+}
+
+bool ChatServer::subscribe(const std::shared_ptr<Connection>& connection, const std::string& room) {
+    EventLoop* shard = EventLoop::current();
+    if (config_.mode == ServerMode::EPOLL && shard) {
+        return shard->subscribe(connection, room);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex_);
+    return rooms_.join(room, connection);
+}
+
+bool ChatServer::unsubscribe(int client_id, const std::string& room) {
+    EventLoop* shard = EventLoop::current();
+    if (config_.mode == ServerMode::EPOLL && shard) {
+        return shard->unsubscribe(client_id, room);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(rooms_mutex_);
+    return rooms_.leave(room, client_id);
+}
+
+bool ChatServer::send_direct(Message& msg, int sender_id) {
+    msg.seq = 0;
+    std::string recipient(msg.recipient);
+
+    std::shared_lock<std::shared_mutex> lock(users_mutex_);
+    auto it = users_.find(recipient);
+    if (it == users_.end()) {
+        LOGF_SAMPLED(LogLevel::DEBUG, "Client {} sent a direct message to unknown user {}",
+                     sender_id, msg.recipient);
+        return false;
     }
+
+    // Older formats cannot mark it private; it still reaches only this client
+    const std::shared_ptr<Connection>& connection = it->second;
+    connection->send(FrameRef::encode(msg, connection->wire_format()));
+
+    LOGF_SAMPLED(LogLevel::DEBUG, "Direct message from {} to {}", msg.username, msg.recipient);
+    return true;
 }
 
-void ChatServer::add_client(int client_id, int socket_fd, const std::string& username) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    
-    auto it = clients_.find(client_id);
-    if (it != clients_.end()) {
-        it->second.username = username;
-        LOG_INFO("Client " << client_id << " username: " << username);
+void ChatServer::add_client(const std::shared_ptr<Connection>& connection,
+                            const std::string& username, uint64_t since_seq) {
+    int client_id = connection->client_id();
+    if (clients_.set_username(client_id, username)) {
+        LOGF_INFO("Client {} username: {}", client_id, username);
+    }
+
+    size_t replayed = history_.attach(*connection, since_seq);
+    if (replayed > 0) {
+        LOGF_INFO("Client {} caught up on {} messages from sequence {}",
+                  client_id, replayed, since_seq);
     }
+
+    std::unique_lock<std::shared_mutex> lock(users_mutex_);
+    users_[username] = connection;
+}
+
+size_t ChatServer::replay_history(Connection& connection, uint64_t since_seq) {
+    return history_.replay(connection, since_seq);
 }
 
 void ChatServer::remove_client(int client_id) {
-    std::lock_guard<std::mutex> lock(clients_mutex_);
-    
-    auto it = clients_.find(client_id);
-    if (it != clients_.end()) {
-        LOG_INFO("Client disconnected: ID " << client_id << " (" << it->second.username << ")");
-        
-        if (it->second.socket_fd >= 0) {
-            close(it->second.socket_fd);
-        }
-        
-        if (it->second.handler_thread.joinable()) {
-            it->second.handler_thread.join();
-        }
-        
-        clients_.erase(it);
+    ClientRegistry::Entry entry;
+    if (!clients_.remove(client_id, &entry)) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(rooms_mutex_);
+        rooms_.leave_all(client_id);
+    }
+    {
+        // Unless a newer connection has taken the name over
+        std::unique_lock<std::shared_mutex> lock(users_mutex_);
+        auto it = users_.find(entry.username);
+        if (it != users_.end() && it->second->client_id() == client_id) {
+            users_.erase(it);
+        }
+    }
+
+    LOGF_INFO("Client disconnected: ID {} ({})", client_id, entry.username);
+    if (entry.connection->dropped() > 0) {
+        LOGF_WARN("Client {} had {} messages dropped by the slow-consumer policy",
+                  client_id, entry.connection->dropped());
+    }
+    if (writer_) {
+        writer_->remove_connection(entry.connection->socket_fd());
+    }
+
+    std::thread finished;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        auto it = handler_threads_.find(client_id);
+        if (it != handler_threads_.end()) {
+            finished = std::move(it->second);
+            handler_threads_.erase(it);
+        }
+    }
+
+    // Normally called from the handler thread itself, which cannot join itself
+    if (finished.joinable()) {
+        if (finished.get_id() == std::this_thread::get_id()) {
+            finished.detach();
+        } else {
+            finished.join();
+        }
+    }
+}
+
+bool ChatServer::check_liveness(Connection& connection, uint64_t now_ms, uint64_t& next_ms) {
+    next_ms = 0;
+    auto earliest = [&next_ms](uint64_t delay) {
+        if (next_ms == 0 || delay < next_ms) {
+            next_ms = delay;
+        }
+    };
+
+    bool joined = connection.joined();
+    uint64_t silent = now_ms - std::min(connection.heard_ms(), now_ms);
+
+    if (!joined && config_.join_timeout_ms > 0) {
+        uint64_t deadline = connection.opened_ms() + config_.join_timeout_ms;
+        if (now_ms >= deadline) {
+            LOGF_WARN("Client {} did not join within {} ms", connection.client_id(),
+                      config_.join_timeout_ms);
+            return false;
+        }
+        earliest(deadline - now_ms);
+    }
+
+    if (config_.heartbeat_ms > 0 && connection.version() >= PROTOCOL_VERSION_4) {
+        // Any traffic since the PING answers it
+        uint64_t pinged = connection.ping_sent_ms();
+        if (pinged != 0 && connection.heard_ms() < pinged) {
+            if (now_ms - pinged >= config_.heartbeat_ms) {
+                LOGF_WARN("Client {} did not answer a heartbeat within {} ms",
+                          connection.client_id(), config_.heartbeat_ms);
+                return false;
+            }
+            earliest(pinged + config_.heartbeat_ms - now_ms);
+        } else if (silent >= config_.heartbeat_ms) {
+            connection.send(ping_frame_);
+            connection.set_ping_sent_ms(now_ms);
+            earliest(config_.heartbeat_ms);
+        } else {
+            connection.set_ping_sent_ms(0);
+            earliest(config_.heartbeat_ms - silent);
+        }
+    } else if (config_.idle_timeout_ms > 0) {
+        if (silent >= config_.idle_timeout_ms) {
+            LOGF_WARN("Client {} was silent for {} ms", connection.client_id(), silent);
+            return false;
+        }
+        earliest(config_.idle_timeout_ms - silent);
+    } else if (!joined && config_.heartbeat_ms > 0) {
+        // Heartbeats are negotiated by the join; look again after it
+        earliest(config_.heartbeat_ms);
+    }
+
+    return true;
+}
+
+std::vector<std::string> ChatServer::rooms_of(int client_id) {
+    std::shared_lock<std::shared_mutex> lock(rooms_mutex_);
+    const std::vector<std::string>* rooms = rooms_.rooms_of(client_id);
+    return rooms ? *rooms : std::vector<std::string>();
+}
+
+void ChatServer::park_client(int client_id, HandoffClient client) {
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    parked_[client_id] = std::move(client);
+    parked_cv_.notify_one();
+}
+
+HandoffLayout ChatServer::listener_layout() const {
+    HandoffLayout layout;
+    layout.sharded = config_.mode != ServerMode::THREADED;
+    layout.listeners = layout.sharded ? static_cast<uint16_t>(reactor_count()) : 1;
+    return layout;
+}
+
+bool ChatServer::take_over() {
+    int peer = Handoff::connect_to(config_.handoff_path);
+    if (peer < 0) {
+        return true;  // Nobody to take over from: a fresh start
+    }
+
+    HandoffLayout own = listener_layout();
+    HandoffLayout theirs;
+    bool accepted = false;
+    if (!Handoff::send_hello(peer, own) ||
+        !Handoff::recv_reply(peer, accepted, theirs, HANDOFF_REQUEST_TIMEOUT_MS)) {
+        LOG_ERROR("The server running at " << config_.handoff_path
+                  << " did not answer the handoff request");
+        close(peer);
+        return false;
+    }
+    if (!accepted) {
+        LOG_ERROR("The running server has " << describe(theirs) << ", this one needs "
+                  << describe(own) << "; start it with the same mode and --threads");
+        close(peer);
+        return false;
+    }
+
+    LOG_INFO("Taking over from the running server...");
+    HandoffState state;
+    bool received = Handoff::recv_state(peer, state, HANDOFF_STATE_TIMEOUT_MS);
+    close(peer);
+    if (!received) {
+        LOG_ERROR("Handoff from the running server failed");
+        return false;
+    }
+
+    inherited_listeners_ = std::move(state.listeners);
+    if (state.unix_listener >= 0) {
+        if (state.unix_path == config_.unix_path) {
+            unix_fd_ = state.unix_listener;
+        } else {
+            // Nobody serves the old path any more
+            close(state.unix_listener);
+            unlink(state.unix_path.c_str());
+        }
+    }
+    history_.resume(state.last_seq);
+    adopted_ = std::move(state.clients);
+
+    LOGF_INFO("Took over {} listener(s) and {} client(s), continuing after message {}",
+              inherited_listeners_.size(), adopted_.size(), state.last_seq);
+    return true;
+}
+
+bool ChatServer::serve_successor() {
+    int peer = accept4(handoff_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (peer < 0) {
+        return false;
+    }
+
+    HandoffLayout own = listener_layout();
+    HandoffLayout theirs;
+    if (!Handoff::recv_hello(peer, theirs, HANDOFF_REQUEST_TIMEOUT_MS)) {
+        LOG_WARN("Ignoring a malformed handoff request");
+        close(peer);
+        return false;
+    }
+
+    // The successor takes the listeners over as they are
+    bool accepted = theirs.sharded == own.sharded && theirs.listeners == own.listeners;
+    if (!Handoff::send_reply(peer, accepted, own) || !accepted) {
+        if (!accepted) {
+            LOG_WARN("Refused a handoff to a server with " << describe(theirs)
+                     << "; this one has " << describe(own));
+        }
+        close(peer);
+        return false;
+    }
+
+    LOG_INFO("Handing over to a new server process...");
+    handing_off_ = true;
+
+    HandoffState state;
+    detach_clients(state.clients);
+
+    // Nothing appends any more; the successor reopens the store
+    history_.flush();
+    if (store_) {
+        store_->close();
+    }
+    state.last_seq = history_.last_seq();
+
+    if (server_fd_ >= 0) {
+        state.listeners.push_back(server_fd_);
+    }
+    for (auto& loop : reactors_) {
+        state.listeners.push_back(loop->listener());
+    }
+    for (auto& loop : uring_loops_) {
+        state.listeners.push_back(loop->listener());
+    }
+    state.unix_listener = unix_fd_;
+    state.unix_path = config_.unix_path;
+
+    handed_off_ = Handoff::send_state(peer, state);
+    close(peer);
+    if (handed_off_) {
+        LOGF_INFO("Handed {} client(s) over", state.clients.size());
+    } else {
+        LOG_ERROR("Handoff failed; closing every connection");
+    }
+
+    running_ = false;
+    return true;
+}
+
+void ChatServer::detach_clients(std::vector<HandoffClient>& clients) {
+    if (config_.mode == ServerMode::THREADED) {
+        park_handlers();
+        writer_->stop();
+
+        // Handler threads park with what they read; rooms and unsent
+        // bytes are collected here, now that nothing else touches them
+        ClientRegistry::Reader reader(clients_);
+        for (auto& entry : reader.clients()) {
+            auto it = parked_.find(entry.client_id);
+            if (it == parked_.end()) {
+                continue;
+            }
+            HandoffClient& client = it->second;
+            client.rooms = rooms_of(entry.client_id);
+            entry.connection->take_unsent(client.outbound);
+            clients.push_back(std::move(client));
+        }
+        parked_.clear();
+    } else if (config_.mode == ServerMode::URING) {
+        for (auto& loop : uring_loops_) {
+            loop->halt();
+        }
+        for (auto& loop : uring_loops_) {
+            loop->detach(clients);
+        }
+    } else {
+        for (auto& loop : reactors_) {
+            loop->halt();
+        }
+
+        // Forwards between halted shards still land in their queues
+        bool waiting = true;
+        while (waiting) {
+            waiting = false;
+            for (auto& loop : reactors_) {
+                waiting = loop->settle() || waiting;
+            }
+        }
+        for (auto& loop : reactors_) {
+            loop->detach(clients);
+        }
+    }
+}
+
+void ChatServer::park_handlers() {
+    std::map<int, std::thread> threads;
+    {
+        std::unique_lock<std::mutex> lock(threads_mutex_);
+
+        // A thread may be between its handing_off() check and recv();
+        // keep interrupting until each one has parked. Threads whose
+        // client disconnects meanwhile remove themselves
+        while (parked_.size() < handler_threads_.size()) {
+            for (auto& pair : handler_threads_) {
+                if (parked_.count(pair.first) == 0) {
+                    pthread_kill(pair.second.native_handle(), HANDOFF_SIGNAL);
+                }
+            }
+            parked_cv_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        threads.swap(handler_threads_);
+    }
+
+    for (auto& pair : threads) {
+        pair.second.join();
+    }
+}
+
+void ChatServer::resume_threaded_clients() {
+    // Rejoin every client before any handler thread reads, so what one
+    // of them had sent reaches all the others
+    std::vector<std::shared_ptr<ClientHandler>> handlers;
+    for (HandoffClient& client : adopted_) {
+        // Handler threads read with blocking calls
+        set_blocking(client.socket_fd);
+        std::shared_ptr<Connection> connection = resume_connection(client.socket_fd);
+        writer_->watch_writable(connection);
+
+        handlers.push_back(std::make_shared<ClientHandler>(connection, this));
+        handlers.back()->resume(client);
+    }
+
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    for (size_t i = 0; i < handlers.size(); ++i) {
+        std::shared_ptr<ClientHandler> handler = handlers[i];
+        handler_threads_[handler->client_id()] =
+            std::thread([handler, inbound = std::move(adopted_[i].inbound)]() {
+                handler->run(inbound);
+            });
+    }
+    adopted_.clear();
+}
+
+void ChatServer::expect_resumers(int count) {
+    {
+        std::lock_guard<std::mutex> lock(resume_mutex_);
+        resuming_ = count;
+    }
+    if (count == 0) {
+        resume_cv_.notify_all();
+    }
+}
+
+void ChatServer::wait_for_resumed() {
+    std::unique_lock<std::mutex> lock(resume_mutex_);
+    if (resuming_ > 0 && --resuming_ == 0) {
+        resume_cv_.notify_all();
+        return;
     }
+    resume_cv_.wait(lock, [this] { return resuming_ == 0; });
 }
@@ -6,17 +6,77 @@
 #define SERVER_H
 
 #include "protocol.h"
+#include "connection.h"
+#include "client_registry.h"
+#include "handoff.h"
+#include "message_history.h"
+#include "message_store.h"
+#include "room_index.h"
 #include <string>
+#include <condition_variable>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <atomic>
 #include <thread>
+#include <unordered_map>
 #include <vector>
+#include <netinet/in.h>
+
+class EventLoop;
+class UringLoop;
+
+// Resolution of the loops' timer wheels; liveness checks run up to this late
+const uint64_t LIVENESS_TICK_MS = 100;
+
+/**
+ * Connection handling strategy
+ * - THREADED: one blocking handler thread per client
+ * - EPOLL: edge-triggered epoll reactors on a fixed pool of threads,
+ *   each accepting from its own SO_REUSEPORT listener
+ * - URING: the same sharding with io_uring loops doing the socket I/O;
+ *   falls back to EPOLL when the kernel lacks support
+ */
+enum class ServerMode {
+    THREADED,
+    EPOLL,
+    URING
+};
+
+/**
+ * Server configuration
+ */
+struct ServerConfig {
+    std::string host = "0.0.0.0";   // IP address to bind to
+    int port = 5000;                // Port number to listen on
+    std::string unix_path;          // Unix socket to listen on as well (empty = none)
+    ServerMode mode = ServerMode::THREADED;
+    int reactor_threads = 0;        // EPOLL/URING mode only (0 = one per core)
+    bool pin_reactors = false;      // Pin reactor i to CPU i
+    std::vector<int> reactor_cpus;  // Explicit CPUs for the reactors (implies pinning)
+    size_t max_outbound_queue = 1024;   // Per-client queued messages
+    SlowConsumerPolicy slow_consumer_policy = SlowConsumerPolicy::DROP_OLDEST;
+    size_t history_bytes = 1024 * 1024;     // Recent broadcasts kept for replay on join (0 = none)
+    StoreConfig store;                      // Persistent message log (empty directory = none)
+    std::string handoff_path;               // Hot-upgrade socket (empty = none)
+    uint64_t join_timeout_ms = 10000;       // Deadline for the JOIN frame (0 = none)
+    uint64_t heartbeat_ms = 30000;          // PING a v4 client silent this long, drop it
+                                            // if it stays silent as long again (0 = off)
+    uint64_t idle_timeout_ms = 0;           // Drop any other client silent this long (0 = off)
+};
 
 /**
  * Multi-threaded TCP chat server
- * Handles multiple concurrent client connections
- * Broadcasts messages to all clients except sender
+ * Handles multiple concurrent client connections, over TCP and
+ * optionally a Unix socket for clients on the same host
+ * Broadcasts lobby messages to all clients except sender, and room
+ * messages to the room's other members only; direct messages go to
+ * one user, found by name
+ *
+ * With a handoff path a new server process started with the same one
+ * takes the listeners and every live connection over from the running
+ * process (see handoff.h), so an upgrade drops nobody
  */
 class ChatServer {
 public:
@@ -27,6 +87,12 @@ public:
      */
     ChatServer(const std::string& host, int port);
 
+    /**
+     * Constructor
+     * @param config Full server configuration
+     */
+    explicit ChatServer(const ServerConfig& config);
+
     /**
      * Destructor - ensures proper cleanup
      */
@@ -35,32 +101,75 @@ public:
     /**
      * Start the server
      * Creates listening socket and accepts connections
+     * Blocks until stop() is called
      * @return true on success, false on error
      */
     bool start();
 
     /**
      * Stop the server gracefully
-     * Closes all client connections and listening socket
+     * Wakes the accept loop; start() then closes all client
+     * connections and the listening socket before returning
      */
     void stop();
 
     /**
-     * Broadcast message to all connected clients except one
-     * Thread-safe operation
-     * @param msg Message to broadcast
+     * Broadcast message to all joined clients except one
+     * Thread-safe operation; never blocks on a slow recipient,
+     * messages are queued per client and drained when writable
+     * @param msg Message to broadcast; a lobby message is recorded in
+     *            the history, which assigns msg.seq. One with a room
+     *            goes to that room's members only, and only if the
+     *            sender is one of them
      * @param exclude_client_id Client ID to exclude from broadcast
      */
-    void broadcast_message(const Message& msg, int exclude_client_id);
+    void broadcast_message(Message& msg, int exclude_client_id);
+
+    /**
+     * Deliver a direct message to the client joined as msg.recipient
+     * Thread-safe; one index lookup and one send, whatever the number
+     * of clients
+     * @param msg Message with recipient set; not numbered or stored
+     * @param sender_id Client ID of the sender
+     * @return false if no joined client has that username
+     */
+    bool send_direct(Message& msg, int sender_id);
+
+    /**
+     * Add a joined client to a room
+     * Thread-safe; in EPOLL mode call from the connection's reactor
+     * @param connection Client connection (protocol v3)
+     * @param room Room name
+     * @return false if already a member or in too many rooms
+     */
+    bool subscribe(const std::shared_ptr<Connection>& connection, const std::string& room);
 
     /**
-     * Add a client to the active clients list
+     * Remove a client from a room
+     * Thread-safe; in EPOLL mode call from the connection's reactor
+     * @return false if it was not a member
+     */
+    bool unsubscribe(int client_id, const std::string& room);
+
+    /**
+     * Mark a client joined: replay the history it asked for, then
+     * start sending it broadcasts, and make it reachable by username
+     * (a later join with the same name takes the name over)
      * Thread-safe operation
-     * @param client_id Client identifier
-     * @param socket_fd Socket file descriptor
+     * @param connection Client connection (wire format negotiated)
      * @param username Client's username
+     * @param since_seq First history sequence number wanted (0 = none)
      */
-    void add_client(int client_id, int socket_fd, const std::string& username);
+    void add_client(const std::shared_ptr<Connection>& connection, const std::string& username,
+                    uint64_t since_seq);
+
+    /**
+     * Send a joined client the kept messages it was not sent live,
+     * from since_seq up to its join, as one batch
+     * Thread-safe operation
+     * @return number of messages replayed
+     */
+    size_t replay_history(Connection& connection, uint64_t since_seq);
 
     /**
      * Remove a client from the active clients list
@@ -69,31 +178,218 @@ public:
      */
     void remove_client(int client_id);
 
+    /**
+     * Create and register the connection for an accepted socket
+     * Thread-safe; called by the accept loop and by reactor shards
+     * @param client_fd Accepted socket (ownership moves to the connection)
+     * @param client_addr Peer address, TCP or Unix (for logging)
+     * @param scheduler Writes the connection's queue (null = written inline)
+     * @return the new connection
+     */
+    std::shared_ptr<Connection> open_connection(int client_fd,
+                                                const struct sockaddr_storage& client_addr,
+                                                SendScheduler* scheduler = nullptr);
+
+    /**
+     * Create and register the connection for a socket handed over by
+     * the previous server process
+     * Thread-safe; called by the loop that will serve it
+     * @param client_fd Inherited socket (ownership moves to the connection)
+     * @param scheduler Writes the connection's queue (null = written inline)
+     * @return the new connection
+     */
+    std::shared_ptr<Connection> resume_connection(int client_fd,
+                                                  SendScheduler* scheduler = nullptr);
+
+    /**
+     * Called by each EPOLL/URING loop once it has rejoined the clients
+     * handed to it, before it reads any of them; returns when every
+     * loop has, so nothing a client had sent is broadcast while
+     * another one is not back yet
+     */
+    void wait_for_resumed();
+
+    /**
+     * Rooms a client is in (THREADED/URING mode; EPOLL shards know their own)
+     * Thread-safe
+     */
+    std::vector<std::string> rooms_of(int client_id);
+
+    /**
+     * Whether a handoff is taking the clients over (THREADED mode
+     * handler threads stop reading between frames once it is)
+     */
+    bool handing_off() const { return handing_off_; }
+
+    /**
+     * Hand a THREADED mode client over from its handler thread, which
+     * then exits without disconnecting it
+     * @param client_id Client identifier
+     * @param client Its handoff state so far (no rooms or unsent bytes yet)
+     */
+    void park_client(int client_id, HandoffClient client);
+
+    /**
+     * Apply the join deadline, heartbeats and idle timeout to a connection
+     * Called by the loop whose timer wheel times it, when its timer
+     * fires; sends a PING when one is due. Cheap on every other path:
+     * readers only stamp Connection::mark_heard()
+     * @param connection Client connection
+     * @param now_ms Current ChatTime::monotonic_ms()
+     * @param next_ms Set to when to check again (0 = nothing to time)
+     * @return false if the connection should be dropped
+     */
+    bool check_liveness(Connection& connection, uint64_t now_ms, uint64_t& next_ms);
+
+    /**
+     * Outbound queue counters (slow-consumer policy firings etc.)
+     */
+    const OutboundStats& outbound_stats() const { return outbound_stats_; }
+
 private:
     /**
-     * Accept loop - runs in main thread
-     * Accepts incoming connections and spawns client handlers
+     * Accept loop - runs in main thread (THREADED mode)
+     * Waits on the TCP and Unix listeners and hands each accepted
+     * connection to a handler thread
      */
     void accept_loop();
 
+    /**
+     * Accept one pending connection and start its handler thread
+     * @return false on an error that ends the accept loop
+     */
+    bool accept_client(int listen_fd);
+
+    /**
+     * Create a bound, listening socket for the configured address
+     * @param reuse_port Set SO_REUSEPORT so several sockets share the port
+     * @return socket fd, or -1 on error
+     */
+    int open_listener(bool reuse_port);
+
+    /**
+     * Start the reactor threads (EPOLL mode) or the single
+     * outbound writer loop (THREADED mode)
+     * @return true on success, false on error
+     */
+    bool start_reactors();
+
+    /**
+     * Start the io_uring loops (URING mode), one shard each
+     * @param count Number of loops
+     * @return true on success, false on error
+     */
+    bool start_uring_loops(int count);
+
+    /**
+     * Open the persistent message store (if configured) and number
+     * new messages after what it recovered
+     * @return true on success, false on error
+     */
+    bool open_store();
+
+    /**
+     * Number of reactors/loops in EPOLL and URING mode
+     */
+    int reactor_count() const;
+
+    /**
+     * Listener layout this configuration needs; a handoff requires
+     * the predecessor's to be the same
+     */
+    HandoffLayout listener_layout() const;
+
+    /**
+     * Take the listeners and clients over from a server running at
+     * handoff_path, if there is one
+     * @return false if there is one but the handoff failed
+     */
+    bool take_over();
+
+    /**
+     * Accept a successor on the handoff socket and, if its layout
+     * matches, hand everything over to it
+     * @return true once handed over; the server then stops
+     */
+    bool serve_successor();
+
+    /**
+     * Stop every reader without closing a connection and describe
+     * the clients for the successor (then nothing writes to them)
+     * @param clients Receives one entry per client
+     */
+    void detach_clients(std::vector<HandoffClient>& clients);
+
+    /**
+     * Interrupt every handler thread until each has parked its client
+     * (THREADED mode handoff); joins them
+     */
+    void park_handlers();
+
+    /**
+     * Start a handler thread for each client taken over (THREADED mode)
+     */
+    void resume_threaded_clients();
+
+    /**
+     * Send a room message to the room's members (THREADED/URING mode)
+     * @return number of recipients
+     */
+    size_t broadcast_to_room(const Message& msg, int sender_id);
+
+    /**
+     * CPU for reactor/loop i, or -1 when unpinned
+     */
+    int reactor_cpu(int index) const;
+
+    /**
+     * Close all client connections and join their threads
+     * Called once the accept loop has exited
+     */
+    void shutdown_clients();
+
+    /**
+     * Set how many loops wait_for_resumed() waits for (0 releases them)
+     */
+    void expect_resumers(int count);
+
     // Server configuration
-    std::string host_;
-    int port_;
-    int server_fd_;
+    ServerConfig config_;
+    int server_fd_;                 // THREADED mode listener
+    int unix_fd_;                   // Unix socket listener, shared by every mode's acceptors
+    int stop_fd_;                   // EPOLL/URING mode: eventfd signalled by stop()
+    int handoff_fd_;                // Listener for a successor process (-1 = none)
+    std::vector<int> inherited_listeners_;  // TCP listeners taken over, in shard order
+    std::vector<HandoffClient> adopted_;    // Clients taken over, until their loops start
+    int resuming_;                          // Loops still rejoining adopted clients
+    std::mutex resume_mutex_;               // Protects resuming_
+    std::condition_variable resume_cv_;     // Signalled when resuming_ drops to 0
 
     // Client management
-    struct ClientInfo {
-        int socket_fd;
-        std::string username;
-        std::thread handler_thread;
-    };
+    ClientRegistry clients_;                    // Read lock-free by broadcasts
+    std::map<int, std::thread> handler_threads_;    // THREADED mode only
+    std::map<int, HandoffClient> parked_;       // THREADED mode handoff: client_id -> state
+    std::mutex threads_mutex_;                  // Protects handler_threads_ and parked_
+    std::condition_variable parked_cv_;         // Signalled as handler threads park
+    std::atomic<int> next_client_id_;           // Auto-incrementing client ID
+    std::unique_ptr<MessageStore> store_;       // Persistent log, if configured
+    MessageHistory history_;                    // Sequence numbers and replay
+    RoomIndex rooms_;                           // THREADED/URING mode; EPOLL shards keep their own
+    std::shared_mutex rooms_mutex_;             // Shared by room broadcasts, exclusive for changes
+    std::unordered_map<std::string, std::shared_ptr<Connection>> users_;   // Joined username -> connection
+    std::shared_mutex users_mutex_;             // Shared by direct messages, exclusive for joins/leaves
 
-    std::map<int, ClientInfo> clients_;  // client_id -> ClientInfo
-    std::mutex clients_mutex_;           // Protects clients_ map
-    int next_client_id_;                 // Auto-incrementing client ID
+    // Reactors (EPOLL mode) and outbound writer (THREADED mode)
+    std::vector<std::unique_ptr<EventLoop>> reactors_;
+    std::unique_ptr<EventLoop> writer_;
+    std::vector<std::unique_ptr<UringLoop>> uring_loops_;   // URING mode
+    OutboundStats outbound_stats_;
+    FrameRef ping_frame_;                       // Encoded once, shared by every PING
 
     // Server state
     std::atomic<bool> running_;
+    std::atomic<bool> handing_off_;             // Readers stop; sockets stay open
+    bool handed_off_;                           // Successor owns sockets and socket files
 };
 
 #endif // SERVER_H
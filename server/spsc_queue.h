@@ -0,0 +1,89 @@
+// MIT License
+// Multi-threaded Chat System - Single-Producer Single-Consumer Queue
+// Copyright (c) 2025
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * Bounded lock-free queue between exactly one producer thread and
+ * one consumer thread
+ *
+ * Head and tail live on separate cache lines and each side caches
+ * the other's index, so the shared lines are only touched when the
+ * queue looks full (producer) or empty (consumer)
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * Constructor
+     * @param capacity Maximum queued items (rounded up to a power of two)
+     */
+    explicit SpscQueue(size_t capacity)
+        : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_.reset(new T[size]);
+        mask_ = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * Append an item (producer thread only)
+     * @return false if the queue is full; item is left untouched
+     */
+    bool try_push(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;
+            }
+        }
+
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest item (consumer thread only)
+     * @return false if the queue is empty
+     */
+    bool try_pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+
+        // Move out so the slot does not keep the item alive
+        item = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::unique_ptr<T[]> slots_;
+    size_t mask_;
+
+    alignas(64) std::atomic<size_t> head_;     // Next slot to pop
+    size_t cached_tail_;                        // Consumer's view of tail_
+
+    alignas(64) std::atomic<size_t> tail_;     // Next slot to push
+    size_t cached_head_;                        // Producer's view of head_
+};
+
+#endif // SPSC_QUEUE_H
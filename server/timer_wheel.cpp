@@ -0,0 +1,144 @@
+// MIT License
+// Multi-threaded Chat System - Timer Wheel Implementation
+// Copyright (c) 2025
+
+#include "timer_wheel.h"
+#include <climits>
+
+TimerWheel::Timer::~Timer() {
+    if (wheel_) {
+        wheel_->cancel(*this);
+    }
+}
+
+TimerWheel::TimerWheel(uint64_t tick_ms, uint64_t now_ms)
+    : tick_ms_(tick_ms > 0 ? tick_ms : 1), now_tick_(now_ms / tick_ms_), size_(0) {
+    for (auto& level : slots_) {
+        for (Timer& head : level) {
+            head.prev_ = head.next_ = &head;
+        }
+    }
+}
+
+void TimerWheel::arm(Timer& timer, uint64_t delay_ms) {
+    if (timer.wheel_ == this) {
+        unlink(timer);
+    } else {
+        if (timer.wheel_) {
+            timer.wheel_->cancel(timer);
+        }
+        timer.wheel_ = this;
+        ++size_;
+    }
+
+    // At least one tick ahead, and within the top level's turn
+    const uint64_t span = (1ull << (SLOT_BITS * LEVELS)) - 1;
+    uint64_t ticks = (delay_ms + tick_ms_ - 1) / tick_ms_;
+    if (ticks == 0) {
+        ticks = 1;
+    } else if (ticks > span) {
+        ticks = span;
+    }
+
+    timer.due_ = now_tick_ + ticks;
+    place(timer);
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer.wheel_ != this) {
+        return;
+    }
+
+    unlink(timer);
+    timer.wheel_ = nullptr;
+    --size_;
+}
+
+size_t TimerWheel::advance(uint64_t now_ms, std::vector<int>& expired) {
+    uint64_t target = now_ms / tick_ms_;
+    size_t count = 0;
+
+    while (now_tick_ < target) {
+        // Nothing armed: no slot to visit on the way
+        if (size_ == 0) {
+            now_tick_ = target;
+            break;
+        }
+        ++now_tick_;
+
+        // A level's slot comes due when every level below completes a turn
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((now_tick_ & ((1ull << (SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level, (now_tick_ >> (SLOT_BITS * level)) & SLOT_MASK);
+        }
+
+        Timer& head = slots_[0][now_tick_ & SLOT_MASK];
+        while (head.next_ != &head) {
+            Timer* timer = head.next_;
+            unlink(*timer);
+            timer->wheel_ = nullptr;
+            --size_;
+            expired.push_back(timer->id);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+int TimerWheel::timeout_ms(uint64_t now_ms) const {
+    if (size_ == 0) {
+        return -1;
+    }
+
+    // The next occupied level-0 slot, unless a cascade comes first
+    uint64_t wait = SLOTS - (now_tick_ & SLOT_MASK);
+    for (uint64_t ticks = 1; ticks < wait; ++ticks) {
+        const Timer& head = slots_[0][(now_tick_ + ticks) & SLOT_MASK];
+        if (head.next_ != &head) {
+            wait = ticks;
+            break;
+        }
+    }
+
+    uint64_t due_ms = (now_tick_ + wait) * tick_ms_;
+    if (due_ms <= now_ms) {
+        return 0;
+    }
+    return due_ms - now_ms > static_cast<uint64_t>(INT_MAX) ? INT_MAX
+                                                             : static_cast<int>(due_ms - now_ms);
+}
+
+void TimerWheel::place(Timer& timer) {
+    uint64_t delta = timer.due_ - now_tick_;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+
+    // Append, so timers due on the same tick expire in arming order
+    Timer& head = slots_[level][(timer.due_ >> (SLOT_BITS * level)) & SLOT_MASK];
+    timer.prev_ = head.prev_;
+    timer.next_ = &head;
+    head.prev_->next_ = &timer;
+    head.prev_ = &timer;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer.prev_->next_ = timer.next_;
+    timer.next_->prev_ = timer.prev_;
+    timer.prev_ = timer.next_ = nullptr;
+}
+
+void TimerWheel::cascade(int level, uint64_t slot) {
+    // Everything here is due within one turn of the level below
+    Timer& head = slots_[level][slot];
+    while (head.next_ != &head) {
+        Timer* timer = head.next_;
+        unlink(*timer);
+        place(*timer);
+    }
+}
@@ -0,0 +1,124 @@
+// MIT License
+// Multi-threaded Chat System - Timer Wheel Header
+// Copyright (c) 2025
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Hierarchical timing wheel (Varghese & Lauck) for connection timeouts
+ *
+ * Four levels of 64 slots each; a level-0 slot covers one tick, a slot
+ * on level n covers 64^n ticks. A timer goes into the level its due
+ * time falls in and moves one level down each time the wheel below it
+ * completes a turn, so arming, cancelling and expiring a timer are all
+ * O(1) and a wheel with 100k timers costs the same per tick as one with
+ * ten. Timers are intrusive list nodes embedded in their owner; nothing
+ * is allocated
+ *
+ * Not thread-safe: each event loop owns one
+ */
+class TimerWheel {
+public:
+    /**
+     * A timer, embedded in whatever it times; it must not move while
+     * armed and is cancelled when destroyed
+     */
+    class Timer {
+    public:
+        Timer() : id(-1), wheel_(nullptr), prev_(nullptr), next_(nullptr), due_(0) {}
+        ~Timer();
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        bool armed() const { return wheel_ != nullptr; }
+
+        int id;                 // Owner's key, reported by advance()
+
+    private:
+        friend class TimerWheel;
+
+        TimerWheel* wheel_;     // Set while armed
+        Timer* prev_;
+        Timer* next_;
+        uint64_t due_;          // Tick it expires on
+    };
+
+    /**
+     * Constructor
+     * @param tick_ms Resolution; timers fire up to one tick late
+     * @param now_ms Current time on the clock later passed to advance()
+     */
+    TimerWheel(uint64_t tick_ms, uint64_t now_ms);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * Arm a timer, or move it if it is armed already
+     * Delays beyond the wheel's span (64^4 ticks) are clamped to it
+     * @param timer Timer to arm
+     * @param delay_ms Time from the last advance() until it fires
+     */
+    void arm(Timer& timer, uint64_t delay_ms);
+
+    /**
+     * Disarm a timer; nothing happens if it is not armed
+     */
+    void cancel(Timer& timer);
+
+    /**
+     * Run the wheel up to now_ms and disarm every timer that came due
+     * @param now_ms Current time
+     * @param expired Receives the id of each expired timer (appended)
+     * @return number of timers expired
+     */
+    size_t advance(uint64_t now_ms, std::vector<int>& expired);
+
+    /**
+     * How long an event loop may sleep before the next advance() is due
+     * Exact up to the next cascade, so a loop with only distant timers
+     * wakes about once every 64 ticks
+     * @param now_ms Current time
+     * @return milliseconds, or -1 when no timer is armed
+     */
+    int timeout_ms(uint64_t now_ms) const;
+
+    /**
+     * Number of armed timers
+     */
+    size_t size() const { return size_; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1ull << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+
+    /**
+     * Link a timer into the slot its due tick falls in
+     */
+    void place(Timer& timer);
+
+    /**
+     * Unlink a timer from its slot (it stays counted)
+     */
+    static void unlink(Timer& timer);
+
+    /**
+     * Re-place every timer of a slot one level down
+     */
+    void cascade(int level, uint64_t slot);
+
+    uint64_t tick_ms_;
+    uint64_t now_tick_;                 // Last tick processed
+    size_t size_;
+    Timer slots_[LEVELS][SLOTS];        // List heads (sentinels)
+};
+
+#endif // TIMER_WHEEL_H
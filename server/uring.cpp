@@ -0,0 +1,264 @@
+// MIT License
+// Multi-threaded Chat System - io_uring Ring Implementation
+// Copyright (c) 2025
+
+#include "uring.h"
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags, const void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                                    flags, arg, arg_size));
+}
+
+int sys_io_uring_register(int ring_fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+void* map_ring(int ring_fd, size_t size, off_t offset) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+}
+
+IoUring::IoUring()
+    : ring_fd_(-1), pending_(0),
+      sq_ptr_(nullptr), sq_size_(0), sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0),
+      sq_array_(nullptr), sqes_(nullptr), sqes_size_(0),
+      cq_ptr_(nullptr), cq_size_(0), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0),
+      cqes_(nullptr),
+      buf_ring_(nullptr), buf_ring_size_(0), buffers_(nullptr), buffers_size_(0),
+      buffer_size_(0), buf_mask_(0), buf_tail_(0) {
+}
+
+IoUring::~IoUring() {
+    // Closing the ring cancels whatever is still in flight before
+    // the memory those requests point at goes away
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+    }
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ && cq_ptr_ != sq_ptr_) {
+        munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_) {
+        munmap(sq_ptr_, sq_size_);
+    }
+    if (buf_ring_) {
+        munmap(buf_ring_, buf_ring_size_);
+    }
+    if (buffers_) {
+        munmap(buffers_, buffers_size_);
+    }
+}
+
+bool IoUring::supported() {
+    IoUring ring;
+    if (!ring.init(8)) {
+        return false;
+    }
+
+    std::vector<char> storage(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(storage.data());
+    if (sys_io_uring_register(ring.ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        return false;
+    }
+
+    // SEND_ZC shipped in the same release (6.0) as multishot receive,
+    // which has no probe bit of its own
+    const int required[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+                            IORING_OP_READ, IORING_OP_SEND_ZC};
+    for (int op : required) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+
+    return ring.setup_buffers(0, 2, 64);
+}
+
+bool IoUring::init(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 4;
+
+    ring_fd_ = sys_io_uring_setup(entries, &params);
+    if (ring_fd_ < 0) {
+        ring_fd_ = -1;
+        return false;
+    }
+
+    const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                            IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG;
+    if ((params.features & needed) != needed) {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    // One mapping covers both rings with IORING_FEAT_SINGLE_MMAP
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size_ > sq_size_) {
+        sq_size_ = cq_size_;
+    }
+    cq_size_ = sq_size_;
+
+    sq_ptr_ = map_ring(ring_fd_, sq_size_, IORING_OFF_SQ_RING);
+    if (!sq_ptr_) {
+        return false;
+    }
+    cq_ptr_ = sq_ptr_;
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(map_ring(ring_fd_, sqes_size_, IORING_OFF_SQES));
+    if (!sqes_) {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool IoUring::setup_buffers(uint16_t group, unsigned count, size_t size) {
+    buf_ring_size_ = count * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    buf_ring_ = static_cast<struct io_uring_buf_ring*>(ring);
+
+    buffers_size_ = count * size;
+    void* buffers = mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        return false;
+    }
+    buffers_ = static_cast<char*>(buffers);
+    buffer_size_ = size;
+    buf_mask_ = count - 1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+
+    for (unsigned bid = 0; bid < count; ++bid) {
+        recycle_buffer(static_cast<uint16_t>(bid));
+    }
+    return true;
+}
+
+struct io_uring_sqe* IoUring::get_sqe() {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) > sq_mask_) {
+        // Full: hand what we have to the kernel without waiting
+        submit_and_wait(0);
+        tail = *sq_tail_;
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) > sq_mask_) {
+            return nullptr;
+        }
+    }
+
+    unsigned index = tail & sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+
+    // Visible to the kernel on the next io_uring_enter()
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++pending_;
+    return sqe;
+}
+
+int IoUring::submit_and_wait(int timeout_ms) {
+    unsigned flags = 0;
+    unsigned wait = 0;
+    if (timeout_ms != 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        wait = 1;
+    }
+
+    int result;
+    if (timeout_ms > 0) {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+        result = sys_io_uring_enter(ring_fd_, pending_, wait, flags | IORING_ENTER_EXT_ARG,
+                                    &arg, sizeof(arg));
+    } else {
+        result = sys_io_uring_enter(ring_fd_, pending_, wait, flags, nullptr, _NSIG / 8);
+    }
+
+    if (result < 0) {
+        return -errno;
+    }
+
+    pending_ -= std::min(pending_, static_cast<unsigned>(result));
+    return result;
+}
+
+struct io_uring_cqe* IoUring::peek_cqe() {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &cqes_[head & cq_mask_];
+}
+
+void IoUring::cqe_seen() {
+    __atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+}
+
+void IoUring::recycle_buffer(uint16_t bid) {
+    // Index the entries by hand: in C++ the header's flexible array
+    // member sits behind an empty struct and is misplaced by 8 bytes
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(buf_ring_) +
+                               (buf_tail_ & buf_mask_);
+    buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf->len = static_cast<uint32_t>(buffer_size_);
+    buf->bid = bid;
+
+    ++buf_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,120 @@
+// MIT License
+// Multi-threaded Chat System - io_uring Ring Header
+// Copyright (c) 2025
+
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Minimal io_uring instance driven through the raw syscalls
+ * (no liburing): one submission/completion ring pair plus one
+ * provided-buffer ring that multishot receives pick buffers from
+ *
+ * Not thread-safe; owned and used by a single event loop thread
+ */
+class IoUring {
+public:
+    IoUring();
+
+    /**
+     * Destructor - tears the ring down (cancels outstanding requests)
+     */
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * Whether the running kernel offers everything the server needs:
+     * ring setup, accept/recv/sendmsg/read opcodes, provided buffer
+     * rings and extended wait arguments
+     */
+    static bool supported();
+
+    /**
+     * Create the rings and map them
+     * @param entries Submission queue size (completion queue is 4x)
+     * @return true on success, false on error (errno set)
+     */
+    bool init(unsigned entries);
+
+    /**
+     * Register a provided buffer ring for buffer selection
+     * @param group Buffer group id used in SQEs
+     * @param count Number of buffers (power of two)
+     * @param size Bytes per buffer
+     * @return true on success, false on error (errno set)
+     */
+    bool setup_buffers(uint16_t group, unsigned count, size_t size);
+
+    /**
+     * Next free submission entry, zeroed; submits pending entries to
+     * make room if the queue is full
+     * @return entry, or nullptr if the kernel would not take more
+     */
+    struct io_uring_sqe* get_sqe();
+
+    /**
+     * Submit pending entries and wait for at least one completion
+     * @param timeout_ms Maximum wait (-1 = no limit, 0 = do not wait)
+     * @return number submitted, or -errno (-ETIME on timeout, -EINTR)
+     */
+    int submit_and_wait(int timeout_ms);
+
+    /**
+     * Oldest unconsumed completion, or nullptr
+     */
+    struct io_uring_cqe* peek_cqe();
+
+    /**
+     * Release the completion returned by peek_cqe()
+     */
+    void cqe_seen();
+
+    /**
+     * Bytes of a provided buffer picked by the kernel
+     */
+    char* buffer(uint16_t bid) const { return buffers_ + static_cast<size_t>(bid) * buffer_size_; }
+
+    /**
+     * Hand a provided buffer back to the kernel
+     */
+    void recycle_buffer(uint16_t bid);
+
+private:
+    int ring_fd_;
+    unsigned pending_;              // SQEs filled but not yet submitted
+
+    // Submission ring
+    void* sq_ptr_;
+    size_t sq_size_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned* sq_array_;
+    struct io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    // Completion ring (shares sq_ptr_ with IORING_FEAT_SINGLE_MMAP)
+    void* cq_ptr_;
+    size_t cq_size_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    struct io_uring_cqe* cqes_;
+
+    // Provided buffers
+    struct io_uring_buf_ring* buf_ring_;
+    size_t buf_ring_size_;
+    char* buffers_;
+    size_t buffers_size_;
+    size_t buffer_size_;
+    unsigned buf_mask_;
+    uint16_t buf_tail_;
+};
+
+#endif // URING_H
@@ -0,0 +1,684 @@
+// MIT License
+// Multi-threaded Chat System - io_uring Event Loop Implementation
+// Copyright (c) 2025
+
+#include "uring_loop.h"
+#include "server.h"
+#include "common.h"
+#include "timestamp.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+// Submission queue size; the completion queue is four times larger
+const unsigned RING_ENTRIES = 1024;
+
+// Provided buffers shared by every multishot receive on one loop
+const uint16_t RECV_BUFFER_GROUP = 0;
+const unsigned RECV_BUFFER_COUNT = 512;
+const size_t RECV_BUFFER_BYTES = 4096;
+
+// Frames handed to the kernel per sendmsg request
+const size_t MAX_SEND_BATCH = 64;
+
+// Give up on requests that do not complete while shutting down
+const int DRAIN_TIMEOUT_MS = 1000;
+
+// Request kinds, stored in the top half of user_data
+enum RequestKind : uint8_t {
+    REQ_ACCEPT = 1,
+    REQ_WAKE,
+    REQ_RECV,
+    REQ_SEND,
+    REQ_CANCEL
+};
+
+uint64_t pack_user_data(uint8_t kind, int client_id) {
+    return (static_cast<uint64_t>(kind) << 32) | static_cast<uint32_t>(client_id);
+}
+
+thread_local UringLoop* current_loop = nullptr;
+}
+
+UringLoop::UringLoop(int loop_id, ChatServer* server)
+    : loop_id_(loop_id), server_(server), listen_fd_(-1), local_listen_fd_(-1), wake_fd_(-1), cpu_(-1),
+      wake_value_(0), inflight_(0), draining_(false), detaching_(false), running_(false),
+      timers_(LIVENESS_TICK_MS, ChatTime::monotonic_ms()), wake_pending_(false) {
+}
+
+UringLoop::~UringLoop() {
+    stop();
+
+    // Kept open until now: other loops may still schedule sends after stop()
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
+
+bool UringLoop::start() {
+    if (!ring_.init(RING_ENTRIES)) {
+        LOG_ERROR("io_uring setup failed: " << strerror(errno));
+        return false;
+    }
+
+    if (!ring_.setup_buffers(RECV_BUFFER_GROUP, RECV_BUFFER_COUNT, RECV_BUFFER_BYTES)) {
+        LOG_ERROR("io_uring buffer ring registration failed: " << strerror(errno));
+        return false;
+    }
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        LOG_ERROR("eventfd failed: " << strerror(errno));
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&UringLoop::run, this);
+    return true;
+}
+
+void UringLoop::stop() {
+    if (running_.exchange(false)) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARN("Failed to wake io_uring loop " << loop_id_ << ": " << strerror(errno));
+        }
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+    // Normally empty after the drain; anything left is cancelled
+    // when the ring is torn down
+    for (auto& pair : sessions_) {
+        if (!pair.second.closing) {
+            pair.second.connection->shutdown();
+            pair.second.handler->on_disconnect();
+        }
+    }
+    sessions_.clear();
+}
+
+void UringLoop::halt() {
+    detaching_ = true;
+    if (running_.exchange(false)) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARN("Failed to wake io_uring loop " << loop_id_ << ": " << strerror(errno));
+        }
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void UringLoop::detach(std::vector<HandoffClient>& clients) {
+    for (auto it = sessions_.begin(); it != sessions_.end();) {
+        Session& session = it->second;
+
+        // Still referenced by the kernel after a drain timeout; stop() closes it
+        if (session.closing || session.inflight > 0) {
+            ++it;
+            continue;
+        }
+
+        HandoffClient client;
+        session.handler->detach(session.inbound, client);
+        client.rooms = server_->rooms_of(it->first);
+
+        // A cancelled sendmsg wrote nothing; what it held goes first
+        for (size_t i = session.iov_done; i < session.iov.size(); ++i) {
+            const char* data = static_cast<const char*>(session.iov[i].iov_base);
+            client.outbound.insert(client.outbound.end(), data, data + session.iov[i].iov_len);
+        }
+        session.connection->take_unsent(client.outbound);
+        clients.push_back(std::move(client));
+
+        // Let go without shutting the socket down
+        it = sessions_.erase(it);
+    }
+}
+
+void UringLoop::schedule_send(Connection& connection) {
+    if (current_loop == this) {
+        ready_.push_back(connection.client_id());
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(remote_mutex_);
+        remote_ready_.push_back(connection.client_id());
+    }
+
+    // One eventfd write per batch of handovers
+    if (wake_pending_.exchange(true)) {
+        return;
+    }
+
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_WARN("Failed to wake io_uring loop " << loop_id_ << ": " << strerror(errno));
+    }
+}
+
+void UringLoop::run() {
+    current_loop = this;
+
+    if (cpu_ >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu_, &cpus);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error != 0) {
+            LOG_WARN("Failed to pin io_uring loop " << loop_id_ << " to CPU " << cpu_
+                     << ": " << strerror(error));
+        }
+    }
+
+    if (listen_fd_ >= 0) {
+        arm_accept(listen_fd_);
+    }
+    if (local_listen_fd_ >= 0) {
+        arm_accept(local_listen_fd_);
+    }
+    arm_wake();
+
+    // Every loop rejoins its share before any of them is read (see
+    // EventLoop::run)
+    std::vector<int> resumed;
+    for (const HandoffClient& client : adopted_) {
+        resumed.push_back(resume_session(client));
+    }
+    server_->wait_for_resumed();
+    for (size_t i = 0; i < adopted_.size(); ++i) {
+        start_resumed(resumed[i], adopted_[i]);
+    }
+    adopted_.clear();
+
+    while (!draining_ || inflight_ > 0) {
+        if (!running_ && !draining_) {
+            begin_drain();
+        }
+
+        // Every send scheduled while handling the last batch goes
+        // out with the same io_uring_enter()
+        submit_sends();
+
+        // Wake for the next liveness check; a drain stops timing sessions
+        int timeout = draining_ ? DRAIN_TIMEOUT_MS : timers_.timeout_ms(ChatTime::monotonic_ms());
+        int result = ring_.submit_and_wait(timeout);
+        if (result == -ETIME && draining_) {
+            LOG_WARN("io_uring loop " << loop_id_ << " stopped with " << inflight_
+                     << " request(s) outstanding");
+            break;
+        }
+        if (result < 0 && result != -ETIME && result != -EINTR && result != -EBUSY &&
+            result != -EAGAIN) {
+            LOG_ERROR("io_uring_enter failed: " << strerror(-result));
+            break;
+        }
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = ring_.peek_cqe()) != nullptr) {
+            struct io_uring_cqe copy = *cqe;
+            ring_.cqe_seen();
+            handle_completion(copy);
+        }
+
+        if (!draining_) {
+            expire_timers();
+        }
+    }
+
+    current_loop = nullptr;
+}
+
+void UringLoop::handle_completion(const struct io_uring_cqe& cqe) {
+    uint8_t kind = static_cast<uint8_t>(cqe.user_data >> 32);
+    int client_id = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+    // Multishot requests stay in flight until the final completion
+    if (!more) {
+        --inflight_;
+    }
+
+    switch (kind) {
+    case REQ_ACCEPT:
+        on_accept(cqe);
+        if (!more && !draining_) {
+            arm_accept(client_id);
+        }
+        return;
+
+    case REQ_WAKE:
+        // Clear before collecting so a later handover signals again
+        wake_pending_.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lock(remote_mutex_);
+            ready_.insert(ready_.end(), remote_ready_.begin(), remote_ready_.end());
+            remote_ready_.clear();
+        }
+        if (running_ && !draining_) {
+            arm_wake();
+        }
+        return;
+
+    case REQ_CANCEL:
+        return;
+
+    default:
+        break;
+    }
+
+    auto it = sessions_.find(client_id);
+    if (it == sessions_.end()) {
+        if (kind == REQ_RECV && (cqe.flags & IORING_CQE_F_BUFFER)) {
+            ring_.recycle_buffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+
+    Session& session = it->second;
+    if (!more) {
+        --session.inflight;
+    }
+
+    if (kind == REQ_RECV) {
+        on_recv(client_id, session, cqe);
+    } else if (kind == REQ_SEND) {
+        on_send(client_id, session, cqe);
+    }
+
+    // Freed only once the kernel no longer references its buffers
+    if (session.closing && session.inflight == 0) {
+        sessions_.erase(client_id);
+    }
+}
+
+struct io_uring_sqe* UringLoop::prepare(uint8_t kind, int client_id) {
+    struct io_uring_sqe* sqe = ring_.get_sqe();
+    if (!sqe) {
+        return nullptr;
+    }
+
+    sqe->user_data = pack_user_data(kind, client_id);
+    ++inflight_;
+    return sqe;
+}
+
+void UringLoop::arm_accept(int listen_fd) {
+    struct io_uring_sqe* sqe = prepare(REQ_ACCEPT, listen_fd);
+    if (!sqe) {
+        LOG_ERROR("io_uring loop " << loop_id_ << " could not queue accept");
+        return;
+    }
+
+    // One request keeps accepting until it fails or is cancelled
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+void UringLoop::arm_wake() {
+    struct io_uring_sqe* sqe = prepare(REQ_WAKE, -1);
+    if (!sqe) {
+        LOG_ERROR("io_uring loop " << loop_id_ << " could not queue wakeup read");
+        return;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wake_value_);
+    sqe->len = sizeof(wake_value_);
+}
+
+bool UringLoop::arm_recv(int client_id, Session& session) {
+    struct io_uring_sqe* sqe = prepare(REQ_RECV, client_id);
+    if (!sqe) {
+        LOG_ERROR("io_uring loop " << loop_id_ << " could not queue receive for client "
+                  << client_id);
+        return false;
+    }
+
+    // The kernel picks a provided buffer for every chunk it completes
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = session.connection->socket_fd();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    ++session.inflight;
+    return true;
+}
+
+bool UringLoop::arm_send(int client_id, Session& session) {
+    // Draining: whatever is still queued stays with the connection
+    if (session.send_armed || session.closing || draining_) {
+        return true;
+    }
+
+    if (session.iov_done == session.iov.size()) {
+        session.sending.clear();
+        session.iov.clear();
+        session.iov_done = 0;
+
+        if (session.connection->take_queued(session.sending, MAX_SEND_BATCH) == 0) {
+            return true;
+        }
+
+        for (const FrameRef& frame : session.sending) {
+            struct iovec iov;
+            iov.iov_base = const_cast<char*>(frame.data());
+            iov.iov_len = frame.size();
+            session.iov.push_back(iov);
+        }
+    }
+
+    struct io_uring_sqe* sqe = prepare(REQ_SEND, client_id);
+    if (!sqe) {
+        // Still holding the frames; retried after the next completion batch
+        ready_.push_back(client_id);
+        return true;
+    }
+
+    memset(&session.hdr, 0, sizeof(session.hdr));
+    session.hdr.msg_iov = session.iov.data() + session.iov_done;
+    session.hdr.msg_iovlen = session.iov.size() - session.iov_done;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = session.connection->socket_fd();
+    sqe->addr = reinterpret_cast<uint64_t>(&session.hdr);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+
+    session.send_armed = true;
+    ++session.inflight;
+    return true;
+}
+
+void UringLoop::on_accept(const struct io_uring_cqe& cqe) {
+    if (cqe.res < 0) {
+        if (cqe.res != -ECANCELED && cqe.res != -ECONNABORTED && cqe.res != -EINTR) {
+            LOG_ERROR("Accept failed on io_uring loop " << loop_id_ << ": " << strerror(-cqe.res));
+        }
+        return;
+    }
+
+    int client_fd = cqe.res;
+    if (draining_) {
+        close(client_fd);
+        return;
+    }
+
+    // Multishot accept has nowhere to store per-connection addresses
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    memset(&client_addr, 0, sizeof(client_addr));
+    getpeername(client_fd, (struct sockaddr*)&client_addr, &client_addr_len);
+
+    std::shared_ptr<Connection> connection = server_->open_connection(client_fd, client_addr, this);
+    int client_id = connection->client_id();
+
+    Session& session = sessions_[client_id];
+    session.connection = std::move(connection);
+    session.handler.reset(new ClientHandler(session.connection, server_));
+
+    if (!arm_recv(client_id, session)) {
+        close_session(client_id);
+        sessions_.erase(client_id);
+        return;
+    }
+
+    session.timer.id = client_id;
+    if (!check_liveness(session, ChatTime::monotonic_ms())) {
+        close_session(client_id);
+    }
+}
+
+int UringLoop::resume_session(const HandoffClient& client) {
+    std::shared_ptr<Connection> connection = server_->resume_connection(client.socket_fd, this);
+    int client_id = connection->client_id();
+
+    Session& session = sessions_[client_id];
+    session.connection = std::move(connection);
+    session.handler.reset(new ClientHandler(session.connection, server_));
+    session.handler->resume(client);
+    return client_id;
+}
+
+void UringLoop::start_resumed(int client_id, const HandoffClient& client) {
+    auto it = sessions_.find(client_id);
+    if (it == sessions_.end()) {
+        return;
+    }
+    Session& session = it->second;
+
+    // Frames that arrived complete before the handoff run now
+    if (!consume(session, client.inbound.data(), client.inbound.size()) ||
+        !arm_recv(client_id, session)) {
+        close_session(client_id);
+        sessions_.erase(client_id);
+        return;
+    }
+
+    session.timer.id = client_id;
+    if (!check_liveness(session, ChatTime::monotonic_ms())) {
+        close_session(client_id);
+    }
+}
+
+void UringLoop::on_recv(int client_id, Session& session, const struct io_uring_cqe& cqe) {
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+    if (cqe.res > 0) {
+        session.connection->mark_heard(ChatTime::monotonic_ms());
+        uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        bool keep = session.closing || consume(session, ring_.buffer(bid), static_cast<size_t>(cqe.res));
+        ring_.recycle_buffer(bid);
+
+        if (!keep) {
+            close_session(client_id);
+        } else if (!more && !session.closing && !draining_ && !arm_recv(client_id, session)) {
+            close_session(client_id);
+        }
+        return;
+    }
+
+    if (cqe.res == -ENOBUFS) {
+        // Every provided buffer is queued for parsing; they are
+        // recycled by now, so just ask again
+        if (!more && !session.closing && !draining_ && !arm_recv(client_id, session)) {
+            close_session(client_id);
+        }
+        return;
+    }
+
+    if (cqe.res == -ECANCELED && detaching_) {
+        return;     // Kept for the handoff
+    }
+
+    if (cqe.res == 0) {
+        if (session.inbound.buffered() != 0) {
+            LOGF_WARN("Connection closed during receive");
+        }
+    } else if (cqe.res != -ECONNRESET && cqe.res != -ECANCELED && !session.closing) {
+        LOGF_ERROR("Receive failed: {}", strerror(-cqe.res));
+    }
+    close_session(client_id);
+}
+
+void UringLoop::on_send(int client_id, Session& session, const struct io_uring_cqe& cqe) {
+    session.send_armed = false;
+
+    if (cqe.res == -ECANCELED && detaching_) {
+        return;     // Its frames are handed over unsent
+    }
+
+    if (cqe.res < 0) {
+        session.connection->send_failed(-cqe.res);
+        close_session(client_id);
+        return;
+    }
+
+    // Step over fully written entries; a partial one is trimmed in place
+    size_t remaining = static_cast<size_t>(cqe.res);
+    while (remaining > 0 && session.iov_done < session.iov.size()) {
+        struct iovec& iov = session.iov[session.iov_done];
+        if (remaining < iov.iov_len) {
+            iov.iov_base = static_cast<char*>(iov.iov_base) + remaining;
+            iov.iov_len -= remaining;
+            break;
+        }
+        remaining -= iov.iov_len;
+        ++session.iov_done;
+    }
+
+    // Continue with the rest, or whatever was queued meanwhile
+    if (!arm_send(client_id, session)) {
+        close_session(client_id);
+    }
+}
+
+bool UringLoop::consume(Session& session, const char* data, size_t size) {
+    while (size > 0) {
+        size_t copied = session.inbound.append(data, size);
+        data += copied;
+        size -= copied;
+
+        // Dispatch every complete frame; a partial one stays buffered
+        RecvBuffer::Status status;
+        while ((status = session.inbound.next_frame(session.frame)) == RecvBuffer::FRAME) {
+            if (!session.handler->on_frame(session.frame)) {
+                return false;
+            }
+        }
+        if (status == RecvBuffer::INVALID) {
+            LOGF_WARN("Received invalid message");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void UringLoop::submit_sends() {
+    std::vector<int> batch;
+    batch.swap(ready_);
+
+    for (int client_id : batch) {
+        auto it = sessions_.find(client_id);
+        if (it == sessions_.end()) {
+            continue;
+        }
+        if (!arm_send(client_id, it->second)) {
+            close_session(client_id);
+        }
+    }
+}
+
+void UringLoop::close_session(int client_id) {
+    auto it = sessions_.find(client_id);
+    if (it == sessions_.end() || it->second.closing) {
+        return;
+    }
+
+    // Shutting the socket down completes its receive and any send;
+    // the handler deregisters from the server right away
+    Session& session = it->second;
+    session.closing = true;
+    session.connection->shutdown();
+    session.handler->on_disconnect();
+}
+
+bool UringLoop::check_liveness(Session& session, uint64_t now_ms) {
+    uint64_t next_ms = 0;
+    if (!server_->check_liveness(*session.connection, now_ms, next_ms)) {
+        return false;
+    }
+    if (next_ms > 0) {
+        timers_.arm(session.timer, next_ms);
+    }
+    return true;
+}
+
+void UringLoop::expire_timers() {
+    uint64_t now_ms = ChatTime::monotonic_ms();
+    expired_.clear();
+    if (timers_.advance(now_ms, expired_) == 0) {
+        return;
+    }
+
+    for (int client_id : expired_) {
+        auto it = sessions_.find(client_id);
+        if (it == sessions_.end() || it->second.closing) {
+            continue;
+        }
+        if (!check_liveness(it->second, now_ms)) {
+            close_session(client_id);
+        }
+    }
+}
+
+void UringLoop::begin_drain() {
+    draining_ = true;
+
+    // Cancelling by fd only touches this ring's requests, so the
+    // shared Unix listener stays armed in the other loops until theirs
+    for (int listen_fd : {listen_fd_, local_listen_fd_}) {
+        if (listen_fd < 0) {
+            continue;
+        }
+        struct io_uring_sqe* sqe = prepare(REQ_CANCEL, -1);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = listen_fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        }
+    }
+
+    struct io_uring_sqe* sqe = prepare(REQ_CANCEL, -1);
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = wake_fd_;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    }
+
+    if (detaching_) {
+        // Stop reading and writing, but leave the sockets intact
+        for (auto& pair : sessions_) {
+            sqe = prepare(REQ_CANCEL, -1);
+            if (sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = pair.second.connection->socket_fd();
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            }
+        }
+        return;
+    }
+
+    std::vector<int> ids;
+    for (auto& pair : sessions_) {
+        ids.push_back(pair.first);
+    }
+    for (int client_id : ids) {
+        close_session(client_id);
+        auto it = sessions_.find(client_id);
+        if (it != sessions_.end() && it->second.inflight == 0) {
+            sessions_.erase(it);
+        }
+    }
+}
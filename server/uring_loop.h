@@ -0,0 +1,245 @@
+// MIT License
+// Multi-threaded Chat System - io_uring Event Loop Header
+// Copyright (c) 2025
+
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include "protocol.h"
+#include "frame.h"
+#include "recv_buffer.h"
+#include "client_handler.h"
+#include "connection.h"
+#include "frame_buffer.h"
+#include "handoff.h"
+#include "timer_wheel.h"
+#include "uring.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Forward declaration
+class ChatServer;
+
+/**
+ * io_uring reactor running on a single thread (URING mode)
+ *
+ * Accepts with one multishot accept on its own SO_REUSEPORT listener,
+ * reads every connection with a multishot receive that picks buffers
+ * from a shared provided-buffer ring, and writes by collecting every
+ * connection that gained queued frames during a batch of completions
+ * into sendmsg requests submitted together with one io_uring_enter()
+ *
+ * Frames are dispatched to the same ClientHandler the other modes use.
+ * Broadcasts go through the server's client registry; a send to a
+ * connection owned by another loop is handed over and wakes it
+ */
+class UringLoop : public SendScheduler {
+public:
+    /**
+     * Constructor
+     * @param loop_id Index of this loop (for logging)
+     * @param server Pointer to parent server
+     */
+    UringLoop(int loop_id, ChatServer* server);
+
+    /**
+     * Destructor - stops the loop and closes owned sockets
+     */
+    ~UringLoop();
+
+    /**
+     * Set up the ring and start the loop thread
+     * @return true on success, false on error
+     */
+    bool start();
+
+    /**
+     * Stop the loop thread and close all owned connections
+     */
+    void stop();
+
+    /**
+     * Stop the loop thread but leave every connection open (handoff):
+     * cancels each connection's requests instead of shutting it down
+     * Follow with detach(), then stop()
+     */
+    void halt();
+
+    /**
+     * After halt() on every loop: describe every connection for a
+     * handoff and let go of it without closing the socket
+     * @param clients Receives one entry per connection
+     */
+    void detach(std::vector<HandoffClient>& clients);
+
+    /**
+     * Serve connections handed over by a previous process (call before start)
+     * @param clients Their sockets are owned by the loop from here on
+     */
+    void adopt(std::vector<HandoffClient> clients) { adopted_ = std::move(clients); }
+
+    /**
+     * Accept connections from a listening socket (call before start)
+     * @param listen_fd Listening socket; the loop closes it
+     */
+    void set_listener(int listen_fd) { listen_fd_ = listen_fd; }
+
+    /**
+     * Shard listener, -1 if none
+     */
+    int listener() const { return listen_fd_; }
+
+    /**
+     * Also accept from a listener every loop shares (call before start)
+     * @param listen_fd Unix socket listener, or -1; the server closes it
+     */
+    void set_local_listener(int listen_fd) { local_listen_fd_ = listen_fd; }
+
+    /**
+     * Pin the loop thread to a CPU (call before start)
+     * @param cpu CPU index, or -1 for no pinning
+     */
+    void set_cpu(int cpu) { cpu_ = cpu; }
+
+    /**
+     * Queue a connection for the next batched submission
+     * Thread-safe; called by Connection::send()
+     */
+    void schedule_send(Connection& connection) override;
+
+private:
+    /**
+     * Per-connection state; lives until its last request completes
+     */
+    struct Session {
+        std::shared_ptr<Connection> connection;
+        std::unique_ptr<ClientHandler> handler;
+        RecvBuffer inbound;                 // Received, unparsed bytes
+        Frame frame;                        // Last decoded frame
+        unsigned inflight = 0;              // Requests not yet completed
+        bool closing = false;
+
+        // The one sendmsg in flight; frames stay referenced until it completes
+        std::vector<FrameRef> sending;
+        std::vector<struct iovec> iov;
+        size_t iov_done = 0;                // Entries fully written
+        struct msghdr hdr;
+        bool send_armed = false;
+
+        TimerWheel::Timer timer;            // Next liveness check
+    };
+
+    /**
+     * Main thread function - submits requests and dispatches completions
+     */
+    void run();
+
+    /**
+     * Dispatch one completion
+     */
+    void handle_completion(const struct io_uring_cqe& cqe);
+
+    /**
+     * Queue a request; counts it as in flight
+     * @return entry to fill, or nullptr if the ring is full
+     */
+    struct io_uring_sqe* prepare(uint8_t kind, int client_id);
+
+    /**
+     * Start a multishot accept; the listener rides in the client_id
+     * half of user_data so its completion knows what to re-arm
+     */
+    void arm_accept(int listen_fd);
+    void arm_wake();
+    bool arm_recv(int client_id, Session& session);
+
+    /**
+     * Start a sendmsg with whatever the connection has queued
+     * (or the unwritten rest of the previous one)
+     * @return false if the connection should be closed
+     */
+    bool arm_send(int client_id, Session& session);
+
+    void on_accept(const struct io_uring_cqe& cqe);
+    void on_recv(int client_id, Session& session, const struct io_uring_cqe& cqe);
+    void on_send(int client_id, Session& session, const struct io_uring_cqe& cqe);
+
+    /**
+     * Parse and dispatch every complete frame in bytes just received
+     * @return false if the connection should be closed
+     */
+    bool consume(Session& session, const char* data, size_t size);
+
+    /**
+     * Submit sends for every connection scheduled since the last call
+     */
+    void submit_sends();
+
+    /**
+     * Shut a connection down and deregister it from the server;
+     * the session is freed once its last request completes
+     */
+    void close_session(int client_id);
+
+    /**
+     * Run the server's liveness check and re-arm the session's timer
+     * @return false if the connection should be closed
+     */
+    bool check_liveness(Session& session, uint64_t now_ms);
+
+    /**
+     * Check every session whose timer came due
+     */
+    void expire_timers();
+
+    /**
+     * Cancel the listener and wake requests and close all sessions
+     * (or, when detaching, cancel their requests and keep them)
+     */
+    void begin_drain();
+
+    /**
+     * Rejoin a connection handed over by a previous process
+     * @return its client ID
+     */
+    int resume_session(const HandoffClient& client);
+
+    /**
+     * Start reading a resumed connection: run the frames it had
+     * buffered, then post its receive
+     */
+    void start_resumed(int client_id, const HandoffClient& client);
+
+    int loop_id_;
+    ChatServer* server_;
+    IoUring ring_;
+    int listen_fd_;                 // Shard listener (-1 if none)
+    int local_listen_fd_;           // Shared Unix socket listener (-1 if none)
+    int wake_fd_;                   // eventfd read through the ring
+    int cpu_;                       // CPU to pin to (-1 = unpinned)
+    uint64_t wake_value_;           // Target of the pending eventfd read
+    unsigned inflight_;             // Requests not yet completed, all kinds
+    bool draining_;
+    std::atomic<bool> detaching_;   // Drain for a handoff: sessions stay open
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+
+    std::unordered_map<int, Session> sessions_;     // client_id -> Session, loop thread only
+    std::vector<HandoffClient> adopted_;            // Resumed when the loop thread starts
+    std::vector<int> ready_;                        // Scheduled from the loop thread
+    TimerWheel timers_;                             // One timer per session, loop thread only
+    std::vector<int> expired_;                      // Scratch for expire_timers()
+
+    std::mutex remote_mutex_;                       // Protects remote_ready_
+    std::vector<int> remote_ready_;                 // Scheduled from other threads
+    std::atomic<bool> wake_pending_;                // wake_fd_ already signalled
+};
+
+#endif // URING_LOOP_H
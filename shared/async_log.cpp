@@ -0,0 +1,418 @@
+// MIT License
+// Multi-threaded Chat System - Asynchronous Logging Implementation
+// Copyright (c) 2025
+
+#include "async_log.h"
+#include "common.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ChatLog {
+
+namespace detail {
+std::atomic<uint8_t> min_level(static_cast<uint8_t>(LogLevel::INFO));
+std::atomic<uint32_t> sample_every(1);
+}
+
+namespace {
+
+const size_t RECORD_HEADER_SIZE = 4 + 8 + 1 + 1 + sizeof(const char*);
+
+/**
+ * One thread's log ring: the owning thread appends, the writer drains
+ * Positions count bytes ever written/consumed; records may wrap
+ */
+struct ThreadBuffer {
+    std::unique_ptr<char[]> data{new char[LOG_BUFFER_SIZE]};
+    alignas(64) std::atomic<uint64_t> head{0};  // Producer: bytes written
+    uint64_t cached_tail = 0;                   // Producer's view of tail
+    std::atomic<bool> appending{false};         // Producer: stop() waits for this to clear
+    alignas(64) std::atomic<uint64_t> tail{0};  // Consumer: bytes drained
+};
+
+std::atomic<bool> g_running(false);
+std::atomic<uint64_t> g_dropped(0);
+
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+
+std::mutex g_writer_mutex;
+std::condition_variable g_writer_cv;
+bool g_stop_requested = false;
+std::thread g_writer;
+int g_flush_interval_ms = 5;
+
+// Serializes synchronous output while the writer is not running
+std::mutex g_sync_mutex;
+
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+ThreadBuffer& local_buffer() {
+    if (!t_buffer) {
+        t_buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        g_buffers.push_back(t_buffer);
+    }
+    return *t_buffer;
+}
+
+/**
+ * Copy into / out of a ring at a position, wrapping at the end
+ */
+void ring_copy_in(char* ring, uint64_t position, const char* data, size_t size) {
+    size_t offset = position & (LOG_BUFFER_SIZE - 1);
+    size_t first = std::min(size, LOG_BUFFER_SIZE - offset);
+    memcpy(ring + offset, data, first);
+    memcpy(ring, data + first, size - first);
+}
+
+void ring_copy_out(const char* ring, uint64_t position, char* data, size_t size) {
+    size_t offset = position & (LOG_BUFFER_SIZE - 1);
+    size_t first = std::min(size, LOG_BUFFER_SIZE - offset);
+    memcpy(data, ring + offset, first);
+    memcpy(data + first, ring, size - first);
+}
+
+template <typename T>
+T load(const char* data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+const char* level_prefix(LogLevel level) {
+    switch (level) {
+    case LogLevel::DEBUG:
+        return ANSI_COLOR_BLUE "[DEBUG] " ANSI_COLOR_RESET;
+    case LogLevel::INFO:
+        return ANSI_COLOR_GREEN "[INFO] " ANSI_COLOR_RESET;
+    case LogLevel::WARN:
+        return ANSI_COLOR_YELLOW "[WARN] " ANSI_COLOR_RESET;
+    case LogLevel::ERROR:
+        return ANSI_COLOR_RED "[ERROR] " ANSI_COLOR_RESET;
+    }
+    return "";
+}
+
+/**
+ * Append the next argument of a record as text
+ * @return bytes of the record it occupied
+ */
+size_t format_arg(const char* arg, std::string& out) {
+    char number[32];
+
+    switch (static_cast<uint8_t>(arg[0])) {
+    case detail::ARG_INT:
+        snprintf(number, sizeof(number), "%lld", static_cast<long long>(load<int64_t>(arg + 1)));
+        out += number;
+        return 1 + 8;
+    case detail::ARG_UINT:
+        snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(load<uint64_t>(arg + 1)));
+        out += number;
+        return 1 + 8;
+    case detail::ARG_DOUBLE:
+        snprintf(number, sizeof(number), "%g", load<double>(arg + 1));
+        out += number;
+        return 1 + 8;
+    default: {
+        uint16_t length = load<uint16_t>(arg + 1);
+        out.append(arg + 3, length);
+        return 3 + length;
+    }
+    }
+}
+
+/**
+ * Turn one encoded record into a line of text
+ */
+void format_record(const char* record, std::string& out) {
+    LogLevel level = static_cast<LogLevel>(record[12]);
+    uint8_t argc = static_cast<uint8_t>(record[13]);
+    const char* format = load<const char*>(record + 14);
+    const char* arg = record + RECORD_HEADER_SIZE;
+
+    out += level_prefix(level);
+    for (const char* p = format; *p; ++p) {
+        if (p[0] == '{' && p[1] == '}' && argc > 0) {
+            arg += format_arg(arg, out);
+            --argc;
+            ++p;
+        } else {
+            out += *p;
+        }
+    }
+    out += '\n';
+}
+
+/**
+ * Drain every ring and write the records in time order
+ */
+void drain() {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        buffers = g_buffers;
+    }
+
+    struct Pending {
+        uint64_t time;
+        size_t offset;
+    };
+    std::vector<char> staging;
+    std::vector<Pending> pending;
+
+    for (auto& buffer : buffers) {
+        uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+
+        while (tail < head) {
+            uint32_t size;
+            ring_copy_out(buffer->data.get(), tail, reinterpret_cast<char*>(&size), sizeof(size));
+
+            size_t offset = staging.size();
+            staging.resize(offset + size);
+            ring_copy_out(buffer->data.get(), tail, staging.data() + offset, size);
+            pending.push_back(Pending{load<uint64_t>(staging.data() + offset + 4), offset});
+            tail += size;
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+    }
+
+    // Records from different threads interleave by the time they were made
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const Pending& a, const Pending& b) { return a.time < b.time; });
+
+    std::string out;
+    std::string err;
+    for (const Pending& record : pending) {
+        const char* data = staging.data() + record.offset;
+        format_record(data, static_cast<LogLevel>(data[12]) == LogLevel::ERROR ? err : out);
+    }
+
+    static uint64_t reported_drops = 0;
+    uint64_t drops = g_dropped.load(std::memory_order_relaxed);
+    if (drops != reported_drops) {
+        out += level_prefix(LogLevel::WARN);
+        out += std::to_string(drops - reported_drops) + " log record(s) dropped, ring full\n";
+        reported_drops = drops;
+    }
+
+    // One write per stream and batch
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    if (!err.empty()) {
+        fwrite(err.data(), 1, err.size(), stderr);
+        fflush(stderr);
+    }
+
+    // Forget rings of threads that have exited once they are empty
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_buffers.erase(std::remove_if(g_buffers.begin(), g_buffers.end(),
+                                   [](const std::shared_ptr<ThreadBuffer>& buffer) {
+                                       return buffer.use_count() == 1 &&
+                                              buffer->tail.load() == buffer->head.load();
+                                   }),
+                    g_buffers.end());
+}
+
+/**
+ * Copy an encoded record into the calling thread's ring, or drop it if full
+ */
+void append(ThreadBuffer& buffer, const char* record, uint32_t size) {
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head + size - buffer.cached_tail > LOG_BUFFER_SIZE) {
+        buffer.cached_tail = buffer.tail.load(std::memory_order_acquire);
+        if (head + size - buffer.cached_tail > LOG_BUFFER_SIZE) {
+            // Never block the caller on the log
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    ring_copy_in(buffer.data.get(), head, record, size);
+    buffer.head.store(head + size, std::memory_order_release);
+}
+
+void writer_loop() {
+    std::unique_lock<std::mutex> lock(g_writer_mutex);
+    while (!g_stop_requested) {
+        g_writer_cv.wait_for(lock, std::chrono::milliseconds(g_flush_interval_ms));
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+} // namespace
+
+namespace detail {
+
+RecordWriter::RecordWriter(LogLevel level, const char* format)
+    : size_(RECORD_HEADER_SIZE), argc_(0) {
+    uint64_t time = now_ns();
+    memcpy(data_ + 4, &time, sizeof(time));
+    data_[12] = static_cast<char>(level);
+    memcpy(data_ + 14, &format, sizeof(format));
+}
+
+void RecordWriter::add(const char* value) {
+    if (!value) {
+        value = "(null)";
+    }
+    add_string(value, strnlen(value, LOG_MAX_STRING));
+}
+
+void RecordWriter::add_number(ArgType type, uint64_t value) {
+    if (size_ + 1 + sizeof(value) > LOG_MAX_RECORD) {
+        return;
+    }
+    data_[size_] = static_cast<char>(type);
+    memcpy(data_ + size_ + 1, &value, sizeof(value));
+    size_ += 1 + sizeof(value);
+    ++argc_;
+}
+
+void RecordWriter::add_string(const char* data, size_t size) {
+    size = std::min(size, LOG_MAX_STRING);
+    if (size_ + 3 + size > LOG_MAX_RECORD) {
+        size = size_ + 3 < LOG_MAX_RECORD ? LOG_MAX_RECORD - size_ - 3 : 0;
+        if (size == 0) {
+            return;
+        }
+    }
+
+    uint16_t length = static_cast<uint16_t>(size);
+    data_[size_] = static_cast<char>(ARG_STRING);
+    memcpy(data_ + size_ + 1, &length, sizeof(length));
+    memcpy(data_ + size_ + 3, data, size);
+    size_ += 3 + size;
+    ++argc_;
+}
+
+void RecordWriter::submit() {
+    uint32_t size = static_cast<uint32_t>(size_);
+    memcpy(data_, &size, sizeof(size));
+    data_[13] = static_cast<char>(argc_);
+
+    if (g_running.load(std::memory_order_acquire)) {
+        ThreadBuffer& buffer = local_buffer();
+
+        // Pairs with stop(): either it sees us appending and waits before
+        // its final drain, or we see it has stopped and write directly
+        buffer.appending.store(true, std::memory_order_seq_cst);
+        if (g_running.load(std::memory_order_seq_cst)) {
+            append(buffer, data_, size);
+            buffer.appending.store(false, std::memory_order_release);
+            return;
+        }
+        buffer.appending.store(false, std::memory_order_relaxed);
+    }
+
+    std::string line;
+    format_record(data_, line);
+    bool error = static_cast<LogLevel>(data_[12]) == LogLevel::ERROR;
+
+    std::lock_guard<std::mutex> lock(g_sync_mutex);
+    FILE* stream = error ? stderr : stdout;
+    fwrite(line.data(), 1, line.size(), stream);
+    fflush(stream);
+}
+
+} // namespace detail
+
+bool start(const LogConfig& config) {
+    std::lock_guard<std::mutex> lock(g_writer_mutex);
+    if (g_running.load()) {
+        return false;
+    }
+
+    set_level(config.level);
+    set_sample_every(config.sample_every);
+    g_flush_interval_ms = std::max(1, config.flush_interval_ms);
+    g_stop_requested = false;
+
+    // Text already buffered by iostreams must come out before async lines
+    std::cout.flush();
+    fflush(stdout);
+
+    g_writer = std::thread(writer_loop);
+    g_running.store(true, std::memory_order_release);
+    return true;
+}
+
+void stop() {
+    {
+        std::lock_guard<std::mutex> lock(g_writer_mutex);
+        if (!g_running.load()) {
+            return;
+        }
+        // Later records are written synchronously
+        g_running.store(false, std::memory_order_seq_cst);
+        g_stop_requested = true;
+    }
+    g_writer_cv.notify_one();
+    g_writer.join();
+
+    // Producers that saw the writer running may still be appending
+    {
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        for (const std::shared_ptr<ThreadBuffer>& buffer : g_buffers) {
+            while (buffer->appending.load(std::memory_order_seq_cst)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Whatever was appended while the writer finished its last pass
+    drain();
+}
+
+bool running() {
+    return g_running.load(std::memory_order_acquire);
+}
+
+void set_level(LogLevel level) {
+    detail::min_level.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+void set_sample_every(uint32_t every) {
+    detail::sample_every.store(std::max<uint32_t>(every, 1), std::memory_order_relaxed);
+}
+
+bool parse_level(const std::string& name, LogLevel& level) {
+    if (name == "debug") {
+        level = LogLevel::DEBUG;
+    } else if (name == "info") {
+        level = LogLevel::INFO;
+    } else if (name == "warn") {
+        level = LogLevel::WARN;
+    } else if (name == "error") {
+        level = LogLevel::ERROR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint64_t dropped() {
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+void log_text(LogLevel level, const std::string& text) {
+    log(level, "{}", text);
+}
+
+} // namespace ChatLog
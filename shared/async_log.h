@@ -0,0 +1,230 @@
+// MIT License
+// Multi-threaded Chat System - Asynchronous Logging
+// Copyright (c) 2025
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/**
+ * Log severities, lowest first
+ */
+enum class LogLevel : uint8_t {
+    DEBUG,
+    INFO,
+    WARN,
+    ERROR
+};
+
+/**
+ * Asynchronous, lock-free logging backend
+ *
+ * A log call encodes a compact binary record: timestamp, level, a
+ * pointer to the (static) format string and the raw arguments. It is
+ * appended to a byte ring owned by the calling thread, with no lock,
+ * allocation or syscall. A background thread drains every ring,
+ * orders the records by time, formats them and writes each batch
+ * with one write() per stream. A record that does not fit in a full
+ * ring is dropped and counted rather than blocking the caller
+ *
+ * Until start() (and after stop()) records are formatted and written
+ * synchronously instead, so tools and tests need no setup
+ *
+ * Format strings use "{}" for each argument, e.g.
+ *   LOGF_INFO("Client {} joined as {}", client_id, username);
+ * Arguments may be integers, floating point, bool, C strings or
+ * std::string; strings are copied (up to LOG_MAX_STRING bytes)
+ */
+namespace ChatLog {
+
+const size_t LOG_BUFFER_SIZE = 64 * 1024;       // Per-thread ring bytes
+const size_t LOG_MAX_RECORD = 2048;             // Largest encoded record
+const size_t LOG_MAX_STRING = 1024;             // Longest string argument kept
+
+/**
+ * Backend settings
+ */
+struct LogConfig {
+    LogLevel level = LogLevel::INFO;    // Records below this are skipped
+    uint32_t sample_every = 1;          // LOGF_SAMPLED keeps 1 in N per call site and thread
+    int flush_interval_ms = 5;          // How often the writer drains the rings
+};
+
+/**
+ * Start the background writer
+ * @return false if it is already running
+ */
+bool start(const LogConfig& config = LogConfig());
+
+/**
+ * Drain every ring, write what is left and stop the writer
+ */
+void stop();
+
+/**
+ * Whether the background writer is running
+ */
+bool running();
+
+/**
+ * Change the minimum level (any time, from any thread)
+ */
+void set_level(LogLevel level);
+
+/**
+ * Change the sampling rate of LOGF_SAMPLED (1 = keep everything)
+ */
+void set_sample_every(uint32_t every);
+
+/**
+ * Parse "debug", "info", "warn" or "error"
+ * @return false if the name is unknown
+ */
+bool parse_level(const std::string& name, LogLevel& level);
+
+/**
+ * Records dropped so far because a thread's ring was full
+ */
+uint64_t dropped();
+
+namespace detail {
+
+extern std::atomic<uint8_t> min_level;
+extern std::atomic<uint32_t> sample_every;
+
+/**
+ * Argument encodings in a record
+ */
+enum ArgType : uint8_t {
+    ARG_INT,        // int64
+    ARG_UINT,       // uint64
+    ARG_DOUBLE,     // double
+    ARG_STRING      // uint16 length + bytes
+};
+
+/**
+ * Encodes one record into a stack buffer
+ * Layout: uint32 size, uint64 time_ns, uint8 level, uint8 argc,
+ *         const char* format, then each argument as a type byte
+ *         followed by its payload
+ */
+class RecordWriter {
+public:
+    RecordWriter(LogLevel level, const char* format);
+
+    void add(const char* value);
+    void add(const std::string& value) { add_string(value.data(), value.size()); }
+    void add(bool value) { add_number(ARG_UINT, static_cast<uint64_t>(value)); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    add(T value) {
+        add_number(ARG_INT, static_cast<uint64_t>(static_cast<int64_t>(value)));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+    add(T value) {
+        add_number(ARG_UINT, static_cast<uint64_t>(value));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type
+    add(T value) {
+        uint64_t bits;
+        double as_double = static_cast<double>(value);
+        memcpy(&bits, &as_double, sizeof(bits));
+        add_number(ARG_DOUBLE, bits);
+    }
+
+    /**
+     * Hand the finished record to the backend
+     */
+    void submit();
+
+private:
+    void add_number(ArgType type, uint64_t value);
+    void add_string(const char* data, size_t size);
+
+    char data_[LOG_MAX_RECORD];
+    size_t size_;
+    uint8_t argc_;
+};
+
+inline void add_all(RecordWriter&) {
+}
+
+template <typename First, typename... Rest>
+void add_all(RecordWriter& writer, const First& first, const Rest&... rest) {
+    writer.add(first);
+    add_all(writer, rest...);
+}
+
+} // namespace detail
+
+/**
+ * Whether records of this level are currently kept
+ */
+inline bool enabled(LogLevel level) {
+    return static_cast<uint8_t>(level) >=
+           detail::min_level.load(std::memory_order_relaxed);
+}
+
+/**
+ * Current LOGF_SAMPLED rate
+ */
+inline uint32_t sample_every() {
+    return detail::sample_every.load(std::memory_order_relaxed);
+}
+
+/**
+ * Log a record (the LOGF_* macros check enabled() first)
+ * @param format Format string; must outlive the process (a literal)
+ */
+template <typename... Args>
+void log(LogLevel level, const char* format, const Args&... args) {
+    detail::RecordWriter writer(level, format);
+    detail::add_all(writer, args...);
+    writer.submit();
+}
+
+/**
+ * Log preformatted text (used by the stream-style LOG_* macros)
+ */
+void log_text(LogLevel level, const std::string& text);
+
+} // namespace ChatLog
+
+#define LOGF_AT(level, ...) \
+    do { \
+        if (ChatLog::enabled(level)) { \
+            ChatLog::log(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOGF_DEBUG(...) LOGF_AT(LogLevel::DEBUG, __VA_ARGS__)
+#define LOGF_INFO(...) LOGF_AT(LogLevel::INFO, __VA_ARGS__)
+#define LOGF_WARN(...) LOGF_AT(LogLevel::WARN, __VA_ARGS__)
+#define LOGF_ERROR(...) LOGF_AT(LogLevel::ERROR, __VA_ARGS__)
+
+/**
+ * Keep one in ChatLog::sample_every() records from this call site
+ * on each thread; for per-message logging left on in production
+ */
+#define LOGF_SAMPLED(level, ...) \
+    do { \
+        if (ChatLog::enabled(level)) { \
+            static thread_local uint32_t log_sample_count_ = 0; \
+            if (log_sample_count_++ % ChatLog::sample_every() == 0) { \
+                ChatLog::log(level, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#endif // ASYNC_LOG_H
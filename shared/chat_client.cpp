@@ -0,0 +1,421 @@
+// MIT License
+// Multi-threaded Chat System - Headless Socket Client Implementation
+// Copyright (c) 2025
+
+#include "chat_client.h"
+#include "common.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+// Host prefix selecting a Unix socket, e.g. "unix:/tmp/chat.sock"
+const char UNIX_ADDRESS_PREFIX[] = "unix:";
+const size_t UNIX_ADDRESS_PREFIX_LEN = sizeof(UNIX_ADDRESS_PREFIX) - 1;
+}
+
+SocketChatClient::SocketChatClient()
+    : socket_fd_(-1), connected_(false), generation_(0), receiving_(false), last_seq_(0),
+      format_(WireFormat::LEGACY), version_(PROTOCOL_VERSION_LEGACY) {
+}
+
+SocketChatClient::~SocketChatClient() {
+    disconnect();
+
+    // A receive thread dropped from its own callback may still be returning from it
+    while (receiving_ && receiver_id_ != std::this_thread::get_id()) {
+        std::this_thread::yield();
+    }
+}
+
+bool SocketChatClient::connect(const std::string& host, int port, const std::string& username,
+                               uint64_t since_seq) {
+    if (connected_) {
+        error_ = "Already connected";
+        return false;
+    }
+
+    // Release what a connection the server closed left behind
+    disconnect();
+    error_.clear();
+    username_ = username;
+
+    if (!open_socket(host, port)) {
+        return false;
+    }
+
+    // Prefer the framed protocol; a legacy server drops the JOIN
+    // frame, so reconnect and fall back to the fixed-size handshake
+    if (!negotiate_framed(since_seq)) {
+        close_socket();
+        if (!open_socket(host, port)) {
+            return false;
+        }
+        format_ = WireFormat::LEGACY;
+        version_ = PROTOCOL_VERSION_LEGACY;
+
+        if (!join_legacy()) {
+            error_ = "Failed to send username";
+            close_socket();
+            return false;
+        }
+    }
+
+    // From here on poll() must never block beyond its timeout;
+    // send_frame() waits for room itself when the send buffer is full
+    if (!ChatUtils::set_nonblocking(socket_fd_)) {
+        error_ = "Failed to make socket non-blocking";
+        close_socket();
+        return false;
+    }
+
+    inbound_.reset();
+    connected_ = true;
+    return true;
+}
+
+bool SocketChatClient::open_socket(const std::string& host, int port) {
+    if (host.compare(0, UNIX_ADDRESS_PREFIX_LEN, UNIX_ADDRESS_PREFIX) == 0) {
+        return open_unix_socket(host.substr(UNIX_ADDRESS_PREFIX_LEN));
+    }
+
+    socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_fd_ < 0) {
+        error_ = std::string("Failed to create socket: ") + strerror(errno);
+        return false;
+    }
+
+    sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr) != 1) {
+        error_ = "Invalid server address: " + host;
+        close_socket();
+        return false;
+    }
+
+    if (::connect(socket_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        error_ = std::string("Failed to connect to server: ") + strerror(errno);
+        close_socket();
+        return false;
+    }
+
+    return true;
+}
+
+bool SocketChatClient::open_unix_socket(const std::string& path) {
+    sockaddr_un server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(server_addr.sun_path)) {
+        error_ = "Invalid Unix socket path: " + path;
+        return false;
+    }
+    memcpy(server_addr.sun_path, path.c_str(), path.size());
+
+    socket_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd_ < 0) {
+        error_ = std::string("Failed to create socket: ") + strerror(errno);
+        return false;
+    }
+
+    if (::connect(socket_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        error_ = std::string("Failed to connect to server: ") + strerror(errno);
+        close_socket();
+        return false;
+    }
+
+    return true;
+}
+
+bool SocketChatClient::negotiate_framed(uint64_t since_seq) {
+    char join[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_join(username_.c_str(), join, PROTOCOL_VERSION_4, since_seq);
+    if (!ChatUtils::send_frame(socket_fd_, join, size)) {
+        return false;
+    }
+
+    Frame reply;
+    const int handshake_timeout_sec = 3;
+    if (!ChatUtils::recv_frame(socket_fd_, reply, handshake_timeout_sec)) {
+        return false;
+    }
+
+    if (reply.format != WireFormat::V2 || reply.type != FrameType::ACK ||
+        reply.version < PROTOCOL_VERSION_2) {
+        return false;
+    }
+
+    // A v2 server acknowledges with 2 and expects text timestamps
+    format_ = reply.version >= PROTOCOL_VERSION_3 ? WireFormat::V3 : WireFormat::V2;
+    version_ = reply.version;
+    return true;
+}
+
+bool SocketChatClient::join_legacy() {
+    Message msg;
+    strncpy(msg.username, username_.c_str(), MAX_USERNAME_LEN - 1);
+    msg.time_ns = ChatTime::now_ns();
+
+    // Servers before protocol v4 take the name from the text
+    strncpy(msg.text, username_.c_str(), MAX_MESSAGE_LEN - 1);
+
+    return ChatUtils::send_message(socket_fd_, msg);
+}
+
+void SocketChatClient::close_socket() {
+    if (socket_fd_ >= 0) {
+        close(socket_fd_);
+        socket_fd_ = -1;
+    }
+}
+
+void SocketChatClient::disconnect() {
+    // Lets the server tell a deliberate exit from a lost connection
+    if (connected_.exchange(false) && version_ >= PROTOCOL_VERSION_4) {
+        char leave[MAX_FRAME_SIZE];
+        write_frame(leave, ChatUtils::encode_leave(leave));
+    }
+    ++generation_;
+
+    // Wakes a receive thread blocked in poll(); it sees end of stream
+    if (socket_fd_ >= 0) {
+        shutdown(socket_fd_, SHUT_RDWR);
+    }
+
+    std::thread receiver;
+    {
+        std::lock_guard<std::mutex> lock(thread_mutex_);
+        if (receive_thread_.joinable()) {
+            if (receive_thread_.get_id() == std::this_thread::get_id()) {
+                // Called from a callback; the loop exits once this returns
+                receive_thread_.detach();
+            } else {
+                receiver = std::move(receive_thread_);
+            }
+        }
+    }
+    if (receiver.joinable()) {
+        receiver.join();
+    }
+
+    close_socket();
+}
+
+bool SocketChatClient::send(const std::string& text, const std::string& room) {
+    if (!connected_) return false;
+
+    if (!room.empty() && format_ != WireFormat::V3) {
+        error_ = "Rooms need protocol v3";
+        return false;
+    }
+
+    Message msg;
+    strncpy(msg.text, text.c_str(), MAX_MESSAGE_LEN - 1);
+    strncpy(msg.room, room.c_str(), MAX_ROOM_LEN - 1);
+
+    if (format_ != WireFormat::LEGACY) {
+        // Username and timestamp are filled in by the server
+        char frame[MAX_FRAME_SIZE];
+        size_t size = ChatUtils::encode_chat(msg, format_, frame);
+        return write_frame(frame, size);
+    }
+
+    // Formatted into the frame by send_message()
+    strncpy(msg.username, username_.c_str(), MAX_USERNAME_LEN - 1);
+    msg.time_ns = ChatTime::now_ns();
+
+    return ChatUtils::send_message(socket_fd_, msg);
+}
+
+bool SocketChatClient::send_direct(const std::string& username, const std::string& text) {
+    if (!connected_) return false;
+
+    if (format_ != WireFormat::V3 || username.empty()) {
+        error_ = username.empty() ? "Empty recipient" : "Direct messages need protocol v3";
+        return false;
+    }
+
+    Message msg;
+    strncpy(msg.recipient, username.c_str(), MAX_USERNAME_LEN - 1);
+    strncpy(msg.text, text.c_str(), MAX_MESSAGE_LEN - 1);
+
+    char frame[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_chat(msg, format_, frame);
+    return write_frame(frame, size);
+}
+
+bool SocketChatClient::subscribe(const std::string& room) {
+    return send_subscription(room, true);
+}
+
+bool SocketChatClient::unsubscribe(const std::string& room) {
+    return send_subscription(room, false);
+}
+
+bool SocketChatClient::send_subscription(const std::string& room, bool subscribe) {
+    if (!connected_) return false;
+
+    if (format_ != WireFormat::V3 || room.empty()) {
+        error_ = room.empty() ? "Empty room name" : "Rooms need protocol v3";
+        return false;
+    }
+
+    char frame[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_subscription(room.c_str(), subscribe, frame);
+    return write_frame(frame, size);
+}
+
+bool SocketChatClient::request_history(uint64_t since_seq) {
+    if (!connected_) return false;
+
+    if (version_ < PROTOCOL_VERSION_4) {
+        error_ = "History requests need protocol v4";
+        return false;
+    }
+
+    char frame[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_history(since_seq, frame);
+    return write_frame(frame, size);
+}
+
+bool SocketChatClient::write_frame(const char* frame, size_t size) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return ChatUtils::send_frame(socket_fd_, frame, size);
+}
+
+int SocketChatClient::poll(int timeout_ms) {
+    if (!connected_) return -1;
+
+    // A callback that disconnects (and maybe connects again) ends this
+    // call before the socket or buffer of the new connection is touched
+    uint64_t generation = generation_;
+    int dispatched = dispatch_buffered(generation);
+    if (dispatched != 0 || generation_ != generation) {
+        return dispatched < 0 ? lost() : dispatched;
+    }
+
+    if (timeout_ms != 0) {
+        struct pollfd pfd;
+        pfd.fd = socket_fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int ready = ::poll(&pfd, 1, timeout_ms);
+        if (ready < 0) {
+            return errno == EINTR ? 0 : lost();
+        }
+        if (ready == 0) {
+            return 0;
+        }
+    }
+
+    // Drain the socket: a short read means nothing more is pending
+    while (generation_ == generation) {
+        size_t wanted = inbound_.writable();
+        ssize_t received = inbound_.fill(socket_fd_);
+
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return lost();
+        }
+
+        if (received == 0) {
+            return lost();
+        }
+
+        int count = dispatch_buffered(generation);
+        if (count < 0) {
+            return lost();
+        }
+        dispatched += count;
+
+        if (static_cast<size_t>(received) < wanted) {
+            break;
+        }
+    }
+
+    return dispatched;
+}
+
+int SocketChatClient::dispatch_buffered(uint64_t generation) {
+    int dispatched = 0;
+
+    while (generation_ == generation) {
+        switch (inbound_.next_frame(frame_)) {
+        case RecvBuffer::FRAME:
+            break;
+        case RecvBuffer::NEED_MORE:
+            return dispatched;
+        case RecvBuffer::INVALID:
+            return -1;
+        }
+
+        // The server checks on a silent client; any answer will do
+        if (frame_.type == FrameType::PING) {
+            char pong[MAX_FRAME_SIZE];
+            if (!write_frame(pong, ChatUtils::encode_heartbeat(false, pong))) {
+                return -1;
+            }
+            continue;
+        }
+        if (frame_.type == FrameType::ERROR) {
+            if (callbacks_.on_error) {
+                callbacks_.on_error(frame_.error, frame_.message.text);
+            }
+            continue;
+        }
+        if (frame_.type != FrameType::CHAT) {
+            continue;
+        }
+
+        if (frame_.message.seq > last_seq_) {
+            last_seq_ = frame_.message.seq;
+        }
+        if (callbacks_.on_message) {
+            callbacks_.on_message(frame_.message);
+        }
+        ++dispatched;
+    }
+    return dispatched;
+}
+
+int SocketChatClient::lost() {
+    if (connected_.exchange(false) && callbacks_.on_disconnected) {
+        callbacks_.on_disconnected();
+    }
+    return -1;
+}
+
+bool SocketChatClient::start() {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (!connected_ || receive_thread_.joinable()) {
+        return false;
+    }
+    if (receiving_) {
+        error_ = "Previous receive thread still running";
+        return false;
+    }
+
+    receiving_ = true;
+    receive_thread_ = std::thread(&SocketChatClient::receive_loop, this, generation_.load());
+    receiver_id_ = receive_thread_.get_id();
+    return true;
+}
+
+void SocketChatClient::receive_loop(uint64_t generation) {
+    while (generation_ == generation && poll(-1) >= 0) {
+    }
+    receiving_ = false;
+}
@@ -0,0 +1,195 @@
+// MIT License
+// Multi-threaded Chat System - Headless Socket Client
+// Copyright (c) 2025
+
+#ifndef CHAT_CLIENT_H
+#define CHAT_CLIENT_H
+
+#include "protocol.h"
+#include "frame.h"
+#include "recv_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Event handlers shared by the headless clients
+ * Each one may be left empty. They run on whichever thread drives the
+ * client: the caller of poll(), or the background thread after start()
+ */
+struct ChatClientCallbacks {
+    std::function<void(const Message&)> on_message;     // Chat message from someone else
+    std::function<void(uint64_t)> on_missed;            // Messages lost (shared memory only)
+    std::function<void()> on_disconnected;              // Peer went away
+    std::function<void(ErrorCode, const std::string&)> on_error;   // Request refused (socket, v4)
+};
+
+/**
+ * Chat client over TCP or a Unix socket, without Qt
+ *
+ * connect() performs the handshake (protocol v4 down to v2, whichever
+ * the server accepts, falling back to the legacy fixed-size frame) and
+ * leaves the socket non-blocking. Incoming
+ * frames are then delivered in one of two ways:
+ *   - poll() on the caller's thread, e.g. from a loop driving many
+ *     clients whose fd() are registered with one epoll instance
+ *   - start(), which runs poll() on a background thread of its own
+ *
+ * A callback may disconnect() and connect() again; the poll() or
+ * receive thread that ran it stops as soon as it returns. A receive
+ * thread left that way still has to finish before start() can run a
+ * new one
+ *
+ * Errors are reported by the return value; error() describes them
+ */
+class SocketChatClient {
+public:
+    SocketChatClient();
+
+    /**
+     * Destructor - stops the receive thread and closes the socket
+     */
+    ~SocketChatClient();
+
+    SocketChatClient(const SocketChatClient&) = delete;
+    SocketChatClient& operator=(const SocketChatClient&) = delete;
+
+    /**
+     * Set the event handlers (before start() or the first poll())
+     */
+    void set_callbacks(const ChatClientCallbacks& callbacks) { callbacks_ = callbacks; }
+
+    /**
+     * Connect and join the chat
+     * @param host Server IPv4 address, or "unix:" and the path of
+     *             the server's Unix socket for a server on this host
+     * @param port Server port (ignored for a Unix socket)
+     * @param username Name to join as
+     * @param since_seq Have the server replay its history from this
+     *                  sequence number first (0 = none); after a
+     *                  reconnect, last_seq() + 1 picks up where it left
+     * @return true once joined
+     */
+    bool connect(const std::string& host, int port, const std::string& username,
+                 uint64_t since_seq = 0);
+
+    /**
+     * Stop the receive thread (if any) and close the connection,
+     * telling a v4 server it was deliberate
+     * on_disconnected is not called for a local disconnect
+     */
+    void disconnect();
+
+    /**
+     * Send a chat message
+     * @param text Message text (truncated to MAX_MESSAGE_LEN - 1)
+     * @param room Room to send to (empty = lobby); needs protocol v3
+     *             and a subscription to the room
+     * @return true if it was written to the socket
+     */
+    bool send(const std::string& text, const std::string& room = "");
+
+    /**
+     * Send a private message to one user (protocol v3 only); it
+     * arrives with Message::recipient set
+     * @param username Addressee (truncated to MAX_USERNAME_LEN - 1)
+     * @param text Message text (truncated to MAX_MESSAGE_LEN - 1)
+     * @return true if it was written to the socket
+     */
+    bool send_direct(const std::string& username, const std::string& text);
+
+    /**
+     * Enter or leave a room (protocol v3 only); messages sent to it
+     * arrive with Message::room set
+     * @param room Room name (truncated to MAX_ROOM_LEN - 1)
+     * @return true if the request was written to the socket
+     */
+    bool subscribe(const std::string& room);
+    bool unsubscribe(const std::string& room);
+
+    /**
+     * Ask for the messages sent before this client joined, from a
+     * sequence number on (protocol v4 only); they arrive like any
+     * other message, older than those already received
+     * @param since_seq First sequence number wanted
+     * @return true if the request was written to the socket
+     */
+    bool request_history(uint64_t since_seq);
+
+    /**
+     * Receive and dispatch whatever has arrived
+     * Frames already buffered are dispatched without a syscall
+     * @param timeout_ms Maximum wait for data (0 = don't wait, -1 = no limit)
+     * @return messages dispatched, or -1 once the connection is gone
+     */
+    int poll(int timeout_ms);
+
+    /**
+     * Run poll() on a background thread until disconnect()
+     * @return false if not connected, already started, or the receive
+     *         thread of a connection dropped from its own callback is
+     *         still running
+     */
+    bool start();
+
+    bool connected() const { return connected_; }
+    int fd() const { return socket_fd_; }
+    WireFormat wire_format() const { return format_; }
+    uint8_t version() const { return version_; }
+    const std::string& error() const { return error_; }
+
+    /**
+     * Sequence number of the newest message received (0 = none, or
+     * a server older than protocol v3); kept across reconnects
+     */
+    uint64_t last_seq() const { return last_seq_; }
+
+private:
+    bool open_socket(const std::string& host, int port);
+    bool open_unix_socket(const std::string& path);
+    bool negotiate_framed(uint64_t since_seq);
+    bool join_legacy();
+    bool send_subscription(const std::string& room, bool subscribe);
+    void close_socket();
+
+    /**
+     * Send one frame; serialized with the PONGs poll() sends back
+     */
+    bool write_frame(const char* frame, size_t size);
+
+    /**
+     * Dispatch every complete buffered frame
+     * @param generation Connection it was called for; stops once it ends
+     * @return messages dispatched, or -1 on a malformed frame
+     */
+    int dispatch_buffered(uint64_t generation);
+
+    /**
+     * Mark the connection lost and tell the callbacks (once)
+     */
+    int lost();
+
+    void receive_loop(uint64_t generation);
+
+    int socket_fd_;
+    std::atomic<bool> connected_;
+    std::atomic<uint64_t> generation_;  // Bumped by disconnect(); ends that connection's poll() and thread
+    std::atomic<bool> receiving_;       // receive_loop() has not returned (it may be detached)
+    std::atomic<uint64_t> last_seq_;
+    std::thread receive_thread_;
+    std::thread::id receiver_id_;
+    std::mutex thread_mutex_;       // receive_thread_, which a callback may detach while start() runs
+    std::mutex send_mutex_;         // One frame on the socket at a time
+    std::string username_;
+    WireFormat format_;
+    uint8_t version_;               // Negotiated protocol version
+    RecvBuffer inbound_;
+    Frame frame_;
+    ChatClientCallbacks callbacks_;
+    std::string error_;
+};
+
+#endif // CHAT_CLIENT_H
@@ -0,0 +1,340 @@
+// MIT License
+// Multi-threaded Chat System - Wire Codec Templates
+// Copyright (c) 2025
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * Compile-time payload schemas
+ *
+ * A payload is declared once as a Schema of fields, each naming the
+ * member it carries by a chain of member pointers:
+ *
+ *   using AckPayload = Codec::Schema<Codec::Int<&Frame::version>>;
+ *   AckPayload::write(frame, out);
+ *   AckPayload::read(data, size, frame);
+ *
+ * and encode, decode and size are generated from that declaration.
+ * Integers go out big-endian whatever the host order, strings as a
+ * length prefix and the bytes (Str) or zero-padded to their array's
+ * full width (Chars). Everything resolves at compile time into
+ * straight-line code: no virtual calls, no tables. A schema whose
+ * fields all have a fixed width is FIXED; its size is a constant and
+ * decoding checks the length once instead of per field
+ *
+ * A field is any type providing
+ *   FIXED, MAX_SIZE                  width is value-independent; largest encoding
+ *   size(owner)                      bytes encode() writes
+ *   encode(owner, char*& out)        write, advancing out
+ *   decode(Reader& in, owner)        read with bounds checks
+ *   decode_fixed(const char*& in, owner)   FIXED only: read unchecked
+ * so special cases are fields too (frame.cpp has two timestamp fields);
+ * a Schema is itself a field, so schemas nest
+ */
+namespace Codec {
+
+/**
+ * Bounds-checked cursor over an encoded payload
+ */
+class Reader {
+public:
+    Reader(const char* data, size_t size) : pos_(data), end_(data + size) {}
+
+    /**
+     * Consume the next bytes
+     * @param size Number of bytes
+     * @param at Set to the first of them
+     * @return false if fewer remain
+     */
+    bool take(size_t size, const char*& at) {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            return false;
+        }
+        at = pos_;
+        pos_ += size;
+        return true;
+    }
+
+    bool at_end() const { return pos_ == end_; }
+
+private:
+    const char* pos_;
+    const char* end_;
+};
+
+/**
+ * Unsigned integer a value travels as (enums by their underlying type)
+ */
+template <typename T, bool = std::is_enum<T>::value>
+struct WireType {
+    using type = std::make_unsigned_t<T>;
+};
+
+template <typename T>
+struct WireType<T, true> {
+    using type = std::make_unsigned_t<std::underlying_type_t<T>>;
+};
+
+/**
+ * Convert between host order and big-endian (the same swap both ways)
+ */
+inline uint8_t big_endian(uint8_t value) { return value; }
+inline uint16_t big_endian(uint16_t value) { return htobe16(value); }
+inline uint32_t big_endian(uint32_t value) { return htobe32(value); }
+inline uint64_t big_endian(uint64_t value) { return htobe64(value); }
+
+// Unaligned access through memcpy compiles to one (byte-swapping) move
+template <typename U>
+inline void put_be(char* out, U value) {
+    value = big_endian(value);
+    memcpy(out, &value, sizeof(U));
+}
+
+template <typename U>
+inline U get_be(const char* in) {
+    U value;
+    memcpy(&value, in, sizeof(U));
+    return big_endian(value);
+}
+
+/**
+ * Follow a member pointer chain: follow(frame, &Frame::message, &Message::seq)
+ */
+template <typename Object>
+constexpr Object& follow(Object& object) {
+    return object;
+}
+
+template <typename Object, typename Member, typename... Rest>
+constexpr auto& follow(Object& object, Member member, Rest... rest) {
+    return follow(object.*member, rest...);
+}
+
+template <typename>
+struct MemberType;
+
+template <typename Class, typename T>
+struct MemberType<T Class::*> {
+    using type = T;
+};
+
+// Type of the member a chain ends at
+template <auto... Path>
+using FieldType = typename MemberType<
+    std::tuple_element_t<sizeof...(Path) - 1, std::tuple<decltype(Path)...>>>::type;
+
+/**
+ * Integer or enum member, big-endian at its own width
+ */
+template <auto... Path>
+struct Int {
+    using Value = FieldType<Path...>;
+    using Wire = typename WireType<Value>::type;
+
+    static constexpr bool FIXED = true;
+    static constexpr size_t MAX_SIZE = sizeof(Wire);
+
+    template <typename Owner>
+    static constexpr size_t size(const Owner&) { return MAX_SIZE; }
+
+    template <typename Owner>
+    static void encode(const Owner& owner, char*& out) {
+        put_be(out, static_cast<Wire>(follow(owner, Path...)));
+        out += MAX_SIZE;
+    }
+
+    template <typename Owner>
+    static void decode_fixed(const char*& in, Owner& owner) {
+        follow(owner, Path...) = static_cast<Value>(get_be<Wire>(in));
+        in += MAX_SIZE;
+    }
+
+    template <typename Owner>
+    static bool decode(Reader& in, Owner& owner) {
+        const char* at = nullptr;
+        if (!in.take(MAX_SIZE, at)) {
+            return false;
+        }
+        decode_fixed(at, owner);
+        return true;
+    }
+};
+
+/**
+ * NUL-terminated char array member sent as a Length-typed byte count
+ * and the bytes; anything that would not fit the array is rejected
+ */
+template <typename Length, auto... Path>
+struct Str {
+    static constexpr size_t CAPACITY = std::extent<FieldType<Path...>>::value;
+    static_assert(CAPACITY > 0, "Str needs a char array member");
+    static_assert(CAPACITY - 1 <= std::numeric_limits<Length>::max(),
+                  "length prefix too narrow for the array");
+
+    static constexpr bool FIXED = false;
+    static constexpr size_t MAX_SIZE = sizeof(Length) + CAPACITY - 1;
+
+    template <typename Owner>
+    static size_t size(const Owner& owner) {
+        return sizeof(Length) + strnlen(follow(owner, Path...), CAPACITY - 1);
+    }
+
+    template <typename Owner>
+    static void encode(const Owner& owner, char*& out) {
+        const char* text = follow(owner, Path...);
+        size_t length = strnlen(text, CAPACITY - 1);
+        put_be(out, static_cast<Length>(length));
+        memcpy(out + sizeof(Length), text, length);
+        out += sizeof(Length) + length;
+    }
+
+    template <typename Owner>
+    static bool decode(Reader& in, Owner& owner) {
+        const char* at = nullptr;
+        if (!in.take(sizeof(Length), at)) {
+            return false;
+        }
+        size_t length = get_be<Length>(at);
+        if (length >= CAPACITY || !in.take(length, at)) {
+            return false;
+        }
+
+        char* text = follow(owner, Path...);
+        memcpy(text, at, length);
+        text[length] = '\0';
+        return true;
+    }
+
+    template <typename Owner>
+    static bool empty(const Owner& owner) { return follow(owner, Path...)[0] == '\0'; }
+};
+
+/**
+ * A string field that must not be empty
+ */
+template <typename Field>
+struct NonEmpty : Field {
+    template <typename Owner>
+    static bool decode(Reader& in, Owner& owner) {
+        return Field::decode(in, owner) && !Field::empty(owner);
+    }
+};
+
+/**
+ * Char array member sent at its full width, zero-padded
+ */
+template <auto... Path>
+struct Chars {
+    static constexpr bool FIXED = true;
+    static constexpr size_t MAX_SIZE = sizeof(FieldType<Path...>);
+
+    template <typename Owner>
+    static constexpr size_t size(const Owner&) { return MAX_SIZE; }
+
+    template <typename Owner>
+    static void encode(const Owner& owner, char*& out) {
+        memcpy(out, follow(owner, Path...), MAX_SIZE);
+        out += MAX_SIZE;
+    }
+
+    template <typename Owner>
+    static void decode_fixed(const char*& in, Owner& owner) {
+        memcpy(follow(owner, Path...), in, MAX_SIZE);
+        in += MAX_SIZE;
+    }
+
+    template <typename Owner>
+    static bool decode(Reader& in, Owner& owner) {
+        const char* at = nullptr;
+        if (!in.take(MAX_SIZE, at)) {
+            return false;
+        }
+        decode_fixed(at, owner);
+        return true;
+    }
+};
+
+/**
+ * Fields in order; itself a field, so schemas nest
+ */
+template <typename... Fields>
+struct Schema {
+    static constexpr bool FIXED = (true && ... && Fields::FIXED);
+    static constexpr size_t MAX_SIZE = (size_t(0) + ... + Fields::MAX_SIZE);
+
+    template <typename Owner>
+    static size_t size(const Owner& owner) {
+        if constexpr (FIXED) {
+            return MAX_SIZE;
+        } else {
+            return (size_t(0) + ... + Fields::size(owner));
+        }
+    }
+
+    template <typename Owner>
+    static void encode(const Owner& owner, char*& out) {
+        (Fields::encode(owner, out), ...);
+    }
+
+    template <typename Owner>
+    static void decode_fixed(const char*& in, Owner& owner) {
+        (Fields::decode_fixed(in, owner), ...);
+    }
+
+    template <typename Owner>
+    static bool decode(Reader& in, Owner& owner) {
+        if constexpr (FIXED) {
+            const char* at = nullptr;
+            if (!in.take(MAX_SIZE, at)) {
+                return false;
+            }
+            decode_fixed(at, owner);
+            return true;
+        } else {
+            return (true && ... && Fields::decode(in, owner));
+        }
+    }
+
+    /**
+     * Encode a whole payload
+     * @param out Buffer of at least MAX_SIZE bytes
+     * @return number of bytes written
+     */
+    template <typename Owner>
+    static size_t write(const Owner& owner, char* out) {
+        char* end = out;
+        encode(owner, end);
+        return static_cast<size_t>(end - out);
+    }
+
+    /**
+     * Decode a whole payload; trailing bytes make it malformed
+     * @return true if it is well-formed
+     */
+    template <typename Owner>
+    static bool read(const char* data, size_t size, Owner& owner) {
+        if constexpr (FIXED) {
+            if (size != MAX_SIZE) {
+                return false;
+            }
+            decode_fixed(data, owner);
+            return true;
+        } else {
+            Reader in(data, size);
+            return decode(in, owner) && in.at_end();
+        }
+    }
+};
+
+} // namespace Codec
+
+#endif // CODEC_H
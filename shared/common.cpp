@@ -4,119 +4,167 @@
 
 #include "common.h"
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/un.h>
+
+namespace {
+
+/**
+ * Wait until the socket is readable
+ * poll() rather than select(), which cannot watch descriptors past
+ * FD_SETSIZE (a process running thousands of clients has them)
+ * @return false on timeout or error
+ */
+bool wait_readable(int socket_fd, int timeout_sec) {
+    struct pollfd pfd;
+    pfd.fd = socket_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int poll_result = poll(&pfd, 1, timeout_sec * 1000);
+
+    if (poll_result < 0) {
+        if (errno != EINTR) {
+            LOG_ERROR("Poll failed: " << strerror(errno));
+        }
+        return false;
+    }
 
-namespace ChatUtils {
+    // 0 means timeout occurred
+    return poll_result > 0;
+}
 
-bool send_message(int socket_fd, const Message& msg) {
+/**
+ * Blocking receive of the next frame through a RecvBuffer
+ * @param exact Read only the bytes the current frame still needs
+ */
+bool recv_buffered(int socket_fd, RecvBuffer& buffer, Frame& frame, int timeout_sec, bool exact) {
     if (socket_fd < 0) {
         LOG_ERROR("Invalid socket descriptor");
         return false;
     }
 
-    const char* data = reinterpret_cast<const char*>(&msg);
-    size_t total_sent = 0;
-    size_t total_size = sizeof(Message);
+    while (true) {
+        switch (buffer.next_frame(frame)) {
+        case RecvBuffer::FRAME:
+            return true;
+        case RecvBuffer::INVALID:
+            LOG_WARN("Received invalid message");
+            return false;
+        case RecvBuffer::NEED_MORE:
+            break;
+        }
 
-    // Send all data, handling partial sends
-    while (total_sent < total_size) {
-        ssize_t sent = send(socket_fd, data + total_sent, 
-                           total_size - total_sent, MSG_NOSIGNAL);
-        
-        if (sent < 0) {
+        // Wait for data if a timeout is specified; re-armed for every
+        // read, so a peer that stalls mid-frame cannot block forever
+        if (timeout_sec > 0 && !wait_readable(socket_fd, timeout_sec)) {
+            return false;
+        }
+
+        ssize_t received = buffer.fill(socket_fd, exact ? buffer.missing() : 0);
+
+        if (received < 0) {
             if (errno == EINTR) {
                 // Interrupted by signal, retry
                 continue;
             }
-            LOG_ERROR("Send failed: " << strerror(errno));
+            if (errno != ECONNRESET) {
+                LOG_ERROR("Receive failed: " << strerror(errno));
+            }
             return false;
         }
-        
-        if (sent == 0) {
-            LOG_WARN("Connection closed while sending");
+
+        if (received == 0) {
+            // Connection closed by peer
+            if (buffer.buffered() != 0) {
+                LOG_WARN("Connection closed during receive");
+            }
             return false;
         }
-        
-        total_sent += sent;
     }
+}
 
-    return true;
+} // namespace
+
+namespace ChatUtils {
+
+bool send_message(int socket_fd, const Message& msg) {
+    char frame[LEGACY_FRAME_SIZE];
+    size_t size = encode_chat(msg, WireFormat::LEGACY, frame);
+    return send_frame(socket_fd, frame, size);
 }
 
-bool recv_message(int socket_fd, Message& msg, int timeout_sec) {
+bool send_frame(int socket_fd, const char* data, size_t total_size) {
     if (socket_fd < 0) {
         LOG_ERROR("Invalid socket descriptor");
         return false;
     }
 
-    // Use select for timeout if specified
-    if (timeout_sec > 0) {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(socket_fd, &read_fds);
-
-        struct timeval timeout;
-        timeout.tv_sec = timeout_sec;
-        timeout.tv_usec = 0;
-
-        int select_result = select(socket_fd + 1, &read_fds, nullptr, nullptr, &timeout);
-        
-        if (select_result < 0) {
-            if (errno != EINTR) {
-                LOG_ERROR("Select failed: " << strerror(errno));
-            }
-            return false;
-        }
-        
-        if (select_result == 0) {
-            // Timeout occurred
-            return false;
-        }
-    }
+    size_t total_sent = 0;
 
-    char* data = reinterpret_cast<char*>(&msg);
-    size_t total_received = 0;
-    size_t total_size = sizeof(Message);
+    // Send all data, handling partial sends
+    while (total_sent < total_size) {
+        ssize_t sent = send(socket_fd, data + total_sent,
+                           total_size - total_sent, MSG_NOSIGNAL);
 
-    // Receive all data, handling partial receives
-    while (total_received < total_size) {
-        ssize_t received = recv(socket_fd, data + total_received, 
-                               total_size - total_received, 0);
-        
-        if (received < 0) {
+        if (sent < 0) {
             if (errno == EINTR) {
                 // Interrupted by signal, retry
                 continue;
             }
-            if (errno != ECONNRESET) {
-                LOG_ERROR("Receive failed: " << strerror(errno));
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Non-blocking socket with a full send buffer, wait for room
+                struct pollfd pfd;
+                pfd.fd = socket_fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR) {
+                    continue;
+                }
             }
+            LOG_ERROR("Send failed: " << strerror(errno));
             return false;
         }
-        
-        if (received == 0) {
-            // Connection closed by peer
-            if (total_received == 0) {
-                // Clean disconnect
-                return false;
-            } else {
-                LOG_WARN("Connection closed during receive");
-                return false;
-            }
+
+        if (sent == 0) {
+            LOG_WARN("Connection closed while sending");
+            return false;
         }
-        
-        total_received += received;
+
+        total_sent += sent;
     }
 
-    // Validate received message
-    if (!msg.is_valid()) {
+    return true;
+}
+
+bool recv_message(int socket_fd, Message& msg, int timeout_sec) {
+    Frame frame;
+    if (!recv_frame(socket_fd, frame, timeout_sec)) {
+        return false;
+    }
+
+    if (frame.format != WireFormat::LEGACY) {
         LOG_WARN("Received invalid message");
         return false;
     }
 
+    msg = frame.message;
     return true;
 }
 
+bool recv_frame(int socket_fd, RecvBuffer& buffer, Frame& frame, int timeout_sec) {
+    return recv_buffered(socket_fd, buffer, frame, timeout_sec, false);
+}
+
+bool recv_frame(int socket_fd, Frame& frame, int timeout_sec) {
+    // No state survives the call, so read exactly up to the frame
+    // boundary and never consume bytes of the next frame
+    RecvBuffer buffer(MAX_FRAME_SIZE);
+    return recv_buffered(socket_fd, buffer, frame, timeout_sec, true);
+}
+
 bool set_nonblocking(int socket_fd) {
     int flags = fcntl(socket_fd, F_GETFL, 0);
     if (flags < 0) {
@@ -147,16 +195,57 @@ bool set_socket_options(int socket_fd) {
         // Not critical, continue
     }
 
-     // Set receive timeout to prevent blocking indefinitely
-    struct timeval rcv_timeout;
-    rcv_timeout.tv_sec = 30;  // 30 second timeout
-    rcv_timeout.tv_usec = 0;
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout)) < 0) {
-        LOG_WARN("Failed to set SO_RCVTIMEO: " << strerror(errno));
-        // Not critical, continue
+    return true;
+}
+
+int listen_unix(const std::string& path, int type, bool replace) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Invalid Unix socket path: " << path);
+        return -1;
     }
+    memcpy(addr.sun_path, path.c_str(), path.size());
 
-    return true;
+    int listen_fd = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        LOG_ERROR("Failed to create Unix socket: " << strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        bool live = false;
+        if (!replace) {
+            int probe = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+            live = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+            if (probe >= 0) {
+                close(probe);
+            }
+        }
+        if (live) {
+            LOG_ERROR("Another server is listening on " << path);
+            close(listen_fd);
+            return -1;
+        }
+        unlink(addr.sun_path);
+    }
+
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("Bind failed for " << path << ": " << strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    if (listen(listen_fd, SOMAXCONN) < 0) {
+        LOG_ERROR("Listen failed: " << strerror(errno));
+        close(listen_fd);
+        unlink(addr.sun_path);
+        return -1;
+    }
+
+    return listen_fd;
 }
 
 } // namespace ChatUtils
@@ -6,7 +6,11 @@
 #define COMMON_H
 
 #include "protocol.h"
+#include "frame.h"
+#include "recv_buffer.h"
+#include "async_log.h"
 #include <iostream>
+#include <sstream>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <sys/select.h>
@@ -20,14 +24,37 @@
 #define ANSI_COLOR_BLUE    "\x1b[34m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
+/**
+ * Stream-style logging: LOG_INFO("Client " << id << " joined")
+ * While the ChatLog writer runs, the text is formatted here and handed
+ * to it (no terminal write on the caller); otherwise it is printed
+ * directly. Hot paths should use the LOGF_* macros from async_log.h,
+ * which defer formatting to the writer as well
+ */
+#define LOG_AT(level, stream, prefix, msg) \
+    do { \
+        if (ChatLog::enabled(level)) { \
+            if (ChatLog::running()) { \
+                std::ostringstream log_text_; \
+                log_text_ << msg; \
+                ChatLog::log_text(level, log_text_.str()); \
+            } else { \
+                stream << prefix << ANSI_COLOR_RESET << msg << std::endl; \
+            } \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(msg) \
+    LOG_AT(LogLevel::DEBUG, std::cout, ANSI_COLOR_BLUE "[DEBUG] ", msg)
+
 #define LOG_INFO(msg) \
-    std::cout << ANSI_COLOR_GREEN << "[INFO] " << ANSI_COLOR_RESET << msg << std::endl
+    LOG_AT(LogLevel::INFO, std::cout, ANSI_COLOR_GREEN "[INFO] ", msg)
 
 #define LOG_WARN(msg) \
-    std::cout << ANSI_COLOR_YELLOW << "[WARN] " << ANSI_COLOR_RESET << msg << std::endl
+    LOG_AT(LogLevel::WARN, std::cout, ANSI_COLOR_YELLOW "[WARN] ", msg)
 
 #define LOG_ERROR(msg) \
-    std::cerr << ANSI_COLOR_RED << "[ERROR] " << ANSI_COLOR_RESET << msg << std::endl
+    LOG_AT(LogLevel::ERROR, std::cerr, ANSI_COLOR_RED "[ERROR] ", msg)
 
 /**
  * Namespace for chat utility functions
@@ -37,6 +64,7 @@ namespace ChatUtils {
 /**
  * Send a complete message over a socket
  * Handles partial sends automatically
+ * On non-blocking sockets, waits for writability instead of failing
  * 
  * @param socket_fd File descriptor of the socket
  * @param msg Message to send
@@ -45,17 +73,53 @@ namespace ChatUtils {
 bool send_message(int socket_fd, const Message& msg);
 
 /**
- * Receive a complete message from a socket
- * Handles partial receives automatically
- * Uses select() for timeout support
+ * Send an already encoded frame over a socket
+ * Handles partial sends automatically
+ *
+ * @param socket_fd File descriptor of the socket
+ * @param data Encoded frame bytes
+ * @param size Number of bytes to send
+ * @return true if the entire frame was sent, false otherwise
+ */
+bool send_frame(int socket_fd, const char* data, size_t size);
+
+/**
+ * Receive a complete legacy message from a socket
+ * The unbuffered recv_frame() path; a frame in any other wire format
+ * is rejected
  * 
  * @param socket_fd File descriptor of the socket
  * @param msg Reference to Message struct to fill
- * @param timeout_sec Timeout in seconds (0 = no timeout)
+ * @param timeout_sec Timeout in seconds for each read (0 = no timeout)
  * @return true if message received successfully, false on error or disconnect
  */
 bool recv_message(int socket_fd, Message& msg, int timeout_sec = 0);
 
+/**
+ * Receive the next frame through a per-connection buffer
+ * Each recv() takes everything the socket has available; frames
+ * already buffered are returned without a syscall
+ *
+ * @param socket_fd File descriptor of the socket
+ * @param buffer Receive buffer owned by the connection
+ * @param frame Reference to Frame to fill
+ * @param timeout_sec Timeout in seconds for each read (0 = no timeout)
+ * @return true if a valid frame was received, false on error or disconnect
+ */
+bool recv_frame(int socket_fd, RecvBuffer& buffer, Frame& frame, int timeout_sec = 0);
+
+/**
+ * Receive one complete frame in either wire format
+ * Legacy and v2 frames are told apart by their first byte.
+ * Unbuffered: reads exactly one frame and nothing beyond it
+ *
+ * @param socket_fd File descriptor of the socket
+ * @param frame Reference to Frame to fill
+ * @param timeout_sec Timeout in seconds for each read (0 = no timeout)
+ * @return true if a valid frame was received, false on error or disconnect
+ */
+bool recv_frame(int socket_fd, Frame& frame, int timeout_sec = 0);
+
 /**
  * Set socket to non-blocking mode
  * 
@@ -74,6 +138,18 @@ bool set_nonblocking(int socket_fd);
  */
 bool set_socket_options(int socket_fd);
 
+/**
+ * Create a non-blocking Unix socket listening at path
+ * A socket file nobody answers on is left over from a process that is
+ * gone and gets replaced; one that accepts belongs to a live process
+ *
+ * @param path Filesystem path to bind
+ * @param type SOCK_STREAM or SOCK_SEQPACKET
+ * @param replace Unlink an existing socket file without probing it
+ * @return socket fd, or -1 on error (also if a live process listens there)
+ */
+int listen_unix(const std::string& path, int type, bool replace);
+
 } // namespace ChatUtils
 
 #endif // COMMON_H
@@ -0,0 +1,274 @@
+// MIT License
+// Multi-threaded Chat System - Wire Framing Implementation
+// Copyright (c) 2025
+
+#include "frame.h"
+#include "codec.h"
+#include <cstring>
+
+namespace {
+
+/**
+ * A legacy frame's timestamp: the text at full width, formatted from
+ * time_ns when the message has none
+ */
+struct LegacyTimestamp : Codec::Chars<&Message::timestamp> {
+    static void encode(const Message& msg, char*& out) {
+        if (msg.timestamp[0] != '\0' || msg.time_ns == 0) {
+            Codec::Chars<&Message::timestamp>::encode(msg, out);
+            return;
+        }
+        memset(out, 0, MAX_TIMESTAMP_LEN);
+        ChatTime::format(msg.time_ns, out);
+        out += MAX_TIMESTAMP_LEN;
+    }
+};
+
+/**
+ * A v2 CHAT's timestamp: length-prefixed text, formatted from time_ns
+ * when the message has none (decodes as a plain string)
+ */
+struct TimestampText : Codec::Str<uint8_t, &Message::timestamp> {
+    static size_t size(const Message& msg) {
+        char formatted[MAX_TIMESTAMP_LEN];
+        return 1 + strnlen(msg.format_timestamp(formatted), MAX_TIMESTAMP_LEN - 1);
+    }
+
+    static void encode(const Message& msg, char*& out) {
+        char formatted[MAX_TIMESTAMP_LEN];
+        const char* timestamp = msg.format_timestamp(formatted);
+        size_t length = strnlen(timestamp, MAX_TIMESTAMP_LEN - 1);
+        *out++ = static_cast<char>(length);
+        memcpy(out, timestamp, length);
+        out += length;
+    }
+};
+
+// Payload schemas, one per layout documented in frame.h
+using Username = Codec::Str<uint8_t, &Message::username>;
+using ChatText = Codec::NonEmpty<Codec::Str<uint16_t, &Message::text>>;
+using RoomName = Codec::NonEmpty<Codec::Str<uint8_t, &Message::room>>;
+
+using LegacyPayload = Codec::Schema<Codec::Chars<&Message::username>, LegacyTimestamp,
+                                    Codec::Chars<&Message::text>>;
+using ChatPayload = Codec::Schema<Username, TimestampText, ChatText>;
+using TimedChatPayload = Codec::Schema<Username, Codec::Int<&Message::seq>,
+                                       Codec::Int<&Message::time_ns>, ChatText>;
+using RoomChatPayload = Codec::Schema<RoomName, TimedChatPayload>;
+using DirectPayload = Codec::Schema<Codec::NonEmpty<Codec::Str<uint8_t, &Message::recipient>>,
+                                    TimedChatPayload>;
+using SubscriptionPayload = Codec::Schema<RoomName>;
+
+using JoinHead = Codec::Schema<Codec::Int<&Frame::version>,
+                               Codec::NonEmpty<Codec::Str<uint8_t, &Frame::message, &Message::username>>>;
+using JoinSince = Codec::Int<&Frame::since_seq>;
+using JoinPayload = Codec::Schema<JoinHead, JoinSince>;
+using AckPayload = Codec::Schema<Codec::Int<&Frame::version>>;
+using EmptyPayload = Codec::Schema<>;
+using HistoryPayload = Codec::Schema<Codec::Int<&Frame::since_seq>>;
+using ErrorPayload = Codec::Schema<Codec::Int<&Frame::error>,
+                                   Codec::Str<uint16_t, &Frame::message, &Message::text>>;
+
+static_assert(LegacyPayload::FIXED && LegacyPayload::MAX_SIZE == LEGACY_FRAME_SIZE,
+              "legacy frames are username, timestamp and text at full width");
+static_assert(FRAME_HEADER_SIZE + JoinPayload::MAX_SIZE <= LEGACY_FRAME_SIZE,
+              "JOIN is padded to a legacy frame");
+static_assert(FRAME_HEADER_SIZE + DirectPayload::MAX_SIZE <= MAX_FRAME_SIZE &&
+              FRAME_HEADER_SIZE + RoomChatPayload::MAX_SIZE <= MAX_FRAME_SIZE &&
+              FRAME_HEADER_SIZE + ChatPayload::MAX_SIZE <= MAX_FRAME_SIZE &&
+              FRAME_HEADER_SIZE + ErrorPayload::MAX_SIZE <= MAX_FRAME_SIZE,
+              "every frame fits MAX_FRAME_SIZE");
+
+/**
+ * Read a TIMED_CHAT, ROOM_CHAT or DIRECT payload; these all decode as
+ * a v3 CHAT
+ */
+template <typename Payload>
+bool read_timed_chat(const char* payload, size_t size, Frame& frame) {
+    frame.format = WireFormat::V3;
+    frame.type = FrameType::CHAT;
+    return Payload::read(payload, size, frame.message);
+}
+
+/**
+ * Write the v2 header once the payload size is known
+ */
+size_t finish_frame(char* out, FrameType type, size_t payload_size) {
+    Codec::put_be(out, static_cast<uint32_t>(1 + payload_size));
+    out[FRAME_LENGTH_SIZE] = static_cast<char>(type);
+    return FRAME_HEADER_SIZE + payload_size;
+}
+
+} // namespace
+
+namespace ChatUtils {
+
+ssize_t frame_size(const char* data, size_t available) {
+    if (available == 0) {
+        return 0;
+    }
+
+    // Legacy frames start with a non-empty username
+    if (data[0] != '\0') {
+        return static_cast<ssize_t>(LEGACY_FRAME_SIZE);
+    }
+
+    if (available < FRAME_LENGTH_SIZE) {
+        return 0;
+    }
+
+    uint32_t length = Codec::get_be<uint32_t>(data);
+    if (length < 1 || FRAME_LENGTH_SIZE + length > MAX_FRAME_SIZE) {
+        return -1;
+    }
+
+    return static_cast<ssize_t>(FRAME_LENGTH_SIZE + length);
+}
+
+bool decode_frame(const char* data, size_t size, Frame& frame) {
+    frame.message.clear();
+    frame.version = 0;
+    frame.since_seq = 0;
+    frame.error = ErrorCode::PROTOCOL;
+
+    if (size == LEGACY_FRAME_SIZE && data[0] != '\0') {
+        frame.format = WireFormat::LEGACY;
+        frame.type = FrameType::CHAT;
+        frame.version = PROTOCOL_VERSION_LEGACY;
+        return LegacyPayload::read(data, size, frame.message) && frame.message.is_valid();
+    }
+
+    if (size < FRAME_HEADER_SIZE || Codec::get_be<uint32_t>(data) != size - FRAME_LENGTH_SIZE) {
+        return false;
+    }
+
+    frame.format = WireFormat::V2;
+    frame.type = static_cast<FrameType>(data[FRAME_LENGTH_SIZE]);
+
+    const char* payload = data + FRAME_HEADER_SIZE;
+    size_t payload_size = size - FRAME_HEADER_SIZE;
+
+    switch (frame.type) {
+    case FrameType::JOIN: {
+        // Trailing padding is allowed (see encode_join); clients that
+        // predate since_seq leave zeros there, which means no replay
+        Codec::Reader in(payload, payload_size);
+        if (!JoinHead::decode(in, frame)) {
+            return false;
+        }
+        JoinSince::decode(in, frame);   // Absent: since_seq stays 0
+        return true;
+    }
+
+    case FrameType::CHAT:
+        return ChatPayload::read(payload, payload_size, frame.message);
+
+    case FrameType::SUBSCRIBE:
+    case FrameType::UNSUBSCRIBE:
+        return SubscriptionPayload::read(payload, payload_size, frame.message);
+
+    case FrameType::ROOM_CHAT:
+        return read_timed_chat<RoomChatPayload>(payload, payload_size, frame);
+
+    case FrameType::DIRECT:
+        return read_timed_chat<DirectPayload>(payload, payload_size, frame);
+
+    case FrameType::TIMED_CHAT:
+        return read_timed_chat<TimedChatPayload>(payload, payload_size, frame);
+
+    case FrameType::ACK:
+        return AckPayload::read(payload, payload_size, frame);
+
+    case FrameType::PING:
+    case FrameType::PONG:
+    case FrameType::LEAVE:
+        return EmptyPayload::read(payload, payload_size, frame);
+
+    case FrameType::HISTORY:
+        return HistoryPayload::read(payload, payload_size, frame);
+
+    case FrameType::ERROR:
+        return ErrorPayload::read(payload, payload_size, frame);
+    }
+
+    return false;
+}
+
+bool opens_session(const Frame& frame) {
+    if (frame.format == WireFormat::LEGACY) {
+        return true;
+    }
+    return frame.type == FrameType::JOIN && frame.version >= PROTOCOL_VERSION_2;
+}
+
+size_t encode_chat(const Message& msg, WireFormat format, char* out) {
+    if (format == WireFormat::LEGACY) {
+        return LegacyPayload::write(msg, out);
+    }
+
+    char* payload = out + FRAME_HEADER_SIZE;
+    if (format == WireFormat::V2) {
+        return finish_frame(out, FrameType::CHAT, ChatPayload::write(msg, payload));
+    }
+    if (msg.recipient[0] != '\0') {
+        return finish_frame(out, FrameType::DIRECT, DirectPayload::write(msg, payload));
+    }
+    if (msg.room[0] != '\0') {
+        return finish_frame(out, FrameType::ROOM_CHAT, RoomChatPayload::write(msg, payload));
+    }
+    return finish_frame(out, FrameType::TIMED_CHAT, TimedChatPayload::write(msg, payload));
+}
+
+size_t encode_join(const char* username, char* out, uint8_t version, uint64_t since_seq) {
+    Frame join;
+    join.version = version;
+    join.since_seq = since_seq;
+    strncpy(join.message.username, username, MAX_USERNAME_LEN - 1);
+
+    char* payload = out + FRAME_HEADER_SIZE;
+    size_t payload_size = LEGACY_FRAME_SIZE - FRAME_HEADER_SIZE;
+    size_t used = JoinPayload::write(join, payload);
+    memset(payload + used, 0, payload_size - used);
+
+    return finish_frame(out, FrameType::JOIN, payload_size);
+}
+
+size_t encode_subscription(const char* room, bool subscribe, char* out) {
+    Message msg;
+    strncpy(msg.room, room, MAX_ROOM_LEN - 1);
+
+    return finish_frame(out, subscribe ? FrameType::SUBSCRIBE : FrameType::UNSUBSCRIBE,
+                        SubscriptionPayload::write(msg, out + FRAME_HEADER_SIZE));
+}
+
+size_t encode_ack(uint8_t version, char* out) {
+    Frame ack;
+    ack.version = version;
+    return finish_frame(out, FrameType::ACK, AckPayload::write(ack, out + FRAME_HEADER_SIZE));
+}
+
+size_t encode_heartbeat(bool ping, char* out) {
+    return finish_frame(out, ping ? FrameType::PING : FrameType::PONG, EmptyPayload::MAX_SIZE);
+}
+
+size_t encode_leave(char* out) {
+    return finish_frame(out, FrameType::LEAVE, EmptyPayload::MAX_SIZE);
+}
+
+size_t encode_history(uint64_t since_seq, char* out) {
+    Frame history;
+    history.since_seq = since_seq;
+    return finish_frame(out, FrameType::HISTORY,
+                        HistoryPayload::write(history, out + FRAME_HEADER_SIZE));
+}
+
+size_t encode_error(ErrorCode error, const char* text, char* out) {
+    Frame refusal;
+    refusal.error = error;
+    strncpy(refusal.message.text, text, MAX_MESSAGE_LEN - 1);
+
+    return finish_frame(out, FrameType::ERROR,
+                        ErrorPayload::write(refusal, out + FRAME_HEADER_SIZE));
+}
+
+} // namespace ChatUtils
@@ -0,0 +1,241 @@
+// MIT License
+// Multi-threaded Chat System - Wire Framing (Protocol v2)
+// Copyright (c) 2025
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "protocol.h"
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * Protocol v2 framing
+ *
+ * Every v2 frame is:
+ *   uint32  length   big-endian, bytes following this field
+ *   uint8   type     FrameType
+ *   ...     payload  type-specific, variable-length fields
+ *
+ * Integers are big-endian; strings are sent as a length followed by
+ * the bytes (no padding). The length field never exceeds
+ * MAX_FRAME_SIZE, so the first byte of a v2 frame is always 0. A
+ * legacy frame is a Message's username, timestamp and text, each
+ * zero-padded to full width (576 bytes), whose first byte is the
+ * first character of a non-empty username, so each frame can be
+ * classified from its first byte. The payloads are declared as
+ * Codec schemas (codec.h) in frame.cpp
+ *
+ * Payloads:
+ *   JOIN        uint8 version, uint8 name_len, name, uint64 since_seq, zero padding
+ *   CHAT        uint8 name_len, name, uint8 ts_len, ts, uint16 text_len, text
+ *   ACK         uint8 version
+ *   TIMED_CHAT  uint8 name_len, name, uint64 seq, uint64 time_ns, uint16 text_len, text
+ *   SUBSCRIBE   uint8 room_len, room
+ *   UNSUBSCRIBE uint8 room_len, room
+ *   ROOM_CHAT   uint8 room_len, room, then the TIMED_CHAT payload
+ *   DIRECT      uint8 to_len, to, then the TIMED_CHAT payload
+ *   PING        (none)
+ *   PONG        (none)
+ *   LEAVE       (none)
+ *   HISTORY     uint64 since_seq
+ *   ERROR       uint8 code, uint16 text_len, text
+ *
+ * The client's JOIN offers the highest version it speaks and the ACK
+ * carries the version the server picked. Version 3 replaces the text
+ * timestamp of CHAT with TIMED_CHAT's binary nanoseconds since the
+ * epoch; the text is produced only for v2 and legacy peers. It also
+ * carries the server's sequence number, which a client hands back as
+ * since_seq when it joins again to have what it missed replayed
+ *
+ * Rooms are a version 3 feature. Every joined client is in the lobby,
+ * which plain CHAT/TIMED_CHAT messages go to; SUBSCRIBE and
+ * UNSUBSCRIBE enter and leave named rooms, and ROOM_CHAT carries a
+ * message for one of them. Room messages are live only: they are not
+ * numbered (seq 0) and not replayed
+ *
+ * DIRECT is a private message to one user, live only as well. The
+ * server looks the addressee up by username and forwards it as DIRECT
+ * to a v3 client; an older client gets it as an ordinary chat message
+ *
+ * Version 4 adds control frames; the encoding is otherwise v3's.
+ * The server sends PING to a client that has been silent for a while
+ * and disconnects it if no traffic follows; the client answers PONG.
+ * Either side may ping, the other always answers. LEAVE ends a
+ * session deliberately, HISTORY asks for the messages from since_seq
+ * up to the client's join, and ERROR tells the client why a request
+ * was refused (the server closes the connection after a fatal one)
+ */
+
+const uint8_t PROTOCOL_VERSION_LEGACY = 1;
+const uint8_t PROTOCOL_VERSION_2 = 2;
+const uint8_t PROTOCOL_VERSION_3 = 3;
+const uint8_t PROTOCOL_VERSION_4 = 4;
+
+const size_t FRAME_LENGTH_SIZE = 4;                         // uint32 length
+const size_t FRAME_HEADER_SIZE = FRAME_LENGTH_SIZE + 1;     // + uint8 type
+const size_t MAX_FRAME_SIZE = 1024;                         // Largest v2 frame
+const size_t LEGACY_FRAME_SIZE = 576;                       // username + timestamp + text
+
+/**
+ * v2 frame types
+ */
+enum class FrameType : uint8_t {
+    JOIN = 1,   // Client -> server: handshake, carries username
+    CHAT = 2,   // Both directions: chat message
+    ACK = 3,        // Server -> client: handshake accepted
+    TIMED_CHAT = 4, // Both directions: chat message with binary time (v3)
+    SUBSCRIBE = 5,  // Client -> server: enter a room (v3)
+    UNSUBSCRIBE = 6,    // Client -> server: leave a room (v3)
+    ROOM_CHAT = 7,  // Both directions: TIMED_CHAT for a room (v3)
+    DIRECT = 8,     // Both directions: TIMED_CHAT for one user (v3)
+    PING = 9,       // Both directions: heartbeat request (v4)
+    PONG = 10,      // Both directions: heartbeat answer (v4)
+    LEAVE = 11,     // Client -> server: end the session (v4)
+    HISTORY = 12,   // Client -> server: replay messages before the join (v4)
+    ERROR = 13      // Server -> client: request refused (v4)
+};
+
+// One past the highest FrameType (sizes per-type tables)
+const size_t FRAME_TYPE_LIMIT = static_cast<size_t>(FrameType::ERROR) + 1;
+
+/**
+ * Reason carried by an ERROR frame
+ */
+enum class ErrorCode : uint8_t {
+    PROTOCOL = 1,   // Frame not allowed here; the connection is closed
+    ROOM = 2,       // SUBSCRIBE refused (already a member, or in too many rooms)
+    RECIPIENT = 3   // DIRECT to a user who is not connected
+};
+
+/**
+ * Encoding used on a connection
+ */
+enum class WireFormat : uint8_t {
+    LEGACY,     // Fixed 576-byte Message
+    V2,         // Length-prefixed variable frames, text timestamps
+    V3          // As V2, chat carries a binary timestamp
+};
+
+// Number of WireFormat values (for per-format frame caches)
+const int WIRE_FORMAT_COUNT = 3;
+
+/**
+ * A decoded frame in either wire format
+ */
+struct Frame {
+    WireFormat format = WireFormat::LEGACY;
+    FrameType type = FrameType::CHAT;   // TIMED_CHAT, ROOM_CHAT and DIRECT decode as CHAT with format V3
+    uint8_t version = 0;        // JOIN/ACK only
+    uint64_t since_seq = 0;     // JOIN, HISTORY: replay history from here (0 = none)
+    ErrorCode error = ErrorCode::PROTOCOL;  // ERROR only
+    Message message;            // JOIN: username, CHAT: all fields, (UN)SUBSCRIBE: room, ERROR: text
+};
+
+namespace ChatUtils {
+
+/**
+ * Determine the size of the frame at the start of a buffer
+ * @param data Buffered bytes
+ * @param available Number of buffered bytes
+ * @return total frame size, 0 if more bytes are needed to tell,
+ *         or -1 if the header is malformed
+ */
+ssize_t frame_size(const char* data, size_t available);
+
+/**
+ * Decode one complete frame (legacy or v2)
+ * @param data Frame bytes
+ * @param size Exact frame size as returned by frame_size()
+ * @param frame Decoded frame
+ * @return true if the frame is well-formed
+ */
+bool decode_frame(const char* data, size_t size, Frame& frame);
+
+/**
+ * Whether a client may open a session with this frame: a legacy
+ * message, or a JOIN offering version 2 or later. Any other v2 or v3
+ * frame (TIMED_CHAT, DIRECT, ...) must not stand in for the handshake
+ * @param frame First frame received from the client
+ */
+bool opens_session(const Frame& frame);
+
+/**
+ * Encode a chat message
+ * LEGACY and V2 need a text timestamp; when msg.timestamp is empty it
+ * is formatted from msg.time_ns here. A V3 message with a recipient
+ * is encoded as DIRECT, one with a room as ROOM_CHAT; the older
+ * formats have neither field
+ * @param msg Message to encode
+ * @param format Wire format to use
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_chat(const Message& msg, WireFormat format, char* out);
+
+/**
+ * Encode a v2 JOIN frame
+ * Padded to LEGACY_FRAME_SIZE so a legacy server reads it as one
+ * (invalid) Message and closes the connection instead of waiting
+ * @param username Username to join as
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @param version Highest protocol version the client speaks
+ * @param since_seq Replay server history from this sequence number (0 = none)
+ * @return number of bytes written
+ */
+size_t encode_join(const char* username, char* out, uint8_t version = PROTOCOL_VERSION_4,
+                   uint64_t since_seq = 0);
+
+/**
+ * Encode a SUBSCRIBE or UNSUBSCRIBE frame
+ * @param room Room name (truncated to MAX_ROOM_LEN - 1)
+ * @param subscribe true to enter the room, false to leave it
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_subscription(const char* room, bool subscribe, char* out);
+
+/**
+ * Encode a v2 ACK frame
+ * @param version Negotiated protocol version
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_ack(uint8_t version, char* out);
+
+/**
+ * Encode a PING or PONG frame
+ * @param ping true for PING, false for PONG
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_heartbeat(bool ping, char* out);
+
+/**
+ * Encode a LEAVE frame
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_leave(char* out);
+
+/**
+ * Encode a HISTORY frame
+ * @param since_seq First sequence number wanted
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_history(uint64_t since_seq, char* out);
+
+/**
+ * Encode an ERROR frame
+ * @param error Reason code
+ * @param text Human-readable detail (truncated to MAX_MESSAGE_LEN - 1)
+ * @param out Buffer of at least MAX_FRAME_SIZE bytes
+ * @return number of bytes written
+ */
+size_t encode_error(ErrorCode error, const char* text, char* out);
+
+} // namespace ChatUtils
+
+#endif // FRAME_H
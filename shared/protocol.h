@@ -5,32 +5,42 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include "timestamp.h"
+#include <cstdint>
 #include <cstring>
 #include <string>
-#include <ctime>
-#include <iomanip>
-#include <sstream>
 #include <arpa/inet.h>
 
 // Protocol constants
 const int MAX_USERNAME_LEN = 32;
 const int MAX_TIMESTAMP_LEN = 32;
 const int MAX_MESSAGE_LEN = 512;
+const int MAX_ROOM_LEN = 32;
 
 /**
  * Message structure for chat protocol
- * Total size: 576 bytes (fixed size for easy serialization)
+ * The legacy wire format is username, timestamp and text at full width;
+ * the fields after them are carried by protocol v3 only. Byte order is
+ * the wire codec's concern (frame.cpp), the struct stays in host order
  */
 struct Message {
     char username[MAX_USERNAME_LEN];      // Username of sender
-    char timestamp[MAX_TIMESTAMP_LEN];    // ISO 8601 timestamp
+    char timestamp[MAX_TIMESTAMP_LEN];    // ISO 8601 timestamp (may be empty if time_ns is set)
     char text[MAX_MESSAGE_LEN];           // Message content
+    uint64_t time_ns;                     // Nanoseconds since the epoch (0 = unknown)
+    uint64_t seq;                         // Server sequence number (0 = none)
+    char room[MAX_ROOM_LEN];              // Room the message is for (empty = lobby)
+    char recipient[MAX_USERNAME_LEN];     // Direct message addressee (empty = not direct)
 
     // Constructor
     Message() {
         memset(username, 0, MAX_USERNAME_LEN);
         memset(timestamp, 0, MAX_TIMESTAMP_LEN);
         memset(text, 0, MAX_MESSAGE_LEN);
+        time_ns = 0;
+        seq = 0;
+        memset(room, 0, MAX_ROOM_LEN);
+        memset(recipient, 0, MAX_USERNAME_LEN);
     }
 
     /**
@@ -38,32 +48,22 @@ struct Message {
      * Format: YYYY-MM-DDTHH:MM:SSZ
      */
     static std::string get_current_timestamp() {
-        std::time_t now = std::time(nullptr);
-        std::tm* utc_time = std::gmtime(&now);
-        
-        std::ostringstream oss;
-        oss << std::put_time(utc_time, "%Y-%m-%dT%H:%M:%SZ");
-        return oss.str();
-    }
-
-    /**
-     * Convert message to network byte order
-     * (Currently no multi-byte integers, but kept for future extensions)
-     */
-    void to_network_order() {
-        // Message structure uses only char arrays
-        // No conversion needed for current implementation
-        // This function is a placeholder for future extensions
+        char text[MAX_TIMESTAMP_LEN];
+        size_t length = ChatTime::format(ChatTime::now_ns(), text);
+        return std::string(text, length);
     }
 
     /**
-     * Convert message from network byte order
-     * (Currently no multi-byte integers, but kept for future extensions)
+     * Human-readable send time: the timestamp text if present,
+     * otherwise time_ns formatted (cached per second)
+     * @param out Buffer of at least MAX_TIMESTAMP_LEN bytes
      */
-    void from_network_order() {
-        // Message structure uses only char arrays
-        // No conversion needed for current implementation
-        // This function is a placeholder for future extensions
+    const char* format_timestamp(char* out) const {
+        if (timestamp[0] != '\0' || time_ns == 0) {
+            return timestamp;
+        }
+        ChatTime::format(time_ns, out);
+        return out;
     }
 
     /**
@@ -102,6 +102,10 @@ struct Message {
         memset(username, 0, MAX_USERNAME_LEN);
         memset(timestamp, 0, MAX_TIMESTAMP_LEN);
         memset(text, 0, MAX_MESSAGE_LEN);
+        time_ns = 0;
+        seq = 0;
+        memset(room, 0, MAX_ROOM_LEN);
+        memset(recipient, 0, MAX_USERNAME_LEN);
     }
 };
 
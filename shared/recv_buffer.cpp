@@ -0,0 +1,85 @@
+// MIT License
+// Multi-threaded Chat System - Buffered Frame Receiver Implementation
+// Copyright (c) 2025
+
+#include "recv_buffer.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+
+RecvBuffer::RecvBuffer(size_t capacity)
+    : capacity_(std::max(capacity, MAX_FRAME_SIZE)), start_(0), end_(0) {
+    data_.reset(new char[capacity_]);
+}
+
+size_t RecvBuffer::writable() const {
+    // Mirrors the compaction decision made by fill()
+    if (start_ == end_ || capacity_ - end_ < MAX_FRAME_SIZE) {
+        return capacity_ - (end_ - start_);
+    }
+    return capacity_ - end_;
+}
+
+void RecvBuffer::compact() {
+    if (start_ == end_) {
+        // Everything parsed; restart at the front for free
+        start_ = end_ = 0;
+    } else if (capacity_ - end_ < MAX_FRAME_SIZE) {
+        // Keep the partial frame, reclaim the parsed prefix
+        memmove(data_.get(), data_.get() + start_, end_ - start_);
+        end_ -= start_;
+        start_ = 0;
+    }
+}
+
+ssize_t RecvBuffer::fill(int socket_fd, size_t max_bytes) {
+    compact();
+
+    size_t space = capacity_ - end_;
+    if (max_bytes > 0 && max_bytes < space) {
+        space = max_bytes;
+    }
+
+    ssize_t received = recv(socket_fd, data_.get() + end_, space, 0);
+    if (received > 0) {
+        end_ += static_cast<size_t>(received);
+    }
+    return received;
+}
+
+size_t RecvBuffer::append(const char* data, size_t size) {
+    compact();
+
+    size_t copied = std::min(size, capacity_ - end_);
+    memcpy(data_.get() + end_, data, copied);
+    end_ += copied;
+    return copied;
+}
+
+RecvBuffer::Status RecvBuffer::next_frame(Frame& frame) {
+    const char* data = data_.get() + start_;
+    size_t available = end_ - start_;
+
+    ssize_t size = ChatUtils::frame_size(data, available);
+    if (size < 0) {
+        return INVALID;
+    }
+    if (size == 0 || static_cast<size_t>(size) > available) {
+        return NEED_MORE;
+    }
+
+    // Decode straight out of the buffer, then consume the bytes
+    bool valid = ChatUtils::decode_frame(data, static_cast<size_t>(size), frame);
+    start_ += static_cast<size_t>(size);
+    return valid ? FRAME : INVALID;
+}
+
+size_t RecvBuffer::missing() const {
+    size_t available = end_ - start_;
+    ssize_t size = ChatUtils::frame_size(data_.get() + start_, available);
+
+    if (size <= 0) {
+        return available < FRAME_LENGTH_SIZE ? FRAME_LENGTH_SIZE - available : 1;
+    }
+    return static_cast<size_t>(size) > available ? static_cast<size_t>(size) - available : 0;
+}
@@ -0,0 +1,108 @@
+// MIT License
+// Multi-threaded Chat System - Buffered Frame Receiver
+// Copyright (c) 2025
+
+#ifndef RECV_BUFFER_H
+#define RECV_BUFFER_H
+
+#include "frame.h"
+#include <cstddef>
+#include <memory>
+#include <sys/types.h>
+
+// Default per-connection receive buffer (holds several frames)
+const size_t DEFAULT_RECV_BUFFER_SIZE = 8192;
+
+/**
+ * Per-connection receive buffer
+ *
+ * fill() reads as much as the socket has available in one recv();
+ * next_frame() then decodes every complete frame directly out of the
+ * buffer. A trailing partial frame stays buffered until the rest
+ * arrives; it is moved to the front only when the free space at the
+ * end can no longer hold a whole frame
+ */
+class RecvBuffer {
+public:
+    /**
+     * Result of next_frame()
+     */
+    enum Status {
+        FRAME,          // A frame was decoded
+        NEED_MORE,      // No complete frame buffered
+        INVALID         // Malformed or invalid frame; close the connection
+    };
+
+    /**
+     * Constructor
+     * @param capacity Buffer size in bytes (at least MAX_FRAME_SIZE)
+     */
+    explicit RecvBuffer(size_t capacity = DEFAULT_RECV_BUFFER_SIZE);
+
+    RecvBuffer(const RecvBuffer&) = delete;
+    RecvBuffer& operator=(const RecvBuffer&) = delete;
+
+    /**
+     * Read from the socket into the free space with a single recv()
+     * @param socket_fd Socket to read from
+     * @param max_bytes Upper bound on bytes to read (0 = all free space)
+     * @return bytes read, 0 on orderly shutdown, -1 on error (see errno)
+     */
+    ssize_t fill(int socket_fd, size_t max_bytes = 0);
+
+    /**
+     * Copy bytes received elsewhere (e.g. an io_uring provided buffer)
+     * into the free space; call next_frame() until NEED_MORE before
+     * appending the rest
+     * @param data Received bytes
+     * @param size Number of bytes
+     * @return bytes copied (at most writable())
+     */
+    size_t append(const char* data, size_t size);
+
+    /**
+     * Decode the next complete frame from the buffer
+     * @param frame Decoded frame
+     */
+    Status next_frame(Frame& frame);
+
+    /**
+     * Discard all buffered bytes (e.g. before reusing on a new socket)
+     */
+    void reset() { start_ = end_ = 0; }
+
+    /**
+     * Bytes still needed to complete the frame at the front
+     * (at least enough to read its header)
+     */
+    size_t missing() const;
+
+    /**
+     * Number of unparsed bytes held
+     */
+    size_t buffered() const { return end_ - start_; }
+
+    /**
+     * First unparsed byte; buffered() bytes are valid from here
+     */
+    const char* unparsed() const { return data_.get() + start_; }
+
+    /**
+     * Bytes the next fill() will ask recv() for (before max_bytes);
+     * a smaller result from fill() means the socket was drained
+     */
+    size_t writable() const;
+
+private:
+    /**
+     * Reclaim the parsed prefix when the tail cannot hold a whole frame
+     */
+    void compact();
+
+    std::unique_ptr<char[]> data_;
+    size_t capacity_;
+    size_t start_;      // First unparsed byte
+    size_t end_;        // One past the last received byte
+};
+
+#endif // RECV_BUFFER_H
@@ -0,0 +1,144 @@
+// MIT License
+// Multi-threaded Chat System - Headless Shared-Memory Client Implementation
+// Copyright (c) 2025
+
+#include "shm_chat_client.h"
+#include <cstring>
+
+ShmChatClient::ShmChatClient()
+    : joined_(false), generation_(0), reading_(false) {
+}
+
+ShmChatClient::~ShmChatClient() {
+    leave();
+
+    // A reader left from its own callback may still be returning from it
+    while (reading_ && reader_id_ != std::this_thread::get_id()) {
+        std::this_thread::yield();
+    }
+}
+
+bool ShmChatClient::join(const std::string& name, const std::string& username,
+                         const ShmRoomOptions& options) {
+    if (joined_) {
+        error_ = "Already joined";
+        return false;
+    }
+
+    error_.clear();
+    username_ = username;
+
+    if (!room_.open(name, options)) {
+        error_ = room_.error();
+        return false;
+    }
+
+    // Replay whatever history the room still retains
+    cursor_ = room_.ring()->oldest();
+    joined_ = true;
+    return true;
+}
+
+void ShmChatClient::leave() {
+    if (!joined_) return;
+
+    ++generation_;
+    joined_ = false;
+
+    // The reader may be asleep on the room's futex
+    room_.ring()->wake_all();
+
+    std::thread reader;
+    {
+        std::lock_guard<std::mutex> lock(thread_mutex_);
+        if (read_thread_.joinable()) {
+            if (read_thread_.get_id() == std::this_thread::get_id()) {
+                // Called from a callback; unmapping under the reader is not safe
+                read_thread_.detach();
+                return;
+            }
+            reader = std::move(read_thread_);
+        }
+    }
+    if (reader.joinable()) {
+        reader.join();
+    }
+
+    room_.close();
+}
+
+bool ShmChatClient::send(const std::string& text) {
+    if (!joined_) return false;
+
+    Message msg;
+    strncpy(msg.username, username_.c_str(), MAX_USERNAME_LEN - 1);
+    ChatTime::format(ChatTime::now_ns(), msg.timestamp);
+    strncpy(msg.text, text.c_str(), MAX_MESSAGE_LEN - 1);
+
+    room_.ring()->publish(msg);
+    return true;
+}
+
+int ShmChatClient::poll(int timeout_ms) {
+    if (!joined_) return -1;
+
+    // A callback that leaves (and maybe joins again) ends this call
+    // before the ring, which join() may have replaced, is touched again
+    uint64_t generation = generation_;
+    int dispatched = drain(generation);
+    if (dispatched == 0 && timeout_ms != 0 && generation_ == generation &&
+        room_.ring()->wait(cursor_, timeout_ms)) {
+        dispatched = drain(generation);
+    }
+    return dispatched;
+}
+
+int ShmChatClient::drain(uint64_t generation) {
+    uint64_t missed = 0;
+    int dispatched = 0;
+
+    ShmRing::Status status;
+    while (generation_ == generation &&
+           (status = room_.ring()->read(cursor_, message_, missed)) != ShmRing::EMPTY) {
+        if (status == ShmRing::OVERRUN) {
+            // Writers lapped this reader; say so instead of skipping silently
+            if (callbacks_.on_missed) {
+                callbacks_.on_missed(missed);
+            }
+            continue;
+        }
+
+        if (strncmp(message_.username, username_.c_str(), MAX_USERNAME_LEN) == 0) {
+            continue;
+        }
+
+        if (callbacks_.on_message) {
+            callbacks_.on_message(message_);
+        }
+        ++dispatched;
+    }
+
+    return dispatched;
+}
+
+bool ShmChatClient::start() {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (!joined_ || read_thread_.joinable()) {
+        return false;
+    }
+    if (reading_) {
+        error_ = "Previous reader still running";
+        return false;
+    }
+
+    reading_ = true;
+    read_thread_ = std::thread(&ShmChatClient::read_loop, this, generation_.load());
+    reader_id_ = read_thread_.get_id();
+    return true;
+}
+
+void ShmChatClient::read_loop(uint64_t generation) {
+    while (generation_ == generation && poll(-1) >= 0) {
+    }
+    reading_ = false;
+}
@@ -0,0 +1,106 @@
+// MIT License
+// Multi-threaded Chat System - Headless Shared-Memory Client
+// Copyright (c) 2025
+
+#ifndef SHM_CHAT_CLIENT_H
+#define SHM_CHAT_CLIENT_H
+
+#include "chat_client.h"
+#include "shm_room.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Chat client for a shared-memory room, without Qt
+ *
+ * Joining replays whatever history the room still retains. Messages
+ * are delivered by poll() on the caller's thread or, after start(),
+ * by a background thread that sleeps on the room's futex while idle.
+ * The client's own messages are not delivered back to it
+ *
+ * A callback may leave() and join() again; the poll() or reader thread
+ * that ran it stops as soon as it returns. A reader thread left that way
+ * still has to finish before start() can run a new one
+ */
+class ShmChatClient {
+public:
+    ShmChatClient();
+
+    /**
+     * Destructor - leaves the room
+     */
+    ~ShmChatClient();
+
+    ShmChatClient(const ShmChatClient&) = delete;
+    ShmChatClient& operator=(const ShmChatClient&) = delete;
+
+    /**
+     * Set the event handlers (before start() or the first poll())
+     */
+    void set_callbacks(const ChatClientCallbacks& callbacks) { callbacks_ = callbacks; }
+
+    /**
+     * Create or join a room
+     * @param name shm_open() name, e.g. "chat_shm"
+     * @param username Name to post as
+     * @param options Layout used if the room does not exist yet
+     * @return true once joined
+     */
+    bool join(const std::string& name, const std::string& username,
+              const ShmRoomOptions& options = ShmRoomOptions());
+
+    /**
+     * Stop the reader thread (if any) and unmap the room
+     */
+    void leave();
+
+    /**
+     * Publish a chat message to the room
+     * @param text Message text (truncated to MAX_MESSAGE_LEN - 1)
+     */
+    bool send(const std::string& text);
+
+    /**
+     * Dispatch every message published since the last call
+     * @param timeout_ms Maximum wait for one (0 = don't wait, -1 = no limit)
+     * @return messages dispatched, or -1 when not joined
+     */
+    int poll(int timeout_ms);
+
+    /**
+     * Run poll() on a background thread until leave()
+     * @return false if not joined, already started, or the reader of
+     *         a session left from its own callback is still running
+     */
+    bool start();
+
+    bool joined() const { return joined_; }
+    ShmRing* ring() const { return room_.ring(); }
+    const std::string& error() const { return error_; }
+
+private:
+    /**
+     * Dispatch everything readable at the cursor
+     * @param generation Session it was called for; stops once it ends
+     */
+    int drain(uint64_t generation);
+
+    void read_loop(uint64_t generation);
+
+    std::string username_;
+    ShmRoom room_;
+    ShmRing::Cursor cursor_;
+    Message message_;
+    std::atomic<bool> joined_;
+    std::atomic<uint64_t> generation_;  // Bumped by leave(); ends that session's poll() and reader
+    std::atomic<bool> reading_;         // read_loop() has not returned (it may be detached)
+    std::thread read_thread_;
+    std::thread::id reader_id_;
+    std::mutex thread_mutex_;           // read_thread_, which a callback may detach while start() runs
+    ChatClientCallbacks callbacks_;
+    std::string error_;
+};
+
+#endif // SHM_CHAT_CLIENT_H
@@ -0,0 +1,401 @@
+// MIT License
+// Multi-threaded Chat System - Shared-Memory Broadcast Ring Implementation
+// Copyright (c) 2025
+
+#include "shm_ring.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+namespace {
+
+// head and tail pack a unit position with a message number
+const unsigned POSITION_BITS = 44;
+const uint64_t POSITION_MASK = (uint64_t(1) << POSITION_BITS) - 1;
+const uint32_t NUMBER_MASK = (uint32_t(1) << (64 - POSITION_BITS)) - 1;
+
+// Marks a record that only fills the gap before the end of the log
+const uint32_t RECORD_PAD = uint32_t(1) << 31;
+
+// Per-record field lengths ahead of the strings
+const size_t PAYLOAD_PREFIX = 4;
+
+// Largest message record; one claim is at most this plus shorter padding
+const uint64_t MAX_RECORD_UNITS =
+    (sizeof(ShmRecordHeader) + PAYLOAD_PREFIX + MAX_USERNAME_LEN - 1 + MAX_TIMESTAMP_LEN - 1 +
+     MAX_MESSAGE_LEN - 1 + SHM_RECORD_UNIT - 1) / SHM_RECORD_UNIT;
+
+uint64_t position_of(uint64_t packed) {
+    return packed & POSITION_MASK;
+}
+
+uint32_t number_of(uint64_t packed) {
+    return static_cast<uint32_t>(packed >> POSITION_BITS);
+}
+
+uint64_t pack(uint64_t position, uint32_t number) {
+    return (position & POSITION_MASK) | (static_cast<uint64_t>(number & NUMBER_MASK) << POSITION_BITS);
+}
+
+// Shared (not FUTEX_PRIVATE_FLAG) so waiters in other processes match
+int futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    return static_cast<int>(syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT,
+                                    expected, timeout_ms < 0 ? nullptr : &timeout, nullptr, 0));
+}
+
+void futex_wake_all(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+}
+
+ShmRing::ShmRing(void* segment)
+    : header_(static_cast<ShmRingHeader*>(segment)),
+      log_(static_cast<char*>(segment) + sizeof(ShmRingHeader)),
+      units_(header_->capacity / SHM_RECORD_UNIT) {
+}
+
+size_t ShmRing::round_capacity(size_t capacity) {
+    size_t rounded = MIN_SHM_RING_CAPACITY;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+size_t ShmRing::segment_size(size_t capacity, bool huge_pages) {
+    size_t size = sizeof(ShmRingHeader) + capacity;
+    if (huge_pages) {
+        size = (size + SHM_HUGE_PAGE_SIZE - 1) / SHM_HUGE_PAGE_SIZE * SHM_HUGE_PAGE_SIZE;
+    }
+    return size;
+}
+
+void ShmRing::initialize(void* segment, size_t capacity, bool huge_pages) {
+    ShmRingHeader* header = static_cast<ShmRingHeader*>(segment);
+    header->magic = SHM_RING_MAGIC;
+    header->capacity = capacity;
+    header->huge_pages = huge_pages ? 1 : 0;
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_relaxed);
+
+    // Joiners read the fields above only after seeing this
+    header->ready.store(1, std::memory_order_release);
+}
+
+ShmRecordHeader* ShmRing::record_at(uint64_t position) const {
+    return reinterpret_cast<ShmRecordHeader*>(log_ + (position & (units_ - 1)) * SHM_RECORD_UNIT);
+}
+
+uint64_t ShmRing::publish(const Message& msg) {
+    size_t bytes = sizeof(ShmRecordHeader) + PAYLOAD_PREFIX +
+                   strnlen(msg.username, MAX_USERNAME_LEN - 1) +
+                   strnlen(msg.timestamp, MAX_TIMESTAMP_LEN - 1) +
+                   strnlen(msg.text, MAX_MESSAGE_LEN - 1);
+    uint64_t units = (bytes + SHM_RECORD_UNIT - 1) / SHM_RECORD_UNIT;
+
+    // Claim space and a message number together; a record never
+    // wraps, so one that would is moved to the start behind padding
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t position;
+    uint64_t pad;
+    uint32_t number;
+    do {
+        position = position_of(head);
+        number = number_of(head);
+        uint64_t offset = position & (units_ - 1);
+        pad = offset + units > units_ ? units_ - offset : 0;
+    } while (!header_->head.compare_exchange_weak(head, pack(position + pad + units, number + 1),
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed));
+
+    uint64_t end = position + pad + units;
+    if (end > units_) {
+        retire(end - units_);
+    }
+
+    if (pad > 0) {
+        write_record(position, pad, number, nullptr);
+    }
+    write_record(position + pad, units, number, &msg);
+
+    // Pairs with wait(): either the reader sees the new stamp, or its
+    // futex_wait sees the bumped word, or we see it counted as waiting
+    header_->wakeups.fetch_add(1, std::memory_order_seq_cst);
+    if (header_->waiters.load(std::memory_order_seq_cst) > 0) {
+        futex_wake_all(header_->wakeups);
+    }
+    return position + pad;
+}
+
+void ShmRing::retire(uint64_t position) {
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    uint64_t stalled_tail = tail;
+    auto stalled_since = std::chrono::steady_clock::now();
+
+    while (position_of(tail) < position) {
+        uint64_t oldest = position_of(tail);
+        ShmRecordHeader* record = record_at(oldest);
+        uint64_t next;
+
+        if (record->sequence.load(std::memory_order_acquire) == 2 * oldest + 2) {
+            // Padding carries the number of the record after it
+            uint32_t number = record->number;
+            uint32_t next_number = (number & RECORD_PAD) ? number : number + 1;
+            next = pack(oldest + record->units, next_number);
+        } else {
+            // Its writer a full lap behind must finish before we overwrite
+            // it, unless it has taken so long that it must have died
+            auto now = std::chrono::steady_clock::now();
+            if (tail != stalled_tail) {
+                stalled_tail = tail;
+                stalled_since = now;
+            }
+            if (now - stalled_since < std::chrono::milliseconds(SHM_WRITER_TIMEOUT_MS)) {
+                std::this_thread::yield();
+                tail = header_->tail.load(std::memory_order_acquire);
+                continue;
+            }
+            next = skip_dead(oldest, number_of(tail));
+        }
+
+        // Fails (and reloads) if another writer retired it first
+        header_->tail.compare_exchange_weak(tail, next, std::memory_order_acq_rel,
+                                            std::memory_order_acquire);
+    }
+}
+
+uint64_t ShmRing::skip_dead(uint64_t position, uint32_t number) const {
+    // The dead writer may not have stamped, let alone sized, its record:
+    // the claim ends where the next stamped record starts
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    uint64_t limit = std::min(position_of(head), position + 2 * MAX_RECORD_UNITS);
+
+    for (uint64_t next = position + 1; next < limit; ++next) {
+        uint64_t stamp = record_at(next)->sequence.load(std::memory_order_acquire);
+        if (stamp == 2 * next + 1 || stamp == 2 * next + 2) {
+            // The claim held one message (and maybe padding before it)
+            return pack(next, number + 1);
+        }
+    }
+
+    // Nothing after it has been written yet: drop every claim up to head
+    return head;
+}
+
+void ShmRing::write_record(uint64_t position, uint64_t units, uint32_t number, const Message* msg) {
+    ShmRecordHeader* record = record_at(position);
+    record->sequence.store(2 * position + 1, std::memory_order_relaxed);
+
+    // Readers that see the odd stamp must not trust the bytes below
+    std::atomic_thread_fence(std::memory_order_release);
+    record->units = static_cast<uint32_t>(units);
+    record->number = (number & NUMBER_MASK) | (msg ? 0 : RECORD_PAD);
+
+    if (msg) {
+        uint8_t username_len = static_cast<uint8_t>(strnlen(msg->username, MAX_USERNAME_LEN - 1));
+        uint8_t timestamp_len = static_cast<uint8_t>(strnlen(msg->timestamp, MAX_TIMESTAMP_LEN - 1));
+        uint16_t text_len = static_cast<uint16_t>(strnlen(msg->text, MAX_MESSAGE_LEN - 1));
+
+        char* payload = reinterpret_cast<char*>(record + 1);
+        payload[0] = static_cast<char>(username_len);
+        payload[1] = static_cast<char>(timestamp_len);
+        memcpy(payload + 2, &text_len, sizeof(text_len));
+        payload += PAYLOAD_PREFIX;
+
+        memcpy(payload, msg->username, username_len);
+        memcpy(payload + username_len, msg->timestamp, timestamp_len);
+        memcpy(payload + username_len + timestamp_len, msg->text, text_len);
+    }
+
+    record->sequence.store(2 * position + 2, std::memory_order_release);
+}
+
+ShmRing::Status ShmRing::read(Cursor& cursor, Record& record, uint64_t& missed) const {
+    while (true) {
+        if (cursor.position < oldest().position) {
+            if (skip_lost(cursor, missed) == OVERRUN) {
+                return OVERRUN;
+            }
+            continue;
+        }
+        if (cursor.position >= newest().position) {
+            return EMPTY;
+        }
+
+        const ShmRecordHeader* header = record_at(cursor.position);
+        uint64_t published = 2 * cursor.position + 2;
+
+        uint64_t before = header->sequence.load(std::memory_order_acquire);
+        if (before < published) {
+            // Claimed, but the writer has not finished copying
+            return EMPTY;
+        }
+        if (before > published) {
+            // Overwritten; tail has moved past it, so go around again
+            if (cursor.position >= oldest().position) {
+                return EMPTY;
+            }
+            continue;
+        }
+
+        uint32_t units = header->units;
+        uint32_t number = header->number;
+        uint64_t offset = cursor.position & (units_ - 1);
+
+        // Only look at the payload of a record that lies within the log
+        size_t username_len = 0;
+        size_t timestamp_len = 0;
+        uint16_t text_len = 0;
+        const unsigned char* payload = reinterpret_cast<const unsigned char*>(header + 1);
+        bool sane = units > 0 && offset + units <= units_;
+        if (sane && !(number & RECORD_PAD)) {
+            username_len = payload[0];
+            timestamp_len = payload[1];
+            memcpy(&text_len, payload + 2, sizeof(text_len));
+
+            size_t bytes = sizeof(ShmRecordHeader) + PAYLOAD_PREFIX +
+                           username_len + timestamp_len + text_len;
+            sane = username_len < MAX_USERNAME_LEN && timestamp_len < MAX_TIMESTAMP_LEN &&
+                   text_len < MAX_MESSAGE_LEN && bytes <= static_cast<size_t>(units) * SHM_RECORD_UNIT;
+        }
+
+        // Fields read under a stamp that changed may be torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+        if (!sane) {
+            return EMPTY;
+        }
+
+        if (number & RECORD_PAD) {
+            cursor.position += units;
+            continue;
+        }
+
+        const char* strings = reinterpret_cast<const char*>(payload + PAYLOAD_PREFIX);
+        record.username = strings;
+        record.username_len = username_len;
+        record.timestamp = strings + username_len;
+        record.timestamp_len = timestamp_len;
+        record.text = strings + username_len + timestamp_len;
+        record.text_len = text_len;
+        record.number = number;
+        record.position = cursor.position;
+        record.next = cursor.position + units;
+        return MESSAGE;
+    }
+}
+
+bool ShmRing::commit(Cursor& cursor, const Record& record) const {
+    // A stamp that changed while the bytes were in use means they may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record_at(record.position)->sequence.load(std::memory_order_relaxed) !=
+        2 * record.position + 2) {
+        return false;
+    }
+
+    cursor.position = record.next;
+    cursor.number = (record.number + 1) & NUMBER_MASK;
+    return true;
+}
+
+ShmRing::Status ShmRing::read(Cursor& cursor, Message& msg, uint64_t& missed) const {
+    Record record;
+
+    while (true) {
+        Status status = read(cursor, record, missed);
+        if (status != MESSAGE) {
+            return status;
+        }
+
+        Message copy;
+        memcpy(copy.username, record.username, record.username_len);
+        memcpy(copy.timestamp, record.timestamp, record.timestamp_len);
+        memcpy(copy.text, record.text, record.text_len);
+
+        if (commit(cursor, record)) {
+            msg = copy;
+            return MESSAGE;
+        }
+    }
+}
+
+bool ShmRing::wait(const Cursor& cursor, int timeout_ms) const {
+    uint32_t seen = header_->wakeups.load(std::memory_order_seq_cst);
+    if (readable(cursor)) {
+        return true;
+    }
+
+    header_->waiters.fetch_add(1, std::memory_order_seq_cst);
+    int result = 0;
+    if (!readable(cursor)) {
+        // Returns at once if a publish bumped the word after we sampled it
+        result = futex_wait(header_->wakeups, seen, timeout_ms);
+    }
+    header_->waiters.fetch_sub(1, std::memory_order_seq_cst);
+
+    if (result < 0 && errno == ETIMEDOUT) {
+        return false;
+    }
+    return readable(cursor);
+}
+
+void ShmRing::wake_all() const {
+    header_->wakeups.fetch_add(1, std::memory_order_seq_cst);
+    futex_wake_all(header_->wakeups);
+}
+
+ShmRing::Cursor ShmRing::oldest() const {
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+
+    Cursor cursor;
+    cursor.position = position_of(tail);
+    cursor.number = number_of(tail);
+    return cursor;
+}
+
+ShmRing::Cursor ShmRing::newest() const {
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+
+    Cursor cursor;
+    cursor.position = position_of(head);
+    cursor.number = number_of(head);
+    return cursor;
+}
+
+bool ShmRing::readable(const Cursor& cursor) const {
+    if (cursor.position < oldest().position) {
+        return true;
+    }
+    if (cursor.position >= newest().position) {
+        return false;
+    }
+
+    // Claimed records only count once their writer has finished
+    return record_at(cursor.position)->sequence.load(std::memory_order_acquire) ==
+           2 * cursor.position + 2;
+}
+
+ShmRing::Status ShmRing::skip_lost(Cursor& cursor, uint64_t& missed) const {
+    Cursor resume = oldest();
+    if (resume.position <= cursor.position) {
+        return EMPTY;
+    }
+
+    // Lost padding alone is not worth reporting
+    missed = (resume.number - cursor.number) & NUMBER_MASK;
+    cursor = resume;
+    return missed > 0 ? OVERRUN : EMPTY;
+}
@@ -0,0 +1,245 @@
+// MIT License
+// Multi-threaded Chat System - Shared-Memory Broadcast Ring
+// Copyright (c) 2025
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include "protocol.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Log bytes of a shared-memory room unless the creator asks otherwise
+const size_t DEFAULT_SHM_RING_CAPACITY = 1 << 20;
+
+// Smallest log a room can be created with (holds several records)
+const size_t MIN_SHM_RING_CAPACITY = 4096;
+
+// Records are padded to, and positions counted in, units of this size
+const size_t SHM_RECORD_UNIT = 16;
+
+// Mapping granularity when a room is backed by huge pages
+const size_t SHM_HUGE_PAGE_SIZE = 2 << 20;
+
+// A record still unfinished this long after the writers lap it is
+// taken to belong to a writer that died, and is dropped
+const int SHM_WRITER_TIMEOUT_MS = 200;
+
+// Identifies a segment laid out by this version of ShmRing
+const uint32_t SHM_RING_MAGIC = 0x43485232;     // "CHR2"
+
+/**
+ * Header of every record in the log
+ * sequence is 2p+1 while the record at unit position p is being
+ * written and 2p+2 once it is published; readers compare it before
+ * and after using the bytes (a per-record seqlock)
+ */
+struct ShmRecordHeader {
+    std::atomic<uint64_t> sequence;
+    uint32_t units;             // Whole record, header included
+    uint32_t number;            // Message number (low 20 bits), top bit marks padding
+};
+
+static_assert(sizeof(ShmRecordHeader) == SHM_RECORD_UNIT,
+              "a padding record must fit in the smallest gap");
+
+/**
+ * Layout of the start of the shared segment; the log follows it
+ */
+struct ShmRingHeader {
+    uint32_t magic;                             // SHM_RING_MAGIC once created
+    std::atomic<uint32_t> ready;                // Set last by the creator
+    uint64_t capacity;                          // Log bytes (power of two)
+    uint32_t huge_pages;                        // Creator asked for huge pages
+    alignas(64) std::atomic<uint64_t> head;     // Next free unit | message number << 44
+    alignas(64) std::atomic<uint64_t> tail;     // Oldest retained unit | its message number << 44
+    alignas(64) std::atomic<uint32_t> wakeups;  // Futex word, bumped after each publish
+    std::atomic<uint32_t> waiters;              // Readers blocked on wakeups
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory ring needs address-free 64-bit atomics");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex word must be a plain 32-bit integer");
+
+/**
+ * Multi-producer, multi-consumer broadcast log over a shared segment
+ *
+ * The segment holds a header and a byte-addressed circular log of
+ * variable-length records, so short messages take little room and the
+ * capacity is picked when the room is created. Writers claim space
+ * with one CAS on head, which also hands out message numbers in log
+ * order; a record that would straddle the end of the log is preceded
+ * by a padding record. Before writing, a writer retires the records
+ * its claim overwrites by advancing tail past them
+ *
+ * Every reader keeps its own cursor and sees every message. read()
+ * returns a view straight into the log; commit() then confirms the
+ * record was not overwritten while it was used. A reader the writers
+ * lapped is told how many messages it lost (exact up to 2^20 at once)
+ * and resumes at the oldest retained record
+ *
+ * Idle readers sleep on a process-shared futex in the segment;
+ * a writer only makes the wake syscall when someone is asleep
+ *
+ * A writer that dies mid-write stalls the other writers once they
+ * lap its record, for SHM_WRITER_TIMEOUT_MS; then its claim is
+ * retired unfinished and readers count the message as lost
+ */
+class ShmRing {
+public:
+    /**
+     * Result of read()
+     */
+    enum Status {
+        MESSAGE,        // A record is available at the cursor
+        EMPTY,          // Nothing published at the cursor yet
+        OVERRUN         // Cursor was lapped; moved forward past the lost messages
+    };
+
+    /**
+     * A reader's position in the log
+     */
+    struct Cursor {
+        uint64_t position = 0;      // Unit position of the next record
+        uint32_t number = 0;        // Its message number (low 20 bits)
+    };
+
+    /**
+     * Zero-copy view of a published record; valid until commit()
+     */
+    struct Record {
+        const char* username = nullptr;
+        size_t username_len = 0;
+        const char* timestamp = nullptr;
+        size_t timestamp_len = 0;
+        const char* text = nullptr;
+        size_t text_len = 0;
+        uint32_t number = 0;        // Message number (low 20 bits)
+        uint64_t position = 0;      // Where the record starts
+        uint64_t next = 0;          // Where the following record starts
+    };
+
+    /**
+     * Constructor
+     * @param segment Mapped, initialized segment
+     */
+    explicit ShmRing(void* segment);
+
+    /**
+     * Log size actually used for a requested capacity
+     * (a power of two, at least MIN_SHM_RING_CAPACITY)
+     */
+    static size_t round_capacity(size_t capacity);
+
+    /**
+     * Bytes to map for a segment
+     * @param capacity Log bytes, as returned by round_capacity()
+     * @param huge_pages Round up to whole huge pages
+     */
+    static size_t segment_size(size_t capacity, bool huge_pages);
+
+    /**
+     * Lay out an empty ring in zero-filled memory (creator only)
+     * @param segment Memory of at least segment_size(capacity) bytes
+     * @param capacity Log bytes, as returned by round_capacity()
+     * @param huge_pages Recorded so later joiners map it the same way
+     */
+    static void initialize(void* segment, size_t capacity, bool huge_pages);
+
+    /**
+     * Append a message, retiring the oldest records when the log is full
+     * @param msg Message to publish (strings are stored at their length)
+     * @return unit position assigned to the record
+     */
+    uint64_t publish(const Message& msg);
+
+    /**
+     * Look at the record at a reader's cursor without copying it
+     * @param cursor Reader position; moved forward on OVERRUN
+     * @param record Receives the view on MESSAGE; call commit() after use
+     * @param missed Receives the number of lost messages on OVERRUN
+     */
+    Status read(Cursor& cursor, Record& record, uint64_t& missed) const;
+
+    /**
+     * Finish with a record returned by read() and step past it
+     * @return false if it was overwritten while in use (discard
+     *         anything taken from it; the next read() reports OVERRUN)
+     */
+    bool commit(Cursor& cursor, const Record& record) const;
+
+    /**
+     * Copying read: read() and commit() into a Message
+     */
+    Status read(Cursor& cursor, Message& msg, uint64_t& missed) const;
+
+    /**
+     * Block until read() at the cursor would not return EMPTY
+     * @param cursor Reader position
+     * @param timeout_ms Maximum wait (-1 = no limit)
+     * @return true if there is something to read, false on timeout or wake_all()
+     */
+    bool wait(const Cursor& cursor, int timeout_ms = -1) const;
+
+    /**
+     * Wake every reader blocked in wait(), e.g. so one can shut down
+     */
+    void wake_all() const;
+
+    /**
+     * Cursor at the oldest retained record
+     */
+    Cursor oldest() const;
+
+    /**
+     * Cursor just past the newest claimed record
+     */
+    Cursor newest() const;
+
+    /**
+     * Log bytes
+     */
+    size_t capacity() const { return static_cast<size_t>(header_->capacity); }
+
+private:
+    /**
+     * Header of the record at a unit position
+     */
+    ShmRecordHeader* record_at(uint64_t position) const;
+
+    /**
+     * Advance tail until it is at least the given position
+     */
+    void retire(uint64_t position);
+
+    /**
+     * Where tail resumes past the unfinished record of a dead writer
+     * @param position The record's unit position
+     * @param number Its message number
+     * @return packed tail
+     */
+    uint64_t skip_dead(uint64_t position, uint32_t number) const;
+
+    /**
+     * Stamp and fill one record (padding when msg is null)
+     */
+    void write_record(uint64_t position, uint64_t units, uint32_t number, const Message* msg);
+
+    /**
+     * Move a lapped cursor to the oldest retained record
+     */
+    Status skip_lost(Cursor& cursor, uint64_t& missed) const;
+
+    /**
+     * Whether read() at the cursor would return MESSAGE or OVERRUN
+     */
+    bool readable(const Cursor& cursor) const;
+
+    ShmRingHeader* header_;
+    char* log_;
+    uint64_t units_;            // Log size in units
+};
+
+#endif // SHM_RING_H
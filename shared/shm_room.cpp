@@ -0,0 +1,172 @@
+// MIT License
+// Multi-threaded Chat System - Shared-Memory Room Segment Implementation
+// Copyright (c) 2025
+
+#include "shm_room.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+// How long a joiner waits for a concurrent creator to finish
+const int CREATE_WAIT_MS = 1000;
+}
+
+ShmRoom::ShmRoom()
+    : fd_(-1), segment_(nullptr), size_(0), created_(false) {
+}
+
+ShmRoom::~ShmRoom() {
+    close();
+}
+
+bool ShmRoom::open(const std::string& name, const ShmRoomOptions& options) {
+    close();
+    error_.clear();
+
+    if (create(name, options)) {
+        created_ = true;
+        return true;
+    }
+    if (errno != EEXIST) {
+        if (error_.empty()) {
+            error_ = std::string("Failed to create shared memory: ") + strerror(errno);
+        }
+        close();
+        return false;
+    }
+
+    if (!join(name)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ShmRoom::close() {
+    ring_.reset();
+
+    if (segment_) {
+        munmap(segment_, size_);
+        segment_ = nullptr;
+        size_ = 0;
+    }
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    created_ = false;
+}
+
+bool ShmRoom::create(const std::string& name, const ShmRoomOptions& options) {
+    fd_ = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    size_t capacity = ShmRing::round_capacity(options.capacity);
+    size_t size = ShmRing::segment_size(capacity, options.huge_pages);
+
+    // ftruncate zero-fills; joiners wait for the ready flag set last
+    if (ftruncate(fd_, static_cast<off_t>(size)) < 0) {
+        int error = errno;
+        shm_unlink(name.c_str());
+        errno = error;
+        return false;
+    }
+
+    if (!map(size, options.huge_pages)) {
+        int error = errno;
+        shm_unlink(name.c_str());
+        errno = error;
+        return false;
+    }
+
+    ShmRing::initialize(segment_, capacity, options.huge_pages);
+    ring_.reset(new ShmRing(segment_));
+    return true;
+}
+
+bool ShmRoom::join(const std::string& name) {
+    fd_ = shm_open(name.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd_ < 0) {
+        error_ = std::string("Failed to open shared memory: ") + strerror(errno);
+        return false;
+    }
+
+    // The creator may still be between shm_open() and initialize()
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CREATE_WAIT_MS);
+    while (true) {
+        struct stat st;
+        if (fstat(fd_, &st) < 0) {
+            error_ = std::string("Failed to inspect shared memory: ") + strerror(errno);
+            return false;
+        }
+
+        if (static_cast<size_t>(st.st_size) >= sizeof(ShmRingHeader)) {
+            if (!segment_ && !map(static_cast<size_t>(st.st_size), false)) {
+                error_ = std::string("Failed to map shared memory: ") + strerror(errno);
+                return false;
+            }
+
+            const ShmRingHeader* header = static_cast<const ShmRingHeader*>(segment_);
+            if (header->ready.load(std::memory_order_acquire)) {
+                break;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            error_ = "Shared memory room was never initialized";
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const ShmRingHeader* header = static_cast<const ShmRingHeader*>(segment_);
+    size_t capacity = static_cast<size_t>(header->capacity);
+    bool huge_pages = header->huge_pages != 0;
+    if (header->magic != SHM_RING_MAGIC || capacity < MIN_SHM_RING_CAPACITY ||
+        (capacity & (capacity - 1)) != 0 ||
+        ShmRing::segment_size(capacity, huge_pages) > size_) {
+        error_ = "Shared memory room has an incompatible layout";
+        return false;
+    }
+
+    // Remap with the creator's huge page advice
+    if (huge_pages) {
+        size_t size = size_;
+        munmap(segment_, size_);
+        segment_ = nullptr;
+        if (!map(size, true)) {
+            error_ = std::string("Failed to map shared memory: ") + strerror(errno);
+            return false;
+        }
+    }
+
+    ring_.reset(new ShmRing(segment_));
+    return true;
+}
+
+bool ShmRoom::map(size_t size, bool huge_pages) {
+    void* segment = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (segment == MAP_FAILED) {
+        return false;
+    }
+
+    segment_ = segment;
+    size_ = size;
+
+    // Best effort: shmem only honours this when the system allows
+    // huge pages for it (shmem_enabled = advise or always)
+    if (huge_pages) {
+        madvise(segment_, size_, MADV_HUGEPAGE);
+    }
+    return true;
+}
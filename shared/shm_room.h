@@ -0,0 +1,94 @@
+// MIT License
+// Multi-threaded Chat System - Shared-Memory Room Segment
+// Copyright (c) 2025
+
+#ifndef SHM_ROOM_H
+#define SHM_ROOM_H
+
+#include "shm_ring.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * How a room is laid out when this process creates it
+ * Ignored when joining an existing room
+ */
+struct ShmRoomOptions {
+    size_t capacity = DEFAULT_SHM_RING_CAPACITY;    // Log bytes (rounded up to a power of two)
+    bool huge_pages = false;                        // Ask for transparent huge pages
+};
+
+/**
+ * A named POSIX shared-memory segment holding one ShmRing
+ *
+ * The first process to open a name creates the segment with its
+ * options and publishes the header last; later processes wait for
+ * it and map the segment at the size the creator chose
+ */
+class ShmRoom {
+public:
+    ShmRoom();
+
+    /**
+     * Destructor - unmaps the segment (the room itself persists)
+     */
+    ~ShmRoom();
+
+    ShmRoom(const ShmRoom&) = delete;
+    ShmRoom& operator=(const ShmRoom&) = delete;
+
+    /**
+     * Create or join a room
+     * @param name shm_open() name, e.g. "chat_shm"
+     * @param options Layout used if the room does not exist yet
+     * @return true on success; error() describes a failure
+     */
+    bool open(const std::string& name, const ShmRoomOptions& options = ShmRoomOptions());
+
+    /**
+     * Unmap the segment
+     */
+    void close();
+
+    /**
+     * Ring in the mapped segment, or nullptr when closed
+     */
+    ShmRing* ring() const { return ring_.get(); }
+
+    /**
+     * Whether open() created the room
+     */
+    bool created() const { return created_; }
+
+    /**
+     * Reason the last open() failed
+     */
+    const std::string& error() const { return error_; }
+
+private:
+    /**
+     * Create the segment exclusively and lay out an empty ring
+     * @return false with errno EEXIST if someone else created it first
+     */
+    bool create(const std::string& name, const ShmRoomOptions& options);
+
+    /**
+     * Map a segment another process created, once it is ready
+     */
+    bool join(const std::string& name);
+
+    /**
+     * Map size bytes of fd_ and apply the huge page advice
+     */
+    bool map(size_t size, bool huge_pages);
+
+    int fd_;
+    void* segment_;
+    size_t size_;
+    bool created_;
+    std::unique_ptr<ShmRing> ring_;
+    std::string error_;
+};
+
+#endif // SHM_ROOM_H
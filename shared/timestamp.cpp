@@ -0,0 +1,55 @@
+// MIT License
+// Multi-threaded Chat System - Binary Timestamps Implementation
+// Copyright (c) 2025
+
+#include "timestamp.h"
+#include <cstring>
+#include <ctime>
+
+namespace ChatTime {
+
+namespace {
+
+const uint64_t NS_PER_SECOND = 1000000000ull;
+
+/**
+ * Text of the last second formatted on this thread
+ */
+struct FormatCache {
+    uint64_t second = UINT64_MAX;
+    char text[TIMESTAMP_TEXT_LEN + 1] = {};
+    size_t length = 0;
+};
+
+thread_local FormatCache t_cache;
+
+} // namespace
+
+uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<uint64_t>(now.tv_sec) * NS_PER_SECOND + static_cast<uint64_t>(now.tv_nsec);
+}
+
+uint64_t monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+}
+
+size_t format(uint64_t time_ns, char* out) {
+    uint64_t second = time_ns / NS_PER_SECOND;
+
+    if (second != t_cache.second) {
+        time_t seconds = static_cast<time_t>(second);
+        struct tm utc_time;
+        gmtime_r(&seconds, &utc_time);
+        t_cache.length = strftime(t_cache.text, sizeof(t_cache.text), "%Y-%m-%dT%H:%M:%SZ", &utc_time);
+        t_cache.second = second;
+    }
+
+    memcpy(out, t_cache.text, t_cache.length + 1);
+    return t_cache.length;
+}
+
+} // namespace ChatTime
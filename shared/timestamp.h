@@ -0,0 +1,46 @@
+// MIT License
+// Multi-threaded Chat System - Binary Timestamps
+// Copyright (c) 2025
+
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Message times travel as 64-bit nanoseconds since the Unix epoch and
+ * are only turned into text where a person or a legacy peer reads them
+ */
+namespace ChatTime {
+
+// Length of a formatted timestamp, "YYYY-MM-DDTHH:MM:SSZ"
+const size_t TIMESTAMP_TEXT_LEN = 20;
+
+/**
+ * Current time in nanoseconds since the epoch
+ * clock_gettime(CLOCK_REALTIME) is served from the vDSO, so this
+ * costs tens of nanoseconds and no syscall
+ */
+uint64_t now_ns();
+
+/**
+ * Milliseconds on a monotonic clock, for timeouts
+ * CLOCK_MONOTONIC_COARSE: a few milliseconds of resolution, no syscall
+ * and cheaper still than now_ns(), so readers can stamp every receive
+ */
+uint64_t monotonic_ms();
+
+/**
+ * Format a time as ISO 8601 (UTC, one-second resolution)
+ * Each thread caches the text of the last second it formatted, so
+ * a stream of messages calls gmtime_r() about once per second
+ * @param time_ns Nanoseconds since the epoch
+ * @param out Buffer of at least TIMESTAMP_TEXT_LEN + 1 bytes
+ * @return characters written (excluding the terminating NUL)
+ */
+size_t format(uint64_t time_ns, char* out);
+
+} // namespace ChatTime
+
+#endif // TIMESTAMP_H
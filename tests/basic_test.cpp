@@ -1,8 +1,40 @@
+// Every check here is an assert(); keep them in Release (NDEBUG) builds too
+#undef NDEBUG
+
 #include "../shared/protocol.h"
 #include "../shared/common.h"
+#include "../shared/codec.h"
+#include "../shared/shm_ring.h"
+#include "../shared/chat_client.h"
+#include "../shared/shm_chat_client.h"
+#include "../server/spsc_queue.h"
+#include "../server/connection.h"
+#include "../server/message_history.h"
+#include "../server/message_store.h"
+#include "../server/room_index.h"
+#include "../server/handoff.h"
+#include "../server/timer_wheel.h"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 void test_message_creation() {
     std::cout << "Testing Message creation..." << std::endl;
@@ -30,6 +62,23 @@ void test_timestamp_generation() {
     assert(ts1.length() >= 19);
     
     std::cout << "  Timestamp: " << ts1 << std::endl;
+
+    // Binary times format as UTC, cached per second on each thread
+    char text[MAX_TIMESTAMP_LEN];
+    const uint64_t second = 1766059200ull * 1000000000ull;    // 2025-12-18T12:00:00Z
+    assert(ChatTime::format(second, text) == ChatTime::TIMESTAMP_TEXT_LEN);
+    assert(strcmp(text, "2025-12-18T12:00:00Z") == 0);
+    assert(ChatTime::format(second + 999999999ull, text) == ChatTime::TIMESTAMP_TEXT_LEN);
+    assert(strcmp(text, "2025-12-18T12:00:00Z") == 0);
+    ChatTime::format(second + 1000000000ull, text);
+    assert(strcmp(text, "2025-12-18T12:00:01Z") == 0);
+
+    Message msg;
+    msg.time_ns = second;
+    assert(strcmp(msg.format_timestamp(text), "2025-12-18T12:00:00Z") == 0);
+    strncpy(msg.timestamp, "client time", MAX_TIMESTAMP_LEN - 1);
+    assert(strcmp(msg.format_timestamp(text), "client time") == 0);
+
     std::cout << "  Timestamp generation test passed" << std::endl;
 }
 
@@ -79,6 +128,1744 @@ void test_message_copy() {
     std::cout << "  Message copy test passed" << std::endl;
 }
 
+void test_v2_frame_roundtrip() {
+    std::cout << "Testing v2 frame encode/decode..." << std::endl;
+
+    Message msg;
+    strncpy(msg.username, "Alice", MAX_USERNAME_LEN - 1);
+    strncpy(msg.timestamp, "2025-12-18T12:00:00Z", MAX_TIMESTAMP_LEN - 1);
+    strncpy(msg.text, "hi", MAX_MESSAGE_LEN - 1);
+
+    char buffer[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_chat(msg, WireFormat::V2, buffer);
+    assert(ChatUtils::frame_size(buffer, size) == static_cast<ssize_t>(size));
+    assert(ChatUtils::frame_size(buffer, 2) == 0);
+
+    Frame frame;
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.format == WireFormat::V2);
+    assert(frame.type == FrameType::CHAT);
+    assert(strcmp(frame.message.username, "Alice") == 0);
+    assert(strcmp(frame.message.timestamp, "2025-12-18T12:00:00Z") == 0);
+    assert(strcmp(frame.message.text, "hi") == 0);
+
+    // Truncated or length-mismatched frames are rejected
+    assert(!ChatUtils::decode_frame(buffer, size - 1, frame));
+
+    std::cout << "  v2 frame: " << size << " bytes vs " << sizeof(Message) << " legacy" << std::endl;
+    assert(size * 10 < sizeof(Message));
+
+    // A server-stamped message gets its text timestamp when encoded
+    msg.timestamp[0] = '\0';
+    msg.time_ns = 1766059200ull * 1000000000ull;
+    size = ChatUtils::encode_chat(msg, WireFormat::V2, buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(strcmp(frame.message.timestamp, "2025-12-18T12:00:00Z") == 0);
+    assert(frame.message.time_ns == 0);
+
+    size = ChatUtils::encode_chat(msg, WireFormat::LEGACY, buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(strcmp(frame.message.timestamp, "2025-12-18T12:00:00Z") == 0);
+    assert(frame.message.time_ns == 0);
+
+    std::cout << "  v2 frame roundtrip test passed" << std::endl;
+}
+
+void test_v3_frame_roundtrip() {
+    std::cout << "Testing v3 frame encode/decode..." << std::endl;
+
+    Message msg;
+    strncpy(msg.username, "Alice", MAX_USERNAME_LEN - 1);
+    strncpy(msg.text, "hi", MAX_MESSAGE_LEN - 1);
+    msg.time_ns = 1766059200123456789ull;
+    msg.seq = 42;
+
+    char buffer[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_chat(msg, WireFormat::V3, buffer);
+    assert(ChatUtils::frame_size(buffer, size) == static_cast<ssize_t>(size));
+
+    // Binary time is smaller than the text it replaces
+    char v2[MAX_FRAME_SIZE];
+    Message text_msg = msg;
+    strncpy(text_msg.timestamp, "2025-12-18T12:00:00Z", MAX_TIMESTAMP_LEN - 1);
+    assert(size < ChatUtils::encode_chat(text_msg, WireFormat::V2, v2));
+
+    Frame frame;
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.format == WireFormat::V3);
+    assert(frame.type == FrameType::CHAT);
+    assert(frame.message.time_ns == 1766059200123456789ull);
+    assert(frame.message.seq == 42);
+    assert(frame.message.timestamp[0] == '\0');
+    assert(strcmp(frame.message.username, "Alice") == 0);
+    assert(strcmp(frame.message.text, "hi") == 0);
+    assert(!ChatUtils::decode_frame(buffer, size - 1, frame));
+
+    // The ACK carries whichever version the server picked
+    size = ChatUtils::encode_ack(PROTOCOL_VERSION_3, buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.type == FrameType::ACK);
+    assert(frame.version == PROTOCOL_VERSION_3);
+
+    // A room message is a TIMED_CHAT prefixed with its room
+    strncpy(msg.room, "ops", MAX_ROOM_LEN - 1);
+    size = ChatUtils::encode_chat(msg, WireFormat::V3, buffer);
+    assert(buffer[FRAME_LENGTH_SIZE] == static_cast<char>(FrameType::ROOM_CHAT));
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.format == WireFormat::V3 && frame.type == FrameType::CHAT);
+    assert(strcmp(frame.message.room, "ops") == 0 && strcmp(frame.message.text, "hi") == 0);
+    assert(frame.message.seq == 42);
+
+    // A direct message names its addressee instead; it takes precedence
+    strncpy(msg.recipient, "Bob", MAX_USERNAME_LEN - 1);
+    size = ChatUtils::encode_chat(msg, WireFormat::V3, buffer);
+    assert(buffer[FRAME_LENGTH_SIZE] == static_cast<char>(FrameType::DIRECT));
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.format == WireFormat::V3 && frame.type == FrameType::CHAT);
+    assert(strcmp(frame.message.recipient, "Bob") == 0 && frame.message.room[0] == '\0');
+    assert(strcmp(frame.message.username, "Alice") == 0 && strcmp(frame.message.text, "hi") == 0);
+
+    size = ChatUtils::encode_subscription("ops", false, buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.type == FrameType::UNSUBSCRIBE && strcmp(frame.message.room, "ops") == 0);
+    size = ChatUtils::encode_subscription("", true, buffer);
+    assert(!ChatUtils::decode_frame(buffer, size, frame));
+
+    // Heartbeats are bare frames
+    size = ChatUtils::encode_heartbeat(true, buffer);
+    assert(size == FRAME_HEADER_SIZE);
+    assert(ChatUtils::decode_frame(buffer, size, frame) && frame.type == FrameType::PING);
+    size = ChatUtils::encode_heartbeat(false, buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame) && frame.type == FrameType::PONG);
+
+    // So are the other control frames, with typed payloads
+    size = ChatUtils::encode_leave(buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame) && frame.type == FrameType::LEAVE);
+    size = ChatUtils::encode_history(77, buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame) && frame.type == FrameType::HISTORY);
+    assert(frame.since_seq == 77);
+    size = ChatUtils::encode_error(ErrorCode::ROOM, "no room", buffer);
+    assert(ChatUtils::decode_frame(buffer, size, frame) && frame.type == FrameType::ERROR);
+    assert(frame.error == ErrorCode::ROOM && strcmp(frame.message.text, "no room") == 0);
+    assert(!ChatUtils::decode_frame(buffer, size - 1, frame));
+
+    std::cout << "  v3 frame roundtrip test passed" << std::endl;
+}
+
+void test_frame_format_detection() {
+    std::cout << "Testing legacy/v2 frame detection..." << std::endl;
+
+    Message msg;
+    strncpy(msg.username, "Bob", MAX_USERNAME_LEN - 1);
+    strncpy(msg.text, "legacy", MAX_MESSAGE_LEN - 1);
+
+    char buffer[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_chat(msg, WireFormat::LEGACY, buffer);
+    assert(size == LEGACY_FRAME_SIZE);
+    assert(ChatUtils::frame_size(buffer, 1) == static_cast<ssize_t>(LEGACY_FRAME_SIZE));
+
+    Frame frame;
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.format == WireFormat::LEGACY);
+    assert(strcmp(frame.message.text, "legacy") == 0);
+
+    // JOIN is padded to a legacy frame but still classified as v2
+    size = ChatUtils::encode_join("Bob", buffer);
+    assert(size == LEGACY_FRAME_SIZE);
+    assert(buffer[0] == '\0');
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.format == WireFormat::V2);
+    assert(frame.type == FrameType::JOIN);
+    assert(frame.version == PROTOCOL_VERSION_4);
+    assert(frame.since_seq == 0);
+    assert(strcmp(frame.message.username, "Bob") == 0);
+
+    // A replay request rides in the padding
+    size = ChatUtils::encode_join("Bob", buffer, PROTOCOL_VERSION_3, 1234567890123ull);
+    assert(size == LEGACY_FRAME_SIZE);
+    assert(ChatUtils::decode_frame(buffer, size, frame));
+    assert(frame.type == FrameType::JOIN);
+    assert(frame.since_seq == 1234567890123ull);
+
+    // Only a legacy message or a v2+ JOIN may open a session; framed
+    // chat, room and direct messages are refused before the handshake
+    bool opens = ChatUtils::opens_session(frame);
+    assert(opens);
+    size = ChatUtils::encode_chat(msg, WireFormat::LEGACY, buffer);
+    bool decoded = ChatUtils::decode_frame(buffer, size, frame);
+    assert(decoded);
+    opens = ChatUtils::opens_session(frame);
+    assert(opens);
+
+    Message timed = msg;
+    timed.time_ns = 1;
+    size = ChatUtils::encode_chat(timed, WireFormat::V3, buffer);
+    decoded = ChatUtils::decode_frame(buffer, size, frame);
+    assert(decoded && frame.format == WireFormat::V3);
+    opens = ChatUtils::opens_session(frame);
+    assert(!opens);
+
+    strncpy(timed.recipient, "Alice", MAX_USERNAME_LEN - 1);
+    size = ChatUtils::encode_chat(timed, WireFormat::V3, buffer);
+    decoded = ChatUtils::decode_frame(buffer, size, frame);
+    assert(decoded && frame.format == WireFormat::V3 && strcmp(frame.message.recipient, "Alice") == 0);
+    opens = ChatUtils::opens_session(frame);
+    assert(!opens);
+
+    size = ChatUtils::encode_chat(msg, WireFormat::V2, buffer);
+    decoded = ChatUtils::decode_frame(buffer, size, frame);
+    assert(decoded && frame.format == WireFormat::V2);
+    opens = ChatUtils::opens_session(frame);
+    assert(!opens);
+
+    size = ChatUtils::encode_join("Bob", buffer, PROTOCOL_VERSION_LEGACY);
+    decoded = ChatUtils::decode_frame(buffer, size, frame);
+    assert(decoded && frame.type == FrameType::JOIN);
+    opens = ChatUtils::opens_session(frame);
+    assert(!opens);
+
+    // Oversized length prefix is malformed
+    buffer[0] = 0; buffer[1] = 0; buffer[2] = 0x7f; buffer[3] = 0;
+    assert(ChatUtils::frame_size(buffer, FRAME_LENGTH_SIZE) < 0);
+
+    std::cout << "  Frame detection test passed" << std::endl;
+}
+
+// Record for the codec test: nested members and a mix of field kinds
+struct CodecSample {
+    struct Header {
+        uint16_t port;
+        uint64_t seq;
+    } header;
+    ErrorCode code;
+    char name[8];
+};
+
+void test_codec() {
+    std::cout << "Testing compile-time codec schemas..." << std::endl;
+
+    using Header = Codec::Schema<Codec::Int<&CodecSample::header, &CodecSample::Header::port>,
+                                 Codec::Int<&CodecSample::header, &CodecSample::Header::seq>>;
+    using Record = Codec::Schema<Header, Codec::Int<&CodecSample::code>,
+                                 Codec::NonEmpty<Codec::Str<uint8_t, &CodecSample::name>>>;
+    static_assert(Header::FIXED && Header::MAX_SIZE == 10, "integers have a fixed width");
+    static_assert(!Record::FIXED && Record::MAX_SIZE == 10 + 1 + 1 + 7, "strings do not");
+
+    CodecSample sample = {};
+    sample.header.port = 0x1234;
+    sample.header.seq = 0x0102030405060708ull;
+    sample.code = ErrorCode::RECIPIENT;
+    strncpy(sample.name, "carol", sizeof(sample.name) - 1);
+
+    // Big-endian whatever the host order
+    char buffer[Record::MAX_SIZE + 8];
+    size_t size = Record::write(sample, buffer);
+    assert(size == Record::size(sample));
+    assert(size == 10 + 1 + 1 + 5);
+    const char expected[] = "\x12\x34\x01\x02\x03\x04\x05\x06\x07\x08\x03\x05" "carol";
+    assert(memcmp(buffer, expected, size) == 0);
+
+    CodecSample decoded = {};
+    assert(Record::read(buffer, size, decoded));
+    assert(decoded.header.port == 0x1234);
+    assert(decoded.header.seq == 0x0102030405060708ull);
+    assert(decoded.code == ErrorCode::RECIPIENT);
+    assert(strcmp(decoded.name, "carol") == 0);
+
+    // Fixed schemas decode with one length check
+    assert(Header::read(buffer, Header::MAX_SIZE, decoded));
+    assert(!Header::read(buffer, Header::MAX_SIZE - 1, decoded));
+    assert(!Header::read(buffer, Header::MAX_SIZE + 1, decoded));
+
+    // Truncated, trailing bytes, a string too long for its field, an empty one
+    assert(!Record::read(buffer, size - 1, decoded));
+    assert(!Record::read(buffer, Header::MAX_SIZE + 1, decoded));
+    buffer[size] = 'x';
+    assert(!Record::read(buffer, size + 1, decoded));
+    buffer[11] = 8;
+    assert(!Record::read(buffer, size + 3, decoded));
+    buffer[11] = 0;
+    assert(!Record::read(buffer, 12, decoded));
+
+    std::cout << "  Codec test passed" << std::endl;
+}
+
+void test_recv_buffer_batching() {
+    std::cout << "Testing buffered multi-frame receive..." << std::endl;
+
+    int fds[2];
+    int paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(paired == 0);
+
+    Message msg;
+    strncpy(msg.username, "Carol", MAX_USERNAME_LEN - 1);
+    strncpy(msg.text, "batched", MAX_MESSAGE_LEN - 1);
+
+    // Three whole frames followed by half of a fourth in one write
+    char frame[MAX_FRAME_SIZE];
+    size_t size = ChatUtils::encode_chat(msg, WireFormat::V2, frame);
+    std::string wire;
+    for (int i = 0; i < 4; ++i) {
+        wire.append(frame, size);
+    }
+    size_t split = wire.size() - size / 2;
+    ssize_t written = write(fds[0], wire.data(), split);
+    assert(written == static_cast<ssize_t>(split));
+
+    RecvBuffer buffer;
+    Frame decoded;
+    ssize_t filled = buffer.fill(fds[1]);
+    assert(filled == static_cast<ssize_t>(split));
+
+    int frames = 0;
+    while (buffer.next_frame(decoded) == RecvBuffer::FRAME) {
+        assert(strcmp(decoded.message.text, "batched") == 0);
+        ++frames;
+    }
+    assert(frames == 3);
+    assert(buffer.missing() == wire.size() - split);
+
+    // The partial frame completes once the rest arrives
+    size_t rest = wire.size() - split;
+    written = write(fds[0], wire.data() + split, rest);
+    assert(written == static_cast<ssize_t>(rest));
+    bool received = ChatUtils::recv_frame(fds[1], buffer, decoded);
+    assert(received);
+    assert(strcmp(decoded.message.username, "Carol") == 0);
+    assert(buffer.buffered() == 0);
+
+    // A peer that stalls mid-frame times out instead of blocking
+    written = write(fds[0], frame, size / 2);
+    assert(written == static_cast<ssize_t>(size / 2));
+    auto started = std::chrono::steady_clock::now();
+    received = ChatUtils::recv_frame(fds[1], buffer, decoded, 1);
+    auto waited = std::chrono::steady_clock::now() - started;
+    assert(!received && waited < std::chrono::seconds(3));
+
+    // Legacy messages go through the same path; a v2 frame is refused
+    close(fds[0]);
+    close(fds[1]);
+    paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(paired == 0);
+
+    bool sent = ChatUtils::send_message(fds[0], msg);
+    assert(sent);
+    Message legacy;
+    received = ChatUtils::recv_message(fds[1], legacy, 1);
+    assert(received && strcmp(legacy.text, "batched") == 0);
+
+    sent = ChatUtils::send_frame(fds[0], frame, size);
+    assert(sent);
+    received = ChatUtils::recv_message(fds[1], legacy, 1);
+    assert(!received);
+
+    char half[LEGACY_FRAME_SIZE];
+    size_t half_size = ChatUtils::encode_chat(msg, WireFormat::LEGACY, half) / 2;
+    written = write(fds[0], half, half_size);
+    assert(written == static_cast<ssize_t>(half_size));
+    received = ChatUtils::recv_message(fds[1], legacy, 1);
+    assert(!received);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    std::cout << "  Buffered receive test passed" << std::endl;
+}
+
+static Message make_history_message(int index) {
+    Message msg;
+    snprintf(msg.username, MAX_USERNAME_LEN, "user%d", index % 3);
+    snprintf(msg.text, MAX_MESSAGE_LEN, "message %d", index);
+    msg.time_ns = 1766059200ull * 1000000000ull + index;
+    return msg;
+}
+
+/**
+ * Read a replay of count messages, which arrives as one write
+ * @return sequence numbers received, in order
+ */
+static std::vector<uint64_t> read_replay(int fd, WireFormat format, size_t count) {
+    std::vector<uint64_t> seqs;
+    RecvBuffer buffer;
+    Frame frame;
+    while (seqs.size() < count) {
+        bool received = ChatUtils::recv_frame(fd, buffer, frame, 1);
+        assert(received);
+        assert(frame.type == FrameType::CHAT);
+        assert(frame.format == format);
+        int index = -1;
+        int parsed = sscanf(frame.message.text, "message %d", &index);
+        assert(parsed == 1);
+        if (format == WireFormat::V3) {
+            assert(frame.message.seq == static_cast<uint64_t>(index));
+        } else {
+            assert(strcmp(frame.message.timestamp, "2025-12-18T12:00:00Z") == 0);
+        }
+        seqs.push_back(static_cast<uint64_t>(index));
+    }
+    assert(buffer.buffered() == 0);
+    return seqs;
+}
+
+void test_message_history() {
+    std::cout << "Testing message history replay..." << std::endl;
+
+    // Room for about four frames; older ones are evicted
+    Message sample = make_history_message(1);
+    char frame[MAX_FRAME_SIZE];
+    size_t frame_size = ChatUtils::encode_chat(sample, WireFormat::V3, frame);
+    MessageHistory history(frame_size * 4 + frame_size / 2);
+
+    for (int i = 1; i <= 10; ++i) {
+        Message msg = make_history_message(i);
+        history.append(msg);
+        assert(msg.seq == static_cast<uint64_t>(i));
+    }
+    assert(history.last_seq() == 10);
+    assert(history.size() >= 3 && history.size() <= 4);
+    uint64_t oldest = 11 - history.size();
+
+    OutboundStats stats;
+    int fds[2];
+    int paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(paired == 0);
+
+    {
+        Connection connection(fds[0], 1, 16, SlowConsumerPolicy::DROP_OLDEST, &stats);
+        connection.set_wire_format(WireFormat::V3);
+
+        // Nothing is live before joining
+        assert(!connection.receives(1));
+
+        // Asking from before the oldest kept message replays what is kept
+        size_t replayed = history.attach(connection, 2);
+        assert(replayed == history.size());
+        std::vector<uint64_t> seqs = read_replay(fds[1], WireFormat::V3, history.size());
+        assert(seqs.front() == oldest && seqs.back() == 10);
+
+        // Live from the next message on, never one that was replayed
+        assert(!connection.receives(10));
+        assert(connection.receives(11));
+
+        // No replay requested: just goes live
+        Message msg = make_history_message(11);
+        history.append(msg);
+        replayed = history.attach(connection, 0);
+        assert(replayed == 0);
+        assert(connection.receives(12) && !connection.receives(11));
+
+        // Scrollback on request stops where the live messages start
+        replayed = history.replay(connection, 10);
+        assert(replayed == 2);
+        seqs = read_replay(fds[1], WireFormat::V3, 2);
+        assert(seqs[0] == 10 && seqs[1] == 11);
+    }
+    close(fds[1]);
+
+    // Older peers get the replay re-encoded in their format
+    paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(paired == 0);
+    {
+        Connection connection(fds[0], 2, 16, SlowConsumerPolicy::DROP_OLDEST, &stats);
+        connection.set_wire_format(WireFormat::V2);
+        size_t replayed = history.attach(connection, 10);
+        assert(replayed == 2);
+        std::vector<uint64_t> seqs = read_replay(fds[1], WireFormat::V2, 2);
+        assert(seqs[0] == 10 && seqs[1] == 11);
+    }
+    close(fds[1]);
+
+    // Broadcasters racing a join: every message arrives exactly once,
+    // the replay first
+    const int BROADCASTERS = 4;
+    const int PER_BROADCASTER = 2000;
+    const uint64_t TOTAL = BROADCASTERS * PER_BROADCASTER;
+    paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(paired == 0);
+    {
+        MessageHistory racing(1024 * 1024);
+        Connection connection(fds[0], 3, TOTAL + 1, SlowConsumerPolicy::DROP_NEWEST, &stats);
+        connection.set_wire_format(WireFormat::V3);
+
+        std::vector<uint64_t> received;
+        std::atomic<bool> done(false);
+        std::thread reader([&]() {
+            RecvBuffer buffer;
+            Frame frame;
+            while (received.size() < TOTAL && ChatUtils::recv_frame(fds[1], buffer, frame, 5)) {
+                received.push_back(frame.message.seq);
+            }
+            done = true;
+        });
+
+        std::vector<std::thread> broadcasters;
+        for (int t = 0; t < BROADCASTERS; ++t) {
+            broadcasters.emplace_back([&racing, &connection, t, PER_BROADCASTER]() {
+                for (int i = 0; i < PER_BROADCASTER; ++i) {
+                    Message msg = make_history_message(t * PER_BROADCASTER + i);
+                    racing.append(msg);
+                    connection.send_broadcast(FrameRef::encode(msg, WireFormat::V3), msg.seq);
+                }
+            });
+        }
+
+        while (racing.last_seq() < TOTAL / 2) {
+            std::this_thread::yield();
+        }
+        size_t replayed = racing.attach(connection, 1);
+        uint64_t live_from = connection.live_from();
+        assert(replayed == live_from - 1);
+
+        for (auto& broadcaster : broadcasters) {
+            broadcaster.join();
+        }
+        // Write out what the socket did not take yet
+        while (!done) {
+            bool flushed = connection.flush();
+            assert(flushed);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        reader.join();
+
+        assert(received.size() == TOTAL);
+        for (uint64_t i = 0; i + 1 < live_from; ++i) {
+            assert(received[i] == i + 1);
+        }
+        std::vector<uint64_t> sorted(received);
+        std::sort(sorted.begin(), sorted.end());
+        for (uint64_t i = 0; i < TOTAL; ++i) {
+            assert(sorted[i] == i + 1);
+        }
+    }
+    close(fds[1]);
+
+    // A zero budget keeps nothing but still numbers messages
+    MessageHistory disabled(0);
+    Message msg = make_history_message(1);
+    disabled.append(msg);
+    assert(msg.seq == 1 && disabled.size() == 0);
+
+    std::cout << "  Message history test passed" << std::endl;
+}
+
+void test_room_index() {
+    std::cout << "Testing room index..." << std::endl;
+
+    OutboundStats stats;
+    std::vector<std::shared_ptr<Connection>> connections;
+    for (int id = 1; id <= 4; ++id) {
+        connections.push_back(std::make_shared<Connection>(-1, id, 16,
+                                                           SlowConsumerPolicy::DROP_OLDEST, &stats));
+    }
+
+    RoomIndex rooms;
+    assert(rooms.members("ops") == nullptr);
+    for (auto& connection : connections) {
+        bool joined = rooms.join("ops", connection);
+        assert(joined);
+    }
+    bool joined = rooms.join("ops", connections[0]);
+    assert(!joined);
+    joined = rooms.join("dev", connections[2]);
+    assert(joined);
+    assert(rooms.size() == 2 && rooms.members("ops")->size() == 4);
+
+    // Leaving swaps the last member into the hole; the index stays consistent
+    bool left = rooms.leave("ops", 1);
+    assert(left);
+    left = rooms.leave("ops", 1);
+    assert(!left);
+    assert(!rooms.is_member("ops", 1) && rooms.is_member("ops", 4));
+    left = rooms.leave("ops", 4);
+    assert(left);
+    std::vector<int> ids;
+    for (const RoomIndex::Member& member : *rooms.members("ops")) {
+        ids.push_back(member.client_id);
+    }
+    std::sort(ids.begin(), ids.end());
+    assert((ids == std::vector<int>{2, 3}));
+
+    // A disconnect leaves every room; empty rooms go away
+    rooms.leave_all(3);
+    assert(rooms.members("dev") == nullptr && rooms.size() == 1);
+    assert(rooms.members("ops")->size() == 1 && rooms.is_member("ops", 2));
+    rooms.leave_all(2);
+    assert(rooms.size() == 0);
+
+    // Joins per client are capped
+    for (size_t i = 0; i < MAX_ROOMS_PER_CLIENT; ++i) {
+        joined = rooms.join("room" + std::to_string(i), connections[0]);
+        assert(joined);
+    }
+    joined = rooms.join("one-too-many", connections[0]);
+    assert(!joined);
+    rooms.leave_all(1);
+    assert(rooms.size() == 0);
+
+    std::cout << "  Room index test passed" << std::endl;
+}
+
+void test_timer_wheel() {
+    std::cout << "Testing timer wheel..." << std::endl;
+
+    const uint64_t start = 1000000;
+    TimerWheel wheel(100, start);
+    std::vector<int> expired;
+    size_t fired = 0;
+    assert(wheel.timeout_ms(start) == -1);
+
+    TimerWheel::Timer a, b, c;
+    a.id = 1;
+    b.id = 2;
+    c.id = 3;
+    wheel.arm(a, 250);
+    wheel.arm(b, 250);
+    wheel.arm(c, 50);
+    assert(wheel.size() == 3 && a.armed());
+    assert(wheel.timeout_ms(start) == 100);
+
+    // Delays round up to whole ticks; same-tick timers fire in arming order
+    fired = wheel.advance(start + 100, expired);
+    assert(fired == 1 && expired == std::vector<int>{3});
+    expired.clear();
+    fired = wheel.advance(start + 299, expired);
+    assert(fired == 0);
+    fired = wheel.advance(start + 300, expired);
+    assert(fired == 2);
+    assert((expired == std::vector<int>{1, 2}) && !a.armed() && wheel.size() == 0);
+    expired.clear();
+
+    // Re-arming moves a timer, cancelling drops it
+    wheel.arm(a, 500);
+    wheel.arm(a, 1000);
+    wheel.arm(b, 200);
+    wheel.cancel(b);
+    wheel.cancel(b);
+    assert(wheel.size() == 1);
+    fired = wheel.advance(start + 800, expired);
+    assert(fired == 0);
+    fired = wheel.advance(start + 1300, expired);
+    assert(fired == 1 && expired[0] == 1);
+    expired.clear();
+
+    // Distant timers cascade down the levels and still fire on their tick
+    const uint64_t delays[] = {6400, 6500, 409600, 500000, 26214400};
+    std::vector<TimerWheel::Timer> timers(5);
+    for (int i = 0; i < 5; ++i) {
+        timers[i].id = i;
+        wheel.arm(timers[i], delays[i]);
+    }
+    uint64_t now = start + 1300;
+    for (int i = 0; i < 5; ++i) {
+        fired = wheel.advance(now + delays[i] - 100, expired);
+        assert(fired == 0);
+        fired = wheel.advance(now + delays[i], expired);
+        assert(fired == 1 && expired.back() == i);
+    }
+    now += delays[4];
+
+    // Destroying an armed timer disarms it
+    {
+        TimerWheel::Timer scoped;
+        wheel.arm(scoped, 100);
+        assert(wheel.size() == 1);
+    }
+    assert(wheel.size() == 0);
+
+    // Many timers cost nothing extra to arm or expire
+    const int count = 120000;
+    std::vector<TimerWheel::Timer> many(count);
+    for (int i = 0; i < count; ++i) {
+        many[i].id = i;
+        wheel.arm(many[i], 100 + (i % 600) * 100);
+    }
+    expired.clear();
+    fired = wheel.advance(now + 30000, expired);
+    assert(fired == count / 2);
+    fired = wheel.advance(now + 60000, expired);
+    assert(fired == count / 2);
+    assert(static_cast<int>(expired.size()) == count && wheel.size() == 0);
+
+    std::cout << "  Timer wheel test passed" << std::endl;
+}
+
+static bool same_file(int a, int b) {
+    struct stat first, second;
+    return fstat(a, &first) == 0 && fstat(b, &second) == 0 &&
+           first.st_dev == second.st_dev && first.st_ino == second.st_ino;
+}
+
+void test_handoff() {
+    std::cout << "Testing server handoff channel..." << std::endl;
+
+    int channel[2];
+    int paired = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel);
+    assert(paired == 0);
+
+    // Request and answer
+    HandoffLayout layout;
+    layout.sharded = true;
+    layout.listeners = 4;
+    HandoffLayout received;
+    bool accepted = false;
+    bool ok = Handoff::send_hello(channel[1], layout);
+    assert(ok);
+    ok = Handoff::recv_hello(channel[0], received, 1000);
+    assert(ok && received.sharded && received.listeners == 4);
+    ok = Handoff::send_reply(channel[0], false, layout);
+    assert(ok);
+    ok = Handoff::recv_reply(channel[1], accepted, received, 1000);
+    assert(ok && !accepted && received.listeners == 4);
+
+    // Listeners and clients travel with their descriptors; buffered
+    // bytes larger than one record are split and reassembled
+    int listener[2], client[2];
+    paired = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, listener);
+    assert(paired == 0);
+    paired = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, client);
+    assert(paired == 0);
+
+    HandoffState state;
+    state.listeners = {listener[0], listener[1]};
+    state.unix_path = "/tmp/chat.sock";
+    state.unix_listener = listener[1];
+    state.last_seq = 12345;
+    HandoffClient alice;
+    alice.socket_fd = client[0];
+    alice.username = "alice";
+    alice.format = WireFormat::V3;
+    alice.version = PROTOCOL_VERSION_4;
+    alice.rooms = {"ops", "dev"};
+    alice.inbound = {'h', 'i'};
+    alice.outbound.resize(100000);
+    for (size_t i = 0; i < alice.outbound.size(); ++i) {
+        alice.outbound[i] = static_cast<char>(i * 7);
+    }
+    state.clients.push_back(alice);
+    state.clients.push_back(HandoffClient());
+    state.clients.back().socket_fd = client[0];
+
+    // More than the channel buffers; the sender runs alongside
+    bool sent = false;
+    std::thread sender([&]() { sent = Handoff::send_state(channel[0], state); });
+    HandoffState copy;
+    ok = Handoff::recv_state(channel[1], copy, 1000);
+    sender.join();
+    assert(ok && sent);
+
+    assert(copy.listeners.size() == 2 && copy.last_seq == 12345);
+    assert(same_file(copy.listeners[0], listener[0]) && same_file(copy.listeners[1], listener[1]));
+    assert(copy.unix_path == state.unix_path && same_file(copy.unix_listener, listener[1]));
+    assert(copy.clients.size() == 2);
+    const HandoffClient& resumed = copy.clients[0];
+    assert(same_file(resumed.socket_fd, client[0]) && resumed.socket_fd != client[0]);
+    assert(resumed.username == "alice" && resumed.format == WireFormat::V3 &&
+           resumed.version == PROTOCOL_VERSION_4);
+    assert((resumed.rooms == std::vector<std::string>{"ops", "dev"}));
+    assert(resumed.inbound == alice.inbound && resumed.outbound == alice.outbound);
+    assert(copy.clients[1].username.empty() && copy.clients[1].outbound.empty());
+    assert(copy.clients[1].version == 0);
+
+    // The received descriptor is the same connection
+    ssize_t moved = write(resumed.socket_fd, "x", 1);
+    assert(moved == 1);
+    char byte = 0;
+    moved = read(client[1], &byte, 1);
+    assert(moved == 1 && byte == 'x');
+
+    // A closed channel fails instead of hanging
+    close(channel[0]);
+    HandoffState none;
+    ok = Handoff::recv_state(channel[1], none, 1000);
+    assert(!ok);
+
+    for (int fd : copy.listeners) {
+        close(fd);
+    }
+    close(copy.unix_listener);
+    for (const HandoffClient& entry : copy.clients) {
+        close(entry.socket_fd);
+    }
+    close(channel[1]);
+    close(listener[0]);
+    close(listener[1]);
+    close(client[0]);
+    close(client[1]);
+
+    std::cout << "  Server handoff channel test passed" << std::endl;
+}
+
+/**
+ * Byte offset where the frames of a segment file end
+ */
+static size_t segment_end(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    assert(file);
+    std::vector<char> data(1 << 16);
+    size_t size = fread(data.data(), 1, data.size(), file);
+    fclose(file);
+
+    size_t offset = 0;
+    while (offset + FRAME_HEADER_SIZE <= size) {
+        ssize_t frame = ChatUtils::frame_size(&data[offset], size - offset);
+        if (frame <= 0) {
+            break;
+        }
+        offset += static_cast<size_t>(frame);
+    }
+    return offset;
+}
+
+void test_message_store() {
+    std::cout << "Testing persistent message store..." << std::endl;
+
+    char directory[] = "/tmp/chat_store_testXXXXXX";
+    char* created = mkdtemp(directory);
+    assert(created != nullptr);
+
+    // Small segments so the log spans several files
+    StoreConfig config;
+    config.directory = directory;
+    config.segment_bytes = 4096;
+    config.sync_interval_ms = 5;
+    config.sync_batch = 8;
+
+    {
+        MessageStore store(config);
+        bool opened = store.open();
+        assert(opened);
+        MessageHistory history(0);
+        history.set_store(&store);
+
+        for (int i = 1; i <= 200; ++i) {
+            Message msg = make_history_message(i);
+            history.append(msg);
+        }
+        // Broadcasts are recorded in batches; flush hands the rest over now
+        history.flush();
+        assert(store.last_seq() == 200 && store.size() == 200);
+
+        // Slices view the mapped segments; together they hold 100..200 in order
+        std::vector<MessageStore::Slice> slices;
+        size_t found = store.slices_from(100, slices);
+        assert(found == 101);
+        assert(slices.size() > 1 && slices.front().first_seq == 100);
+        uint64_t expected = 100;
+        for (const MessageStore::Slice& slice : slices) {
+            size_t offset = 0;
+            Frame frame;
+            for (size_t i = 0; i < slice.messages; ++i) {
+                ssize_t size = ChatUtils::frame_size(slice.data + offset, slice.size - offset);
+                assert(size > 0);
+                bool decoded = ChatUtils::decode_frame(slice.data + offset, size, frame);
+                assert(decoded && frame.message.seq == expected);
+                ++expected;
+                offset += static_cast<size_t>(size);
+            }
+            assert(offset == slice.size);
+        }
+        assert(expected == 201);
+    }
+
+    // Recovery rebuilds the index and numbering continues
+    std::string last_segment;
+    {
+        MessageStore store(config);
+        bool opened = store.open();
+        assert(opened);
+        assert(store.last_seq() == 200 && store.size() == 200);
+
+        MessageHistory history(0);
+        history.set_store(&store);
+        Message msg = make_history_message(201);
+        history.append(msg);
+        assert(msg.seq == 201);
+
+        history.flush();
+        std::vector<MessageStore::Slice> slices;
+        size_t found = store.slices_from(1, slices);
+        assert(found == 201);
+        assert(slices.front().first_seq == 1);
+
+        // Replay to a v3 client goes out straight from the mapping
+        OutboundStats stats;
+        int fds[2];
+        int paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        assert(paired == 0);
+        {
+            Connection connection(fds[0], 1, 16, SlowConsumerPolicy::DROP_OLDEST, &stats);
+            connection.set_wire_format(WireFormat::V3);
+            size_t replayed = history.attach(connection, 190);
+            assert(replayed == 12);
+            std::vector<uint64_t> seqs = read_replay(fds[1], WireFormat::V3, 12);
+            assert(seqs.front() == 190 && seqs.back() == 201);
+            assert(connection.receives(202) && !connection.receives(201));
+
+            // A scrollback request cuts the mapped slices at the join
+            connection.set_live_from(180);
+            replayed = history.replay(connection, 150);
+            assert(replayed == 30);
+            seqs = read_replay(fds[1], WireFormat::V3, 30);
+            assert(seqs.front() == 150 && seqs.back() == 179);
+        }
+        close(fds[1]);
+
+        char name[32];
+        snprintf(name, sizeof(name), "/%020llu.log",
+                 static_cast<unsigned long long>(slices.back().first_seq));
+        last_segment = std::string(directory) + name;
+    }
+
+    // A torn write after the last frame is discarded and cleared
+    size_t end = segment_end(last_segment);
+    char frame[MAX_FRAME_SIZE];
+    Message torn = make_history_message(202);
+    torn.seq = 202;
+    size_t size = ChatUtils::encode_chat(torn, WireFormat::V3, frame);
+    int fd = open(last_segment.c_str(), O_WRONLY);
+    assert(fd >= 0);
+    ssize_t written = pwrite(fd, frame, size / 2, static_cast<off_t>(end));
+    assert(written == static_cast<ssize_t>(size / 2));
+    close(fd);
+
+    {
+        MessageStore store(config);
+        bool opened = store.open();
+        assert(opened);
+        assert(store.last_seq() == 201);
+        MessageHistory history(0);
+        history.set_store(&store);
+        Message msg = make_history_message(202);
+        history.append(msg);
+        assert(msg.seq == 202);
+    }
+    {
+        MessageStore store(config);
+        bool opened = store.open();
+        assert(opened);
+        assert(store.last_seq() == 202 && store.size() == 202);
+    }
+
+    // Beyond the retention budget the oldest segments are deleted, and a
+    // replay sends only the newest replay_limit messages
+    StoreConfig retained = config;
+    retained.directory = std::string(directory) + "/retained";
+    retained.retain_bytes = 3 * config.segment_bytes;
+    retained.replay_limit = 20;
+    {
+        MessageStore store(retained);
+        bool opened = store.open();
+        assert(opened);
+
+        // The sync thread creates the next segment ahead of time
+        std::string spare = retained.directory + "/next.tmp";
+        struct stat info;
+        for (int i = 0; i < 200 && stat(spare.c_str(), &info) != 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        assert(stat(spare.c_str(), &info) == 0);
+
+        MessageHistory history(0);
+        history.set_store(&store);
+        for (int i = 1; i <= 500; ++i) {
+            Message msg = make_history_message(i);
+            history.append(msg);
+        }
+        history.flush();
+        assert(store.last_seq() == 500 && store.size() < 500);
+
+        int segments = 0;
+        DIR* dir = opendir(retained.directory.c_str());
+        assert(dir != nullptr);
+        while (struct dirent* entry = readdir(dir)) {
+            if (strstr(entry->d_name, ".log")) {
+                ++segments;
+            }
+        }
+        closedir(dir);
+        assert(segments == 3);
+
+        std::vector<MessageStore::Slice> slices;
+        size_t found = store.slices_from(1, slices);
+        assert(found == store.size() && slices.front().first_seq == 501 - store.size());
+
+        OutboundStats stats;
+        int fds[2];
+        int paired = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        assert(paired == 0);
+        {
+            Connection connection(fds[0], 1, 16, SlowConsumerPolicy::DROP_OLDEST, &stats);
+            connection.set_wire_format(WireFormat::V3);
+            size_t replayed = history.attach(connection, 1);
+            assert(replayed == 20);
+            std::vector<uint64_t> seqs = read_replay(fds[1], WireFormat::V3, 20);
+            assert(seqs.front() == 481 && seqs.back() == 500);
+        }
+        close(fds[1]);
+    }
+    {
+        // Retention applies to what is recovered, too
+        retained.retain_bytes = config.segment_bytes;
+        MessageStore store(retained);
+        bool opened = store.open();
+        assert(opened);
+        assert(store.last_seq() == 500 && store.size() < 200);
+    }
+
+    std::string command = std::string("rm -rf ") + directory;
+    int removed = system(command.c_str());
+    assert(removed == 0);
+
+    std::cout << "  Message store test passed" << std::endl;
+}
+
+void test_spsc_queue() {
+    std::cout << "Testing SPSC queue..." << std::endl;
+
+    SpscQueue<int> queue(4);
+    int value = 0;
+    bool popped = queue.try_pop(value);
+    assert(!popped);
+
+    // Fills at capacity and leaves a rejected item untouched
+    for (int i = 0; i < 4; ++i) {
+        int item = i;
+        bool pushed = queue.try_push(item);
+        assert(pushed);
+    }
+    int extra = 99;
+    bool pushed = queue.try_push(extra);
+    assert(!pushed);
+    assert(extra == 99);
+    popped = queue.try_pop(value);
+    assert(popped && value == 0);
+
+    // Order is preserved across threads while the queue wraps
+    const int count = 120000;
+    std::thread producer([&queue]() {
+        for (int i = 4; i < count; ++i) {
+            int item = i;
+            while (!queue.try_push(item)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    for (int expected = 1; expected < count; ++expected) {
+        while (!queue.try_pop(value)) {
+            std::this_thread::yield();
+        }
+        assert(value == expected);
+    }
+    producer.join();
+    popped = queue.try_pop(value);
+    assert(!popped);
+
+    std::cout << "  SPSC queue test passed" << std::endl;
+}
+
+/**
+ * Derive every byte of a variable-length message from (writer, seq)
+ * so a torn or misplaced copy shows
+ */
+static void make_ring_message(Message& msg, int writer, int seq) {
+    msg = Message();
+    char fill = static_cast<char>('a' + (writer * 7 + seq) % 26);
+    size_t length = 9 + static_cast<size_t>(seq * 37 + writer) % 300;
+    memset(msg.timestamp, fill, 1 + seq % (MAX_TIMESTAMP_LEN - 2));
+    memset(msg.text, fill, length);
+    snprintf(msg.username, MAX_USERNAME_LEN, "w%d", writer);
+    snprintf(msg.text, 16, "%08d", seq);
+    msg.text[8] = fill;
+}
+
+static bool check_ring_message(const Message& msg, int& writer, int& seq) {
+    if (sscanf(msg.username, "w%d", &writer) != 1 || sscanf(msg.text, "%8d", &seq) != 1) {
+        return false;
+    }
+
+    Message expected;
+    make_ring_message(expected, writer, seq);
+    return memcmp(&expected, &msg, sizeof(Message)) == 0;
+}
+
+static void* map_ring(size_t capacity) {
+    size_t size = ShmRing::segment_size(capacity, false);
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(memory != MAP_FAILED);
+    ShmRing::initialize(memory, capacity, false);
+    return memory;
+}
+
+void test_shm_ring() {
+    std::cout << "Testing shared-memory ring..." << std::endl;
+
+    // Short messages take little room: a burst of a thousand fits a 256 KiB log
+    size_t capacity = ShmRing::round_capacity(200 * 1024);
+    assert(capacity == 256 * 1024);
+    void* memory = map_ring(capacity);
+    ShmRing ring(memory);
+
+    Message msg;
+    ShmRing::Cursor cursor = ring.oldest();
+    uint64_t missed = 0;
+    ShmRing::Status state = ring.read(cursor, msg, missed);
+    assert(state == ShmRing::EMPTY);
+
+    const int burst = 1000;
+    for (int i = 0; i < burst; ++i) {
+        make_ring_message(msg, 0, i);
+        ring.publish(msg);
+    }
+
+    // Zero-copy reads point into the log and survive commit()
+    int writer = -1;
+    int seq = -1;
+    ShmRing::Record record;
+    for (int i = 0; i < burst; ++i) {
+        state = ring.read(cursor, record, missed);
+        assert(state == ShmRing::MESSAGE);
+        assert(record.text >= static_cast<char*>(memory) &&
+               record.text < static_cast<char*>(memory) + ShmRing::segment_size(capacity, false));
+
+        Message copy;
+        memcpy(copy.username, record.username, record.username_len);
+        memcpy(copy.timestamp, record.timestamp, record.timestamp_len);
+        memcpy(copy.text, record.text, record.text_len);
+        bool committed = ring.commit(cursor, record);
+        assert(committed);
+        bool intact = check_ring_message(copy, writer, seq);
+        assert(intact && seq == i);
+    }
+    state = ring.read(cursor, msg, missed);
+    assert(state == ShmRing::EMPTY);
+
+    // An idle reader sleeps until the next publish, not a poll interval
+    bool woken = ring.wait(cursor, 10);
+    assert(!woken);
+    std::thread sleeper([&ring, cursor]() {
+        bool published = ring.wait(cursor);
+        assert(published);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    make_ring_message(msg, 1, 0);
+    ring.publish(msg);
+    sleeper.join();
+    state = ring.read(cursor, msg, missed);
+    assert(state == ShmRing::MESSAGE);
+    munmap(memory, ShmRing::segment_size(capacity, false));
+
+    // Lapping a reader of a small log is reported once, with the exact
+    // number lost, and reading resumes at the oldest retained message
+    capacity = MIN_SHM_RING_CAPACITY;
+    memory = map_ring(capacity);
+    ShmRing small(memory);
+    const int written = 200;
+    for (int i = 0; i < written; ++i) {
+        make_ring_message(msg, 2, i);
+        small.publish(msg);
+    }
+
+    cursor = ShmRing::Cursor();
+    state = small.read(cursor, msg, missed);
+    assert(state == ShmRing::OVERRUN);
+    assert(missed > 0 && missed < static_cast<uint64_t>(written));
+    int expected = static_cast<int>(missed);
+    while (small.read(cursor, msg, missed) == ShmRing::MESSAGE) {
+        bool intact = check_ring_message(msg, writer, seq);
+        assert(intact && seq == expected);
+        ++expected;
+    }
+    assert(expected == written);
+
+    // Several writer and reader processes: every message a reader gets
+    // is intact and in per-writer order, and received + missed adds up;
+    // readers block on the shared futex whenever they catch up
+    munmap(memory, ShmRing::segment_size(capacity, false));
+    memory = map_ring(capacity);
+    ShmRing shared(memory);
+    const int writers = 3;
+    const int readers = 3;
+    const int per_writer = 100000;
+    const uint64_t total = static_cast<uint64_t>(writers) * per_writer;
+
+    std::vector<pid_t> children;
+    for (int r = 0; r < readers; ++r) {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            ShmRing::Cursor position;
+            uint64_t received = 0;
+            uint64_t lost = 0;
+            std::vector<int> last_seq(writers, -1);
+            Message copy;
+
+            while (received + lost < total) {
+                uint64_t gap = 0;
+                ShmRing::Status status = shared.read(position, copy, gap);
+                if (status == ShmRing::EMPTY) {
+                    shared.wait(position, 100);
+                    continue;
+                }
+                if (status == ShmRing::OVERRUN) {
+                    lost += gap;
+                    continue;
+                }
+
+                int w = -1;
+                int sq = -1;
+                if (!check_ring_message(copy, w, sq) || w < 0 || w >= writers || sq <= last_seq[w]) {
+                    _exit(1);
+                }
+                last_seq[w] = sq;
+                ++received;
+            }
+            _exit(received + lost == total && received > 0 ? 0 : 2);
+        }
+        children.push_back(pid);
+    }
+
+    for (int w = 0; w < writers; ++w) {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            Message out;
+            for (int i = 0; i < per_writer; ++i) {
+                make_ring_message(out, w, i);
+                shared.publish(out);
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    for (pid_t pid : children) {
+        int exit_status = 0;
+        pid_t reaped = waitpid(pid, &exit_status, 0);
+        assert(reaped == pid);
+        assert(WIFEXITED(exit_status) && WEXITSTATUS(exit_status) == 0);
+    }
+    assert(shared.newest().number == (total & ((1u << 20) - 1)));
+    munmap(memory, ShmRing::segment_size(capacity, false));
+
+    // A writer killed mid-publish leaves a claim that is never finished;
+    // the others wait for it a while, then retire it and carry on, and
+    // readers count it as lost
+    memory = map_ring(capacity);
+    ShmRing crashed(memory);
+    ShmRing::Cursor stuck;
+    for (int attempt = 0; attempt < 1000 && stuck.position == crashed.newest().position; ++attempt) {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            Message out;
+            for (int i = 0;; ++i) {
+                make_ring_message(out, 0, i);
+                crashed.publish(out);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500 + attempt % 7 * 100));
+        kill(pid, SIGKILL);
+        pid_t reaped = waitpid(pid, nullptr, 0);
+        assert(reaped == pid);
+
+        // Read up to the first record that is not published
+        stuck = crashed.oldest();
+        uint64_t gap = 0;
+        while (crashed.read(stuck, msg, gap) != ShmRing::EMPTY) {
+        }
+    }
+    assert(stuck.position < crashed.newest().position);
+
+    const int survivors = 2;
+    const int per_survivor = 20000;
+    const uint64_t after_crash = static_cast<uint64_t>(survivors) * per_survivor + 1;
+    auto crash_start = std::chrono::steady_clock::now();
+    children.clear();
+
+    pid_t reader = fork();
+    assert(reader >= 0);
+    if (reader == 0) {
+        alarm(30);
+        uint64_t received = 0;
+        uint64_t lost = 0;
+        Message copy;
+        while (received + lost < after_crash) {
+            uint64_t gap = 0;
+            ShmRing::Status status = crashed.read(stuck, copy, gap);
+            if (status == ShmRing::EMPTY) {
+                crashed.wait(stuck, 100);
+            } else if (status == ShmRing::OVERRUN) {
+                lost += gap;
+            } else {
+                ++received;
+            }
+        }
+        _exit(received + lost == after_crash && lost > 0 ? 0 : 2);
+    }
+    children.push_back(reader);
+
+    for (int w = 1; w <= survivors; ++w) {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            alarm(30);
+            Message out;
+            for (int i = 0; i < per_survivor; ++i) {
+                make_ring_message(out, w, i);
+                crashed.publish(out);
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    for (pid_t pid : children) {
+        int exit_status = 0;
+        pid_t reaped = waitpid(pid, &exit_status, 0);
+        assert(reaped == pid);
+        assert(WIFEXITED(exit_status) && WEXITSTATUS(exit_status) == 0);
+    }
+    auto crash_wait = std::chrono::steady_clock::now() - crash_start;
+    assert(crash_wait >= std::chrono::milliseconds(SHM_WRITER_TIMEOUT_MS));
+    assert(crashed.newest().number == ((stuck.number + after_crash) & ((1u << 20) - 1)));
+
+    munmap(memory, ShmRing::segment_size(capacity, false));
+    std::cout << "  Shared-memory ring test passed" << std::endl;
+}
+
+void test_chat_client() {
+    std::cout << "Testing headless clients..." << std::endl;
+
+    // A one-connection v2 server: ACK the join, send a burst, read a reply
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int result = bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    assert(result == 0);
+    result = listen(listener, 1);
+    assert(result == 0);
+    socklen_t addr_len = sizeof(addr);
+    result = getsockname(listener, (struct sockaddr*)&addr, &addr_len);
+    assert(result == 0);
+
+    const int burst = 3;
+    std::string reply;
+    std::thread server([listener, &reply]() {
+        int fd = accept(listener, nullptr, nullptr);
+        assert(fd >= 0);
+
+        Frame frame;
+        bool got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame);
+        assert(frame.type == FrameType::JOIN && strcmp(frame.message.username, "bot") == 0);
+
+        char out[MAX_FRAME_SIZE * (burst + 1)];
+        size_t size = ChatUtils::encode_ack(PROTOCOL_VERSION_2, out);
+        for (int i = 0; i < burst; ++i) {
+            Message msg;
+            strncpy(msg.username, "alice", MAX_USERNAME_LEN - 1);
+            strncpy(msg.timestamp, "2025-01-01T00:00:00Z", MAX_TIMESTAMP_LEN - 1);
+            snprintf(msg.text, MAX_MESSAGE_LEN, "message %d", i);
+            size += ChatUtils::encode_chat(msg, WireFormat::V2, out + size);
+        }
+        bool sent = ChatUtils::send_frame(fd, out, size);
+        assert(sent);
+
+        got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame);
+        reply = frame.message.text;
+        close(fd);
+    });
+
+    int received = 0;
+    int disconnects = 0;
+    ChatClientCallbacks callbacks;
+    callbacks.on_message = [&received](const Message& msg) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "message %d", received);
+        assert(strcmp(msg.username, "alice") == 0 && strcmp(msg.text, expected) == 0);
+        ++received;
+    };
+    callbacks.on_disconnected = [&disconnects]() { ++disconnects; };
+
+    SocketChatClient client;
+    client.set_callbacks(callbacks);
+    bool connected = client.connect("127.0.0.1", ntohs(addr.sin_port), "bot");
+    assert(connected);
+    assert(client.wire_format() == WireFormat::V2);
+    connected = client.connect("127.0.0.1", ntohs(addr.sin_port), "bot");
+    assert(!connected);
+
+    while (received < burst) {
+        int polled = client.poll(1000);
+        assert(polled >= 0);
+    }
+    bool sent = client.send("hello server");
+    assert(sent);
+
+    // The server hangs up: poll() reports it once and keeps saying so
+    while (client.poll(1000) >= 0) {
+    }
+    server.join();
+    assert(reply == "hello server");
+    int polled = client.poll(0);
+    assert(disconnects == 1 && !client.connected() && polled == -1);
+    client.disconnect();
+    close(listener);
+
+    // The same client over a Unix socket, selected by the unix: prefix
+    std::string path = "/tmp/chat_test_" + std::to_string(getpid()) + ".sock";
+    unlink(path.c_str());
+    int unix_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(unix_listener >= 0);
+    sockaddr_un unix_addr;
+    memset(&unix_addr, 0, sizeof(unix_addr));
+    unix_addr.sun_family = AF_UNIX;
+    strncpy(unix_addr.sun_path, path.c_str(), sizeof(unix_addr.sun_path) - 1);
+    result = bind(unix_listener, (struct sockaddr*)&unix_addr, sizeof(unix_addr));
+    assert(result == 0);
+    result = listen(unix_listener, 1);
+    assert(result == 0);
+
+    std::thread unix_server([unix_listener]() {
+        int fd = accept(unix_listener, nullptr, nullptr);
+        assert(fd >= 0);
+
+        Frame frame;
+        bool got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame);
+        assert(frame.type == FrameType::JOIN && frame.version == PROTOCOL_VERSION_4);
+
+        // A v4 client answers heartbeats
+        char out[MAX_FRAME_SIZE];
+        size_t size = ChatUtils::encode_ack(PROTOCOL_VERSION_4, out);
+        size += ChatUtils::encode_heartbeat(true, out + size);
+        bool sent = ChatUtils::send_frame(fd, out, size);
+        assert(sent);
+        got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame && frame.type == FrameType::PONG);
+        got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame && strcmp(frame.message.text, "over unix") == 0);
+
+        // Control frames are typed both ways
+        size = ChatUtils::encode_error(ErrorCode::RECIPIENT, "nobody is not connected", out);
+        sent = ChatUtils::send_frame(fd, out, size);
+        assert(sent);
+        got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame && frame.type == FrameType::HISTORY && frame.since_seq == 5);
+        got_frame = ChatUtils::recv_frame(fd, frame, 3);
+        assert(got_frame && frame.type == FrameType::LEAVE);
+        close(fd);
+    });
+
+    SocketChatClient local;
+    ErrorCode refused = ErrorCode::PROTOCOL;
+    ChatClientCallbacks local_callbacks;
+    local_callbacks.on_error = [&refused](ErrorCode error, const std::string& text) {
+        assert(text == "nobody is not connected");
+        refused = error;
+    };
+    local.set_callbacks(local_callbacks);
+    connected = local.connect("unix:" + path, 0, "bot");
+    assert(connected);
+    assert(local.wire_format() == WireFormat::V3 && local.version() == PROTOCOL_VERSION_4);
+    polled = local.poll(1000);
+    assert(polled == 0);
+    sent = local.send("over unix");
+    assert(sent);
+    for (int i = 0; i < 100 && refused != ErrorCode::RECIPIENT; ++i) {
+        polled = local.poll(10);
+        assert(polled == 0);
+    }
+    assert(refused == ErrorCode::RECIPIENT);
+    bool requested = local.request_history(5);
+    assert(requested);
+    local.disconnect();
+    unix_server.join();
+    close(unix_listener);
+    unlink(path.c_str());
+
+    SocketChatClient missing;
+    connected = missing.connect("unix:" + path, 0, "bot");
+    assert(!connected);
+
+    // A callback may reconnect: the receive thread that ran it stops,
+    // and a new one can be started once it has
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    addr.sin_port = 0;
+    result = bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+    assert(result == 0);
+    result = listen(listener, 2);
+    assert(result == 0);
+    addr_len = sizeof(addr);
+    result = getsockname(listener, (struct sockaddr*)&addr, &addr_len);
+    assert(result == 0);
+
+    std::thread reconnect_server([listener]() {
+        for (const char* text : {"first", "second"}) {
+            int fd = accept(listener, nullptr, nullptr);
+            assert(fd >= 0);
+            Frame frame;
+            bool got_frame = ChatUtils::recv_frame(fd, frame, 3);
+            assert(got_frame && frame.type == FrameType::JOIN);
+
+            char out[MAX_FRAME_SIZE * 2];
+            Message msg;
+            strncpy(msg.username, "alice", MAX_USERNAME_LEN - 1);
+            strncpy(msg.text, text, MAX_MESSAGE_LEN - 1);
+            msg.time_ns = 1;
+            size_t size = ChatUtils::encode_ack(PROTOCOL_VERSION_4, out);
+            size += ChatUtils::encode_chat(msg, WireFormat::V3, out + size);
+            bool sent = ChatUtils::send_frame(fd, out, size);
+            assert(sent);
+
+            // Until the client leaves
+            while (ChatUtils::recv_frame(fd, frame, 3) && frame.type != FrameType::LEAVE) {
+            }
+            close(fd);
+        }
+    });
+
+    SocketChatClient redial;
+    std::atomic<bool> redialed(false);
+    std::atomic<bool> got_second(false);
+    int port = ntohs(addr.sin_port);
+    ChatClientCallbacks redial_callbacks;
+    redial_callbacks.on_message = [&redial, &redialed, &got_second, port](const Message& msg) {
+        if (strcmp(msg.text, "first") == 0) {
+            redial.disconnect();
+            redialed = redial.connect("127.0.0.1", port, "bot");
+        } else if (strcmp(msg.text, "second") == 0) {
+            got_second = true;
+        }
+    };
+    redial.set_callbacks(redial_callbacks);
+    connected = redial.connect("127.0.0.1", port, "bot");
+    assert(connected);
+    bool started = redial.start();
+    assert(started);
+    for (int i = 0; i < 1000 && !redialed; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(redialed && redial.connected());
+    started = false;
+    for (int i = 0; i < 1000 && !started; ++i) {
+        started = redial.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(started);
+    for (int i = 0; i < 1000 && !got_second; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(got_second);
+    redial.disconnect();
+    reconnect_server.join();
+    close(listener);
+
+    // Shared memory: each member sees the others' messages, not its own
+    std::string name = "/chat_test_" + std::to_string(getpid());
+    shm_unlink(name.c_str());
+    ShmRoomOptions options;
+    options.capacity = MIN_SHM_RING_CAPACITY;
+
+    std::atomic<int> bob_received(0);
+    ShmChatClient alice;
+    ShmChatClient bob;
+    ChatClientCallbacks bob_callbacks;
+    bob_callbacks.on_message = [&bob_received](const Message& msg) {
+        assert(strcmp(msg.username, "alice") == 0);
+        ++bob_received;
+    };
+    bob.set_callbacks(bob_callbacks);
+
+    bool joined = alice.join(name, "alice", options);
+    assert(joined);
+    sent = alice.send("before bob");
+    assert(sent);
+    joined = bob.join(name, "bob");
+    assert(joined);
+    assert(bob.ring()->capacity() == MIN_SHM_RING_CAPACITY);
+
+    // History is replayed to a late joiner
+    polled = bob.poll(0);
+    assert(polled == 1 && bob_received == 1);
+    polled = alice.poll(0);
+    assert(polled == 0);
+
+    started = bob.start();
+    assert(started);
+    sent = alice.send("after bob");
+    assert(sent);
+    for (int i = 0; i < 1000 && bob_received < 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(bob_received == 2);
+
+    // A callback may leave and join again: the reader that ran it stops
+    // before touching the old mapping, and a new one can be started
+    ShmChatClient carol;
+    std::atomic<bool> rejoined(false);
+    std::atomic<bool> got_after(false);
+    ChatClientCallbacks carol_callbacks;
+    carol_callbacks.on_message = [&carol, &rejoined, &got_after, &name](const Message& msg) {
+        if (!rejoined) {
+            carol.leave();
+            rejoined = carol.join(name, "carol");
+        } else if (strcmp(msg.text, "after rejoin") == 0) {
+            got_after = true;
+        }
+    };
+    carol.set_callbacks(carol_callbacks);
+    joined = carol.join(name, "carol");
+    assert(joined);
+    started = carol.start();
+    assert(started);
+    for (int i = 0; i < 1000 && !rejoined; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(rejoined && carol.joined());
+    started = false;
+    for (int i = 0; i < 1000 && !started; ++i) {
+        started = carol.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(started);
+    sent = alice.send("after rejoin");
+    assert(sent);
+    for (int i = 0; i < 1000 && !got_after; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(got_after);
+    carol.leave();
+
+    bob.leave();
+    alice.leave();
+    polled = bob.poll(0);
+    assert(!bob.joined() && polled == -1);
+    shm_unlink(name.c_str());
+
+    std::cout << "  Headless client test passed" << std::endl;
+}
+
+void test_async_log() {
+    std::cout << "Testing asynchronous logging..." << std::endl;
+
+    // Capture stdout in a file while the writer runs
+    fflush(stdout);
+    FILE* capture = tmpfile();
+    assert(capture);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+
+    ChatLog::LogConfig config;
+    config.level = LogLevel::INFO;
+    config.sample_every = 10;
+    bool started = ChatLog::start(config);
+    assert(started);
+    started = ChatLog::start(config);
+    assert(!started);
+
+    const int threads = 4;
+    const int per_thread = 1000;
+    std::vector<std::thread> loggers;
+    for (int t = 0; t < threads; ++t) {
+        loggers.emplace_back([t]() {
+            std::string name = "thread" + std::to_string(t);
+            for (int i = 0; i < per_thread; ++i) {
+                LOGF_INFO("record {} from {} of {} ({})", i, name.c_str(), -t, 0.5);
+                LOGF_DEBUG("filtered {}", i);
+                LOGF_SAMPLED(LogLevel::INFO, "sampled {}", i);
+            }
+        });
+    }
+    for (auto& logger : loggers) {
+        logger.join();
+    }
+    LOG_INFO("stream " << 42);
+    ChatLog::stop();
+    assert(!ChatLog::running());
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    // Every record made it, formatted, and nothing was dropped
+    rewind(capture);
+    char line[512];
+    int records = 0;
+    int sampled = 0;
+    int streamed = 0;
+    int filtered = 0;
+    while (fgets(line, sizeof(line), capture)) {
+        int i = -1;
+        int t = -1;
+        const char* record = strstr(line, "record ");
+        if (record && sscanf(record, "record %d from thread%d of", &i, &t) == 2) {
+            char expected[64];
+            snprintf(expected, sizeof(expected), "of %d (0.5)\n", -t);
+            assert(strstr(line, expected));
+            ++records;
+        }
+        sampled += strstr(line, "sampled ") != nullptr;
+        streamed += strstr(line, "stream 42") != nullptr;
+        filtered += strstr(line, "filtered") != nullptr;
+    }
+    fclose(capture);
+
+    assert(ChatLog::dropped() == 0);
+    assert(records == threads * per_thread);
+    assert(sampled == threads * per_thread / 10);
+    assert(streamed == 1 && filtered == 0);
+
+    // Stopping while threads still log loses nothing: each record is
+    // either drained by stop() or written synchronously after it
+    fflush(stdout);
+    capture = tmpfile();
+    assert(capture);
+    saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+
+    started = ChatLog::start(config);
+    assert(started);
+    std::atomic<int> logging(0);
+    loggers.clear();
+    for (int t = 0; t < threads; ++t) {
+        loggers.emplace_back([&logging]() {
+            logging.fetch_add(1);
+            for (int i = 0; i < per_thread; ++i) {
+                LOGF_INFO("racing {}", i);
+            }
+        });
+    }
+    while (logging.load() < threads) {
+        std::this_thread::yield();
+    }
+    ChatLog::stop();
+    for (auto& logger : loggers) {
+        logger.join();
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    rewind(capture);
+    int racing = 0;
+    while (fgets(line, sizeof(line), capture)) {
+        racing += strstr(line, "racing ") != nullptr;
+    }
+    fclose(capture);
+    assert(ChatLog::dropped() == 0);
+    assert(racing == threads * per_thread);
+
+    std::cout << "  Asynchronous logging test passed" << std::endl;
+}
+
 int main() {
     std::cout << "==================================================" << std::endl;
     std::cout << "OS Chat Project - Basic Tests" << std::endl;
@@ -90,6 +1877,20 @@ int main() {
         test_message_size();
         test_max_lengths();
         test_message_copy();
+        test_v2_frame_roundtrip();
+        test_v3_frame_roundtrip();
+        test_frame_format_detection();
+        test_codec();
+        test_recv_buffer_batching();
+        test_message_history();
+        test_message_store();
+        test_room_index();
+        test_timer_wheel();
+        test_handoff();
+        test_spsc_queue();
+        test_shm_ring();
+        test_chat_client();
+        test_async_log();
         
         std::cout << std::endl;
         std::cout << "==================================================" << std::endl;